@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+// HDR-style log-linear latency histogram. Values below 128 are counted
+// exactly; above that each power of two is split into 64 buckets, so any
+// percentile is within 1.6% of the true value. Recording is O(1) with no
+// allocation. Not thread-safe: keep one per thread and Merge at the end.
+class LatencyHistogram {
+public:
+    LatencyHistogram() : counts_(kBuckets, 0) {}
+
+    void Record(std::uint64_t value) {
+        ++counts_[index(value)];
+        ++count_;
+        sum_ += value;
+        max_ = std::max(max_, value);
+        min_ = std::min(min_, value);
+    }
+
+    void Merge(const LatencyHistogram& other) {
+        for (std::size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        max_ = std::max(max_, other.max_);
+        min_ = std::min(min_, other.min_);
+    }
+
+    std::uint64_t Count() const { return count_; }
+    std::uint64_t Max() const { return max_; }
+    std::uint64_t Min() const { return count_ ? min_ : 0; }
+    double Mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0.0; }
+
+    // Smallest recorded bucket value with at least 'p' percent of the
+    // values at or below it, reported as the top of the bucket (capped at
+    // the maximum).
+    std::uint64_t Percentile(double p) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        const auto rank = static_cast<std::uint64_t>(std::max(1.0, p / 100.0 * static_cast<double>(count_) + 0.5));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                return std::min(upper_bound(i), max_);
+            }
+        }
+        return max_;
+    }
+
+private:
+    static constexpr int kSubBits = 7;
+    static constexpr std::uint64_t kExact = 1u << kSubBits;      // 128
+    static constexpr std::uint64_t kHalf = 1u << (kSubBits - 1); // 64 buckets per doubling
+    static constexpr std::size_t kBuckets = kExact + (64 - kSubBits) * kHalf;
+
+    static std::size_t index(std::uint64_t value) {
+        if (value < kExact) {
+            return static_cast<std::size_t>(value);
+        }
+        const int shift = std::bit_width(value) - kSubBits; // >= 1
+        const std::uint64_t sub = value >> shift;          // [64, 128)
+        return kExact + static_cast<std::size_t>(shift - 1) * kHalf + static_cast<std::size_t>(sub - kHalf);
+    }
+
+    static std::uint64_t upper_bound(std::size_t i) {
+        if (i < kExact) {
+            return i;
+        }
+        const std::size_t shift = (i - kExact) / kHalf + 1;
+        const std::uint64_t sub = (i - kExact) % kHalf + kHalf;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::vector<std::uint64_t> counts_;
+    std::uint64_t count_ = 0;
+    std::uint64_t sum_ = 0;
+    std::uint64_t max_ = 0;
+    std::uint64_t min_ = UINT64_MAX;
+};
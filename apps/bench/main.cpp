@@ -1,5 +1,8 @@
 #include "kvcache/api.hpp"
+#include "kvcache/object_store.hpp"
+#include "kvcache/peer.hpp"
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <string>
 #include <random>
@@ -7,85 +10,332 @@
 #include <atomic>
 #include <chrono>
 #include <numeric>
+#include <algorithm>
+#include <cstdio>
 #include "kvcache/cxxopts.hpp"
+#include "histogram.hpp"
+#include "workload.hpp"
+
+using Clock = std::chrono::steady_clock;
 
 struct BenchConfig {
     int num_threads = 4;
     int num_prompts = 1000;
-    int min_prompt_len = 512;
-    int max_prompt_len = 2048;
     int block_size = 256;
     double get_ratio = 0.8;
+    std::string mode = "mixed";
+    int max_threads = 64;
+    int duration_ms = 1000;
+    bool write_behind = false;
+    int block_bytes = 1024;
+    double rate = 0.0;            // Requests per second across all threads; 0 is closed loop
+    int load_parallelism = 0;     // LoadAll fan-out; 0 uses Config::load_parallelism
+    int nodes = 1;                // In-process cluster nodes sharing the object store
+    int tenants = 1;              // Threads store as tenant thread_id % tenants
+    std::string json_path;
+    std::string prometheus_path;  // Library metrics in Prometheus text format
+    WorkloadConfig workload;
 };
 
-struct Stats {
-    std::atomic<int> num_puts{0};
-    std::atomic<int> num_gets{0};
-    std::atomic<int> cache_hits{0};
-    std::atomic<double> put_latency_ms{0.0};
-    std::atomic<double> get_latency_ms{0.0};
-};
+enum Op { kLookup, kLoad, kStore, kRequest, kNumOps };
+static const char* const kOpNames[kNumOps] = {"lookup", "load", "store", "request"};
 
-// Helper function to atomically add to a std::atomic<double>
-// This is required for compilers that don't support fetch_add on double (pre-C++20)
-void atomic_add_double(std::atomic<double>& atomic_double, double value) {
-    double old_val = atomic_double.load();
-    double new_val;
-    do {
-        new_val = old_val + value;
-    } while (!atomic_double.compare_exchange_weak(old_val, new_val));
-}
+// Builds without S3 have only the memory backend
+#ifdef KVCACHE_WITH_S3
+static const char* const kDefaultBackend = "s3";
+#else
+static const char* const kDefaultBackend = "memory";
+#endif
+
+// Per-thread counters; merged once the threads have joined, so nothing here
+// is shared while the benchmark runs
+struct Stats {
+    LatencyHistogram latency_ns[kNumOps];
+    std::uint64_t requests = 0;
+    std::uint64_t gets = 0;
+    std::uint64_t puts = 0;
+    std::uint64_t cache_hits = 0;     // Lookups that matched at least one block
+    std::uint64_t prompt_tokens = 0;  // Over lookups
+    std::uint64_t matched_tokens = 0;
+    std::uint64_t loaded_bytes = 0;
+    std::uint64_t load_failures = 0;  // LoadAll returned fewer blocks than Lookup matched
 
-std::vector<std::uint32_t> generate_prompt(int len, std::mt19937& rng) {
-    std::vector<std::uint32_t> tokens(len);
-    std::uniform_int_distribution<std::uint32_t> dist(0, 50256); // vocab size
-    for (int i = 0; i < len; ++i) {
-        tokens[i] = dist(rng);
+    void Merge(const Stats& other) {
+        for (int op = 0; op < kNumOps; ++op) {
+            latency_ns[op].Merge(other.latency_ns[op]);
+        }
+        requests += other.requests;
+        gets += other.gets;
+        puts += other.puts;
+        cache_hits += other.cache_hits;
+        prompt_tokens += other.prompt_tokens;
+        matched_tokens += other.matched_tokens;
+        loaded_bytes += other.loaded_bytes;
+        load_failures += other.load_failures;
     }
-    return tokens;
+};
+
+static std::uint64_t elapsed_ns(Clock::time_point start, Clock::time_point end) {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
 }
 
+// mixed: each request is a GET (Lookup, then LoadAll of the matched blocks)
+// with probability get_ratio, else a PUT (StoreSequence).
+// pipeline: each request is the serving path, Lookup -> LoadAll ->
+// StoreSequence of the whole prompt, so only the unmatched tail uploads.
+// With a rate, requests start on a Poisson schedule and their latency is
+// measured from the scheduled start, so a stall shows up in the tail
+// instead of silently slowing the offered load.
 void worker_thread(kvcache::KVCache& cache,
                    const BenchConfig& cfg,
                    Stats& stats,
-                   const std::vector<std::vector<std::uint32_t>>& prompts,
+                   const std::vector<std::uint8_t>& payload,
                    int thread_id) {
+    Workload workload(cfg.workload, thread_id);
     std::mt19937 rng(thread_id);
     std::uniform_real_distribution<> op_dist(0.0, 1.0);
-    std::uniform_int_distribution<int> prompt_dist(0, prompts.size() - 1);
+    std::exponential_distribution<double> gap_s(cfg.rate > 0 ? cfg.rate / cfg.num_threads : 1.0);
+    const bool pipeline = cfg.mode == "pipeline";
+    const auto tenant = static_cast<kvcache::TenantId>(thread_id % cfg.tenants);
+    std::vector<std::uint8_t> dest;
 
     int ops_per_thread = cfg.num_prompts / cfg.num_threads;
+    Clock::time_point next_start = Clock::now();
 
     for (int i = 0; i < ops_per_thread; ++i) {
-        const auto& tokens = prompts[prompt_dist(rng)];
-        
-        if (op_dist(rng) < cfg.get_ratio) {
-            // GET operation
-            auto start = std::chrono::high_resolution_clock::now();
+        const auto& tokens = workload.Next();
+
+        Clock::time_point start;
+        if (cfg.rate > 0) {
+            next_start += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(gap_s(rng)));
+            std::this_thread::sleep_until(next_start);
+            start = next_start;
+        } else {
+            start = Clock::now();
+        }
+
+        const bool get = pipeline || op_dist(rng) < cfg.get_ratio;
+        const bool put = pipeline || !get;
+
+        if (get) {
+            ++stats.gets;
+            auto t0 = Clock::now();
             auto result = cache.Lookup(tokens);
-            auto end = std::chrono::high_resolution_clock::now();
-            
-            stats.num_gets++;
-            if (result.matched_tokens > 0) {
-                stats.cache_hits++;
+            auto t1 = Clock::now();
+            stats.latency_ns[kLookup].Record(elapsed_ns(t0, t1));
+            stats.prompt_tokens += tokens.size();
+            stats.matched_tokens += result.matched_tokens;
+
+            if (!result.handles.empty()) {
+                ++stats.cache_hits;
+                dest.resize(kvcache::KVCache::TotalBytes(result));
+                auto loaded = cache.LoadAll(result, dest, cfg.load_parallelism);
+                stats.latency_ns[kLoad].Record(elapsed_ns(t1, Clock::now()));
+                stats.loaded_bytes += loaded.loaded_bytes;
+                if (loaded.loaded_blocks < result.handles.size()) {
+                    ++stats.load_failures;
+                }
             }
-            atomic_add_double(stats.get_latency_ms, std::chrono::duration<double, std::milli>(end - start).count());
+        }
 
-        } else {
-            // PUT operation
+        if (put) {
             std::uint32_t num_blocks = tokens.size() / cfg.block_size;
-            if (num_blocks == 0) continue;
-
-            std::vector<std::uint8_t> block_data(1024); // dummy data
-            
-            auto start = std::chrono::high_resolution_clock::now();
-            for (std::uint32_t j = 0; j < num_blocks; ++j) {
-                cache.Store(tokens, j, block_data);
+            if (num_blocks > 0) {
+                ++stats.puts;
+                std::vector<kvcache::bytes_view> blocks(num_blocks, payload);
+                auto t0 = Clock::now();
+                if (cfg.write_behind) {
+                    // 'payload' is copied onto the queue before this returns
+                    cache.StoreSequenceAsync(tokens, blocks, nullptr, tenant);
+                } else {
+                    cache.StoreSequence(tokens, blocks, tenant);
+                }
+                stats.latency_ns[kStore].Record(elapsed_ns(t0, Clock::now()));
             }
-            auto end = std::chrono::high_resolution_clock::now();
-            
-            stats.num_puts++;
-            atomic_add_double(stats.put_latency_ms, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+
+        stats.latency_ns[kRequest].Record(elapsed_ns(start, Clock::now()));
+        ++stats.requests;
+    }
+}
+
+static void print_latency_table(const Stats& stats) {
+    std::cout << "Latency (us)      count       mean        p50        p90        p99       p999        max" << std::endl;
+    for (int op = 0; op < kNumOps; ++op) {
+        const LatencyHistogram& h = stats.latency_ns[op];
+        if (h.Count() == 0) {
+            continue;
+        }
+        auto us = [](double ns) { return ns / 1000.0; };
+        char line[160];
+        std::snprintf(line, sizeof(line), "  %-10s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f", kOpNames[op],
+                      static_cast<unsigned long long>(h.Count()), us(h.Mean()), us(h.Percentile(50)),
+                      us(h.Percentile(90)), us(h.Percentile(99)), us(h.Percentile(99.9)), us(h.Max()));
+        std::cout << line << std::endl;
+    }
+}
+
+static void write_json_config(std::ostream& out, const BenchConfig& cfg) {
+    const WorkloadConfig& w = cfg.workload;
+    out << "  \"config\": {"
+        << "\"mode\": \"" << cfg.mode << "\", "
+        << "\"workload\": \"" << w.kind << "\", "
+        << "\"threads\": " << cfg.num_threads << ", "
+        << "\"nodes\": " << cfg.nodes << ", "
+        << "\"tenants\": " << cfg.tenants << ", "
+        << "\"prompts\": " << cfg.num_prompts << ", "
+        << "\"block_size\": " << cfg.block_size << ", "
+        << "\"block_bytes\": " << cfg.block_bytes << ", "
+        << "\"get_ratio\": " << cfg.get_ratio << ", "
+        << "\"rate\": " << cfg.rate << ", "
+        << "\"write_behind\": " << (cfg.write_behind ? "true" : "false") << ", "
+        << "\"min_len\": " << w.min_prompt_len << ", "
+        << "\"max_len\": " << w.max_prompt_len << ", "
+        << "\"system_prompts\": " << w.system_prompts << ", "
+        << "\"system_len\": " << w.system_len << ", "
+        << "\"zipf\": " << w.zipf_s << ", "
+        << "\"min_turn\": " << w.min_turn_len << ", "
+        << "\"max_turn\": " << w.max_turn_len << ", "
+        << "\"response_len\": " << w.response_len << ", "
+        << "\"conversations\": " << w.conversations << "}";
+}
+
+static bool write_json(const std::string& path, const BenchConfig& cfg, const Stats& stats, double duration_s) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    out << "{\n";
+    write_json_config(out, cfg);
+    out << ",\n";
+    out << "  \"duration_s\": " << duration_s << ",\n";
+    out << "  \"requests_per_s\": " << (duration_s > 0 ? stats.requests / duration_s : 0.0) << ",\n";
+    out << "  \"gets\": " << stats.gets << ",\n";
+    out << "  \"puts\": " << stats.puts << ",\n";
+    out << "  \"hit_rate\": " << (stats.gets ? static_cast<double>(stats.cache_hits) / stats.gets : 0.0) << ",\n";
+    out << "  \"token_hit_rate\": "
+        << (stats.prompt_tokens ? static_cast<double>(stats.matched_tokens) / stats.prompt_tokens : 0.0) << ",\n";
+    out << "  \"loaded_bytes\": " << stats.loaded_bytes << ",\n";
+    out << "  \"load_failures\": " << stats.load_failures << ",\n";
+    out << "  \"latency_us\": {";
+    bool first = true;
+    for (int op = 0; op < kNumOps; ++op) {
+        const LatencyHistogram& h = stats.latency_ns[op];
+        out << (first ? "\n" : ",\n") << "    \"" << kOpNames[op] << "\": {"
+            << "\"count\": " << h.Count() << ", "
+            << "\"mean\": " << h.Mean() / 1000.0 << ", "
+            << "\"p50\": " << h.Percentile(50) / 1000.0 << ", "
+            << "\"p90\": " << h.Percentile(90) / 1000.0 << ", "
+            << "\"p99\": " << h.Percentile(99) / 1000.0 << ", "
+            << "\"p999\": " << h.Percentile(99.9) / 1000.0 << ", "
+            << "\"max\": " << h.Max() / 1000.0 << "}";
+        first = false;
+    }
+    out << "\n  }\n}\n";
+    return static_cast<bool>(out);
+}
+
+// Stores every prompt of the pool, then measures Lookup throughput with
+// 1, 2, 4, ... max_threads concurrent readers and no writers.
+void run_lookup_scaling(kvcache::KVCache& cache,
+                        const BenchConfig& cfg,
+                        const std::vector<std::vector<std::uint32_t>>& prompts,
+                        const std::vector<std::uint8_t>& payload) {
+    for (const auto& tokens : prompts) {
+        std::vector<kvcache::bytes_view> blocks(tokens.size() / cfg.block_size, payload);
+        cache.StoreSequence(tokens, blocks);
+    }
+
+    std::cout << "------ Lookup Scaling -------" << std::endl;
+    std::vector<int> steps;
+    for (int n = 1; n < cfg.max_threads; n *= 2) {
+        steps.push_back(n);
+    }
+    steps.push_back(std::max(cfg.max_threads, 1));
+
+    struct Step {
+        int threads;
+        double ops_per_sec;
+        double speedup;
+        double hit_rate;
+        std::uint64_t p99_ns;
+    };
+    std::vector<Step> results;
+
+    double base_ops_per_sec = 0.0;
+    for (int n : steps) {
+        std::atomic<bool> stop{false};
+        std::vector<std::uint64_t> lookups(n, 0);
+        std::vector<std::uint64_t> hits(n, 0);
+        std::vector<LatencyHistogram> latency(n);
+        std::vector<std::thread> threads;
+
+        for (int t = 0; t < n; ++t) {
+            threads.emplace_back([&, t] {
+                std::mt19937 rng(t);
+                std::uniform_int_distribution<int> prompt_dist(0, prompts.size() - 1);
+                // Count locally to keep the counters off shared cache lines
+                std::uint64_t local_lookups = 0, local_hits = 0;
+                LatencyHistogram local_latency;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    auto t0 = Clock::now();
+                    auto result = cache.Lookup(prompts[prompt_dist(rng)]);
+                    local_latency.Record(elapsed_ns(t0, Clock::now()));
+                    ++local_lookups;
+                    if (result.matched_tokens > 0) {
+                        ++local_hits;
+                    }
+                }
+                lookups[t] = local_lookups;
+                hits[t] = local_hits;
+                latency[t] = std::move(local_latency);
+            });
+        }
+
+        auto start = Clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(cfg.duration_ms));
+        stop = true;
+        for (auto& t : threads) {
+            t.join();
+        }
+        double elapsed_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::uint64_t total = std::accumulate(lookups.begin(), lookups.end(), std::uint64_t{0});
+        std::uint64_t total_hits = std::accumulate(hits.begin(), hits.end(), std::uint64_t{0});
+        LatencyHistogram merged;
+        for (const auto& h : latency) {
+            merged.Merge(h);
+        }
+        double ops_per_sec = total / elapsed_s;
+        if (base_ops_per_sec == 0.0) {
+            base_ops_per_sec = ops_per_sec;
+        }
+        Step step{n, ops_per_sec, base_ops_per_sec > 0 ? ops_per_sec / base_ops_per_sec : 0.0,
+                  total > 0 ? (double)total_hits / total : 0.0, merged.Percentile(99)};
+        results.push_back(step);
+        std::cout << "Threads: " << n
+                  << "  Lookups/s: " << step.ops_per_sec
+                  << "  Speedup: " << step.speedup
+                  << "  Hit rate: " << step.hit_rate * 100.0 << " %"
+                  << "  p99: " << step.p99_ns / 1000.0 << " us"
+                  << std::endl;
+    }
+    std::cout << "-----------------------------" << std::endl;
+
+    if (!cfg.json_path.empty()) {
+        std::ofstream out(cfg.json_path);
+        out << "{\n";
+        write_json_config(out, cfg);
+        out << ",\n  \"steps\": [";
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            const Step& s = results[i];
+            out << (i ? ",\n" : "\n") << "    {\"threads\": " << s.threads << ", \"lookups_per_s\": " << s.ops_per_sec
+                << ", \"speedup\": " << s.speedup << ", \"hit_rate\": " << s.hit_rate
+                << ", \"p99_us\": " << s.p99_ns / 1000.0 << "}";
+        }
+        out << "\n  ]\n}\n";
+        if (!out) {
+            std::cerr << "Failed to write " << cfg.json_path << std::endl;
         }
     }
 }
@@ -94,11 +344,43 @@ int main(int argc, char** argv) {
     cxxopts::Options options("kvbench", "Benchmark tool for KVCache");
     options.add_options()
         ("t,threads", "Number of worker threads", cxxopts::value<int>()->default_value("4"))
-        ("p,prompts", "Total number of operations", cxxopts::value<int>()->default_value("1000"))
-        ("min-len", "Min prompt length", cxxopts::value<int>()->default_value("512"))
-        ("max-len", "Max prompt length", cxxopts::value<int>()->default_value("2048"))
+        ("p,prompts", "Total number of requests", cxxopts::value<int>()->default_value("1000"))
+        ("min-len", "Min prompt length (uniform)", cxxopts::value<int>()->default_value("512"))
+        ("max-len", "Max prompt length (uniform; history cap for chat)", cxxopts::value<int>()->default_value("2048"))
         ("b,block-size", "Block size in tokens", cxxopts::value<int>()->default_value("256"))
-        ("g,get-ratio", "Ratio of GET operations (0.0 to 1.0)", cxxopts::value<double>()->default_value("0.8"))
+        ("block-bytes", "Payload bytes per stored block", cxxopts::value<int>()->default_value("1024"))
+        ("g,get-ratio", "Ratio of GET requests in mixed mode (0.0 to 1.0)", cxxopts::value<double>()->default_value("0.8"))
+        ("mode", "Benchmark mode: mixed, pipeline or lookup-scaling", cxxopts::value<std::string>()->default_value("mixed"))
+        ("workload", "Prompt model: uniform, zipf or chat", cxxopts::value<std::string>()->default_value("uniform"))
+        ("pool-size", "Distinct prompts for the uniform workload", cxxopts::value<int>()->default_value("100"))
+        ("system-prompts", "Shared system prompts (zipf, chat)", cxxopts::value<int>()->default_value("32"))
+        ("system-len", "System prompt length in tokens", cxxopts::value<int>()->default_value("1024"))
+        ("zipf", "Zipf exponent of system prompt and conversation popularity", cxxopts::value<double>()->default_value("1.0"))
+        ("min-turn", "Min user turn length", cxxopts::value<int>()->default_value("64"))
+        ("max-turn", "Max user turn length", cxxopts::value<int>()->default_value("512"))
+        ("response-len", "Tokens appended per chat turn after the request", cxxopts::value<int>()->default_value("128"))
+        ("conversations", "Open chat conversations per thread", cxxopts::value<int>()->default_value("16"))
+        ("rate", "Open-loop request rate per second across threads (0 = closed loop)", cxxopts::value<double>()->default_value("0"))
+        ("load-parallelism", "LoadAll fan-out (0 = library default)", cxxopts::value<int>()->default_value("0"))
+        ("dram-bytes", "DRAM tier capacity (0 disables it)", cxxopts::value<std::uint64_t>()->default_value("0"))
+        ("json", "Write results as JSON to this path", cxxopts::value<std::string>()->default_value(""))
+        ("prometheus", "Write the cache's own metrics in Prometheus text format to this path", cxxopts::value<std::string>()->default_value(""))
+        ("max-threads", "Highest reader thread count for lookup-scaling", cxxopts::value<int>()->default_value("64"))
+        ("duration-ms", "Measurement time per step for lookup-scaling", cxxopts::value<int>()->default_value("1000"))
+        ("write-behind", "Store through StoreSequenceAsync", cxxopts::value<bool>()->default_value("false"))
+        ("index-shards", "Number of index shards", cxxopts::value<int>()->default_value("16"))
+        ("capacity-bytes", "Cache capacity (0 = library default)", cxxopts::value<std::uint64_t>()->default_value("0"))
+        ("admission", "Admission policy: all or doorkeeper", cxxopts::value<std::string>()->default_value("all"))
+        ("tenants", "Tenants sharing the cache; threads are spread over them", cxxopts::value<int>()->default_value("1"))
+        ("tenant-quota-bytes", "Capacity quota of each tenant (0 = none)", cxxopts::value<std::uint64_t>()->default_value("0"))
+        ("nodes", "Cluster nodes in this process sharing the object store; threads are spread over them", cxxopts::value<int>()->default_value("1"))
+        ("sync-interval-ms", "Cluster event sync interval (with --nodes)", cxxopts::value<std::uint32_t>()->default_value("200"))
+        ("backend", "Object store: s3 or memory", cxxopts::value<std::string>()->default_value(kDefaultBackend))
+        ("get-latency-us", "Injected GET time to first byte (memory backend)", cxxopts::value<std::uint32_t>()->default_value("0"))
+        ("put-latency-us", "Injected PUT latency (memory backend)", cxxopts::value<std::uint32_t>()->default_value("0"))
+        ("meta-latency-us", "Injected DELETE and LIST latency (memory backend)", cxxopts::value<std::uint32_t>()->default_value("0"))
+        ("bandwidth-mbps", "Injected per-request bandwidth in MB/s, 0 = unlimited (memory backend)", cxxopts::value<double>()->default_value("0"))
+        ("jitter", "Injected latency jitter fraction (memory backend)", cxxopts::value<double>()->default_value("0"))
         ("h,help", "Print usage");
     
     auto result = options.parse(argc, argv);
@@ -109,72 +391,234 @@ int main(int argc, char** argv) {
     }
 
     BenchConfig cfg;
-    cfg.num_threads = result["threads"].as<int>();
+    cfg.num_threads = std::max(result["threads"].as<int>(), 1);
     cfg.num_prompts = result["prompts"].as<int>();
-    cfg.min_prompt_len = result["min-len"].as<int>();
-    cfg.max_prompt_len = result["max-len"].as<int>();
     cfg.block_size = result["block-size"].as<int>();
+    cfg.block_bytes = result["block-bytes"].as<int>();
     cfg.get_ratio = result["get-ratio"].as<double>();
+    cfg.mode = result["mode"].as<std::string>();
+    cfg.max_threads = result["max-threads"].as<int>();
+    cfg.duration_ms = result["duration-ms"].as<int>();
+    cfg.write_behind = result["write-behind"].as<bool>();
+    cfg.rate = result["rate"].as<double>();
+    cfg.load_parallelism = result["load-parallelism"].as<int>();
+    cfg.nodes = std::max(result["nodes"].as<int>(), 1);
+    cfg.tenants = std::clamp(result["tenants"].as<int>(), 1, 1 << 16);
+    cfg.json_path = result["json"].as<std::string>();
+    cfg.prometheus_path = result["prometheus"].as<std::string>();
+    cfg.workload.kind = result["workload"].as<std::string>();
+    cfg.workload.min_prompt_len = result["min-len"].as<int>();
+    cfg.workload.max_prompt_len = result["max-len"].as<int>();
+    cfg.workload.pool_size = std::max(result["pool-size"].as<int>(), 1);
+    cfg.workload.system_prompts = std::max(result["system-prompts"].as<int>(), 1);
+    cfg.workload.system_len = result["system-len"].as<int>();
+    cfg.workload.zipf_s = result["zipf"].as<double>();
+    cfg.workload.min_turn_len = result["min-turn"].as<int>();
+    cfg.workload.max_turn_len = std::max(result["max-turn"].as<int>(), cfg.workload.min_turn_len);
+    cfg.workload.response_len = result["response-len"].as<int>();
+    cfg.workload.conversations = std::max(result["conversations"].as<int>(), 1);
+
+    if (cfg.mode != "mixed" && cfg.mode != "pipeline" && cfg.mode != "lookup-scaling") {
+        std::cerr << "Unknown mode: " << cfg.mode << std::endl;
+        return 1;
+    }
+    if (cfg.workload.kind != "uniform" && cfg.workload.kind != "zipf" && cfg.workload.kind != "chat") {
+        std::cerr << "Unknown workload: " << cfg.workload.kind << std::endl;
+        return 1;
+    }
+    const std::string backend = result["backend"].as<std::string>();
+    if (backend != "s3" && backend != "memory") {
+        std::cerr << "Unknown backend: " << backend << std::endl;
+        return 1;
+    }
+#ifndef KVCACHE_WITH_S3
+    if (backend == "s3") {
+        // KVCache(cfg) would quietly keep objects in memory instead
+        std::cerr << "Built without S3 (KVCACHE_WITH_S3=OFF); use --backend memory" << std::endl;
+        return 1;
+    }
+#endif
 
     std::cout << "--- Benchmark Configuration ---" << std::endl;
     std::cout << "Threads: " << cfg.num_threads << std::endl;
-    std::cout << "Total Ops: " << cfg.num_prompts << std::endl;
-    std::cout << "Prompt Length: [" << cfg.min_prompt_len << ", " << cfg.max_prompt_len << "]" << std::endl;
-    std::cout << "Block Size: " << cfg.block_size << std::endl;
-    std::cout << "GET Ratio: " << cfg.get_ratio << std::endl;
+    if (cfg.nodes > 1) {
+        std::cout << "Cluster Nodes: " << cfg.nodes << std::endl;
+    }
+    if (cfg.tenants > 1) {
+        std::cout << "Tenants: " << cfg.tenants << std::endl;
+    }
+    std::cout << "Total Requests: " << cfg.num_prompts << std::endl;
+    std::cout << "Workload: " << cfg.workload.kind << std::endl;
+    if (cfg.workload.kind == "uniform") {
+        std::cout << "Prompt Length: [" << cfg.workload.min_prompt_len << ", " << cfg.workload.max_prompt_len << "]" << std::endl;
+    } else {
+        std::cout << "System Prompts: " << cfg.workload.system_prompts << " x " << cfg.workload.system_len
+                  << " tokens, Zipf s=" << cfg.workload.zipf_s << std::endl;
+        std::cout << "User Turn: [" << cfg.workload.min_turn_len << ", " << cfg.workload.max_turn_len << "]" << std::endl;
+    }
+    std::cout << "Block Size: " << cfg.block_size << " tokens, " << cfg.block_bytes << " bytes" << std::endl;
+    if (cfg.mode == "mixed") {
+        std::cout << "GET Ratio: " << cfg.get_ratio << std::endl;
+    }
+    std::cout << "Rate: " << (cfg.rate > 0 ? std::to_string(cfg.rate) + " req/s (open loop)" : "closed loop") << std::endl;
+    std::cout << "Mode: " << cfg.mode << std::endl;
+    std::cout << "Backend: " << backend << std::endl;
     std::cout << "-----------------------------" << std::endl;
 
-    // Generate a pool of prompts
-    std::mt19937 rng(1234);
-    std::uniform_int_distribution<int> len_dist(cfg.min_prompt_len, cfg.max_prompt_len);
-    std::vector<std::vector<std::uint32_t>> prompts;
-    for (int i = 0; i < 100; ++i) { // pool of 100 prompts
-        prompts.push_back(generate_prompt(len_dist(rng), rng));
+    // One block payload shared by every store; only its size matters
+    std::vector<std::uint8_t> payload(cfg.block_bytes);
+    std::mt19937 payload_rng(99);
+    for (auto& byte : payload) {
+        byte = static_cast<std::uint8_t>(payload_rng());
     }
 
     kvcache::Config kv_cfg;
     kv_cfg.block_size_tokens = cfg.block_size;
-    kvcache::KVCache cache(kv_cfg);
+    kv_cfg.index_shards = result["index-shards"].as<int>();
+    kv_cfg.dram_cache_bytes = result["dram-bytes"].as<std::uint64_t>();
+    if (result["capacity-bytes"].as<std::uint64_t>() > 0) {
+        kv_cfg.capacity_bytes = result["capacity-bytes"].as<std::uint64_t>();
+    }
+    const std::string admission = result["admission"].as<std::string>();
+    if (admission == "doorkeeper") {
+        kv_cfg.admission = kvcache::AdmissionPolicy::Doorkeeper;
+    } else if (admission != "all") {
+        std::cerr << "Unknown admission policy: " << admission << std::endl;
+        return 1;
+    }
+    if (cfg.tenants > 1 || result["tenant-quota-bytes"].as<std::uint64_t>() > 0) {
+        for (int t = 0; t < cfg.tenants; ++t) {
+            kv_cfg.tenants.push_back({"tenant" + std::to_string(t), result["tenant-quota-bytes"].as<std::uint64_t>()});
+        }
+    }
+    std::shared_ptr<kvcache::ObjectStore> store;
+    if (backend == "memory") {
+        store = std::make_shared<kvcache::MemoryObjectStore>();
+        kvcache::LatencyProfile profile;
+        profile.get_latency_us = result["get-latency-us"].as<std::uint32_t>();
+        profile.put_latency_us = result["put-latency-us"].as<std::uint32_t>();
+        profile.meta_latency_us = result["meta-latency-us"].as<std::uint32_t>();
+        profile.bandwidth_bytes_per_sec = static_cast<std::uint64_t>(result["bandwidth-mbps"].as<double>() * 1e6);
+        profile.jitter = result["jitter"].as<double>();
+        if (profile.get_latency_us || profile.put_latency_us || profile.meta_latency_us ||
+            profile.bandwidth_bytes_per_sec) {
+            store = std::make_shared<kvcache::LatencyObjectStore>(store, profile);
+        }
+    }
+    if (cfg.nodes > 1 && !store) {
+        std::cerr << "--nodes needs the memory backend" << std::endl;
+        return 1;
+    }
+
+    // With --nodes, every node is a full KVCache in cluster mode over the
+    // one store, and peers reach each other through a LocalPeerTransport.
+    // Only worker threads fetch from peers, so the handlers are never
+    // called once they have joined.
+    auto peers = std::make_shared<kvcache::LocalPeerTransport>();
+    std::vector<std::unique_ptr<kvcache::KVCache>> nodes;
+    for (int n = 0; n < cfg.nodes; ++n) {
+        if (cfg.nodes == 1) {
+            nodes.push_back(std::make_unique<kvcache::KVCache>(kv_cfg, store)); // S3 when 'store' is null
+            break;
+        }
+        kvcache::Config node_cfg = kv_cfg;
+        node_cfg.cluster_node_id = "node" + std::to_string(n);
+        node_cfg.cluster_advertise_address = node_cfg.cluster_node_id;
+        node_cfg.cluster_sync_interval_ms = result["sync-interval-ms"].as<std::uint32_t>();
+        nodes.push_back(std::make_unique<kvcache::KVCache>(node_cfg, store, peers));
+        kvcache::KVCache* node = nodes.back().get();
+        peers->Register(node_cfg.cluster_advertise_address,
+                        [node](const kvcache::PrefixKey& key, kvcache::mutable_bytes_view dest) {
+                            return node->ServePeer(key, dest);
+                        });
+    }
+    kvcache::KVCache& cache = *nodes.front();
+
+    if (cfg.mode == "lookup-scaling") {
+        Workload workload(cfg.workload, 0);
+        std::vector<std::vector<std::uint32_t>> prompts;
+        for (int i = 0; i < cfg.workload.pool_size; ++i) {
+            prompts.push_back(workload.Next());
+        }
+        run_lookup_scaling(cache, cfg, prompts, payload);
+        return 0;
+    }
 
     std::vector<std::thread> threads;
     std::vector<Stats> thread_stats(cfg.num_threads);
 
-    auto start_time = std::chrono::high_resolution_clock::now();
+    auto start_time = Clock::now();
 
     for (int i = 0; i < cfg.num_threads; ++i) {
-        threads.emplace_back(worker_thread, std::ref(cache), std::cref(cfg), std::ref(thread_stats[i]), std::cref(prompts), i);
+        threads.emplace_back(worker_thread, std::ref(*nodes[i % cfg.nodes]), std::cref(cfg), std::ref(thread_stats[i]),
+                             std::cref(payload), i);
     }
 
     for (auto& t : threads) {
         t.join();
     }
+    for (auto& node : nodes) {
+        node->Flush();
+    }
 
-    auto end_time = std::chrono::high_resolution_clock::now();
+    auto end_time = Clock::now();
     double total_duration_s = std::chrono::duration<double>(end_time - start_time).count();
 
     Stats total_stats;
     for (const auto& s : thread_stats) {
-        total_stats.num_gets += s.num_gets.load();
-        total_stats.num_puts += s.num_puts.load();
-        total_stats.cache_hits += s.cache_hits.load();
-        atomic_add_double(total_stats.get_latency_ms, s.get_latency_ms.load());
-        atomic_add_double(total_stats.put_latency_ms, s.put_latency_ms.load());
+        total_stats.Merge(s);
     }
 
-    double hit_rate = (total_stats.num_gets > 0) ? (double)total_stats.cache_hits / total_stats.num_gets * 100.0 : 0.0;
-    double avg_get_latency = (total_stats.num_gets > 0) ? total_stats.get_latency_ms.load() / total_stats.num_gets : 0.0;
-    double avg_put_latency = (total_stats.num_puts > 0) ? total_stats.put_latency_ms.load() / total_stats.num_puts : 0.0;
-    double ops_per_sec = cfg.num_prompts / total_duration_s;
+    double hit_rate = total_stats.gets > 0 ? (double)total_stats.cache_hits / total_stats.gets * 100.0 : 0.0;
+    double token_hit_rate = total_stats.prompt_tokens > 0
+        ? (double)total_stats.matched_tokens / total_stats.prompt_tokens * 100.0 : 0.0;
+    double ops_per_sec = total_stats.requests / total_duration_s;
 
     std::cout << "----------- Results -----------" << std::endl;
     std::cout << "Total duration: " << total_duration_s << " s" << std::endl;
-    std::cout << "Operations per second: " << ops_per_sec << std::endl;
-    std::cout << "GET operations: " << total_stats.num_gets << std::endl;
-    std::cout << "PUT operations: " << total_stats.num_puts << std::endl;
+    std::cout << "Requests per second: " << ops_per_sec << std::endl;
+    std::cout << "GET requests: " << total_stats.gets << std::endl;
+    std::cout << "PUT requests: " << total_stats.puts << std::endl;
     std::cout << "Cache hit rate: " << hit_rate << " %" << std::endl;
-    std::cout << "Avg. GET latency: " << avg_get_latency << " ms" << std::endl;
-    std::cout << "Avg. PUT latency: " << avg_put_latency << " ms" << std::endl;
+    std::cout << "Token hit rate: " << token_hit_rate << " %" << std::endl;
+    std::cout << "Loaded: " << total_stats.loaded_bytes << " bytes, " << total_stats.load_failures
+              << " incomplete loads" << std::endl;
+    print_latency_table(total_stats);
+
+    const kvcache::CacheStats cache_stats = cache.GetStats();
+    std::cout << "Library: " << cache_stats.s3_gets << " GETs, " << cache_stats.s3_puts << " PUTs, "
+              << cache_stats.coalesced_loads << " coalesced loads, " << cache_stats.evictions << " evictions, "
+              << cache_stats.lock_contended << " contended shard locks, " << cache_stats.stores_not_admitted
+              << " stores not admitted" << std::endl;
+    for (const auto& tenant : cache_stats.tenants) {
+        std::cout << "Tenant " << tenant.name << ": " << tenant.used_bytes << " bytes used";
+        if (tenant.capacity_bytes > 0) {
+            std::cout << " of " << tenant.capacity_bytes;
+        }
+        std::cout << std::endl;
+    }
+    for (int n = 0; cfg.nodes > 1 && n < cfg.nodes; ++n) {
+        const kvcache::CacheStats node_stats = nodes[n]->GetStats();
+        std::cout << "Node " << n << ": " << node_stats.index_blocks << " blocks indexed, " << node_stats.peer_loads
+                  << " peer loads (" << node_stats.peer_load_failures << " failed), " << node_stats.peer_served
+                  << " served to peers, " << node_stats.cluster_events_applied << " events applied"
+                  << (node_stats.cluster_leader ? ", leader" : "") << std::endl;
+    }
     std::cout << "-----------------------------" << std::endl;
 
+    if (!cfg.prometheus_path.empty()) {
+        std::ofstream out(cfg.prometheus_path);
+        out << kvcache::FormatPrometheus(cache_stats);
+        if (!out) {
+            std::cerr << "Failed to write " << cfg.prometheus_path << std::endl;
+            return 1;
+        }
+    }
+
+    if (!cfg.json_path.empty() && !write_json(cfg.json_path, cfg, total_stats, total_duration_s)) {
+        std::cerr << "Failed to write " << cfg.json_path << std::endl;
+        return 1;
+    }
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Prompt generators for kvbench. Each worker thread owns one generator, so
+// Next() needs no locking.
+
+// Draws ranks 0..n-1 with P(k) proportional to 1 / (k + 1)^s.
+class ZipfSampler {
+public:
+    ZipfSampler(std::size_t n, double s) : cdf_(std::max<std::size_t>(n, 1)) {
+        double sum = 0.0;
+        for (std::size_t k = 0; k < cdf_.size(); ++k) {
+            sum += 1.0 / std::pow(static_cast<double>(k + 1), s);
+            cdf_[k] = sum;
+        }
+        for (auto& c : cdf_) {
+            c /= sum;
+        }
+    }
+
+    template <typename Rng>
+    std::size_t operator()(Rng& rng) const {
+        const double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        const auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+        return std::min<std::size_t>(it - cdf_.begin(), cdf_.size() - 1);
+    }
+
+private:
+    std::vector<double> cdf_;
+};
+
+struct WorkloadConfig {
+    std::string kind = "uniform"; // uniform, zipf or chat
+    int min_prompt_len = 512;     // uniform: prompt length range
+    int max_prompt_len = 2048;    //          (chat: history cap)
+    int pool_size = 100;          // uniform: distinct prompts
+    int system_prompts = 32;      // zipf, chat: shared system prompts
+    int system_len = 1024;
+    double zipf_s = 1.0;          // Skew of system prompt and conversation popularity
+    int min_turn_len = 64;        // User turn length range
+    int max_turn_len = 512;
+    int response_len = 128;       // chat: tokens the model adds per turn
+    int conversations = 16;       // chat: open conversations per thread
+};
+
+inline std::vector<std::uint32_t> random_tokens(std::size_t len, std::mt19937& rng) {
+    std::uniform_int_distribution<std::uint32_t> dist(0, 50256); // vocab size
+    std::vector<std::uint32_t> tokens(len);
+    for (auto& token : tokens) {
+        token = dist(rng);
+    }
+    return tokens;
+}
+
+/**
+ * uniform: prompts drawn uniformly from a fixed pool of unrelated prompts.
+ * zipf:    a Zipf-popular system prompt followed by a fresh user turn, so
+ *          requests share long prefixes.
+ * chat:    multi-turn conversations, each on a Zipf-popular system prompt.
+ *          A Zipf-chosen conversation gets a new user turn per request and
+ *          then the model's response, so its prompt grows and every request
+ *          extends the previous one. Conversations restart past the cap.
+ */
+class Workload {
+public:
+    // The shared prompts are generated from a fixed seed, so every thread
+    // (and every run) sees the same ones
+    Workload(const WorkloadConfig& cfg, int thread_id)
+        : cfg_(cfg), rng_(1000 + thread_id),
+          system_zipf_(cfg.system_prompts, cfg.zipf_s), conversation_zipf_(cfg.conversations, cfg.zipf_s) {
+        std::mt19937 shared(1234);
+        if (cfg_.kind == "uniform") {
+            std::uniform_int_distribution<int> len(cfg_.min_prompt_len, cfg_.max_prompt_len);
+            for (int i = 0; i < cfg_.pool_size; ++i) {
+                pool_.push_back(random_tokens(len(shared), shared));
+            }
+        } else {
+            for (int i = 0; i < cfg_.system_prompts; ++i) {
+                pool_.push_back(random_tokens(cfg_.system_len, shared));
+            }
+            conversations_.resize(std::max(cfg_.conversations, 1));
+        }
+    }
+
+    // The next prompt to serve
+    const std::vector<std::uint32_t>& Next() {
+        if (cfg_.kind == "uniform") {
+            return pool_[std::uniform_int_distribution<std::size_t>(0, pool_.size() - 1)(rng_)];
+        }
+        if (cfg_.kind == "zipf") {
+            prompt_ = pool_[system_zipf_(rng_)];
+            append_turn(&prompt_, turn_len());
+            return prompt_;
+        }
+
+        // chat
+        auto& history = conversations_[conversation_zipf_(rng_)];
+        const int turn = turn_len();
+        if (history.empty() || history.size() + turn > static_cast<std::size_t>(cfg_.max_prompt_len)) {
+            history = pool_[system_zipf_(rng_)];
+        }
+        append_turn(&history, turn);
+        prompt_ = history;
+        append_turn(&history, cfg_.response_len); // The reply is part of the next prompt
+        return prompt_;
+    }
+
+private:
+    int turn_len() {
+        return std::uniform_int_distribution<int>(cfg_.min_turn_len, cfg_.max_turn_len)(rng_);
+    }
+
+    void append_turn(std::vector<std::uint32_t>* tokens, int len) {
+        std::vector<std::uint32_t> turn = random_tokens(len, rng_);
+        tokens->insert(tokens->end(), turn.begin(), turn.end());
+    }
+
+    WorkloadConfig cfg_;
+    std::mt19937 rng_;
+    ZipfSampler system_zipf_;
+    ZipfSampler conversation_zipf_;
+    std::vector<std::vector<std::uint32_t>> pool_;
+    std::vector<std::vector<std::uint32_t>> conversations_;
+    std::vector<std::uint32_t> prompt_;
+};
@@ -0,0 +1,113 @@
+#include "kvcache/hash.hpp"
+#include "kvcache/xxh_dispatch.hpp"
+#include "xxhash.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "kvcache/cxxopts.hpp"
+
+// Compares prefix-key hashing through the serialization buffer MakePrefixKey
+// used to fill byte by byte against the zero-allocation streaming path, and
+// times each XXH3 build this CPU can run on block payloads.
+
+// The former MakePrefixKey: serialize into a heap vector, then one XXH3 call
+static kvcache::PrefixKey legacy_prefix_key(const std::vector<std::uint32_t>& tokens,
+                                            std::uint32_t block_size,
+                                            const std::string& model_id) {
+    std::vector<std::uint8_t> buf;
+    buf.reserve(1 + sizeof(block_size) + sizeof(std::uint16_t) + model_id.size() + tokens.size() * sizeof(std::uint32_t));
+    auto append_le = [&buf](auto value) {
+        for (std::size_t i = 0; i < sizeof(value); ++i) {
+            buf.push_back(static_cast<std::uint8_t>((value >> (i * 8)) & 0xFF));
+        }
+    };
+    buf.push_back(1);
+    append_le(block_size);
+    append_le(static_cast<std::uint16_t>(model_id.size()));
+    buf.insert(buf.end(), model_id.begin(), model_id.end());
+    for (std::uint32_t token : tokens) {
+        append_le(token);
+    }
+    XXH128_hash_t hash = XXH3_128bits(buf.data(), buf.size());
+    kvcache::PrefixKey key;
+    std::memcpy(key.data(), &hash, sizeof(hash));
+    return key;
+}
+
+// Runs 'fn' 'iterations' times and returns the mean nanoseconds per call
+template <typename Fn>
+static double time_ns(int iterations, Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        fn();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+int main(int argc, char** argv) {
+    cxxopts::Options options("kvhashbench", "Microbenchmark for prefix-key hashing");
+    options.add_options()
+        ("tokens", "Prompt length in tokens", cxxopts::value<int>()->default_value("4096"))
+        ("b,block-size", "Block size in tokens", cxxopts::value<int>()->default_value("256"))
+        ("payload-bytes", "Block payload size for MakeContentKey", cxxopts::value<int>()->default_value("1048576"))
+        ("i,iterations", "Calls per measurement", cxxopts::value<int>()->default_value("2000"))
+        ("h,help", "Print usage");
+    auto result = options.parse(argc, argv);
+    if (result.count("help")) {
+        std::cout << options.help() << std::endl;
+        return 0;
+    }
+
+    const int num_tokens = result["tokens"].as<int>();
+    const auto block_size = static_cast<std::uint32_t>(result["block-size"].as<int>());
+    const int payload_bytes = result["payload-bytes"].as<int>();
+    const int iterations = result["iterations"].as<int>();
+    const std::string model_id = "bench-model";
+
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<std::uint32_t> dist(0, 50256);
+    std::vector<std::uint32_t> tokens(num_tokens);
+    for (auto& token : tokens) {
+        token = dist(rng);
+    }
+    std::vector<std::uint8_t> payload(payload_bytes);
+    for (auto& byte : payload) {
+        byte = static_cast<std::uint8_t>(rng());
+    }
+
+    if (legacy_prefix_key(tokens, block_size, model_id) != kvcache::MakePrefixKey(tokens, block_size, model_id)) {
+        std::cerr << "MakePrefixKey disagrees with the serialized path" << std::endl;
+        return 1;
+    }
+
+    std::cout << "--- Hash Benchmark ---" << std::endl;
+    std::cout << "Prompt: " << num_tokens << " tokens, block size " << block_size << std::endl;
+    std::cout << "Dispatched XXH3 build: " << kvcache::HashBackend() << std::endl;
+
+    volatile std::uint8_t sink = 0;
+    double legacy = time_ns(iterations, [&] { sink = legacy_prefix_key(tokens, block_size, model_id)[0]; });
+    double streaming = time_ns(iterations, [&] { sink = kvcache::MakePrefixKey(tokens, block_size, model_id)[0]; });
+    std::cout << "MakePrefixKey, serialized: " << legacy << " ns" << std::endl;
+    std::cout << "MakePrefixKey, in place:   " << streaming << " ns  (" << legacy / streaming << "x)" << std::endl;
+
+    const std::uint32_t num_blocks = tokens.size() / block_size;
+    std::vector<kvcache::PrefixKey> keys(num_blocks);
+    double boundaries = time_ns(iterations, [&] {
+        kvcache::MakeBlockPrefixKeys(tokens, block_size, model_id, num_blocks, keys.data());
+        sink = keys.empty() ? 0 : keys.back()[0];
+    });
+    std::cout << "MakeBlockPrefixKeys (" << num_blocks << " boundaries): " << boundaries << " ns" << std::endl;
+
+    std::cout << "XXH3-128 of a " << payload_bytes << "-byte payload:" << std::endl;
+    for (const kvcache::XxhOps* ops : kvcache::XxhAvailable()) {
+        double ns = time_ns(iterations, [&] { sink = static_cast<std::uint8_t>(ops->hash(payload.data(), payload.size(), 0).low64); });
+        std::cout << "  " << ops->name << ": " << ns << " ns  (" << payload_bytes / ns << " GB/s)" << std::endl;
+    }
+    std::cout << "----------------------" << std::endl;
+    (void)sink;
+    return 0;
+}
@@ -0,0 +1,289 @@
+#include "kvcache/api.hpp"
+#include "kvcache/hash.hpp"
+#include "kvcache/index.hpp"
+#include "kvcache/lru.hpp"
+#include "kvcache/metrics.hpp"
+#include "kvcache/object_store.hpp"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+// CPU hot paths of the cache in isolation. Every KVCache here keeps its
+// objects in a MemoryObjectStore, so no benchmark touches the network and
+// the numbers are stable enough to compare across commits.
+
+static const std::string kModel = "demo-model";
+static constexpr std::uint32_t kBlockSize = 256;
+static constexpr std::uint32_t kMaxPromptTokens = 16384;
+
+static std::vector<std::uint32_t> random_tokens(std::size_t len, std::uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<std::uint32_t> dist(0, 50000);
+    std::vector<std::uint32_t> tokens(len);
+    for (auto& t : tokens) {
+        t = dist(rng);
+    }
+    return tokens;
+}
+
+static kvcache::PrefixKey random_key(std::mt19937_64& rng) {
+    kvcache::PrefixKey key;
+    std::uint64_t words[2] = {rng(), rng()};
+    std::memcpy(key.data(), words, sizeof(words));
+    return key;
+}
+
+// --- Hashing ---
+
+static void BM_MakePrefixKey(benchmark::State& state) {
+    auto tokens = random_tokens(state.range(0), 1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(kvcache::MakePrefixKey(tokens, kBlockSize, kModel));
+    }
+    state.SetBytesProcessed(state.iterations() * tokens.size() * sizeof(std::uint32_t));
+    state.SetLabel(kvcache::HashBackend());
+}
+BENCHMARK(BM_MakePrefixKey)->RangeMultiplier(4)->Range(256, kMaxPromptTokens);
+
+// Every block boundary key of one prompt, as Lookup and StoreSequence need
+static void BM_MakeBlockPrefixKeys(benchmark::State& state) {
+    auto tokens = random_tokens(state.range(0), 1);
+    const std::uint32_t num_blocks = tokens.size() / kBlockSize;
+    std::vector<kvcache::PrefixKey> keys(num_blocks);
+    for (auto _ : state) {
+        kvcache::MakeBlockPrefixKeys(tokens, kBlockSize, kModel, num_blocks, keys.data());
+        benchmark::DoNotOptimize(keys.data());
+    }
+    state.SetItemsProcessed(state.iterations() * num_blocks);
+}
+BENCHMARK(BM_MakeBlockPrefixKeys)->RangeMultiplier(4)->Range(256, kMaxPromptTokens);
+
+// --- Lookup ---
+
+// A cache holding 'index_blocks' blocks as prompts of kMaxPromptTokens
+// random tokens, built once per size and shared by every benchmark and
+// thread that asks for it.
+struct PopulatedCache {
+    std::unique_ptr<kvcache::KVCache> cache;
+    std::vector<std::vector<std::uint32_t>> prompts;
+};
+
+static PopulatedCache& populated_cache(std::uint32_t index_blocks) {
+    static std::mutex mutex;
+    static std::map<std::uint32_t, std::unique_ptr<PopulatedCache>> caches;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& slot = caches[index_blocks];
+    if (!slot) {
+        slot = std::make_unique<PopulatedCache>();
+        kvcache::Config cfg;
+        cfg.block_size_tokens = kBlockSize;
+        slot->cache = std::make_unique<kvcache::KVCache>(cfg, std::make_shared<kvcache::MemoryObjectStore>());
+
+        // Small payloads: the index, not the copy, is what is measured
+        const std::vector<std::uint8_t> payload(64, 0xAB);
+        const std::uint32_t blocks_per_prompt = kMaxPromptTokens / kBlockSize;
+        const std::uint32_t num_prompts = std::max(index_blocks / blocks_per_prompt, 1u);
+        for (std::uint32_t i = 0; i < num_prompts; ++i) {
+            slot->prompts.push_back(random_tokens(kMaxPromptTokens, 1000 + i));
+            std::vector<kvcache::bytes_view> blocks(blocks_per_prompt, payload);
+            slot->cache->StoreSequence(slot->prompts.back(), blocks);
+        }
+    }
+    return *slot;
+}
+
+// Queries matching the first 'len' tokens of stored prompts
+static std::vector<std::vector<std::uint32_t>> hit_queries(const PopulatedCache& pc, std::size_t len) {
+    std::vector<std::vector<std::uint32_t>> queries;
+    for (std::size_t i = 0; i < std::min<std::size_t>(pc.prompts.size(), 64); ++i) {
+        queries.emplace_back(pc.prompts[i].begin(), pc.prompts[i].begin() + len);
+    }
+    return queries;
+}
+
+// Args: prompt length, blocks in the index
+static void BM_LookupHit(benchmark::State& state) {
+    auto& pc = populated_cache(state.range(1));
+    auto queries = hit_queries(pc, state.range(0));
+    std::size_t i = 0;
+    for (auto _ : state) {
+        auto result = pc.cache->Lookup(queries[i++ % queries.size()]);
+        benchmark::DoNotOptimize(result.matched_tokens);
+    }
+    state.SetItemsProcessed(state.iterations() * (state.range(0) / kBlockSize));
+}
+BENCHMARK(BM_LookupHit)->ArgsProduct({{512, 2048, 8192, kMaxPromptTokens}, {1 << 10, 1 << 14, 1 << 18}});
+
+// A miss on block 0 costs one key and one probe, whatever the prompt length
+static void BM_LookupMiss(benchmark::State& state) {
+    auto& pc = populated_cache(state.range(1));
+    std::vector<std::vector<std::uint32_t>> queries;
+    for (std::uint32_t i = 0; i < 64; ++i) {
+        queries.push_back(random_tokens(state.range(0), 900000 + i));
+    }
+    std::size_t i = 0;
+    for (auto _ : state) {
+        auto result = pc.cache->Lookup(queries[i++ % queries.size()]);
+        benchmark::DoNotOptimize(result.matched_tokens);
+    }
+}
+BENCHMARK(BM_LookupMiss)->ArgsProduct({{512, kMaxPromptTokens}, {1 << 14}});
+
+// Readers contending on the index shard locks and the prefix tree
+static void BM_LookupContended(benchmark::State& state) {
+    auto& pc = populated_cache(1 << 14);
+    auto queries = hit_queries(pc, 4096);
+    std::size_t i = state.thread_index();
+    for (auto _ : state) {
+        auto result = pc.cache->Lookup(queries[i++ % queries.size()]);
+        benchmark::DoNotOptimize(result.matched_tokens);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LookupContended)->ThreadRange(1, 32)->UseRealTime();
+
+// Lookup plus LoadAll of the matched blocks out of the memory store
+static void BM_LookupLoadAll(benchmark::State& state) {
+    static std::once_flag once;
+    static std::unique_ptr<kvcache::KVCache> cache;
+    static std::vector<std::uint32_t> prompt;
+    std::call_once(once, [] {
+        kvcache::Config cfg;
+        cfg.block_size_tokens = kBlockSize;
+        cache = std::make_unique<kvcache::KVCache>(cfg, std::make_shared<kvcache::MemoryObjectStore>());
+        prompt = random_tokens(kMaxPromptTokens, 7);
+        const std::vector<std::uint8_t> payload(256 * 1024, 0xCD);
+        std::vector<kvcache::bytes_view> blocks(kMaxPromptTokens / kBlockSize, payload);
+        cache->StoreSequence(prompt, blocks);
+    });
+    std::vector<std::uint32_t> query(prompt.begin(), prompt.begin() + state.range(0));
+    std::vector<std::uint8_t> dest;
+    std::uint64_t bytes = 0;
+    for (auto _ : state) {
+        auto result = cache->Lookup(query);
+        dest.resize(kvcache::KVCache::TotalBytes(result));
+        bytes += cache->LoadAll(result, dest).loaded_bytes;
+    }
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_LookupLoadAll)->RangeMultiplier(4)->Range(1024, kMaxPromptTokens)->UseRealTime();
+
+// --- Index recency and eviction ---
+
+static std::unique_ptr<kvcache::BlockIndex> populated_index(std::size_t blocks, std::uint32_t shards,
+                                                            kvcache::EvictionPolicyKind policy,
+                                                            std::vector<kvcache::PrefixKey>* keys) {
+    auto index = std::make_unique<kvcache::BlockIndex>(shards, policy);
+    std::mt19937_64 rng(42);
+    kvcache::BlockInfo info;
+    info.size = 1;
+    for (std::size_t i = 0; i < blocks; ++i) {
+        keys->push_back(random_key(rng));
+        index->Upsert(keys->back(), info);
+    }
+    return index;
+}
+
+// Args: blocks in the index, policy (0 = LRU, 1 = S3-FIFO)
+static void BM_IndexTouch(benchmark::State& state) {
+    std::vector<kvcache::PrefixKey> keys;
+    auto index = populated_index(state.range(0), 16, static_cast<kvcache::EvictionPolicyKind>(state.range(1)), &keys);
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<std::size_t> pick(0, keys.size() - 1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(index->Touch(keys[pick(rng)]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IndexTouch)->ArgsProduct({{1 << 10, 1 << 16, 1 << 20}, {0, 1}});
+
+// Steady state at capacity: each iteration inserts one block and evicts one
+static void BM_IndexInsertEvict(benchmark::State& state) {
+    std::vector<kvcache::PrefixKey> keys;
+    auto index = populated_index(state.range(0), 16, static_cast<kvcache::EvictionPolicyKind>(state.range(1)), &keys);
+    std::mt19937_64 rng(2);
+    kvcache::BlockInfo info;
+    info.size = 1;
+    kvcache::PrefixKey victim;
+    kvcache::BlockInfo victim_info;
+    for (auto _ : state) {
+        index->Upsert(random_key(rng), info);
+        benchmark::DoNotOptimize(index->EvictOne(&victim, &victim_info));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IndexInsertEvict)->ArgsProduct({{1 << 10, 1 << 16, 1 << 20}, {0, 1}});
+
+// Touches from many threads on one index; the arg is the shard count, so
+// 1 shows a single lock and higher counts how far sharding spreads it
+static void BM_IndexTouchContended(benchmark::State& state) {
+    static std::mutex mutex;
+    static std::map<std::int64_t, std::pair<std::unique_ptr<kvcache::BlockIndex>, std::vector<kvcache::PrefixKey>>> indexes;
+    kvcache::BlockIndex* index;
+    const std::vector<kvcache::PrefixKey>* keys;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& slot = indexes[state.range(0)];
+        if (!slot.first) {
+            slot.first = populated_index(1 << 16, state.range(0), kvcache::EvictionPolicyKind::LRU, &slot.second);
+        }
+        index = slot.first.get();
+        keys = &slot.second;
+    }
+    std::mt19937 rng(state.thread_index());
+    std::uniform_int_distribution<std::size_t> pick(0, keys->size() - 1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(index->Touch((*keys)[pick(rng)]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IndexTouchContended)->Arg(1)->Arg(16)->Arg(64)->ThreadRange(1, 32)->UseRealTime();
+
+static void BM_LRUTrackerTouchEvict(benchmark::State& state) {
+    kvcache::LRUTracker tracker;
+    const std::size_t size = state.range(0);
+    std::vector<std::string> keys;
+    for (std::size_t i = 0; i < size * 2; ++i) {
+        keys.push_back("model/b256/" + std::to_string(i) + ".kv");
+    }
+    for (std::size_t i = 0; i < size; ++i) {
+        tracker.Touch(keys[i]);
+    }
+    std::size_t next = size;
+    for (auto _ : state) {
+        tracker.Touch(keys[next++ % keys.size()]);
+        benchmark::DoNotOptimize(tracker.Evict());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LRUTrackerTouchEvict)->Range(1 << 10, 1 << 18);
+
+// --- Metrics ---
+
+// Cost of one timed op plus a counter, the unit every cache call pays.
+// Arg: 0 = metrics off, 1 = on, 2 = on with a trace sink.
+static void BM_MetricsScopedOp(benchmark::State& state) {
+    static std::atomic<std::uint64_t> spans{0};
+    static const kvcache::Metrics off(false, nullptr);
+    static const kvcache::Metrics on(true, nullptr);
+    static const kvcache::Metrics traced(true, [](const kvcache::TraceSpan&) {
+        spans.fetch_add(1, std::memory_order_relaxed);
+    });
+    const kvcache::Metrics* const variants[] = {&off, &on, &traced};
+    const kvcache::Metrics& metrics = *variants[state.range(0)];
+    for (auto _ : state) {
+        kvcache::ScopedOp op(metrics, kvcache::Op::Lookup);
+        metrics.Add(kvcache::Counter::Lookups);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MetricsScopedOp)->DenseRange(0, 2)->ThreadRange(1, 16)->UseRealTime();
+
+BENCHMARK_MAIN();
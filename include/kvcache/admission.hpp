@@ -0,0 +1,46 @@
+#pragma once
+
+#include "types.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace kvcache {
+
+/**
+ * @class Doorkeeper
+ * @brief Bloom filter admitting a key the second time it is offered.
+ *
+ * A prefix that is stored once and never reused would otherwise cost a PUT,
+ * capacity and, later, a DELETE. The filter remembers the keys offered
+ * within the last 'window' first sightings, using about ten bits per key,
+ * and clears itself once that many have been recorded, so a key must recur
+ * within roughly one window to be admitted. False positives admit a key
+ * on its first sighting, for about 1% of keys when the filter is full.
+ *
+ * Thread-safe and lock-free; a clear racing with an insert may lose that
+ * key, which only delays its admission.
+ */
+class Doorkeeper {
+public:
+    explicit Doorkeeper(std::uint64_t window);
+
+    /**
+     * @brief Returns true if 'key' was offered before; otherwise records it
+     * and returns false.
+     */
+    bool Admit(const PrefixKey& key);
+
+private:
+    static constexpr int kProbes = 4;
+
+    std::unique_ptr<std::atomic<std::uint64_t>[]> words_;
+    std::uint64_t bit_mask_ = 0;
+    std::uint64_t window_ = 0;
+    std::atomic<std::uint64_t> recorded_{0};
+
+    Doorkeeper(const Doorkeeper&) = delete;
+    Doorkeeper& operator=(const Doorkeeper&) = delete;
+};
+
+} // namespace kvcache
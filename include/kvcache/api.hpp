@@ -1,37 +1,181 @@
 #pragma once
 
 #include "types.hpp"
+#include "buffer_pool.hpp"
+#include "metrics.hpp"
 #include <vector>
 #include <memory>
 #include <cstdint>
+#include <functional>
+#include <future>
 #include "span_compat.hpp"
 
 namespace kvcache {
 
 // Forward declaration of internal state
 class KVCacheImpl;
+class ObjectStore;
+class PeerTransport;
+
+// Completion callback for async operations; runs on an I/O thread.
+// Async calls made from one run inline on that thread.
+using CompletionCallback = std::function<void(bool ok)>;
+
+// Receives one slice of a block, [offset, offset + slice.size()), as soon as
+// it has landed in the destination. Return false to abort the load.
+using ChunkCallback = std::function<bool(std::uint64_t offset, bytes_view slice)>;
+
+// Identifies one Prefetch call for CancelPrefetch; 0 means nothing was queued.
+using PrefetchTicket = std::uint64_t;
+
+// Receives the number of leading blocks of a sequence that were stored.
+using SequenceCallback = std::function<void(std::uint32_t stored)>;
 
 class KVCache {
 public:
     explicit KVCache(const Config& cfg);
+
+    // Keeps objects in 'store' instead of the S3 bucket named by 'cfg', e.g.
+    // a MemoryObjectStore for benchmarks that run without a network. The
+    // S3 settings in 'cfg' are then unused. A null 'store' is the same as
+    // KVCache(cfg).
+    KVCache(const Config& cfg, std::shared_ptr<ObjectStore> store);
+
+    // Cluster mode (Config::cluster_node_id) over 'store', fetching from
+    // peers through 'peers', e.g. a LocalPeerTransport joining nodes in one
+    // process. A null 'peers' uses a TcpPeerTransport.
+    KVCache(const Config& cfg, std::shared_ptr<ObjectStore> store, std::shared_ptr<PeerTransport> peers);
     ~KVCache();
 
-    // Compute best available cached prefix for 'tokens'.
+    // Compute best available cached prefix for 'tokens'. Walks the block
+    // prefix tree from block 0 and stops at the first block not resident,
+    // so the match may end on a block shared by several prompt lineages.
+    // Cost is proportional to the matched length, not to tokens.size().
     LookupResult Lookup(const std::vector<std::uint32_t>& tokens) const;
 
+    // Start fetching the blocks Lookup(tokens) matches from S3 into the
+    // local tiers in the background, so later Loads hit locally. Blocks are
+    // queued in block order and served lowest index first across all
+    // prefetches, within Config::prefetch_budget_bytes. Needs a local tier.
+    PrefetchTicket Prefetch(const std::vector<std::uint32_t>& tokens);
+
+    // Lookup, then prefetch what it matched. '*ticket' (if given) receives
+    // the prefetch ticket.
+    LookupResult LookupAndPrefetch(const std::vector<std::uint32_t>& tokens, PrefetchTicket* ticket = nullptr);
+
+    // Drops the prefetch's blocks that have not started; running fetches finish.
+    void CancelPrefetch(PrefetchTicket ticket);
+
     // Load the full bytes of one block.
     bool Load(const BlockRef& ref, std::vector<std::uint8_t>* out_bytes);
 
-    // Store one block for the prefix ending at block_index.
+    // Load one block straight into caller memory (e.g. pinned host memory);
+    // 'dest' must hold at least ref.size bytes. Exactly ref.size bytes are
+    // written, with no intermediate copy.
+    bool Load(const BlockRef& ref, mutable_bytes_view dest);
+
+    // Load one block into a pooled buffer. A DRAM hit returns the tier's own
+    // buffer, shared rather than copied; it stays valid after eviction.
+    // Returns null on a miss.
+    std::shared_ptr<const Buffer> LoadShared(const BlockRef& ref);
+
+    // Load one block into 'dest' like Load, calling 'on_chunk' with each
+    // slice of 'layout' in order as soon as it has arrived, while the rest
+    // of the GET is still in flight. Slices are views into 'dest'. The
+    // callback runs on the calling thread. Encoded blocks (Config::codec),
+    // local hits, blocks served by a cluster peer and blocks joined to a
+    // load already in flight are delivered slice by slice once complete.
+    bool LoadStreaming(const BlockRef& ref, mutable_bytes_view dest, const BlockLayout& layout,
+                       const ChunkCallback& on_chunk);
+
+    // Load every block of 'result' concurrently into one contiguous buffer,
+    // block i placed right after block i-1. 'dest' must hold at least
+    // TotalBytes(result). At most 'max_parallel' GETs run at once (0 uses
+    // Config::load_parallelism). Must not be called from a completion callback.
+    LoadAllResult LoadAll(const LookupResult& result,
+                          mutable_bytes_view dest,
+                          std::uint32_t max_parallel = 0);
+
+    // Sum of the block sizes of 'result', i.e. the size LoadAll needs.
+    static std::uint64_t TotalBytes(const LookupResult& result);
+
+    // Store one block for the prefix ending at block_index. The bytes are
+    // uploaded in place, so the caller's buffer is never copied. The block
+    // counts against 'tenant' (an index into Config::tenants). Returns false
+    // on failure, for an unknown tenant, and for a block Config::admission
+    // declined.
     bool Store(const std::vector<std::uint32_t>& tokens,
                std::uint32_t block_index,
-               bytes_view block_bytes);
+               bytes_view block_bytes,
+               TenantId tenant = 0);
+
+    // Store consecutive blocks 0..blocks.size()-1 of 'tokens', hashing every
+    // block boundary once. Returns the number of leading blocks stored;
+    // with Config::admission, the blocks from the first declined one on are
+    // not stored.
+    std::uint32_t StoreSequence(const std::vector<std::uint32_t>& tokens,
+                                const std::vector<bytes_view>& blocks,
+                                TenantId tenant = 0);
+
+    // Like StoreSequence, but returns once the blocks are copied onto the
+    // write-behind queue (Config::write_behind_threads), blocking only while
+    // Config::write_behind_bytes of copies are pending. Uploads run in
+    // parallel; a block becomes visible to Lookup once it and every block
+    // before it are uploaded, so lookups always see a contiguous prefix.
+    // 'done' runs on an upload thread once the whole sequence has settled.
+    std::future<std::uint32_t> StoreSequenceAsync(const std::vector<std::uint32_t>& tokens,
+                                                  const std::vector<bytes_view>& blocks,
+                                                  TenantId tenant = 0);
+    void StoreSequenceAsync(const std::vector<std::uint32_t>& tokens,
+                            const std::vector<bytes_view>& blocks,
+                            SequenceCallback done,
+                            TenantId tenant = 0);
+
+    // Blocks until every StoreSequenceAsync issued so far has settled.
+    void Flush();
+
+    // Async variants, run on the I/O pool (Config::io_threads). They block
+    // only while Config::max_inflight_requests operations are outstanding.
+    // Called from a completion callback, they run on the callback's thread
+    // before returning, as does a WritePolicy::WriteBack upload, since that
+    // thread already holds one of the slots.
+    // '*out_bytes' and the memory behind 'block_bytes' must stay valid until
+    // the future is ready or the callback has run. Store hashes 'tokens'
+    // before returning, so the token vector need not outlive the call.
+    std::future<bool> LoadAsync(const BlockRef& ref, std::vector<std::uint8_t>* out_bytes);
+    void LoadAsync(const BlockRef& ref, std::vector<std::uint8_t>* out_bytes, CompletionCallback done);
+    std::future<bool> StoreAsync(const std::vector<std::uint32_t>& tokens,
+                                 std::uint32_t block_index,
+                                 bytes_view block_bytes,
+                                 TenantId tenant = 0);
+    void StoreAsync(const std::vector<std::uint32_t>& tokens,
+                    std::uint32_t block_index,
+                    bytes_view block_bytes,
+                    CompletionCallback done,
+                    TenantId tenant = 0);
 
     // Introspection
     std::uint64_t UsedBytes() const;
     std::uint64_t CapacityBytes() const;
     void SetCapacityBytes(std::uint64_t cap);
 
+    // True while a background rebuild from S3 (Config::rebuild_index_from_s3)
+    // is still listing the bucket. Lookups return partial results meanwhile.
+    bool IndexRebuilding() const;
+
+    // Counters of the pool behind block buffers (Config::buffer_pool_bytes).
+    BufferPoolStats BufferStats() const;
+
+    // Counters, gauges and latency percentiles since construction; render
+    // with FormatPrometheus. Counters stay zero unless Config::enable_metrics.
+    CacheStats GetStats() const;
+
+    // Answers another node's fetch of block 'key' into 'dest', which must be
+    // exactly the block's size, from the local tiers or else the object
+    // store. This is the PeerHandler behind Config::cluster_listen_port;
+    // register it with a LocalPeerTransport to join nodes in one process.
+    bool ServePeer(const PrefixKey& key, mutable_bytes_view dest);
+
 private:
     // PIMPL Idiom
     std::unique_ptr<KVCacheImpl> p_impl;
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "span_compat.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace kvcache {
+
+class BufferPool;
+
+/**
+ * @struct BufferPoolStats
+ * @brief Counters of a BufferPool since it was created.
+ */
+struct BufferPoolStats {
+    std::uint64_t allocations = 0;    // Buffers handed out
+    std::uint64_t reused = 0;         // ... taken from a free list
+    std::uint64_t unpooled = 0;       // ... from the heap: too large, or the pool was full
+    std::uint64_t bytes_in_use = 0;   // Size-class bytes held by live pooled buffers
+    std::uint64_t bytes_reserved = 0; // Slab bytes mapped, in use or free
+    std::uint64_t slabs = 0;
+    std::uint64_t hugepage_slabs = 0; // Slabs backed by explicit 2 MiB pages
+};
+
+/**
+ * @class Buffer
+ * @brief A fixed-size, uninitialized byte buffer whose storage goes back to
+ * its pool when the buffer is destroyed.
+ *
+ * Obtained from BufferPool::Allocate; a buffer keeps its pool alive, so it
+ * may outlive the cache that handed it out.
+ */
+class Buffer {
+public:
+    // For BufferPool; 'size_class' is -1 for heap storage
+    Buffer(std::shared_ptr<BufferPool> pool, std::uint8_t* data, std::size_t size, int size_class);
+    ~Buffer();
+
+    std::uint8_t* data() { return data_; }
+    const std::uint8_t* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+    std::uint8_t* begin() { return data_; }
+    std::uint8_t* end() { return data_ + size_; }
+    const std::uint8_t* begin() const { return data_; }
+    const std::uint8_t* end() const { return data_ + size_; }
+
+    operator bytes_view() const { return bytes_view(data_, size_); }
+    operator mutable_bytes_view() { return mutable_bytes_view(data_, size_); }
+
+private:
+    std::shared_ptr<BufferPool> pool_;
+    std::uint8_t* data_;
+    std::size_t size_;
+    int size_class_;
+
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+};
+
+/**
+ * @class BufferPool
+ * @brief Size-classed slab allocator for block buffers.
+ *
+ * Sizes are rounded up to a class, four per power of two from 4 KiB to
+ * 64 MiB, so a buffer wastes at most a fifth of its class. Each class carves
+ * its buffers out of slabs of at least 2 MiB mapped with mmap, optionally on
+ * explicit hugepages (falling back to transparent ones), and keeps freed
+ * buffers on its own free list under its own lock. Slabs are kept until the
+ * pool is destroyed, so their addresses stay valid for registration with a
+ * NIC or GPU (see ForEachSlab). Once 'max_bytes' of slabs are mapped, or for
+ * larger sizes, buffers come from the heap instead.
+ *
+ * Thread-safe.
+ */
+class BufferPool : public std::enable_shared_from_this<BufferPool> {
+public:
+    static std::shared_ptr<BufferPool> Create(std::uint64_t max_bytes, bool hugepages);
+    ~BufferPool();
+
+    /**
+     * @brief Returns an uninitialized buffer of exactly 'size' bytes.
+     */
+    std::shared_ptr<Buffer> Allocate(std::size_t size);
+
+    /**
+     * @brief Returns a buffer holding a copy of 'data'.
+     */
+    std::shared_ptr<Buffer> Copy(bytes_view data);
+
+    BufferPoolStats Stats() const;
+
+    /**
+     * @brief Calls 'visit' with every slab mapped so far, e.g. to register
+     * them as RDMA memory regions or pinned host memory. Slabs mapped later
+     * are not reported.
+     */
+    void ForEachSlab(const std::function<void(void* base, std::size_t bytes)>& visit) const;
+
+    // For Buffer
+    void Release(int size_class, std::uint8_t* data);
+
+private:
+    static constexpr int kNumClasses = 4 * 14 + 1; // 4 KiB .. 64 MiB, four per doubling
+
+    struct SizeClass {
+        std::mutex mutex;
+        std::vector<std::uint8_t*> free; // Released buffers; guarded by mutex
+        std::uint8_t* fresh = nullptr;   // Next never-used buffer of the newest slab; guarded by mutex
+        std::size_t fresh_left = 0;      // Guarded by mutex
+    };
+
+    struct Slab {
+        void* base;
+        std::size_t bytes;
+        bool hugepages;
+    };
+
+    BufferPool(std::uint64_t max_bytes, bool hugepages);
+
+    static int class_for(std::size_t size);
+    static std::size_t class_bytes(int size_class);
+    bool grow(int size_class, SizeClass& cls);
+
+    std::uint64_t max_bytes_;
+    bool hugepages_;
+    std::array<SizeClass, kNumClasses> classes_;
+
+    mutable std::mutex slab_mutex_;
+    std::vector<Slab> slabs_; // Guarded by slab_mutex_
+
+    std::atomic<std::uint64_t> allocations_{0};
+    std::atomic<std::uint64_t> reused_{0};
+    std::atomic<std::uint64_t> unpooled_{0};
+    std::atomic<std::uint64_t> bytes_in_use_{0};
+    std::atomic<std::uint64_t> bytes_reserved_{0};
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+};
+
+} // namespace kvcache
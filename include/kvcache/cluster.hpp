@@ -0,0 +1,201 @@
+#pragma once
+
+#include "types.hpp"
+#include "hash.hpp"
+#include "index_snapshot.hpp"
+#include "metrics.hpp"
+#include "object_store.hpp"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace kvcache {
+
+/**
+ * @class HashRing
+ * @brief Consistent-hash ring over node ids, kVirtualNodes points per node.
+ *
+ * Keys map to the first point at or after their low 64 bits, so adding or
+ * removing a node only moves the keys of its own arcs.
+ */
+class HashRing {
+public:
+    static constexpr int kVirtualNodes = 64;
+
+    HashRing() = default;
+    explicit HashRing(std::vector<std::string> nodes);
+
+    /**
+     * @brief Returns the node owning 'key', or null if the ring is empty.
+     */
+    const std::string* Owner(const PrefixKey& key) const;
+
+    const std::vector<std::string>& Nodes() const { return nodes_; }
+
+private:
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> points_; // Sorted by position
+    std::vector<std::string> nodes_;
+};
+
+struct ClusterOptions {
+    std::string prefix;  // Object key prefix for heartbeats and events, ending in '/'
+    std::string node_id;
+    std::string address; // Where peers fetch from; empty if this node does not serve
+    std::string model_id;
+    std::uint32_t block_size = 0;
+    std::uint32_t sync_interval_ms = 200;
+    std::uint32_t heartbeat_interval_ms = 1000;
+    std::uint32_t node_timeout_ms = 10000;
+    std::uint32_t event_retention = 4096;
+    bool share_recency = true;
+};
+
+/**
+ * @class ClusterSync
+ * @brief Mirrors index events between nodes that share one bucket.
+ *
+ * Each node batches its Store, Evict and Touch events and, every sync
+ * interval, writes them as one numbered event object under
+ * '<prefix>e/<node_id>/'. It also writes a heartbeat object
+ * '<prefix>h/<node_id>' holding a beat counter, its next event number, the
+ * oldest event object it still keeps and how far it has read every other
+ * node's events. Every node reads the heartbeats of the others and fetches
+ * event objects it has not applied yet, so a block stored on one node
+ * becomes visible to Lookup on all of them within about a sync interval.
+ *
+ * A node is live while its beat keeps advancing. The live node with the
+ * lowest id is the leader; only it runs eviction, so the shared bucket is
+ * evicted once under one recency order fed by everyone's Touch events.
+ * Live nodes with an address form the HashRing that picks the peer to ask
+ * for a block before going to the object store.
+ *
+ * Events apply idempotently, so replaying some twice after a crash is
+ * harmless. Every event object carrying evictions also records how far its
+ * writer had read each other node's events, so a store that an eviction
+ * followed is not resurrected on a node that reads the two the other way
+ * round. A node that falls more than event_retention objects behind
+ * another skips the gap and counts the lost events.
+ */
+class ClusterSync {
+public:
+    using ApplyFn = std::function<void(const IndexRecord& record)>;
+    using TouchFn = std::function<void(const PrefixKey& key)>;
+
+    /**
+     * @brief Reads the current heartbeats and starts the sync thread.
+     * @param resume Continue from the read positions this node last
+     * published (its index was restored from a snapshot); otherwise replay
+     * each node's events from the oldest one it keeps.
+     * @param apply Called on the sync thread for each remote Store, Evict
+     * or Deleted record.
+     * @param touch Called on the sync thread for each remote Touch.
+     */
+    ClusterSync(std::shared_ptr<ObjectStore> store, ClusterOptions options, const Metrics& metrics,
+                bool resume, ApplyFn apply, TouchFn touch);
+
+    /**
+     * @brief Publishes pending events and a last heartbeat, then stops.
+     */
+    ~ClusterSync();
+
+    void PublishStore(const IndexRecord& record);
+    void PublishEvict(const PrefixKey& key, std::uint32_t index);
+    void PublishDeleted(const IndexRecord& record);
+    void PublishTouch(const PrefixKey& key);
+
+    bool IsLeader() const;
+    std::size_t LiveNodes() const;
+
+    /**
+     * @brief Returns the address of the live node owning 'key' on the
+     * ring, or an empty string if that is this node or no node serves.
+     */
+    std::string PeerFor(const PrefixKey& key) const;
+
+private:
+    struct Member {
+        std::string address;
+        std::uint64_t beat = 0;
+        std::uint64_t next_seq = 0;  // From its heartbeat
+        std::uint64_t first_seq = 0; // From its heartbeat
+        std::uint64_t cursor = 0;    // Next of its event objects to apply
+        std::chrono::steady_clock::time_point last_advance;
+        bool live = true;
+        bool left = false; // Said goodbye in its last heartbeat
+    };
+
+    // Touches are deduplicated per stripe, so the hot path only contends
+    // with loads of keys that hash to the same stripe
+    static constexpr std::size_t kTouchStripes = 16;
+    struct alignas(64) TouchStripe {
+        std::mutex mutex;
+        std::unordered_set<PrefixKey, PrefixKeyHash> keys;
+    };
+
+    void run();
+    void join(bool resume);
+    bool flush();
+    void write_heartbeat(bool leaving = false);
+    void refresh_members(bool discover);
+    void poll_events();
+    bool apply_object(const std::string& node, std::uint64_t seq);
+    bool superseded(const PrefixKey& key, const std::string& node, std::uint64_t seq) const;
+    void trim_superseded();
+    void trim_events();
+    void update_view_locked();
+    std::string heartbeat_key(const std::string& node) const;
+    std::string event_key(const std::string& node, std::uint64_t seq) const;
+
+    std::shared_ptr<ObjectStore> store_;
+    ClusterOptions options_;
+    const Metrics& metrics_;
+    ApplyFn apply_;
+    TouchFn touch_;
+    PrefixKey fingerprint_;
+
+    // Events not yet written; guarded by pending_mutex_
+    std::mutex pending_mutex_;
+    std::vector<IndexRecord> pending_;
+    std::array<TouchStripe, kTouchStripes> touches_;
+
+    // Sync thread state; only view_ and stop_ are shared, under mutex_
+    mutable std::mutex mutex_;
+    std::map<std::string, Member> members_; // Other nodes, by id
+    std::uint64_t beat_ = 0;
+    std::uint64_t next_seq_ = 0;
+    std::uint64_t first_seq_ = 0;
+    std::map<std::string, std::uint64_t> resume_cursors_; // From this node's last heartbeat
+
+    // Keys evicted by a node that had read further into some writer's
+    // events than this one: that writer's stores of the key below the
+    // recorded position came before the eviction and are skipped
+    std::unordered_map<PrefixKey, std::map<std::string, std::uint64_t>, PrefixKeyHash> superseded_;
+
+    // What other threads read, rebuilt whenever the live set changes
+    struct View {
+        bool leader = true;
+        std::size_t live_nodes = 1;
+        HashRing ring;
+        std::map<std::string, std::string> addresses; // Ring node -> address
+    };
+    std::shared_ptr<const View> view_; // Guarded by mutex_
+
+    std::condition_variable cv_;
+    bool stop_ = false; // Guarded by mutex_
+    std::thread thread_;
+
+    ClusterSync(const ClusterSync&) = delete;
+    ClusterSync& operator=(const ClusterSync&) = delete;
+};
+
+} // namespace kvcache
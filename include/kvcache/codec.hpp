@@ -0,0 +1,53 @@
+#pragma once
+
+#include "types.hpp"
+#include "span_compat.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace kvcache {
+
+struct CodecOptions {
+    Codec codec = Codec::None;
+    int level = 0;
+    std::uint32_t channels = 0; // FP16 values per token row (quantizing codecs)
+};
+
+// Fixed header in front of every encoded object. Raw (Codec::None) objects
+// have no header; object keys tell the two apart (see KVCacheImpl).
+struct BlockHeader {
+    char magic[4];              // "KVBK"
+    std::uint8_t version;
+    std::uint8_t codec;         // Codec
+    std::uint16_t reserved0;
+    std::uint32_t channels;     // Quantizing codecs: values per token row
+    std::uint32_t reserved1;
+    std::uint64_t logical_size; // Decoded size
+    std::uint64_t payload_size; // Bytes after the header
+};
+static_assert(sizeof(BlockHeader) == 32, "BlockHeader is an on-disk format");
+
+/**
+ * @brief Returns true if this build can encode and decode 'codec'.
+ */
+bool CodecAvailable(Codec codec);
+
+/**
+ * @brief Encodes 'data' into a self-describing object (header + payload).
+ * @return False if the codec is not built in, the payload layout does not
+ * fit it, or the result would not be smaller; store the block raw then.
+ */
+bool EncodeBlock(const CodecOptions& options, bytes_view data, std::vector<std::uint8_t>* object);
+
+/**
+ * @brief Validates and copies out the header of an encoded object.
+ */
+bool ReadBlockHeader(bytes_view object, BlockHeader* header);
+
+/**
+ * @brief Decodes an encoded object into 'dest', which must be exactly the
+ * logical size recorded in its header.
+ */
+bool DecodeBlock(bytes_view object, mutable_bytes_view dest);
+
+} // namespace kvcache
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+namespace kvcache {
+
+/**
+ * @class EvictionPolicy
+ * @brief Decides which resident entry to evict next.
+ *
+ * Entries are named by dense slot numbers owned by the caller (BlockIndex
+ * or LRUTracker), and the policy keeps its per-entry state in arrays
+ * indexed by slot, so there is no per-entry allocation. A slot may be
+ * reused once it has been removed or returned by Victim().
+ *
+ * Not thread-safe; callers serialize access (BlockIndex holds the shard
+ * lock around every call).
+ */
+class EvictionPolicy {
+public:
+    virtual ~EvictionPolicy() = default;
+
+    /**
+     * @brief Starts tracking a slot.
+     * @param fingerprint Identifies the key across slot reuse, so policies
+     * with a history of evicted keys can recognise a returning key.
+     * @param cold Place the slot where it is evicted first (recency unknown).
+     */
+    virtual void Insert(std::uint32_t slot, std::uint64_t fingerprint, bool cold) = 0;
+
+    /**
+     * @brief Records a hit on a tracked slot.
+     */
+    virtual void Access(std::uint32_t slot) = 0;
+
+    /**
+     * @brief Stops tracking a slot without evicting it.
+     */
+    virtual void Remove(std::uint32_t slot) = 0;
+
+    /**
+     * @brief Picks the next victim and stops tracking it.
+     * @return False if no slot is tracked.
+     */
+    virtual bool Victim(std::uint32_t* slot) = 0;
+
+    /**
+     * @brief Calls 'visit' for every tracked slot, next victim first.
+     */
+    virtual void ForEach(const std::function<void(std::uint32_t)>& visit) const = 0;
+
+    /**
+     * @brief Returns the number of tracked slots.
+     */
+    virtual std::size_t Size() const = 0;
+};
+
+/**
+ * @brief Creates the policy selected by Config::eviction_policy.
+ */
+std::unique_ptr<EvictionPolicy> MakeEvictionPolicy(EvictionPolicyKind kind);
+
+} // namespace kvcache
@@ -1,18 +1,94 @@
 #pragma once
 
+#include "types.hpp"
+#include "span_compat.hpp"
+#include "xxh_dispatch.hpp"
 #include <vector>
 #include <cstdint>
+#include <cstring>
+#include <cstddef>
 #include <string>
 #include <array>
+#include <memory>
 
 namespace kvcache {
 
-using PrefixKey = std::array<std::uint8_t, 16>;
-
-PrefixKey MakePrefixKey(const std::vector<std::uint32_t>& tokens,
+// XXH3-128 of the key header (version, block size, model id) followed by
+// the tokens as little-endian uint32s. Allocates nothing: on little-endian
+// hosts the token array is hashed in place.
+PrefixKey MakePrefixKey(tokens_view tokens,
                         std::uint32_t block_size,
                         const std::string& model_id);
 
 std::string ToHex(const PrefixKey& key);
 
-} // namespace kvcache
\ No newline at end of file
+// XXH3-128 of a block payload, naming content-addressed objects. 'seed'
+// separates payloads written with different codec settings.
+PrefixKey MakeContentKey(bytes_view data, std::uint64_t seed = 0);
+
+// Vector unit of the XXH3 build picked at startup, e.g. "avx2".
+const char* HashBackend();
+
+// Parses the 32-character lowercase or uppercase hex form written by ToHex.
+bool FromHex(const std::string& hex, PrefixKey* key);
+
+// Hasher for unordered containers keyed by PrefixKey. The key is already a
+// uniformly distributed XXH3 digest, so its low 64 bits are used directly.
+struct PrefixKeyHash {
+    std::size_t operator()(const PrefixKey& key) const noexcept {
+        std::uint64_t h;
+        std::memcpy(&h, key.data(), sizeof(h));
+        return static_cast<std::size_t>(h);
+    }
+};
+
+/**
+ * @class PrefixHasher
+ * @brief Computes the PrefixKey of every block boundary in a single pass.
+ *
+ * The hasher keeps an XXH3-128 streaming state over the same serialization
+ * MakePrefixKey uses, so the key returned for block i is identical to
+ * MakePrefixKey(tokens[0, (i + 1) * block_size)). Each token is hashed once,
+ * no matter how many boundaries are requested. The state lives inside the
+ * hasher, so hashing allocates nothing.
+ */
+class PrefixHasher {
+public:
+    PrefixHasher(std::uint32_t block_size, const std::string& model_id);
+
+    /**
+     * @brief Feeds the next block of block_size tokens.
+     * @param block_tokens Pointer to exactly block_size tokens.
+     * @return The key of the prefix ending at this block.
+     */
+    PrefixKey NextBlock(const std::uint32_t* block_tokens);
+
+    /**
+     * @brief Returns the number of blocks fed so far.
+     */
+    std::uint32_t BlocksHashed() const { return blocks_hashed_; }
+
+private:
+    const XxhOps& ops_;
+    XxhState state_;
+    std::uint32_t block_size_;
+    std::uint32_t blocks_hashed_ = 0;
+
+    PrefixHasher(const PrefixHasher&) = delete;
+    PrefixHasher& operator=(const PrefixHasher&) = delete;
+};
+
+// Keys of the first 'num_blocks' block boundaries of 'tokens', in block order.
+std::vector<PrefixKey> MakeBlockPrefixKeys(tokens_view tokens,
+                                           std::uint32_t block_size,
+                                           const std::string& model_id,
+                                           std::uint32_t num_blocks);
+
+// Same, written to keys[0, num_blocks) with no allocation.
+void MakeBlockPrefixKeys(tokens_view tokens,
+                         std::uint32_t block_size,
+                         const std::string& model_id,
+                         std::uint32_t num_blocks,
+                         PrefixKey* keys);
+
+} // namespace kvcache
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "types.hpp"
+#include "hash.hpp"
+#include "eviction_policy.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace kvcache {
+
+// Metadata the index keeps for one resident block.
+struct BlockInfo {
+    std::uint64_t size = 0;     // Logical (decoded) size
+    std::uint32_t index = 0;    // Block index; the key alone fixes the prefix length
+    bool has_parent = false;    // False for block 0 and for blocks of unknown lineage
+    PrefixKey parent{};         // Key of block index-1 of the same prompt
+    bool has_content = false;   // Stored as a content-addressed object
+    PrefixKey content{};        // XXH3-128 of the payload when has_content
+    std::uint64_t stored_size = 0; // Object size in S3; counted against capacity
+    Codec codec = Codec::None;  // Codec the object was written with
+    bool has_segment = false;   // Packed into a multi-block segment object
+    PrefixKey segment{};        // Segment id when has_segment
+    std::uint64_t offset = 0;   // Start of the block's object within the segment
+    TenantId tenant = 0;        // Whose capacity it counts against and whose policy evicts it
+};
+
+// Reference state of one segment object, as returned by SparseSegments.
+struct SegmentUsage {
+    PrefixKey segment;
+    std::uint64_t live_bytes = 0;    // Bytes of blocks still indexed in it
+    std::uint64_t payload_bytes = 0; // Bytes of all the blocks it was written with
+    std::vector<PrefixKey> members;  // Keys packed into it; some may have moved on
+};
+
+// Waits on the index shard locks. Only acquisitions that found the lock
+// taken are timed, so an uncontended one costs a single try_lock.
+struct LockWaitStats {
+    std::uint64_t contended = 0; // Acquisitions that had to wait
+    std::uint64_t wait_ns = 0;   // Total time spent waiting
+};
+
+/**
+ * @class BlockIndex
+ * @brief Sharded, thread-safe map from PrefixKey to block metadata.
+ *
+ * Keys are spread over a power-of-two number of shards using the high 64 bits
+ * of the digest (the low bits already pick the hash-table bucket). Each shard
+ * has its own reader/writer lock and its own eviction policy per tenant, so
+ * lookups only take shared locks and recency updates only contend within one
+ * shard. Entries live in a per-shard slot array that the policies index
+ * directly.
+ *
+ * Blocks form a prefix tree through BlockInfo::parent. Only leaves are
+ * handed to the eviction policy, so a block is never evicted while a
+ * longer resident prefix depends on it; a parent becomes evictable when
+ * its last child leaves. A block stored before its parent is parked as an
+ * orphan of the missing key and adopted when the parent arrives. Linking a
+ * child locks the child's and the parent's shard together.
+ */
+class BlockIndex {
+public:
+    /**
+     * @param num_shards Requested shard count, rounded up to a power of two.
+     * @param policy Eviction policy instantiated for each shard and tenant.
+     * @param num_tenants Tenants whose blocks are evicted separately;
+     * BlockInfo::tenant is clamped below it.
+     */
+    explicit BlockIndex(std::uint32_t num_shards, EvictionPolicyKind policy = EvictionPolicyKind::LRU,
+                        std::uint32_t num_tenants = 1);
+    ~BlockIndex();
+
+    /**
+     * @brief Looks up a block without changing its recency.
+     * @return True and fills 'info' if the key is resident.
+     */
+    bool Find(const PrefixKey& key, BlockInfo* info) const;
+
+    /**
+     * @brief Inserts a block as recently used, or updates it in place and
+     * records a hit.
+     * @param previous If non-null, set to the replaced metadata when the key
+     * was already resident.
+     * @return The change in resident bytes (new size minus old size).
+     */
+    std::int64_t Upsert(const PrefixKey& key, const BlockInfo& info,
+                        std::optional<BlockInfo>* previous = nullptr);
+
+    /**
+     * @brief Records a hit if the key is resident with the same size and
+     * content as 'info', linking its parent if that was unknown.
+     * @return False if the key is absent or holds a different payload.
+     */
+    bool Refresh(const PrefixKey& key, const BlockInfo& info);
+
+    /**
+     * @brief Inserts a block where its shard evicts first unless it is
+     * already resident. Used for blocks whose recency is unknown.
+     * @return True if the block was inserted.
+     */
+    bool InsertCold(const PrefixKey& key, const BlockInfo& info);
+
+    /**
+     * @brief Records a hit on a resident block.
+     * @return False if the key is not resident.
+     */
+    bool Touch(const PrefixKey& key);
+
+    /**
+     * @brief Removes a specific block. Its children, if any, become orphans
+     * until the key is inserted again.
+     * @return True and fills 'info' if the key was resident.
+     */
+    bool Remove(const PrefixKey& key, BlockInfo* info);
+
+    /**
+     * @brief Removes a block and every resident descendant, calling 'visit'
+     * for each one removed (the block itself first).
+     * @return The number of blocks removed.
+     */
+    std::size_t RemoveSubtree(const PrefixKey& key,
+                              const std::function<void(const PrefixKey&, const BlockInfo&)>& visit);
+
+    /**
+     * @brief Removes the victim of a tenant's policy, always a leaf, from
+     * the next shard that has one, visiting shards round-robin so eviction
+     * pressure is spread evenly.
+     * @return False if the tenant has no evictable block.
+     */
+    bool EvictOne(PrefixKey* key, BlockInfo* info, TenantId tenant = 0);
+
+    /**
+     * @brief Calls 'visit' for every resident block, shard by shard and
+     * next victim first within a shard and tenant, so re-inserting in this
+     * order restores each policy's recency. Each shard is read under its shared lock.
+     */
+    void ForEach(const std::function<void(const PrefixKey&, const BlockInfo&)>& visit) const;
+
+    /**
+     * @brief Takes a reference on a content-addressed object.
+     * @return True if this is the first reference, i.e. it must be uploaded.
+     */
+    bool AcquireContent(const PrefixKey& content);
+
+    /**
+     * @brief Drops a reference on a content-addressed object.
+     * @return True if that was the last reference, i.e. it can be deleted.
+     */
+    bool ReleaseContent(const PrefixKey& content);
+
+    /**
+     * @brief Returns true if any resident block references the content.
+     */
+    bool HasContent(const PrefixKey& content) const;
+
+    /**
+     * @brief Takes a reference on a segment object for the block 'key'
+     * occupying 'bytes' of it.
+     * @param payload_bytes Total block bytes in the segment, recorded with
+     * its first reference.
+     */
+    void AcquireSegment(const PrefixKey& segment, const PrefixKey& key, std::uint64_t bytes,
+                        std::uint64_t payload_bytes);
+
+    /**
+     * @brief Drops a block's reference on a segment object.
+     * @return True if that was the last reference, i.e. it can be deleted.
+     */
+    bool ReleaseSegment(const PrefixKey& segment, std::uint64_t bytes);
+
+    /**
+     * @brief Returns the recorded payload size of a referenced segment, or 0.
+     */
+    std::uint64_t SegmentPayloadBytes(const PrefixKey& segment) const;
+
+    /**
+     * @brief Returns up to 'limit' segments whose live bytes are at most
+     * 'max_live_ratio' of their payload, i.e. worth compacting.
+     */
+    std::vector<SegmentUsage> SparseSegments(double max_live_ratio, std::size_t limit) const;
+
+    /**
+     * @brief Points a packed block at its copy in another segment, provided
+     * it still lives in 'from'.
+     * @param info If non-null, set to the updated metadata.
+     * @return False if the key is absent or no longer in 'from'.
+     */
+    bool Relocate(const PrefixKey& key, const PrefixKey& from, const PrefixKey& to, std::uint64_t offset,
+                  BlockInfo* info = nullptr);
+
+    /**
+     * @brief Returns the number of resident blocks across all shards.
+     */
+    std::size_t Size() const;
+
+    std::uint32_t NumShards() const { return static_cast<std::uint32_t>(shards_.size()); }
+
+    /**
+     * @brief Returns the shard lock waits summed over all shards.
+     */
+    LockWaitStats LockWaits() const;
+
+private:
+    struct Entry {
+        PrefixKey key;
+        BlockInfo info;
+        std::vector<PrefixKey> children; // Resident blocks whose parent is this one
+        std::uint64_t last_access = 0;   // BlockIndex clock at the last insert or hit
+        bool evictable = false;          // Tracked by the policy, i.e. a leaf
+    };
+
+    struct SegmentRefs {
+        std::uint32_t blocks = 0;
+        std::uint64_t live_bytes = 0;
+        std::uint64_t payload_bytes = 0;
+        std::vector<PrefixKey> members;
+    };
+
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        mutable std::atomic<std::uint64_t> lock_contended{0};
+        mutable std::atomic<std::uint64_t> lock_wait_ns{0};
+        // Node storage for the maps below, recycled as blocks come and go;
+        // only touched under the exclusive lock
+        std::pmr::unsynchronized_pool_resource arena;
+        std::pmr::unordered_map<PrefixKey, std::uint32_t, PrefixKeyHash> slots{&arena}; // Key -> slot
+        std::vector<Entry> entries;                                                      // Indexed by slot
+        std::vector<std::uint32_t> free_slots;
+        std::vector<std::unique_ptr<EvictionPolicy>> policies; // One per tenant
+        // Missing parent -> resident children, kept in the parent's shard
+        std::pmr::unordered_multimap<PrefixKey, PrefixKey, PrefixKeyHash> orphans{&arena};
+        // Content digest -> references, kept in the digest's shard
+        std::pmr::unordered_map<PrefixKey, std::uint32_t, PrefixKeyHash> content_refs{&arena};
+        // Segment id -> references, kept in the id's shard
+        std::pmr::unordered_map<PrefixKey, SegmentRefs, PrefixKeyHash> segments{&arena};
+    };
+
+    Shard& shard_for(const PrefixKey& key) const;
+    static EvictionPolicy& policy_for(const Shard& shard, TenantId tenant);
+    static std::shared_lock<std::shared_mutex> lock_shared(const Shard& shard);
+    static std::unique_lock<std::shared_mutex> lock_exclusive(const Shard& shard);
+    std::int64_t insert(const PrefixKey& key, const BlockInfo& info, bool cold, bool* inserted,
+                        std::optional<BlockInfo>* previous);
+    void insert_locked(Shard& shard, const PrefixKey& key, const BlockInfo& info, bool cold);
+    void link_locked(Shard& parent_shard, const PrefixKey& key, const PrefixKey& parent);
+    bool remove_node(const PrefixKey& key, BlockInfo* info, std::vector<PrefixKey>* children);
+    void detach(const PrefixKey& key, const PrefixKey& parent, std::uint64_t last_access);
+    static void promote_locked(Shard& shard, std::uint32_t slot, bool cold);
+    static void release_locked(Shard& shard, std::uint32_t slot);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::uint64_t shard_mask_;
+    std::atomic<std::uint32_t> evict_cursor_{0};
+    std::atomic<std::uint64_t> clock_{0};
+
+    BlockIndex(const BlockIndex&) = delete;
+    BlockIndex& operator=(const BlockIndex&) = delete;
+};
+
+} // namespace kvcache
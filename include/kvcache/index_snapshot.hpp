@@ -0,0 +1,104 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace kvcache {
+
+// One persisted index event. Snapshots hold only Store records; the journal
+// holds both kinds. Fixed-size so a snapshot can be mapped and walked in place.
+struct IndexRecord {
+    // kDeleted only travels in cluster events: the object the record names
+    // has been deleted from the bucket
+    enum Op : std::uint32_t { kStore = 1, kEvict = 2, kDeleted = 3 };
+
+    PrefixKey key;
+    PrefixKey parent;  // Key of block index-1; all zeros for block 0 or when unknown
+    PrefixKey content; // Payload digest of a deduplicated block; otherwise all zeros
+    PrefixKey segment; // Segment id of a packed block; otherwise all zeros
+    std::uint64_t size;        // Logical size
+    std::uint64_t stored_size; // Object size
+    std::uint64_t offset;        // Packed blocks: object offset in the segment
+    std::uint64_t segment_bytes; // Packed blocks: payload size of the segment
+    std::uint32_t index;
+    std::uint32_t op;
+    std::uint32_t codec;       // Codec of the object
+    std::uint32_t tenant;      // BlockInfo::tenant; 0 in files written before tenants
+};
+static_assert(sizeof(IndexRecord) == 112, "IndexRecord is an on-disk format");
+
+/**
+ * @class IndexSnapshot
+ * @brief Persists the block index as a binary snapshot plus an append-only journal.
+ *
+ * On disk there are three files: '<path>' (the snapshot), '<path>.journal'
+ * (events since the snapshot was started) and, transiently while a new
+ * snapshot is written, '<path>.journal.old'. Replaying snapshot, old journal
+ * and journal in that order always reproduces the index, because Store and
+ * Evict records are idempotent. Files written for a different model or block
+ * size are ignored.
+ *
+ * Thread-safe; journal appends are serialized internally.
+ */
+class IndexSnapshot {
+public:
+    IndexSnapshot(const std::string& path, std::uint32_t block_size, const std::string& model_id);
+    ~IndexSnapshot();
+
+    /**
+     * @brief Replays the snapshot and journals, then opens the journal for appends.
+     * @param apply Called for every record, oldest first.
+     * @return The number of records replayed.
+     */
+    std::uint64_t Load(const std::function<void(const IndexRecord&)>& apply);
+
+    // Journals 'record' as a Store; its op field is ignored.
+    void AppendStore(IndexRecord record);
+    void AppendEvict(const PrefixKey& key, std::uint32_t index);
+
+    /**
+     * @brief Writes a new snapshot and starts a fresh journal.
+     * @param collect Returns the current index contents, LRU first. It runs
+     * with journal appends blocked, so no event falls between it and the
+     * journal switch; the snapshot file itself is written after unblocking.
+     * @return False if the snapshot could not be written (the journals are kept).
+     */
+    bool Write(const std::function<std::vector<IndexRecord>()>& collect);
+
+private:
+    struct FileHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t block_size;
+        PrefixKey fingerprint; // MakePrefixKey of an empty prompt: fixes model and block size
+        std::uint64_t record_count;
+        std::uint8_t reserved[24];
+    };
+    static_assert(sizeof(FileHeader) == 64, "FileHeader is an on-disk format");
+
+    FileHeader make_header(const char* magic, std::uint64_t record_count) const;
+    bool header_matches(const FileHeader& header, const char* magic) const;
+    std::uint64_t replay_snapshot(const std::function<void(const IndexRecord&)>& apply) const;
+    std::uint64_t replay_journal(const std::string& path, const std::function<void(const IndexRecord&)>& apply) const;
+    bool open_journal();
+    bool fold_into_old_journal();
+    void append(const IndexRecord& record);
+
+    std::string path_;
+    std::string journal_path_;
+    std::string old_journal_path_;
+    std::uint32_t block_size_;
+    PrefixKey fingerprint_;
+
+    std::mutex mutex_; // Guards journal_fd_
+    int journal_fd_ = -1;
+
+    IndexSnapshot(const IndexSnapshot&) = delete;
+    IndexSnapshot& operator=(const IndexSnapshot&) = delete;
+};
+
+} // namespace kvcache
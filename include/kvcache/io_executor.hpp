@@ -0,0 +1,64 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kvcache {
+
+/**
+ * @class IoExecutor
+ * @brief Fixed pool of I/O threads with a bound on in-flight requests.
+ *
+ * A task is in flight from the moment it is submitted until it returns.
+ * Submit() blocks while 'max_inflight' tasks are queued or running, so a
+ * caller that produces requests faster than the object store completes them
+ * is slowed down instead of growing the queue without limit.
+ *
+ * A task submitted from one of the pool's own threads runs inline instead:
+ * the submitting task holds a slot itself, so waiting for room could wait
+ * forever once every thread did the same.
+ */
+class IoExecutor {
+public:
+    IoExecutor(std::uint32_t num_threads, std::uint32_t max_inflight);
+
+    /**
+     * @brief Runs every task that was already submitted, then joins the threads.
+     */
+    ~IoExecutor();
+
+    /**
+     * @brief Queues a task, blocking while the in-flight limit is reached.
+     * Called from one of this pool's threads, runs the task right away.
+     * @param task The work to run on one of the I/O threads.
+     */
+    void Submit(std::function<void()> task);
+
+    /**
+     * @brief Returns the number of tasks currently queued or running.
+     */
+    std::size_t InFlight() const;
+
+private:
+    void WorkerLoop();
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_work_;
+    std::condition_variable cv_space_;
+    std::deque<std::function<void()>> queue_;
+    std::size_t in_flight_ = 0;
+    std::size_t max_inflight_;
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+
+    IoExecutor(const IoExecutor&) = delete;
+    IoExecutor& operator=(const IoExecutor&) = delete;
+};
+
+} // namespace kvcache
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "types.hpp"
+#include "buffer_pool.hpp"
+#include "hash.hpp"
+#include "span_compat.hpp"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace kvcache {
+
+// Immutable, shared block payload, usually from the cache's BufferPool.
+// Readers keep a block alive while they copy out of it, even if the tier
+// evicts it concurrently.
+using BlockBuffer = std::shared_ptr<const Buffer>;
+
+/**
+ * @class MemoryTier
+ * @brief Capacity-bounded, thread-safe LRU cache of block payloads in DRAM.
+ *
+ * Map and list nodes come from a pool owned by the tier, so churn does not
+ * go through the global allocator.
+ */
+class MemoryTier {
+public:
+    explicit MemoryTier(std::uint64_t capacity_bytes);
+
+    /**
+     * @brief Returns the block and marks it most recently used.
+     * @return The payload, or nullptr on a miss.
+     */
+    BlockBuffer Get(const PrefixKey& key);
+
+    /**
+     * @brief Inserts or replaces a block, evicting LRU blocks to make room.
+     * Blocks larger than the whole tier are not admitted.
+     * @return The blocks evicted to make room, for demotion to a lower tier.
+     */
+    std::vector<std::pair<PrefixKey, BlockBuffer>> Put(const PrefixKey& key, BlockBuffer data);
+
+    /**
+     * @brief Drops a block if present.
+     */
+    void Erase(const PrefixKey& key);
+
+    std::uint64_t UsedBytes() const;
+    std::uint64_t CapacityBytes() const { return capacity_bytes_; }
+
+private:
+    struct Entry {
+        BlockBuffer data;
+        std::pmr::list<PrefixKey>::iterator lru_it;
+    };
+
+    mutable std::mutex mutex_;
+    std::pmr::unsynchronized_pool_resource arena_; // Guarded by mutex_
+    std::pmr::unordered_map<PrefixKey, Entry, PrefixKeyHash> entries_{&arena_};
+    std::pmr::list<PrefixKey> lru_list_{&arena_}; // MRU at front, LRU at back
+    std::uint64_t used_bytes_ = 0;
+    std::uint64_t capacity_bytes_;
+};
+
+/**
+ * @class DiskTier
+ * @brief Capacity-bounded LRU cache of block payloads on local disk.
+ *
+ * Each block is one file named after its prefix key and a generation that
+ * is new for every Put, so a block written again never shares a path with
+ * its evicted or erased predecessor, whose file is unlinked later. Files
+ * are written to a temporary name and renamed into place, so readers never
+ * see a partial block, and file I/O happens outside the tier's lock. Files left in the
+ * directory by an earlier process are removed on construction.
+ */
+class DiskTier {
+public:
+    DiskTier(const std::string& dir, std::uint64_t capacity_bytes);
+
+    /**
+     * @brief Writes a block, evicting LRU blocks to make room.
+     * @return False if the block does not fit or the write failed.
+     */
+    bool Put(const PrefixKey& key, bytes_view data);
+
+    /**
+     * @brief Reads a block into 'dest' and marks it most recently used.
+     * @return False on a miss or if the block is larger than 'dest'.
+     */
+    bool Get(const PrefixKey& key, mutable_bytes_view dest, std::uint64_t* bytes_read);
+
+    /**
+     * @brief Returns whether a block is present, marking it most recently
+     * used, without reading it.
+     */
+    bool Contains(const PrefixKey& key);
+
+    /**
+     * @brief Drops a block if present.
+     */
+    void Erase(const PrefixKey& key);
+
+    std::uint64_t UsedBytes() const;
+
+private:
+    struct Entry {
+        std::uint64_t size;
+        std::uint64_t generation;
+        std::pmr::list<PrefixKey>::iterator lru_it;
+    };
+
+    std::string path_for(const PrefixKey& key, std::uint64_t generation) const;
+
+    std::string dir_;
+    mutable std::mutex mutex_;
+    std::pmr::unsynchronized_pool_resource arena_; // Guarded by mutex_
+    std::pmr::unordered_map<PrefixKey, Entry, PrefixKeyHash> entries_{&arena_};
+    std::pmr::list<PrefixKey> lru_list_{&arena_}; // MRU at front, LRU at back
+    std::uint64_t used_bytes_ = 0;
+    std::uint64_t capacity_bytes_;
+    std::uint64_t next_generation_ = 0; // Guarded by mutex_
+};
+
+} // namespace kvcache
@@ -1,29 +1,31 @@
 #pragma once
 
+#include "eviction_policy.hpp"
 #include <string>
-#include <list>
+#include <memory>
 #include <unordered_map>
 #include <optional>
+#include <vector>
 
 namespace kvcache {
 
 /**
  * @class LRUTracker
- * @brief Manages the order of keys based on a Least Recently Used (LRU) policy.
+ * @brief Tracks string keys and evicts them under an EvictionPolicy.
  *
  * This class is not thread-safe by itself. External synchronization (e.g., a std::mutex)
  * is required if it's accessed from multiple threads.
  *
- * The front of the list is the Most Recently Used (MRU) item, and the back
- * is the Least Recently Used (LRU) item.
+ * Keys are mapped to dense slots for the policy, the same way BlockIndex
+ * does for prefix keys. The default policy is plain LRU.
  */
 class LRUTracker {
 public:
-    LRUTracker() = default;
+    explicit LRUTracker(EvictionPolicyKind policy = EvictionPolicyKind::LRU);
+    ~LRUTracker();
 
     /**
-     * @brief Marks a key as recently used by moving it to the front of the list.
-     * If the key does not exist, it is inserted.
+     * @brief Records a use of a key, inserting it if it is not tracked.
      * @param key The key to touch.
      */
     void Touch(const std::string& key);
@@ -35,7 +37,7 @@ public:
     void Remove(const std::string& key);
 
     /**
-     * @brief Evicts the least recently used key and returns it.
+     * @brief Evicts the policy's victim and returns it.
      * @return The evicted key, or std::nullopt if the tracker is empty.
      */
     std::optional<std::string> Evict();
@@ -53,8 +55,10 @@ public:
     size_t Size() const;
 
 private:
-    std::list<std::string> lru_list_;
-    std::unordered_map<std::string, std::list<std::string>::iterator> key_map_;
+    std::unordered_map<std::string, std::uint32_t> key_map_; // Key -> slot
+    std::vector<std::string> keys_;                          // Indexed by slot
+    std::vector<std::uint32_t> free_slots_;
+    std::unique_ptr<EvictionPolicy> policy_;
 };
 
 } // namespace kvcache
@@ -0,0 +1,317 @@
+#pragma once
+
+#include "types.hpp"
+#include "buffer_pool.hpp"
+#include "object_store.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace kvcache {
+
+// Capacity held by one tenant (Config::tenants), counted per block
+// reference, so a deduplicated payload counts once for each tenant using it.
+struct TenantUsage {
+    std::string name;
+    std::uint64_t used_bytes = 0;
+    std::uint64_t capacity_bytes = 0; // 0 without a quota
+};
+
+/**
+ * @struct LatencyStats
+ * @brief Latency distribution of one kind of operation.
+ *
+ * Percentiles come from log-linear buckets, four per power of two, so
+ * they are within about 12% of the exact value.
+ */
+struct LatencyStats {
+    // Cumulative counts: le[i] operations took less than kBoundBaseNs << i ns
+    static constexpr int kBounds = 26;
+    static constexpr std::uint64_t kBoundBaseNs = 1024;
+
+    std::uint64_t count = 0;
+    std::uint64_t total_ns = 0;
+    std::uint64_t max_ns = 0;
+    std::uint64_t p50_ns = 0;
+    std::uint64_t p90_ns = 0;
+    std::uint64_t p99_ns = 0;
+    std::uint64_t p999_ns = 0;
+    std::array<std::uint64_t, kBounds> le{};
+};
+
+/**
+ * @struct CacheStats
+ * @brief Point-in-time snapshot returned by KVCache::GetStats.
+ *
+ * Counters are totals since the cache was created; gauges are current
+ * values. Loads and stores count blocks, not calls.
+ */
+struct CacheStats {
+    // Lookup
+    std::uint64_t lookups = 0;
+    std::uint64_t lookup_hits = 0;        // Matched at least one block
+    std::uint64_t lookup_tokens = 0;      // Tokens asked for
+    std::uint64_t matched_tokens = 0;
+    std::uint64_t matched_blocks = 0;
+
+    // Load
+    std::uint64_t loads = 0;
+    std::uint64_t load_failures = 0;
+    std::uint64_t loaded_bytes = 0;
+    std::uint64_t dram_hits = 0;
+    std::uint64_t ssd_hits = 0;
+    std::uint64_t s3_loads = 0;           // Went to the object store
+    std::uint64_t coalesced_loads = 0;    // Joined another load's GET
+    std::uint64_t peer_loads = 0;         // Fetched from another cluster node
+    std::uint64_t peer_load_failures = 0; // Peer fetches that fell back to the object store
+    std::uint64_t peer_served = 0;        // Blocks this node served to peers
+
+    // Store
+    std::uint64_t stores = 0;
+    std::uint64_t store_failures = 0;
+    std::uint64_t stores_resident = 0;    // Already resident; nothing uploaded
+    std::uint64_t stores_deduplicated = 0; // Payload already stored under another prefix
+    std::uint64_t stores_not_admitted = 0; // Declined by Config::admission; not failures
+    std::uint64_t stored_bytes = 0;
+
+    // Object store requests
+    std::uint64_t s3_gets = 0;
+    std::uint64_t s3_get_errors = 0;
+    std::uint64_t s3_get_bytes = 0;
+    std::uint64_t s3_puts = 0;
+    std::uint64_t s3_put_errors = 0;
+    std::uint64_t s3_put_bytes = 0;
+    std::uint64_t s3_deletes = 0;         // Keys, whether in single or batch requests
+    std::uint64_t s3_delete_errors = 0;
+    std::uint64_t s3_lists = 0;
+
+    // Eviction
+    std::uint64_t evictions = 0;
+    std::uint64_t evicted_bytes = 0;      // Stored bytes released
+    std::uint64_t gc_passes = 0;
+
+    // Cluster index events
+    std::uint64_t cluster_events_published = 0;
+    std::uint64_t cluster_events_applied = 0;
+    std::uint64_t cluster_events_lost = 0;  // Skipped after falling behind retention
+
+    // Index shard locks
+    std::uint64_t lock_contended = 0;
+    std::uint64_t lock_wait_ns = 0;
+
+    // Gauges
+    std::uint64_t used_bytes = 0;
+    std::uint64_t capacity_bytes = 0;
+    std::uint64_t index_blocks = 0;
+    std::uint64_t gc_backlog_bytes = 0;   // Used bytes above the GC low watermark
+    std::uint64_t gc_pending_deletes = 0; // DeleteObjects batches queued or running
+    std::uint64_t dram_bytes = 0;
+    std::uint64_t ssd_bytes = 0;
+    std::uint64_t s3_requests_in_flight = 0;
+    std::uint64_t s3_bytes_in_flight = 0; // Bytes of GETs and PUTs under way
+    std::uint64_t io_in_flight = 0;       // I/O pool tasks queued or running
+    std::uint64_t write_behind_bytes = 0;
+    std::uint64_t prefetch_bytes = 0;
+    std::uint64_t cluster_nodes = 0;      // Live nodes including this one; 0 outside cluster mode
+    bool cluster_leader = false;          // This node runs eviction for the cluster
+    BufferPoolStats buffers;
+    std::vector<TenantUsage> tenants;     // By TenantId
+
+    // Latencies. 'load' is per block or packed run; 's3_*' are single requests.
+    LatencyStats lookup;
+    LatencyStats load;
+    LatencyStats load_all;
+    LatencyStats store;
+    LatencyStats store_sequence;
+    LatencyStats s3_get;
+    LatencyStats s3_put;
+    LatencyStats s3_delete;
+    LatencyStats s3_list;
+
+    double HitRatio() const { return lookups ? static_cast<double>(lookup_hits) / lookups : 0.0; }
+    double TokenHitRatio() const {
+        return lookup_tokens ? static_cast<double>(matched_tokens) / lookup_tokens : 0.0;
+    }
+};
+
+/**
+ * @brief Renders 'stats' in the Prometheus text exposition format, every
+ * name prefixed with 'prefix' and an underscore. Latencies become
+ * histograms in seconds.
+ */
+std::string FormatPrometheus(const CacheStats& stats, const std::string& prefix = "kvcache");
+
+enum class Counter : std::uint32_t {
+    Lookups, LookupHits, LookupTokens, MatchedTokens, MatchedBlocks,
+    Loads, LoadFailures, LoadedBytes, DramHits, SsdHits, S3Loads, CoalescedLoads,
+    PeerLoads, PeerLoadFailures, PeerServed,
+    Stores, StoreFailures, StoresResident, StoresDeduplicated, StoresNotAdmitted, StoredBytes,
+    S3Gets, S3GetErrors, S3GetBytes, S3Puts, S3PutErrors, S3PutBytes, S3Deletes, S3DeleteErrors, S3Lists,
+    Evictions, EvictedBytes, GcPasses,
+    ClusterEventsPublished, ClusterEventsApplied, ClusterEventsLost,
+    kCount
+};
+
+enum class Op : std::uint32_t {
+    Lookup, Load, LoadAll, Store, StoreSequence, S3Get, S3Put, S3Delete, S3List,
+    kCount
+};
+
+/**
+ * @brief Span name of 'op', e.g. "lookup" or "s3.get".
+ */
+const char* OpName(Op op);
+
+/**
+ * @class Metrics
+ * @brief Counters and latency histograms striped across threads.
+ *
+ * Each thread updates one of kStripes cache-line-aligned stripes with
+ * relaxed atomics, so recording never contends with other threads unless
+ * there are more threads than stripes. Snapshot sums the stripes.
+ *
+ * With metrics disabled and no trace sink, recording is a branch.
+ */
+class Metrics {
+public:
+    static constexpr std::size_t kStripes = 16;
+    static constexpr std::size_t kBuckets = 160; // Up to 2^41 ns
+
+    Metrics(bool enabled, TraceSink trace_sink);
+    ~Metrics();
+
+    bool Enabled() const { return enabled_; }
+    bool Tracing() const { return static_cast<bool>(trace_sink_); }
+
+    void Add(Counter counter, std::uint64_t n = 1) const {
+        if (enabled_) {
+            stripe().counters[static_cast<std::size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+    void Record(Op op, std::uint64_t ns) const;
+    void Emit(const TraceSpan& span) const { trace_sink_(span); }
+
+    /**
+     * @brief Adjusts the in-flight object store gauges.
+     */
+    void AddInFlight(std::int64_t requests, std::int64_t bytes) const;
+
+    /**
+     * @brief Fills the counters, in-flight gauges and latencies of 'stats'.
+     */
+    void Snapshot(CacheStats* stats) const;
+
+    static std::size_t BucketIndex(std::uint64_t ns);
+    static std::uint64_t BucketLowerBound(std::size_t index);
+
+private:
+    static constexpr std::size_t kCounters = static_cast<std::size_t>(Counter::kCount);
+    static constexpr std::size_t kOps = static_cast<std::size_t>(Op::kCount);
+
+    struct alignas(64) Stripe {
+        std::atomic<std::uint64_t> counters[kCounters];
+        std::atomic<std::uint64_t> total_ns[kOps];
+        std::atomic<std::uint64_t> max_ns[kOps];
+        std::atomic<std::uint64_t> buckets[kOps][kBuckets];
+    };
+
+    Stripe& stripe() const;
+    void fill(Op op, LatencyStats* stats) const;
+
+    bool enabled_;
+    TraceSink trace_sink_;
+    std::unique_ptr<Stripe[]> stripes_;
+    mutable std::atomic<std::int64_t> requests_in_flight_{0};
+    mutable std::atomic<std::int64_t> bytes_in_flight_{0};
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+};
+
+/**
+ * @class ScopedOp
+ * @brief Times one operation into a Metrics histogram and, with a trace
+ * sink, reports it as a span when the scope ends.
+ *
+ * Ops opened on one thread nest: the innermost open op is the parent of
+ * the next. Work handed to another thread carries its parent over with
+ * SpanParentScope.
+ */
+class ScopedOp {
+public:
+    ScopedOp(const Metrics& metrics, Op op);
+    ~ScopedOp();
+
+    void SetBytes(std::uint64_t bytes) { bytes_ = bytes; }
+    void SetOk(bool ok) { ok_ = ok; }
+
+    /**
+     * @brief Returns the id of the innermost span open on this thread, or 0.
+     */
+    static std::uint64_t CurrentSpan();
+
+private:
+    const Metrics& metrics_;
+    Op op_;
+    bool timed_;
+    bool ok_ = true;
+    std::uint64_t bytes_ = 0;
+    std::uint64_t start_ns_ = 0;
+    std::uint64_t id_ = 0;
+    std::uint64_t parent_ = 0;
+
+    ScopedOp(const ScopedOp&) = delete;
+    ScopedOp& operator=(const ScopedOp&) = delete;
+};
+
+/**
+ * @class SpanParentScope
+ * @brief Makes 'parent' the enclosing span of ops opened on this thread
+ * while in scope.
+ */
+class SpanParentScope {
+public:
+    explicit SpanParentScope(std::uint64_t parent);
+    ~SpanParentScope();
+
+private:
+    std::uint64_t saved_;
+
+    SpanParentScope(const SpanParentScope&) = delete;
+    SpanParentScope& operator=(const SpanParentScope&) = delete;
+};
+
+/**
+ * @class MeteredObjectStore
+ * @brief Wraps another ObjectStore and records each request's latency,
+ * bytes and outcome, with a span per request when tracing.
+ */
+class MeteredObjectStore : public ObjectStore {
+public:
+    MeteredObjectStore(std::shared_ptr<ObjectStore> inner, const Metrics& metrics);
+
+    bool GetObject(const std::string& key, std::vector<std::uint8_t>* data) override;
+    bool GetObject(const std::string& key, mutable_bytes_view dest, std::uint64_t* bytes_read) override;
+    bool GetObjectRange(const std::string& key, std::uint64_t offset, mutable_bytes_view dest,
+                        std::uint64_t* bytes_read) override;
+    bool GetObjectStreaming(const std::string& key, bool ranged, std::uint64_t offset, mutable_bytes_view dest,
+                            const std::function<bool(std::uint64_t received)>& on_progress,
+                            std::uint64_t* bytes_read) override;
+    bool PutObject(const std::string& key, bytes_view data) override;
+    bool DeleteObject(const std::string& key) override;
+    std::size_t DeleteObjects(const std::vector<std::string>& keys) override;
+    bool ListObjects(const std::string& prefix,
+                     const std::function<bool(const std::string& key, std::uint64_t size)>& visit) override;
+
+private:
+    bool get(std::uint64_t expected_bytes, const std::function<bool(std::uint64_t*)>& request);
+
+    std::shared_ptr<ObjectStore> inner_;
+    const Metrics& metrics_;
+};
+
+} // namespace kvcache
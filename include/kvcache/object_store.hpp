@@ -0,0 +1,164 @@
+#pragma once
+
+#include "span_compat.hpp"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace kvcache {
+
+/**
+ * @class ObjectStore
+ * @brief The object operations KVCache issues against its backing store.
+ *
+ * S3Client is the production backend. MemoryObjectStore and
+ * LatencyObjectStore stand in for it when benchmarking or profiling the
+ * cache without a network. Implementations must be thread-safe.
+ */
+class ObjectStore {
+public:
+    virtual ~ObjectStore() = default;
+
+    virtual bool GetObject(const std::string& key, std::vector<std::uint8_t>* data) = 0;
+
+    /**
+     * @brief Reads the whole object into 'dest'.
+     * Fails if the object is larger than 'dest'; on success '*bytes_read'
+     * (if given) is the object size.
+     */
+    virtual bool GetObject(const std::string& key, mutable_bytes_view dest, std::uint64_t* bytes_read) = 0;
+
+    /**
+     * @brief Reads bytes [offset, offset + dest.size()) into 'dest'.
+     * '*bytes_read' is shorter than dest.size() only at the end of the object.
+     */
+    virtual bool GetObjectRange(const std::string& key, std::uint64_t offset, mutable_bytes_view dest,
+                                std::uint64_t* bytes_read) = 0;
+
+    /**
+     * @brief Like GetObjectRange (or GetObject when 'ranged' is false), but
+     * calls 'on_progress' with the number of bytes in 'dest' so far each
+     * time more of the body arrives. Returning false aborts the transfer.
+     * Progress never goes backwards: a transfer that would have to restart
+     * after some of the body was reported fails instead.
+     */
+    virtual bool GetObjectStreaming(const std::string& key, bool ranged, std::uint64_t offset, mutable_bytes_view dest,
+                                    const std::function<bool(std::uint64_t received)>& on_progress,
+                                    std::uint64_t* bytes_read) = 0;
+
+    /**
+     * @brief Stores 'data' under 'key', replacing any existing object.
+     * 'data' only has to stay valid until the call returns.
+     */
+    virtual bool PutObject(const std::string& key, bytes_view data) = 0;
+
+    /**
+     * @brief Deletes one object. Deleting a missing key succeeds.
+     */
+    virtual bool DeleteObject(const std::string& key) = 0;
+
+    /**
+     * @brief Deletes up to 1000 keys in one request.
+     * @return The number of keys that could not be deleted.
+     */
+    virtual std::size_t DeleteObjects(const std::vector<std::string>& keys) = 0;
+
+    /**
+     * @brief Calls 'visit' for every object whose key starts with 'prefix',
+     * in key order.
+     * @return False if the listing fails or 'visit' returns false.
+     */
+    virtual bool ListObjects(const std::string& prefix,
+                             const std::function<bool(const std::string& key, std::uint64_t size)>& visit) = 0;
+};
+
+/**
+ * @class MemoryObjectStore
+ * @brief An ObjectStore kept in process memory.
+ *
+ * Objects are immutable once stored, so reads copy out of them without
+ * holding the lock. Streaming reads report progress every
+ * kStreamChunkBytes, like a socket delivering the body in pieces.
+ */
+class MemoryObjectStore : public ObjectStore {
+public:
+    static constexpr std::size_t kStreamChunkBytes = 64 * 1024;
+
+    bool GetObject(const std::string& key, std::vector<std::uint8_t>* data) override;
+    bool GetObject(const std::string& key, mutable_bytes_view dest, std::uint64_t* bytes_read) override;
+    bool GetObjectRange(const std::string& key, std::uint64_t offset, mutable_bytes_view dest,
+                        std::uint64_t* bytes_read) override;
+    bool GetObjectStreaming(const std::string& key, bool ranged, std::uint64_t offset, mutable_bytes_view dest,
+                            const std::function<bool(std::uint64_t received)>& on_progress,
+                            std::uint64_t* bytes_read) override;
+    bool PutObject(const std::string& key, bytes_view data) override;
+    bool DeleteObject(const std::string& key) override;
+    std::size_t DeleteObjects(const std::vector<std::string>& keys) override;
+    bool ListObjects(const std::string& prefix,
+                     const std::function<bool(const std::string& key, std::uint64_t size)>& visit) override;
+
+    std::size_t ObjectCount() const;
+    std::uint64_t StoredBytes() const;
+
+private:
+    using Object = std::shared_ptr<const std::vector<std::uint8_t>>;
+
+    Object find(const std::string& key) const;
+
+    mutable std::shared_mutex mutex_;
+    std::map<std::string, Object> objects_; // Ordered for ListObjects
+    std::uint64_t stored_bytes_ = 0;
+};
+
+/**
+ * @brief Service times injected by LatencyObjectStore.
+ *
+ * A transfer of n bytes takes latency + n / bandwidth. Bandwidth is per
+ * request, like the throughput of one S3 connection, so concurrent
+ * requests do not slow each other down.
+ */
+struct LatencyProfile {
+    std::uint32_t get_latency_us = 0;          // Time to first byte of a GET
+    std::uint32_t put_latency_us = 0;          // PUT without the transfer time
+    std::uint32_t meta_latency_us = 0;         // DELETE and each LIST call
+    std::uint64_t bandwidth_bytes_per_sec = 0; // 0 is unlimited
+    double jitter = 0.0;                       // Latencies scaled by a uniform factor in [1 - jitter, 1 + jitter]
+};
+
+/**
+ * @class LatencyObjectStore
+ * @brief Wraps another ObjectStore and delays each request by a LatencyProfile.
+ *
+ * Delays are spent sleeping, so the calling thread is blocked but not
+ * busy, as it would be waiting on the network. Streaming reads pace their
+ * progress callbacks to the bandwidth.
+ */
+class LatencyObjectStore : public ObjectStore {
+public:
+    LatencyObjectStore(std::shared_ptr<ObjectStore> inner, const LatencyProfile& profile);
+
+    bool GetObject(const std::string& key, std::vector<std::uint8_t>* data) override;
+    bool GetObject(const std::string& key, mutable_bytes_view dest, std::uint64_t* bytes_read) override;
+    bool GetObjectRange(const std::string& key, std::uint64_t offset, mutable_bytes_view dest,
+                        std::uint64_t* bytes_read) override;
+    bool GetObjectStreaming(const std::string& key, bool ranged, std::uint64_t offset, mutable_bytes_view dest,
+                            const std::function<bool(std::uint64_t received)>& on_progress,
+                            std::uint64_t* bytes_read) override;
+    bool PutObject(const std::string& key, bytes_view data) override;
+    bool DeleteObject(const std::string& key) override;
+    std::size_t DeleteObjects(const std::vector<std::string>& keys) override;
+    bool ListObjects(const std::string& prefix,
+                     const std::function<bool(const std::string& key, std::uint64_t size)>& visit) override;
+
+private:
+    void delay(std::uint32_t latency_us, std::uint64_t bytes) const;
+
+    std::shared_ptr<ObjectStore> inner_;
+    LatencyProfile profile_;
+};
+
+} // namespace kvcache
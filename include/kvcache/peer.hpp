@@ -0,0 +1,160 @@
+#pragma once
+
+#include "types.hpp"
+#include "span_compat.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace kvcache {
+
+// Serves one peer fetch: fills 'dest', whose size is the block's logical
+// size, and returns true, or returns false if the block is not available.
+using PeerHandler = std::function<bool(const PrefixKey& key, mutable_bytes_view dest)>;
+
+// Decides whether a fetch of 'size' bytes of block 'key' is worth serving,
+// before anything is allocated for it; normally whether the block is
+// indexed with that size.
+using PeerCheck = std::function<bool(const PrefixKey& key, std::uint64_t size)>;
+
+/**
+ * @class PeerTransport
+ * @brief Fetches blocks from other cluster nodes.
+ *
+ * Addresses are the Config::cluster_advertise_address each node publishes
+ * in its heartbeat. Implementations must be thread-safe and should fail
+ * fast: a failed fetch falls back to the object store.
+ */
+class PeerTransport {
+public:
+    virtual ~PeerTransport() = default;
+
+    /**
+     * @brief Reads block 'key' from the node at 'address' into 'dest',
+     * which is exactly the block's logical size.
+     */
+    virtual bool Fetch(const std::string& address, const PrefixKey& key, mutable_bytes_view dest) = 0;
+};
+
+/**
+ * @class LocalPeerTransport
+ * @brief Connects nodes that share one process, for benchmarks and tests.
+ *
+ * Each node registers a handler (normally KVCache::ServePeer) under its
+ * address; Fetch calls it directly on the caller's thread.
+ */
+class LocalPeerTransport : public PeerTransport {
+public:
+    void Register(const std::string& address, PeerHandler handler);
+    void Unregister(const std::string& address);
+
+    bool Fetch(const std::string& address, const PrefixKey& key, mutable_bytes_view dest) override;
+
+private:
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const PeerHandler>> handlers_;
+};
+
+/**
+ * @class TcpPeerTransport
+ * @brief Fetches blocks from TcpPeerServer instances over TCP.
+ *
+ * Keeps up to 'connections_per_peer' idle connections to each address for
+ * reuse, each for at most 'max_idle_ms', which stays under the server's
+ * idle timeout. Every peer holds a server thread per connection kept here,
+ * so the pool is kept small. A fetch that fails on a reused connection,
+ * which the server may have closed, is retried once on a fresh one.
+ * Connecting, sending and each receive are bounded by 'timeout_ms'.
+ */
+class TcpPeerTransport : public PeerTransport {
+public:
+    explicit TcpPeerTransport(std::uint32_t timeout_ms, std::size_t connections_per_peer = 2,
+                              std::uint32_t max_idle_ms = 5000);
+    ~TcpPeerTransport();
+
+    bool Fetch(const std::string& address, const PrefixKey& key, mutable_bytes_view dest) override;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct IdleConnection {
+        int fd;
+        Clock::time_point since;
+    };
+
+    int take_connection(const std::string& address, bool* reused);
+    void return_connection(const std::string& address, int fd);
+
+    std::uint32_t timeout_ms_;
+    std::size_t connections_per_peer_;
+    std::chrono::milliseconds max_idle_;
+    std::mutex mutex_; // Guards idle_
+    std::unordered_map<std::string, std::vector<IdleConnection>> idle_;
+
+    TcpPeerTransport(const TcpPeerTransport&) = delete;
+    TcpPeerTransport& operator=(const TcpPeerTransport&) = delete;
+};
+
+/**
+ * @class TcpPeerServer
+ * @brief Answers TcpPeerTransport fetches with a PeerHandler.
+ *
+ * One thread accepts connections and each connection is served by its own
+ * thread, up to 'max_connections'; further ones are closed. Requests on a
+ * connection are answered in order. A connection that sends nothing for
+ * 'idle_timeout_ms' is closed, so clients' idle pools do not hold threads
+ * indefinitely.
+ *
+ * The server listens on all interfaces and does not authenticate peers:
+ * anyone who can reach the port can read cached blocks by key. Keep it on
+ * a private network. A request 'check' rejects is answered as a miss
+ * without allocating its buffer, so requests cannot make the server hold
+ * more than its largest servable block per connection.
+ */
+class TcpPeerServer {
+public:
+    /**
+     * @param port Port to listen on, on all interfaces; 0 picks a free one.
+     */
+    TcpPeerServer(std::uint16_t port, PeerHandler handler, PeerCheck check, std::size_t max_connections = 64,
+                  std::uint32_t idle_timeout_ms = 10000);
+    ~TcpPeerServer();
+
+    bool Listening() const { return listen_fd_ >= 0; }
+    std::uint16_t Port() const { return port_; }
+
+private:
+    struct Connection {
+        int fd;
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+
+    void accept_loop();
+    void serve(Connection* connection);
+    void reap_locked();
+
+    PeerHandler handler_;
+    PeerCheck check_;
+    std::size_t max_connections_;
+    std::uint32_t idle_timeout_ms_;
+    int listen_fd_ = -1;
+    std::uint16_t port_ = 0;
+    std::atomic<bool> stop_{false};
+    std::thread accept_thread_;
+    std::mutex mutex_; // Guards connections_
+    std::vector<std::unique_ptr<Connection>> connections_;
+
+    TcpPeerServer(const TcpPeerServer&) = delete;
+    TcpPeerServer& operator=(const TcpPeerServer&) = delete;
+};
+
+} // namespace kvcache
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "types.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace kvcache {
+
+/**
+ * @class Prefetcher
+ * @brief Background block fetches ordered by block index, under a byte budget.
+ *
+ * Queued blocks run lowest block index first across every prefetch, then in
+ * submission order, so block 0 of each request is fetched before block 1 of
+ * any. The budget bounds the bytes queued or in flight; a prefetch admits
+ * its blocks in order until the next one would not fit.
+ *
+ * Thread-safe.
+ */
+class Prefetcher {
+public:
+    using Fetch = std::function<void(const BlockRef&)>;
+
+    /**
+     * @param fetch Called on a worker thread for each block to bring in.
+     */
+    Prefetcher(std::uint32_t num_threads, std::uint64_t budget_bytes, Fetch fetch);
+
+    /**
+     * @brief Drops queued blocks and joins the workers once running fetches return.
+     */
+    ~Prefetcher();
+
+    /**
+     * @brief Queues 'blocks' (in block order) as one prefetch.
+     * @return A ticket for Cancel, or 0 if no block fit in the budget.
+     */
+    std::uint64_t Submit(const std::vector<BlockRef>& blocks);
+
+    /**
+     * @brief Drops the ticket's queued blocks, returning their budget at once.
+     * Fetches already running finish.
+     */
+    void Cancel(std::uint64_t ticket);
+
+    /**
+     * @brief Returns the bytes queued or in flight.
+     */
+    std::uint64_t PendingBytes() const;
+
+private:
+    struct Request {
+        std::uint64_t queued_bytes = 0; // Guarded by mutex_
+        std::size_t remaining = 0;      // Blocks not yet popped; guarded by mutex_
+        bool cancelled = false;         // Guarded by mutex_
+    };
+
+    struct Item {
+        std::uint32_t index;
+        std::uint64_t seq;
+        BlockRef ref;
+        std::uint64_t ticket;
+    };
+
+    struct Later {
+        bool operator()(const Item& a, const Item& b) const {
+            return a.index != b.index ? a.index > b.index : a.seq > b.seq;
+        }
+    };
+
+    void WorkerLoop();
+
+    Fetch fetch_;
+    std::uint64_t budget_bytes_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::priority_queue<Item, std::vector<Item>, Later> queue_;
+    std::unordered_map<std::uint64_t, Request> requests_;
+    std::uint64_t pending_bytes_ = 0;
+    std::uint64_t next_ticket_ = 1;
+    std::uint64_t next_seq_ = 0;
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+};
+
+} // namespace kvcache
@@ -2,10 +2,12 @@
 
 #include "types.hpp"
 #include "span_compat.hpp"
+#include "object_store.hpp"
 #include <memory>
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <functional>
 
 namespace Aws {
     namespace S3 {
@@ -15,14 +17,40 @@ namespace Aws {
 
 namespace kvcache {
 
-class S3Client {
+// Transfers of at least Config::multipart_threshold_bytes are split into
+// parts run concurrently on a small internal pool: multipart upload for
+// PutObject, ranged GETs landing in place for the zero-copy reads.
+class S3Client : public ObjectStore {
 public:
     explicit S3Client(const Config& cfg);
-    ~S3Client();
+    ~S3Client() override;
 
-    bool GetObject(const std::string& key, std::vector<std::uint8_t>* data);
-    bool PutObject(const std::string& key, bytes_view data);
-    bool DeleteObject(const std::string& key);
+    bool GetObject(const std::string& key, std::vector<std::uint8_t>* data) override;
+
+    // Streams the object body directly into 'dest' with no intermediate
+    // copy.
+    bool GetObject(const std::string& key, mutable_bytes_view dest, std::uint64_t* bytes_read) override;
+
+    // Ranged GET straight into 'dest'.
+    bool GetObjectRange(const std::string& key, std::uint64_t offset, mutable_bytes_view dest,
+                        std::uint64_t* bytes_read) override;
+
+    // 'on_progress' runs every time the SDK hands over more of the body.
+    bool GetObjectStreaming(const std::string& key, bool ranged, std::uint64_t offset, mutable_bytes_view dest,
+                            const std::function<bool(std::uint64_t received)>& on_progress,
+                            std::uint64_t* bytes_read) override;
+
+    // Uploads 'data' in place, without copying it into an SDK stream. Large
+    // objects go up as a multipart upload, aborted if any part fails.
+    bool PutObject(const std::string& key, bytes_view data) override;
+    bool DeleteObject(const std::string& key) override;
+
+    // One multi-object DeleteObjects request.
+    std::size_t DeleteObjects(const std::vector<std::string>& keys) override;
+
+    // ListObjectsV2, following continuation tokens.
+    bool ListObjects(const std::string& prefix,
+                     const std::function<bool(const std::string& key, std::uint64_t size)>& visit) override;
 
 private:
     struct S3ClientImpl;
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "types.hpp"
+#include "span_compat.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace kvcache {
+
+// A segment object packs several blocks: a SegmentHeader, 'count'
+// SegmentEntry records (the offset table), then the blocks' objects back to
+// back. Each object is what a standalone block would hold, encoded or not.
+// Offsets are from the start of the segment, so one block is one ranged GET.
+struct SegmentHeader {
+    char magic[4];          // "KVSG"
+    std::uint8_t version;
+    std::uint8_t reserved0[3];
+    std::uint32_t count;    // Entries in the offset table
+    std::uint32_t reserved1;
+};
+static_assert(sizeof(SegmentHeader) == 16, "SegmentHeader is an on-disk format");
+
+struct SegmentEntry {
+    PrefixKey key;
+    PrefixKey parent;       // All zeros when has_parent is 0
+    std::uint64_t size;     // Logical (decoded) size
+    std::uint64_t offset;   // Start of the block's object
+    std::uint64_t length;   // Size of the block's object
+    std::uint32_t index;
+    std::uint8_t codec;     // Codec
+    std::uint8_t has_parent;
+    std::uint16_t tenant;   // TenantId of the block when it was packed
+};
+static_assert(sizeof(SegmentEntry) == 64, "SegmentEntry is an on-disk format");
+
+/**
+ * @brief Returns the size of the header plus an offset table of 'count' entries.
+ */
+std::size_t SegmentTableBytes(std::uint32_t count);
+
+/**
+ * @brief Lays out a segment from one object per entry. Fills in each
+ * entry's offset and length; the other fields are taken as given.
+ */
+void BuildSegment(std::vector<SegmentEntry>* entries, const std::vector<bytes_view>& objects,
+                  std::vector<std::uint8_t>* segment);
+
+/**
+ * @brief Validates the header at the start of a segment.
+ */
+bool ReadSegmentHeader(bytes_view data, SegmentHeader* header);
+
+/**
+ * @brief Parses the offset table from the first SegmentTableBytes(count)
+ * bytes of a segment.
+ */
+bool ReadSegmentTable(bytes_view data, std::vector<SegmentEntry>* entries);
+
+} // namespace kvcache
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace kvcache {
+
+/**
+ * @class SingleFlight
+ * @brief Collapses concurrent calls for the same key into one execution.
+ *
+ * The first caller for a key becomes the leader and runs the work. Callers
+ * that arrive while it is in flight block until it finishes and receive a
+ * copy of its result, so Value should be cheap to copy (a bool or a
+ * shared_ptr). Callers arriving after the flight has closed start a new one.
+ * If the work throws, joiners receive Value{} and the leader the exception.
+ *
+ * Thread-safe.
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class SingleFlight {
+public:
+    /**
+     * @brief Runs 'work' for 'key', or joins the call already in flight.
+     * @param work Invoked by the leader only, as work(close). 'close' stops
+     * new callers from joining and returns how many are waiting, so the
+     * leader can skip building a shareable result nobody will read. If work
+     * never calls it, the flight closes when work returns.
+     * @param shared Set to true if the result came from another caller.
+     */
+    template <typename Work>
+    Value Do(const Key& key, Work&& work, bool* shared = nullptr) {
+        std::shared_ptr<Call> call;
+        bool leader = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& slot = calls_[key];
+            if (!slot) {
+                slot = std::make_shared<Call>();
+                leader = true;
+            } else {
+                ++slot->waiters;
+            }
+            call = slot;
+        }
+
+        if (shared) {
+            *shared = !leader;
+        }
+        if (!leader) {
+            std::unique_lock<std::mutex> lock(call->mutex);
+            call->cv.wait(lock, [&] { return call->done; });
+            return call->value;
+        }
+
+        bool closed = false;
+        std::size_t waiters = 0;
+        auto close = [&]() -> std::size_t {
+            if (!closed) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                calls_.erase(key);
+                waiters = call->waiters;
+                closed = true;
+            }
+            return waiters;
+        };
+
+        // Joiners are released even if work throws
+        auto finish = [&](const Value& value) {
+            if (close() > 0) {
+                {
+                    std::lock_guard<std::mutex> lock(call->mutex);
+                    call->value = value;
+                    call->done = true;
+                }
+                call->cv.notify_all();
+            }
+        };
+        Value value{};
+        try {
+            value = work(close);
+        } catch (...) {
+            finish(Value{});
+            throw;
+        }
+        finish(value);
+        return value;
+    }
+
+private:
+    struct Call {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool done = false;
+        Value value{};
+        std::size_t waiters = 0; // Guarded by SingleFlight::mutex_
+    };
+
+    std::mutex mutex_;
+    std::unordered_map<Key, std::shared_ptr<Call>, Hash> calls_;
+};
+
+} // namespace kvcache
@@ -4,6 +4,11 @@
 #include <cstdint>
 #include <vector>
 
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#define KVCACHE_HAS_STD_SPAN 1
+#endif
+
 namespace kvcache {
 
 // A simplified, C++17-compatible view over a contiguous sequence of bytes,
@@ -19,6 +24,10 @@ public:
     // Constructor from a vector of bytes
     bytes_view(const std::vector<std::uint8_t>& vec) : data_(vec.data()), size_(vec.size()) {}
 
+#ifdef KVCACHE_HAS_STD_SPAN
+    bytes_view(std::span<const std::uint8_t> s) : data_(s.data()), size_(s.size()) {}
+#endif
+
     const std::uint8_t* data() const { return data_; }
     std::size_t size() const { return size_; }
     bool empty() const { return size_ == 0; }
@@ -31,4 +40,61 @@ private:
     std::size_t size_;
 };
 
+// Writable counterpart of bytes_view, used for caller-provided destination
+// buffers.
+class mutable_bytes_view {
+public:
+    mutable_bytes_view() : data_(nullptr), size_(0) {}
+    mutable_bytes_view(std::uint8_t* data, std::size_t size) : data_(data), size_(size) {}
+    mutable_bytes_view(std::vector<std::uint8_t>& vec) : data_(vec.data()), size_(vec.size()) {}
+
+#ifdef KVCACHE_HAS_STD_SPAN
+    mutable_bytes_view(std::span<std::uint8_t> s) : data_(s.data()), size_(s.size()) {}
+#endif
+
+    std::uint8_t* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    std::uint8_t* begin() const { return data_; }
+    std::uint8_t* end() const { return data_ + size_; }
+
+    // Sub-view of 'count' bytes starting at 'offset'; the caller checks bounds.
+    mutable_bytes_view subview(std::size_t offset, std::size_t count) const {
+        return mutable_bytes_view(data_ + offset, count);
+    }
+
+    operator bytes_view() const { return bytes_view(data_, size_); }
+
+private:
+    std::uint8_t* data_;
+    std::size_t size_;
+};
+
+// Read-only view over token ids, similar to std::span<const std::uint32_t>.
+class tokens_view {
+public:
+    tokens_view() : data_(nullptr), size_(0) {}
+    tokens_view(const std::uint32_t* data, std::size_t size) : data_(data), size_(size) {}
+    tokens_view(const std::vector<std::uint32_t>& vec) : data_(vec.data()), size_(vec.size()) {}
+
+#ifdef KVCACHE_HAS_STD_SPAN
+    tokens_view(std::span<const std::uint32_t> s) : data_(s.data()), size_(s.size()) {}
+#endif
+
+    const std::uint32_t* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const std::uint32_t* begin() const { return data_; }
+    const std::uint32_t* end() const { return data_ + size_; }
+
+    // The first 'count' tokens; the caller checks bounds.
+    tokens_view first(std::size_t count) const { return tokens_view(data_, count); }
+
+private:
+    const std::uint32_t* data_;
+    std::size_t size_;
+};
+
 } // namespace kvcache
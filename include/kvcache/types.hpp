@@ -2,14 +2,38 @@
 
 #include <string>
 #include <vector>
+#include <array>
 #include <cstdint>
+#include <functional>
 
 namespace kvcache {
 
+// 128-bit XXH3 digest identifying a token prefix (see hash.hpp).
+using PrefixKey = std::array<std::uint8_t, 16>;
+
+// Index into Config::tenants naming whose capacity a stored block uses.
+using TenantId = std::uint16_t;
+
+// Payload codec applied between the caller's bytes and the S3 object.
+enum class Codec : std::uint8_t {
+    None = 0, // Raw object, no header
+    LZ4 = 1,  // Lossless; needs a KVCACHE_WITH_LZ4 build
+    Zstd = 2, // Lossless; needs a KVCACHE_WITH_ZSTD build
+    Int8 = 3, // Lossy: FP16 -> INT8 with one scale per channel
+    FP8 = 4,  // Lossy: FP16 -> FP8 E4M3 with one scale per channel
+};
+
 struct BlockRef {
-    std::string s3_key;
-    std::uint64_t size;
+    PrefixKey key; // Prefix key of the tokens ending at this block
+    std::uint64_t size;            // Logical (decoded) size; what Load writes
     std::uint32_t index;
+    std::uint64_t stored_size = 0; // Object size in S3 after the codec
+    Codec codec = Codec::None;
+    // Where the object sits when it was packed (Config::pack_blocks): bytes
+    // [offset, offset + stored_size) of the segment object
+    bool packed = false;
+    PrefixKey segment{};
+    std::uint64_t offset = 0;
 };
 
 struct LookupResult {
@@ -17,10 +41,174 @@ struct LookupResult {
     std::vector<BlockRef> handles;
 };
 
+// Outcome of KVCache::LoadAll: the longest run of blocks, starting at
+// block 0, whose bytes were written to the destination.
+struct LoadAllResult {
+    std::uint32_t loaded_blocks = 0;
+    std::uint32_t loaded_tokens = 0;
+    std::uint64_t loaded_bytes = 0;
+};
+
+// How a block divides into slices for KVCache::LoadStreaming, e.g. one
+// slice per layer so attention on layer 0 can start while the rest of the
+// block is still arriving.
+struct BlockLayout {
+    std::vector<std::uint64_t> slice_bytes; // Slice sizes in order; must sum to the block size
+    std::uint64_t chunk_bytes = 1ull << 20; // Fixed slice size when slice_bytes is empty
+};
+
+// One timed operation, reported to Config::trace_sink when it ends. Spans
+// nest through parent_id: a Load issued by LoadAll, or a GET issued by a
+// Load, names the enclosing span.
+struct TraceSpan {
+    const char* name;          // "lookup", "load", "store", "s3.get", ...
+    std::uint64_t id;          // Unique within the process; never 0
+    std::uint64_t parent_id;   // 0 for a top-level operation
+    std::uint64_t start_ns;    // steady_clock time since its epoch
+    std::uint64_t duration_ns;
+    std::uint64_t bytes;       // Payload bytes moved, where meaningful
+    bool ok;
+};
+
+// Called on the thread that ran the operation; must be thread-safe.
+using TraceSink = std::function<void(const TraceSpan& span)>;
+
+enum class WritePolicy {
+    WriteThrough, // Store returns once the block is in S3
+    WriteBack,    // Store returns once the block is in DRAM; the PUT runs on the I/O pool
+};
+
+enum class EvictionPolicyKind {
+    LRU,    // Least recently used
+    S3Fifo, // Scan-resistant: one-shot prefixes cannot flush shared ones
+};
+
+enum class AdmissionPolicy {
+    All,        // Upload every block stored
+    Doorkeeper, // Upload a new block only the second time it is stored
+};
+
+// One tenant sharing the cache, e.g. a model or a customer.
+struct TenantConfig {
+    std::string name;                 // Label in metrics
+    std::uint64_t capacity_bytes = 0; // Quota; 0 leaves only Config::capacity_bytes
+};
+
 struct Config {
     std::string model_id = "demo-model";
     std::uint32_t block_size_tokens = 256;
     std::uint64_t capacity_bytes = 10ull * 1024 * 1024 * 1024; // 10 GiB
+    std::uint32_t index_shards = 16; // Rounded up to a power of two
+    EvictionPolicyKind eviction_policy = EvictionPolicyKind::LRU; // Applied per shard and tenant
+
+    // Tenants sharing capacity_bytes; TenantId i is tenants[i], and no
+    // tenants means one tenant 0 without a quota. GC evicts a tenant past
+    // gc_high_watermark * its quota down to gc_low_watermark * its quota
+    // from its own blocks only, so it cannot push out another's prefixes.
+    // Tenants partition capacity, not keys: blocks stay shared by prefix.
+    std::vector<TenantConfig> tenants;
+
+    // With Doorkeeper, a block that is not resident is uploaded only if it
+    // was stored before within the last admission_window_blocks new
+    // blocks, so prompts seen once cost no PUT. Later blocks of a
+    // declined sequence are declined with it but still remembered.
+    AdmissionPolicy admission = AdmissionPolicy::All;
+    std::uint64_t admission_window_blocks = 1ull << 20;
+
+    // Name S3 objects by an XXH3-128 of their payload rather than by prefix,
+    // so identical blocks reached through different prefixes are uploaded
+    // and counted against capacity once. The index reference-counts them.
+    bool dedup_blocks = false;
+
+    // GC starts once usage exceeds high * capacity and then evicts down to
+    // low * capacity in one pass. Deletes go out in DeleteObjects batches.
+    double gc_high_watermark = 1.0;
+    double gc_low_watermark = 0.9;
+    std::uint32_t gc_delete_batch = 1000;      // S3 allows at most 1000 keys
+    std::uint32_t gc_delete_threads = 2;
+
+    // Pack the blocks of each StoreSequence call into segment objects of up
+    // to this many blocks, each with an offset table, and read them back
+    // with ranged GETs. 0 or 1 stores one object per block. Ignored with
+    // dedup_blocks. GC rewrites a segment whose live bytes fall to
+    // segment_compact_ratio of what it was written with.
+    std::uint32_t pack_blocks = 0;
+    double segment_compact_ratio = 0.5;
+
+    // Codec for new objects. Every object records its own codec, so a
+    // bucket written with mixed settings stays readable. Blocks the codec
+    // cannot shrink, or whose layout does not fit it, are stored raw.
+    Codec codec = Codec::None;
+    int codec_level = 0;            // LZ4-HC level (0 = fast LZ4) or zstd level (0 = default)
+    std::uint32_t kv_channels = 0;  // FP16 values per token row, for Int8 and FP8
+
+    // Async I/O
+    std::uint32_t io_threads = 8;
+    std::uint32_t max_inflight_requests = 64; // Queued plus running
+    std::uint32_t load_parallelism = 16;      // Default LoadAll fan-out
+
+    // KVCache::Prefetch workers, and the bytes they may have queued or in
+    // flight; 0 uses half of the DRAM tier (or the disk tier without one)
+    std::uint32_t prefetch_threads = 4;
+    std::uint64_t prefetch_budget_bytes = 0;
+
+    // Local tiers in front of S3, which is always the cold tier
+    std::uint64_t dram_cache_bytes = 0;       // 0 disables the DRAM tier
+    std::string ssd_cache_dir;                // Empty disables the SSD tier
+    std::uint64_t ssd_cache_bytes = 0;
+    WritePolicy write_policy = WritePolicy::WriteThrough; // WriteBack needs the DRAM tier
+
+    // KVCache::StoreSequenceAsync upload threads, and the bytes of block
+    // copies they may hold before StoreSequenceAsync blocks the caller
+    std::uint32_t write_behind_threads = 8;
+    std::uint64_t write_behind_bytes = 256ull << 20;
+
+    // Slabs the block buffer pool may map for reuse before allocations fall
+    // back to the heap; 0 uses dram_cache_bytes plus write_behind_bytes.
+    // Hugepage slabs need pages reserved in vm.nr_hugepages, else they fall
+    // back to transparent hugepages.
+    std::uint64_t buffer_pool_bytes = 0;
+    bool buffer_pool_hugepages = false;
+
+    // Striped counters and latency histograms behind KVCache::GetStats.
+    // Disabling them skips every clock read on the hot paths.
+    bool enable_metrics = true;
+    // Receives a span for every Lookup, block load and store, LoadAll,
+    // StoreSequence and object store request. Null disables tracing.
+    TraceSink trace_sink;
+
+    // Index persistence for warm restarts; an empty path disables it. The
+    // journal is kept next to the snapshot as '<path>.journal'.
+    std::string index_snapshot_path;
+    std::uint32_t snapshot_interval_seconds = 300;
+
+    // When no snapshot was restored, rebuild the index in the background by
+    // listing the bucket, split into this many concurrent LIST streams by
+    // hex prefix (rounded to 16 or 256). Lookups see blocks as they arrive.
+    bool rebuild_index_from_s3 = false;
+    std::uint32_t rebuild_list_parallelism = 16;
+
+    // Cluster mode: nodes sharing a bucket mirror each other's index events
+    // through objects under '<model>/b<block_size>/n/'. An empty node id
+    // disables it; ids must be unique and must not contain '/'.
+    std::string cluster_node_id;
+    // "host:port" peers fetch blocks from; empty keeps this node off the
+    // peer ring. A listen port of 0 starts no peer server. The server
+    // listens on all interfaces without authentication, so the port must
+    // only be reachable from the cluster's private network.
+    std::string cluster_advertise_address;
+    std::uint16_t cluster_listen_port = 0;
+    std::uint32_t cluster_sync_interval_ms = 200;
+    std::uint32_t cluster_heartbeat_interval_ms = 1000;
+    // A node whose heartbeat stops advancing for this long is dead
+    std::uint32_t cluster_node_timeout_ms = 10000;
+    // Event objects each node keeps; a node further behind loses events
+    std::uint32_t cluster_event_retention = 4096;
+    // Publish hits so the leader evicts by cluster-wide recency
+    bool cluster_share_recency = true;
+    // Ask the block's ring owner before the object store
+    bool cluster_peer_fetch = true;
+    std::uint32_t cluster_peer_timeout_ms = 200;
 
     // S3 Configuration
     std::string s3_endpoint;
@@ -29,6 +217,31 @@ struct Config {
     std::string aws_access_key_id;
     std::string aws_secret_access_key;
     bool s3_use_path_style = true;
+
+    // S3 client tuning. The SDK's own defaults (25 connections, no retry
+    // jitter) serialize a busy node behind a few sockets.
+    std::uint32_t s3_max_connections = 256;
+    bool s3_tcp_keep_alive = true;
+    std::uint32_t s3_keep_alive_interval_ms = 30000;
+    std::uint32_t s3_connect_timeout_ms = 1000;
+    std::uint32_t s3_request_timeout_ms = 3000;
+    // Retries back off exponentially from s3_retry_base_ms, capped at
+    // s3_retry_max_backoff_ms, with full jitter. 0 retries disables them.
+    std::uint32_t s3_max_retries = 3;
+    std::uint32_t s3_retry_base_ms = 25;
+    std::uint32_t s3_retry_max_backoff_ms = 2000;
+    // Threads of a dedicated SDK executor for async callbacks; 0 keeps the
+    // SDK's default executor
+    std::uint32_t s3_executor_threads = 0;
+
+    // Objects of at least multipart_threshold_bytes are uploaded with S3
+    // multipart upload, and reads of at least that many bytes are split into
+    // parallel ranged GETs, in parts of multipart_part_bytes (S3 wants 5 MiB
+    // or more for all but the last). Each transfer runs at most
+    // transfer_parallelism parts at once. A threshold of 0 disables both.
+    std::uint64_t multipart_threshold_bytes = 32ull << 20;
+    std::uint64_t multipart_part_bytes = 8ull << 20;
+    std::uint32_t transfer_parallelism = 8;
 };
 
 } // namespace kvcache
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kvcache {
+
+/**
+ * @class WriteBehindQueue
+ * @brief Upload threads bounded by the bytes their tasks hold.
+ *
+ * Each task comes with the size of the buffer it uploads. Submit() blocks
+ * while the bytes queued or running would pass the budget, so a producer
+ * that stores faster than the object store accepts is slowed down instead
+ * of piling up copies. A task larger than the whole budget is admitted once
+ * nothing else is pending. Tasks run in submission order.
+ *
+ * Thread-safe.
+ */
+class WriteBehindQueue {
+public:
+    WriteBehindQueue(std::uint32_t num_threads, std::uint64_t budget_bytes);
+
+    /**
+     * @brief Runs every task that was already submitted, then joins the threads.
+     */
+    ~WriteBehindQueue();
+
+    /**
+     * @brief Queues a task holding 'bytes', blocking while the budget is used up.
+     */
+    void Submit(std::uint64_t bytes, std::function<void()> task);
+
+    /**
+     * @brief Blocks until every task submitted so far has returned.
+     */
+    void Drain();
+
+    /**
+     * @brief Returns the bytes held by queued or running tasks.
+     */
+    std::uint64_t PendingBytes() const;
+
+private:
+    struct Task {
+        std::uint64_t bytes;
+        std::function<void()> run;
+    };
+
+    void WorkerLoop();
+
+    std::uint64_t budget_bytes_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_work_;
+    std::condition_variable cv_space_;
+    std::deque<Task> queue_;
+    std::uint64_t pending_bytes_ = 0;
+    std::size_t pending_tasks_ = 0;
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+
+    WriteBehindQueue(const WriteBehindQueue&) = delete;
+    WriteBehindQueue& operator=(const WriteBehindQueue&) = delete;
+};
+
+} // namespace kvcache
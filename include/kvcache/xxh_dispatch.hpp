@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace kvcache {
+
+// XXH3-128 for the widest vector unit the CPU supports, picked once at
+// startup. With KVCACHE_XXH_DISPATCH on x86-64 the library carries AVX2 and
+// AVX-512 builds of XXH3 next to the baseline (SSE2) one; elsewhere only
+// the baseline is built, which is NEON on AArch64.
+
+struct Hash128 {
+    std::uint64_t low64;
+    std::uint64_t high64;
+};
+
+// Storage for an XXH3 streaming state, so hashers need no heap allocation
+struct alignas(64) XxhState {
+    unsigned char bytes[640];
+};
+
+struct XxhOps {
+    const char* name; // Vector unit the XXH3 build targets, e.g. "avx2"
+    void (*reset)(XxhState* state);
+    void (*update)(XxhState* state, const void* data, std::size_t len);
+    Hash128 (*digest)(const XxhState* state);
+    Hash128 (*hash)(const void* data, std::size_t len, std::uint64_t seed);
+};
+
+/**
+ * @brief Returns the fastest build the CPU can run.
+ */
+const XxhOps& XxhDispatch();
+
+/**
+ * @brief Returns every build the CPU can run, baseline first.
+ */
+std::vector<const XxhOps*> XxhAvailable();
+
+} // namespace kvcache
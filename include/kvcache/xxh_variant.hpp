@@ -0,0 +1,66 @@
+#pragma once
+
+// XXH3 compiled for one instruction set. Included once by each xxh_*.cpp
+// translation unit, which is built with that unit's target flags (see
+// CMakeLists.txt). XXH_INLINE_ALL gives every XXH3 function internal
+// linkage, so no code built for a wider vector unit can be picked by the
+// linker for the rest of the library. Keep C++ library templates out of
+// these units for the same reason.
+
+#include "xxh_dispatch.hpp"
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
+namespace kvcache {
+namespace {
+
+static_assert(sizeof(XXH3_state_t) <= sizeof(XxhState), "XxhState is too small for XXH3_state_t");
+static_assert(alignof(XXH3_state_t) <= alignof(XxhState), "XxhState is underaligned for XXH3_state_t");
+
+XXH3_state_t* xxh_state(XxhState* state) {
+    return reinterpret_cast<XXH3_state_t*>(state->bytes);
+}
+
+void xxh_reset(XxhState* state) {
+    XXH3_state_t* s = xxh_state(state);
+    XXH3_INITSTATE(s);
+    XXH3_128bits_reset(s);
+}
+
+void xxh_update(XxhState* state, const void* data, std::size_t len) {
+    XXH3_128bits_update(xxh_state(state), data, len);
+}
+
+Hash128 xxh_digest(const XxhState* state) {
+    XXH128_hash_t h = XXH3_128bits_digest(reinterpret_cast<const XXH3_state_t*>(state->bytes));
+    return Hash128{h.low64, h.high64};
+}
+
+Hash128 xxh_hash(const void* data, std::size_t len, std::uint64_t seed) {
+    XXH128_hash_t h = XXH3_128bits_withSeed(data, len, seed);
+    return Hash128{h.low64, h.high64};
+}
+
+constexpr const char* xxh_vector_name() {
+#if XXH_VECTOR == XXH_AVX512
+    return "avx512";
+#elif XXH_VECTOR == XXH_AVX2
+    return "avx2";
+#elif XXH_VECTOR == XXH_SSE2
+    return "sse2";
+#elif XXH_VECTOR == XXH_NEON
+    return "neon";
+#elif XXH_VECTOR == XXH_SVE
+    return "sve";
+#elif XXH_VECTOR == XXH_VSX
+    return "vsx";
+#else
+    return "scalar";
+#endif
+}
+
+constexpr XxhOps kXxhOps{xxh_vector_name(), &xxh_reset, &xxh_update, &xxh_digest, &xxh_hash};
+
+} // namespace
+} // namespace kvcache
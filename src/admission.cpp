@@ -0,0 +1,55 @@
+#include "kvcache/admission.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace kvcache {
+
+Doorkeeper::Doorkeeper(std::uint64_t window) : window_(std::max<std::uint64_t>(window, 1)) {
+    // Ten bits per key with four probes, rounded up to a power of two
+    std::uint64_t bits = 64;
+    while (bits < window_ * 10) {
+        bits <<= 1;
+    }
+    bit_mask_ = bits - 1;
+    const std::uint64_t words = bits / 64;
+    words_ = std::make_unique<std::atomic<std::uint64_t>[]>(words);
+    for (std::uint64_t i = 0; i < words; ++i) {
+        words_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+bool Doorkeeper::Admit(const PrefixKey& key) {
+    // The key is already a uniform 128-bit hash; its halves drive double
+    // hashing, with an odd step so probes never repeat a bit
+    std::uint64_t h1 = 0;
+    std::uint64_t h2 = 0;
+    std::memcpy(&h1, key.data(), sizeof(h1));
+    std::memcpy(&h2, key.data() + sizeof(h1), sizeof(h2));
+    h2 |= 1;
+
+    bool seen = true;
+    for (int i = 0; i < kProbes; ++i) {
+        const std::uint64_t bit = (h1 + static_cast<std::uint64_t>(i) * h2) & bit_mask_;
+        const std::uint64_t mask = 1ull << (bit & 63);
+        std::atomic<std::uint64_t>& word = words_[bit >> 6];
+        if ((word.load(std::memory_order_relaxed) & mask) == 0) {
+            word.fetch_or(mask, std::memory_order_relaxed);
+            seen = false;
+        }
+    }
+    if (seen) {
+        return true;
+    }
+
+    if (recorded_.fetch_add(1, std::memory_order_relaxed) + 1 == window_) {
+        const std::uint64_t words = (bit_mask_ + 1) / 64;
+        for (std::uint64_t i = 0; i < words; ++i) {
+            words_[i].store(0, std::memory_order_relaxed);
+        }
+        recorded_.store(0, std::memory_order_relaxed);
+    }
+    return false;
+}
+
+} // namespace kvcache
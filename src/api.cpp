@@ -1,291 +1,2498 @@
 #include "kvcache/api.hpp"
+#include "kvcache/admission.hpp"
+#include "kvcache/buffer_pool.hpp"
+#include "kvcache/cluster.hpp"
+#include "kvcache/codec.hpp"
 #include "kvcache/hash.hpp"
+#include "kvcache/index.hpp"
+#include "kvcache/index_snapshot.hpp"
+#include "kvcache/io_executor.hpp"
+#include "kvcache/local_tier.hpp"
+#include "kvcache/metrics.hpp"
+#include "kvcache/object_store.hpp"
+#include "kvcache/peer.hpp"
+#include "kvcache/prefetcher.hpp"
+#ifdef KVCACHE_WITH_S3
 #include "kvcache/s3_client.hpp"
+#endif
 #include "kvcache/s3_settings.hpp"
+#include "kvcache/segment.hpp"
+#include "kvcache/single_flight.hpp"
+#include "kvcache/write_behind.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <iostream>
-#include <list>
+#include <latch>
 #include <mutex>
+#include <random>
 #include <condition_variable>
 #include <thread>
-#include <unordered_map>
 #include <chrono>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace kvcache {
 
-// --- Internal Data Structures ---
+// An encoded object, kept alive by the uploads that read from it
+using ObjectBuffer = std::shared_ptr<const std::vector<std::uint8_t>>;
+
+// One StoreSequenceAsync call. Its blocks upload in any order, but
+// 'published' only advances over a run of settled blocks, under 'mutex', so
+// they enter the index in prefix order and Lookup never sees a gap.
+struct SequenceUpload {
+    enum class State : std::uint8_t {
+        Queued,
+        Uploaded,  // In S3, waiting for the blocks before it
+        Resident,  // Already indexed; nothing to publish
+        Failed,
+    };
+
+    std::vector<PrefixKey> keys;
+    std::vector<BlockBuffer> blocks; // Copies of the caller's blocks
+    std::vector<BlockInfo> infos;
+    std::vector<std::uint8_t> uploaded; // Whether block j's own PUT wrote its object
+    SequenceCallback done;
 
-struct BlockMeta {
-    std::uint64_t size;
-    std::list<std::string>::iterator lru_it;
+    std::mutex mutex;
+    std::vector<State> state; // Guarded by mutex
+    std::uint32_t published = 0; // Guarded by mutex
+    std::uint32_t cut = 0;       // First failed block, or the block count; guarded by mutex
+    std::uint32_t remaining = 0; // Blocks not yet settled; guarded by mutex
 };
 
 // PIMPL: Private Implementation
 class KVCacheImpl {
 public:
-    KVCacheImpl(const Config& cfg);
+    KVCacheImpl(const Config& cfg, std::shared_ptr<ObjectStore> store, std::shared_ptr<PeerTransport> peers);
     ~KVCacheImpl();
 
     void GcThreadLoop();
 
     LookupResult Lookup(const std::vector<std::uint32_t>& tokens) const;
+    PrefetchTicket Prefetch(const LookupResult& result);
+    void CancelPrefetch(PrefetchTicket ticket);
     bool Load(const BlockRef& ref, std::vector<std::uint8_t>* out_bytes);
+    bool Load(const BlockRef& ref, mutable_bytes_view dest);
+    BlockBuffer LoadShared(const BlockRef& ref);
+    bool LoadStreaming(const BlockRef& ref, mutable_bytes_view dest, const BlockLayout& layout,
+                       const ChunkCallback& on_chunk);
+    LoadAllResult LoadAll(const LookupResult& result, mutable_bytes_view dest, std::uint32_t max_parallel);
     bool Store(const std::vector<std::uint32_t>& tokens,
                std::uint32_t block_index,
-               bytes_view block_bytes);
+               bytes_view block_bytes,
+               TenantId tenant);
+    std::uint32_t StoreSequence(const std::vector<std::uint32_t>& tokens,
+                                const std::vector<bytes_view>& blocks,
+                                TenantId tenant);
+    void LoadAsync(const BlockRef& ref, std::vector<std::uint8_t>* out_bytes, CompletionCallback done);
+    void StoreAsync(const std::vector<std::uint32_t>& tokens,
+                    std::uint32_t block_index,
+                    bytes_view block_bytes,
+                    CompletionCallback done,
+                    TenantId tenant);
+    void StoreSequenceAsync(const std::vector<std::uint32_t>& tokens,
+                            const std::vector<bytes_view>& blocks,
+                            SequenceCallback done,
+                            TenantId tenant);
+    void Flush();
     
     std::uint64_t UsedBytes() const;
     std::uint64_t CapacityBytes() const;
     void SetCapacityBytes(std::uint64_t cap);
+    bool IndexRebuilding() const;
+    BufferPoolStats BufferStats() const { return buffers_->Stats(); }
+    CacheStats GetStats() const;
+    bool ServePeer(const PrefixKey& key, mutable_bytes_view dest);
 
 private:
-    std::string make_s3_key(const std::string& prefix_hex, std::uint32_t block_index) const;
-    void touch_lru(const std::string& s3_key);
-    void evict_lru();
+    using BlockList = std::vector<std::pair<PrefixKey, BlockInfo>>;
+
+    std::string make_s3_key(const PrefixKey& key, std::uint32_t block_index) const;
+    std::string object_key(const PrefixKey& key, const BlockInfo& info) const;
+    std::size_t evict_batch();
+    bool store_block(const PrefixKey& key, std::uint32_t block_index, bytes_view block_bytes,
+                     const PrefixKey* parent, TenantId tenant, bool check_admission);
+    std::uint32_t admit_prefix(const std::vector<PrefixKey>& keys);
+    bool write_block(const PrefixKey& key, const BlockInfo& raw_info, bytes_view block_bytes);
+    void publish_block(const PrefixKey& key, const BlockInfo& info, BlockBuffer local_copy,
+                       BlockList* stale_objects, bool announce = true);
+    void upload_sequence_block(const std::shared_ptr<SequenceUpload>& seq, std::uint32_t j);
+    void settle_sequence_block(const std::shared_ptr<SequenceUpload>& seq, std::uint32_t j,
+                               SequenceUpload::State state);
+    ObjectBuffer encode_block(bytes_view block_bytes, BlockInfo* info) const;
+    bool packing_enabled() const { return config_.pack_blocks > 1 && !config_.dedup_blocks; }
+    std::uint32_t store_packed(const std::vector<std::uint32_t>& tokens, const std::vector<bytes_view>& blocks,
+                               TenantId tenant);
+    bool write_segment(const std::vector<PrefixKey>& keys, const std::vector<bytes_view>& blocks,
+                       const std::vector<std::uint32_t>& pending, TenantId tenant);
+    PrefixKey new_segment_id(const PrefixKey& key);
+    std::string segment_key(const PrefixKey& segment) const;
+    void compact_segments();
+    void reap_orphan_segments();
+    void compact_segment(const SegmentUsage& usage);
+    void rebuild_segment(const std::string& s3_key, std::uint64_t object_size);
+    bool load_run(const std::vector<BlockRef>& handles, std::uint32_t first, std::uint32_t last,
+                  mutable_bytes_view dest, std::uint32_t* loaded);
+    bool load_streaming(const BlockRef& ref, mutable_bytes_view dest, const BlockLayout& layout,
+                        const ChunkCallback& on_chunk);
+    bool load_into(const BlockRef& ref, mutable_bytes_view dest);
+    bool load_block(const BlockRef& ref, mutable_bytes_view dest);
+    bool fetch_into(const BlockRef& ref, mutable_bytes_view dest, bool ask_peers = true);
+    bool fetch_from_peer(const PrefixKey& key, mutable_bytes_view dest);
+    bool get_object(const std::string& s3_key, const BlockInfo& info, mutable_bytes_view buffer);
+    bool read_local(const PrefixKey& key, mutable_bytes_view dest);
+    void prefetch_block(const BlockRef& ref);
+    void cache_local(const PrefixKey& key, BlockBuffer data);
+    void drop_local(const PrefixKey& key);
+    bool over_high_watermark() const;
+    std::uint64_t low_watermark_bytes() const;
+    std::uint32_t num_tenants() const { return static_cast<std::uint32_t>(tenant_used_.size()); }
+    TenantId known_tenant(std::uint32_t tenant) const { return tenant < num_tenants() ? tenant : 0; }
+    std::uint64_t tenant_quota(TenantId tenant) const;
+    std::uint64_t tenant_used(TenantId tenant) const { return tenant_used_[tenant].load(std::memory_order_relaxed); }
+    bool tenant_over_high(TenantId tenant) const;
+    bool restore_index();
+    BlockInfo record_info(const IndexRecord& record) const;
+    void apply_record(const IndexRecord& record);
+    void apply_remote(const IndexRecord& record);
+    void start_cluster(bool resume);
+    void touch(const PrefixKey& key);
+    bool gc_owner() const { return !cluster_ || cluster_->IsLeader(); }
+    void rebuild_from_s3();
+    bool parse_s3_key(const std::string& s3_key, PrefixKey* key, std::uint32_t* block_index, bool* encoded) const;
+    static IndexRecord make_record(const PrefixKey& key, const BlockInfo& info, std::uint64_t segment_bytes = 0);
+    std::uint64_t content_seed() const;
+    std::string s3_key_prefix() const;
+    void write_snapshot();
+    bool unindex(const PrefixKey& key, const BlockInfo& info);
+    bool release_block(const BlockInfo& info);
+    void account_store(const PrefixKey& key, const BlockInfo& info, BlockList* stale_objects);
+    bool acquire_content(const BlockInfo& info);
+    bool release_content(const BlockInfo& info);
+    bool object_referenced(const PrefixKey& key, const BlockInfo& info) const;
+    void delete_blocks(BlockList blocks);
+    void run_deletes(BlockList blocks);
+    void repair_deleted(const PrefixKey& key, const BlockInfo& info, BlockList* orphaned);
+    void run_repairs(const BlockList& deleted);
+    static BlockList::value_type segment_object(const PrefixKey& segment);
+    bool begin_store(const std::string& s3_key, const BlockInfo& info);
+    void end_put(const std::string& s3_key);
+    bool write_back_enabled() const { return dram_ && config_.write_policy == WritePolicy::WriteBack; }
+    bool count_load(ScopedOp& op, bool ok, std::uint64_t bytes) const;
+    bool count_store(ScopedOp& op, bool ok, std::uint64_t bytes) const;
 
     Config config_;
-    std::unique_ptr<S3Client> s3_client_;
+    CodecOptions codec_options_;
 
-    // Thread-safe state
-    mutable std::mutex mutex_;
-    std::condition_variable cv_gc_;
-    std::uint64_t used_bytes_ = 0;
-    std::uint64_t capacity_bytes_;
+    // Counters and latencies; declared before store_, which may record into it
+    Metrics metrics_;
+    std::shared_ptr<ObjectStore> store_; // S3Client unless the caller supplied a backend
+
+    // Backs block buffers: local tier copies, coalesced loads, staging
+    std::shared_ptr<BufferPool> buffers_;
+
+    // Sharded in-memory index, keyed by the binary prefix key of each block.
+    // The S3 key string is only formatted when a request is issued.
+    BlockIndex index_;
+    std::atomic<std::uint64_t> used_bytes_{0};
+    std::atomic<std::uint64_t> capacity_bytes_;
+
+    // Bytes charged to each tenant, by TenantId. used_bytes_ counts each
+    // object once; these count every block referencing one, so a shared
+    // payload is paid for by each tenant using it.
+    std::vector<std::atomic<std::uint64_t>> tenant_used_;
+
+    // Config::admission; null admits every block
+    std::unique_ptr<Doorkeeper> doorkeeper_;
+
+    // Snapshot + journal of the index; null when persistence is disabled
+    std::unique_ptr<IndexSnapshot> snapshot_;
+
+    // Local tiers; either may be null. S3 holds every indexed block unless
+    // a write-back upload is still pending.
+    std::unique_ptr<MemoryTier> dram_;
+    std::unique_ptr<DiskTier> ssd_;
+
+    // Async I/O pool
+    std::unique_ptr<IoExecutor> io_;
+
+    // Background fetches into the local tiers; null without one
+    std::unique_ptr<Prefetcher> prefetcher_;
+
+    // StoreSequenceAsync uploads, bounded by the bytes of block copies held
+    std::unique_ptr<WriteBehindQueue> write_behind_;
+
+    // Runs GC's DeleteObjects batches, apart from io_ so that reclaiming
+    // space never queues ahead of inference loads
+    std::unique_ptr<IoExecutor> delete_io_;
 
-    // In-memory index
-    std::unordered_map<std::string, std::uint32_t> prefix_hwm_; // prefix_hex -> highest_contiguous_block_index
-    std::unordered_map<std::string, BlockMeta> block_metadata_; // s3_key -> metadata
-    std::list<std::string> lru_list_; // MRU at front, LRU at back
+    // Object keys being PUT, with their writer counts, and being deleted.
+    // A block stored again right after its eviction reuses the key its
+    // delete is about to remove, so a delete skips keys that are being
+    // written or are indexed again by the time it runs, and a PUT waits
+    // out a delete of its key that has already gone out. Deduplicated
+    // stores also read it to tell whether their payload is still uploading.
+    std::mutex object_mutex_;
+    std::condition_variable object_cv_;
+    std::unordered_map<std::string, std::uint32_t> puts_in_flight_;
+    std::unordered_set<std::string> deletes_in_flight_;
+
+    // Blocks indexed by write-back stores whose upload has not finished,
+    // with their store counts. They stay out of the snapshot and journal
+    // until S3 has them, so a restart never indexes a missing object.
+    std::mutex write_back_mutex_;
+    std::unordered_map<PrefixKey, std::uint32_t, PrefixKeyHash> write_backs_pending_;
+
+    // Deleted objects to check once their in-flight PUTs end, by object
+    // key, so that a repair never parks a delete_io_ worker on an upload
+    std::unordered_map<std::string, BlockList> repairs_pending_;
+
+    // Concurrent S3 fetches of one block share a single GET, and concurrent
+    // stores of one block a single PUT
+    SingleFlight<PrefixKey, BlockBuffer, PrefixKeyHash> load_flights_;
+    SingleFlight<PrefixKey, bool, PrefixKeyHash> store_flights_;
+
+    // Segment ids hash a per-process random seed and a counter, so a new
+    // segment never reuses the name of one still referenced. GC only looks
+    // for sparse segments after a packed block has been released.
+    std::uint64_t segment_seed_;
+    std::atomic<std::uint64_t> segment_counter_{0};
+    std::atomic<bool> segments_released_{true};
+
+    // Segments an S3 rebuild found with no block left to index, and when.
+    // The rebuild itself never deletes; the GC owner does, once a segment
+    // has stayed unreferenced for a grace period, so one a writer (here or
+    // on another node) has just PUT but not yet indexed survives.
+    std::mutex orphan_mutex_;
+    std::vector<std::pair<PrefixKey, std::chrono::steady_clock::time_point>> orphan_segments_;
+
+    // Background index rebuild from S3 LIST
+    std::thread rebuild_thread_;
+    std::atomic<bool> rebuilding_{false};
+    std::atomic<bool> stop_rebuild_{false};
 
     // GC thread
+    std::mutex gc_mutex_;
+    std::condition_variable cv_gc_;
     std::thread gc_thread_;
     bool stop_gc_ = false;
+
+    // Cluster mode (Config::cluster_node_id); all null otherwise. The sync
+    // thread applies other nodes' events, and the server answers their
+    // fetches of blocks this node owns on the ring.
+    std::shared_ptr<PeerTransport> peers_;
+    std::unique_ptr<ClusterSync> cluster_;
+    std::unique_ptr<TcpPeerServer> peer_server_;
 };
 
 
 // --- KVCacheImpl Implementation ---
 
-KVCacheImpl::KVCacheImpl(const Config& cfg) : config_(cfg) {
+KVCacheImpl::KVCacheImpl(const Config& cfg, std::shared_ptr<ObjectStore> store, std::shared_ptr<PeerTransport> peers)
+    : config_(cfg), metrics_(cfg.enable_metrics, cfg.trace_sink), store_(std::move(store)),
+      index_(cfg.index_shards, cfg.eviction_policy, static_cast<std::uint32_t>(cfg.tenants.size())),
+      capacity_bytes_(cfg.capacity_bytes),
+      tenant_used_(std::clamp<std::size_t>(cfg.tenants.size(), 1, std::size_t{1} << 16)),
+      segment_seed_((static_cast<std::uint64_t>(std::random_device{}()) << 32) ^ std::random_device{}()) {
     ApplyS3ConfigDefaults(config_);
-    capacity_bytes_ = config_.capacity_bytes;
-    s3_client_ = std::make_unique<S3Client>(config_);
+    codec_options_ = CodecOptions{config_.codec, config_.codec_level, config_.kv_channels};
+    if (!CodecAvailable(config_.codec)) {
+        std::cerr << "kvcache: codec " << static_cast<int>(config_.codec)
+                  << " is not built in; storing blocks raw" << std::endl;
+        codec_options_.codec = Codec::None;
+    }
+    if (!store_) {
+#ifdef KVCACHE_WITH_S3
+        store_ = std::make_shared<S3Client>(config_);
+#else
+        std::cerr << "kvcache: built without S3; keeping objects in memory" << std::endl;
+        store_ = std::make_shared<MemoryObjectStore>();
+#endif
+    }
+    if (metrics_.Enabled() || metrics_.Tracing()) {
+        store_ = std::make_shared<MeteredObjectStore>(std::move(store_), metrics_);
+    }
+    std::uint64_t pool_bytes = config_.buffer_pool_bytes;
+    if (pool_bytes == 0) {
+        pool_bytes = config_.dram_cache_bytes + config_.write_behind_bytes;
+    }
+    buffers_ = BufferPool::Create(pool_bytes, config_.buffer_pool_hugepages);
+    if (config_.dram_cache_bytes > 0) {
+        dram_ = std::make_unique<MemoryTier>(config_.dram_cache_bytes);
+    }
+    if (!config_.ssd_cache_dir.empty() && config_.ssd_cache_bytes > 0) {
+        ssd_ = std::make_unique<DiskTier>(config_.ssd_cache_dir, config_.ssd_cache_bytes);
+    }
+    if (config_.admission == AdmissionPolicy::Doorkeeper) {
+        doorkeeper_ = std::make_unique<Doorkeeper>(config_.admission_window_blocks);
+    }
+    io_ = std::make_unique<IoExecutor>(config_.io_threads, config_.max_inflight_requests);
+    delete_io_ = std::make_unique<IoExecutor>(config_.gc_delete_threads, config_.gc_delete_threads * 2);
+    write_behind_ = std::make_unique<WriteBehindQueue>(config_.write_behind_threads, config_.write_behind_bytes);
+    if (dram_ || ssd_) {
+        std::uint64_t budget = config_.prefetch_budget_bytes;
+        if (budget == 0) {
+            budget = (dram_ ? dram_->CapacityBytes() : config_.ssd_cache_bytes) / 2;
+        }
+        prefetcher_ = std::make_unique<Prefetcher>(config_.prefetch_threads, budget,
+                                                   [this](const BlockRef& ref) { prefetch_block(ref); });
+    }
+    bool restored = restore_index();
+    if (!config_.cluster_node_id.empty()) {
+        peers_ = std::move(peers);
+        start_cluster(restored);
+    }
+    if (!restored && config_.rebuild_index_from_s3) {
+        rebuilding_ = true;
+        rebuild_thread_ = std::thread(&KVCacheImpl::rebuild_from_s3, this);
+    }
 
     // Start GC thread
     gc_thread_ = std::thread(&KVCacheImpl::GcThreadLoop, this);
 }
 
 KVCacheImpl::~KVCacheImpl() {
+    // Peers fall back to the object store from here on
+    peer_server_.reset();
+
+    stop_rebuild_ = true;
+    if (rebuild_thread_.joinable()) {
+        rebuild_thread_.join();
+    }
+
+    // Finish outstanding async operations (including write-back uploads)
+    // while the index, tiers and client still exist
+    write_behind_.reset();
+    prefetcher_.reset();
+    io_.reset();
+
     {
-        std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<std::mutex> lock(gc_mutex_);
         stop_gc_ = true;
     }
     cv_gc_.notify_one();
     if (gc_thread_.joinable()) {
         gc_thread_.join();
     }
+    delete_io_.reset();
+
+    // Publishes the last evictions and says goodbye, so the next node in
+    // line takes over GC without waiting for the timeout
+    cluster_.reset();
+
+    // Leave a fresh snapshot so the next start does not replay the journal
+    write_snapshot();
 }
 
-void KVCacheImpl::GcThreadLoop() {
-    while (true) {
-        std::unique_lock<std::mutex> lock(mutex_);
-        cv_gc_.wait_for(lock, std::chrono::seconds(1), [this] {
-            return stop_gc_ || used_bytes_ > capacity_bytes_;
-        });
+bool KVCacheImpl::restore_index() {
+    if (config_.index_snapshot_path.empty()) {
+        return false;
+    }
+    snapshot_ = std::make_unique<IndexSnapshot>(config_.index_snapshot_path,
+                                                config_.block_size_tokens, config_.model_id);
+    std::uint64_t replayed = snapshot_->Load([this](const IndexRecord& record) { apply_record(record); });
+    return replayed > 0;
+}
 
-        if (stop_gc_) {
-            break;
-        }
+BlockInfo KVCacheImpl::record_info(const IndexRecord& record) const {
+    BlockInfo info{record.size, record.index, record.parent != PrefixKey{}, record.parent,
+                   record.content != PrefixKey{}, record.content,
+                   record.stored_size, static_cast<Codec>(record.codec),
+                   record.segment != PrefixKey{}, record.segment, record.offset};
+    info.tenant = known_tenant(record.tenant);
+    return info;
+}
 
-        while (used_bytes_ > capacity_bytes_) {
-            evict_lru();
+void KVCacheImpl::apply_record(const IndexRecord& record) {
+    if (record.op == IndexRecord::kStore) {
+        BlockInfo info = record_info(record);
+        if (info.has_segment) {
+            index_.AcquireSegment(info.segment, record.key, info.stored_size, record.segment_bytes);
+        }
+        if (info.has_content) {
+            acquire_content(info);
+        }
+        account_store(record.key, info, nullptr);
+    } else if (record.op == IndexRecord::kEvict) {
+        BlockInfo info;
+        if (index_.Remove(record.key, &info)) {
+            release_block(info);
         }
     }
 }
 
-void KVCacheImpl::evict_lru() {
-    // Assumes lock is held
-    if (lru_list_.empty()) {
+void KVCacheImpl::start_cluster(bool resume) {
+    if (config_.cluster_node_id.find('/') != std::string::npos) {
+        std::cerr << "kvcache: cluster node id '" << config_.cluster_node_id
+                  << "' contains '/'; running standalone" << std::endl;
         return;
     }
+    if (config_.cluster_peer_fetch && !peers_) {
+        peers_ = std::make_shared<TcpPeerTransport>(config_.cluster_peer_timeout_ms);
+    }
+    if (config_.cluster_listen_port != 0) {
+        peer_server_ = std::make_unique<TcpPeerServer>(config_.cluster_listen_port,
+            [this](const PrefixKey& key, mutable_bytes_view dest) { return ServePeer(key, dest); },
+            [this](const PrefixKey& key, std::uint64_t size) {
+                BlockInfo info;
+                return index_.Find(key, &info) && info.size == size;
+            });
+    }
 
-    std::string key_to_evict = lru_list_.back();
-    lru_list_.pop_back();
+    ClusterOptions options;
+    options.prefix = s3_key_prefix() + "n/";
+    options.node_id = config_.cluster_node_id;
+    options.address = config_.cluster_advertise_address;
+    options.model_id = config_.model_id;
+    options.block_size = config_.block_size_tokens;
+    options.sync_interval_ms = config_.cluster_sync_interval_ms;
+    options.heartbeat_interval_ms = config_.cluster_heartbeat_interval_ms;
+    options.node_timeout_ms = config_.cluster_node_timeout_ms;
+    options.event_retention = config_.cluster_event_retention;
+    options.share_recency = config_.cluster_share_recency;
+    cluster_ = std::make_unique<ClusterSync>(store_, std::move(options), metrics_, resume,
+        [this](const IndexRecord& record) { apply_remote(record); },
+        [this](const PrefixKey& key) { index_.Touch(key); });
+}
 
-    auto meta_it = block_metadata_.find(key_to_evict);
-    if (meta_it == block_metadata_.end()) {
-        return; // Should not happen
+void KVCacheImpl::apply_remote(const IndexRecord& record) {
+    // Another node stored or evicted the block; the object store already
+    // reflects it, so only the index, the local tiers and the journal follow
+    if (record.op == IndexRecord::kStore) {
+        apply_record(record);
+        if (snapshot_) {
+            snapshot_->AppendStore(record);
+        }
+        if (over_high_watermark()) {
+            cv_gc_.notify_one();
+        }
+    } else if (record.op == IndexRecord::kEvict) {
+        BlockInfo info;
+        if (index_.Remove(record.key, &info)) {
+            drop_local(record.key);
+            if (snapshot_) {
+                snapshot_->AppendEvict(record.key, info.index);
+            }
+            release_block(info);
+        }
+    } else if (record.op == IndexRecord::kDeleted) {
+        delete_io_->Submit([this, deleted = BlockList{{record.key, record_info(record)}}] { run_repairs(deleted); });
     }
+}
 
-    std::uint64_t size_to_free = meta_it->second.size;
-    block_metadata_.erase(meta_it);
-    
-    used_bytes_ -= size_to_free;
+void KVCacheImpl::touch(const PrefixKey& key) {
+    index_.Touch(key);
+    if (cluster_) {
+        cluster_->PublishTouch(key);
+    }
+}
 
-    // This is a simplified HWM update. A correct implementation would need to parse the key
-    // to find the prefix and potentially rescan, which is complex. For now, we accept
-    // that HWMs might not be perfectly accurate after eviction of non-HWM blocks.
-    // A full implementation would require a reverse index from block to prefix.
-    // For simplicity, we are not adjusting HWM here, which means lookups might fail for
-    // prefixes where a middle block was evicted.
+std::string KVCacheImpl::s3_key_prefix() const {
+    return config_.model_id + "/b" + std::to_string(config_.block_size_tokens) + "/";
+}
 
-    // Unlock to perform S3 operation
-    mutex_.unlock();
-    s3_client_->DeleteObject(key_to_evict);
-    mutex_.lock();
+IndexRecord KVCacheImpl::make_record(const PrefixKey& key, const BlockInfo& info, std::uint64_t segment_bytes) {
+    IndexRecord record{};
+    record.key = key;
+    record.parent = info.has_parent ? info.parent : PrefixKey{};
+    record.content = info.has_content ? info.content : PrefixKey{};
+    record.size = info.size;
+    record.stored_size = info.stored_size;
+    if (info.has_segment) {
+        record.segment = info.segment;
+        record.offset = info.offset;
+        record.segment_bytes = segment_bytes;
+    }
+    record.index = info.index;
+    record.op = IndexRecord::kStore;
+    record.codec = static_cast<std::uint32_t>(info.codec);
+    record.tenant = info.tenant;
+    return record;
 }
 
-std::string KVCacheImpl::make_s3_key(const std::string& prefix_hex, std::uint32_t block_index) const {
-    return config_.model_id + "/b" + std::to_string(config_.block_size_tokens) +
-           "/" + prefix_hex + "/" + std::to_string(block_index) + ".kv";
+std::uint64_t KVCacheImpl::content_seed() const {
+    // Identical payloads stored under different codec settings are
+    // different objects
+    return static_cast<std::uint64_t>(codec_options_.codec) |
+           static_cast<std::uint64_t>(static_cast<std::uint8_t>(codec_options_.level)) << 8 |
+           static_cast<std::uint64_t>(codec_options_.channels) << 32;
 }
 
-void KVCacheImpl::touch_lru(const std::string& s3_key) {
-    // Assumes lock is held
-    auto meta_it = block_metadata_.find(s3_key);
-    if (meta_it != block_metadata_.end()) {
-        lru_list_.splice(lru_list_.begin(), lru_list_, meta_it->second.lru_it);
+bool KVCacheImpl::parse_s3_key(const std::string& s3_key, PrefixKey* key, std::uint32_t* block_index,
+                               bool* encoded) const {
+    // Inverse of make_s3_key: <model_id>/b<B>/<32 hex>/<block_index>.kv[z]
+    const std::string prefix = s3_key_prefix();
+    const std::size_t hex_len = key->size() * 2;
+    if (s3_key.compare(0, prefix.size(), prefix) != 0 || s3_key.size() < prefix.size() + hex_len + 5) {
+        return false;
+    }
+    std::size_t pos = prefix.size();
+    if (!FromHex(s3_key.substr(pos, hex_len), key) || s3_key[pos + hex_len] != '/') {
+        return false;
+    }
+    pos += hex_len + 1;
+
+    std::size_t dot = s3_key.find('.', pos);
+    if (dot == std::string::npos || dot == pos) {
+        return false;
+    }
+    if (s3_key.compare(dot, std::string::npos, ".kv") == 0) {
+        *encoded = false;
+    } else if (s3_key.compare(dot, std::string::npos, ".kvz") == 0) {
+        *encoded = true;
+    } else {
+        return false;
+    }
+    std::uint64_t value = 0;
+    for (std::size_t i = pos; i < dot; ++i) {
+        if (s3_key[i] < '0' || s3_key[i] > '9') {
+            return false;
+        }
+        value = value * 10 + static_cast<std::uint64_t>(s3_key[i] - '0');
+        if (value > UINT32_MAX) {
+            return false;
+        }
     }
+    *block_index = static_cast<std::uint32_t>(value);
+    return true;
 }
 
-LookupResult KVCacheImpl::Lookup(const std::vector<std::uint32_t>& tokens) const {
-    const std::uint32_t B = config_.block_size_tokens;
-    std::uint32_t N = tokens.size();
-    std::uint32_t K = (N / B) * B;
-
-    if (K == 0) {
-        return {0, {}};
-    }
-
-    std::lock_guard<std::mutex> lock(mutex_);
-
-    for (std::uint32_t k = K; k > 0; k -= B) {
-        std::vector<std::uint32_t> prefix_tokens(tokens.begin(), tokens.begin() + k);
-        PrefixKey pkey = MakePrefixKey(prefix_tokens, B, config_.model_id);
-        std::string pkey_hex = ToHex(pkey);
-
-        auto hwm_it = prefix_hwm_.find(pkey_hex);
-        if (hwm_it != prefix_hwm_.end()) {
-            std::uint32_t hwm = hwm_it->second;
-            std::uint32_t matched_blocks = hwm + 1;
-            std::uint32_t matched_tokens = std::min(k, matched_blocks * B);
-
-            LookupResult result;
-            result.matched_tokens = matched_tokens;
-            
-            for (std::uint32_t i = 0; i < matched_tokens / B; ++i) {
-                std::string s3_key = make_s3_key(pkey_hex, i);
-                auto meta_it = block_metadata_.find(s3_key);
-                if (meta_it != block_metadata_.end()) {
-                    result.handles.push_back({s3_key, meta_it->second.size, i});
-                } else {
-                    // This indicates an inconsistency, maybe a block was evicted.
-                    // We should return what we have contiguously from block 0.
-                    result.matched_tokens = i * B;
-                    return result;
-                }
+void KVCacheImpl::rebuild_from_s3() {
+    // Prefix keys are uniform, so splitting on the leading hex digits gives
+    // evenly sized LIST streams.
+    const int digits = config_.rebuild_list_parallelism > 16 ? 2 : 1;
+    const int num_prefixes = digits == 2 ? 256 : 16;
+    static constexpr char kDigits[] = "0123456789abcdef";
+
+    // One more stream lists the segment objects under s/
+    std::atomic<int> next_prefix{0};
+    auto lister = [&] {
+        for (int p = next_prefix.fetch_add(1); p <= num_prefixes && !stop_rebuild_; p = next_prefix.fetch_add(1)) {
+            if (p == num_prefixes) {
+                store_->ListObjects(s3_key_prefix() + "s/", [&](const std::string& s3_key, std::uint64_t size) {
+                    rebuild_segment(s3_key, size);
+                    return !stop_rebuild_.load(std::memory_order_relaxed);
+                });
+                continue;
             }
-            return result;
+            std::string prefix = s3_key_prefix();
+            if (digits == 2) {
+                prefix += kDigits[p >> 4];
+            }
+            prefix += kDigits[p & 0xF];
+
+            store_->ListObjects(prefix, [&](const std::string& s3_key, std::uint64_t size) {
+                // Object keys do not name the parent, so listed blocks start
+                // without lineage and are linked when next stored
+                PrefixKey key;
+                BlockInfo info;
+                bool encoded = false;
+                if (!parse_s3_key(s3_key, &key, &info.index, &encoded)) {
+                    return !stop_rebuild_.load(std::memory_order_relaxed);
+                }
+                info.size = size;
+                info.stored_size = size;
+                if (encoded) {
+                    // The logical size and codec are in the object header
+                    BlockHeader header;
+                    std::uint64_t n = 0;
+                    std::vector<std::uint8_t> raw(sizeof(header));
+                    if (!store_->GetObjectRange(s3_key, 0, raw, &n) || n != raw.size() ||
+                        !ReadBlockHeader(raw, &header)) {
+                        return !stop_rebuild_.load(std::memory_order_relaxed);
+                    }
+                    info.size = header.logical_size;
+                    info.codec = static_cast<Codec>(header.codec);
+                }
+                if (index_.InsertCold(key, info)) {
+                    used_bytes_.fetch_add(info.stored_size, std::memory_order_relaxed);
+                    tenant_used_[info.tenant].fetch_add(info.stored_size, std::memory_order_relaxed);
+                    if (snapshot_) {
+                        snapshot_->AppendStore(make_record(key, info));
+                    }
+                    if (over_high_watermark()) {
+                        cv_gc_.notify_one();
+                    }
+                }
+                return !stop_rebuild_.load(std::memory_order_relaxed);
+            });
+        }
+    };
+
+    const std::uint32_t num_listers = std::max<std::uint32_t>(1,
+        std::min<std::uint32_t>(config_.rebuild_list_parallelism, num_prefixes));
+    std::vector<std::thread> listers;
+    listers.reserve(num_listers);
+    for (std::uint32_t i = 0; i < num_listers; ++i) {
+        listers.emplace_back(lister);
+    }
+    for (auto& t : listers) {
+        t.join();
+    }
+    rebuilding_ = false;
+}
+
+void KVCacheImpl::rebuild_segment(const std::string& s3_key, std::uint64_t object_size) {
+    // Segments name their blocks, parents included, in the offset table.
+    // The table comes from the bucket, so it is trusted no further than the
+    // object's listed size.
+    const std::string prefix = s3_key_prefix() + "s/";
+    PrefixKey segment;
+    if (s3_key.size() != prefix.size() + segment.size() * 2 + 4 ||
+        !FromHex(s3_key.substr(prefix.size(), segment.size() * 2), &segment) ||
+        s3_key.compare(s3_key.size() - 4, 4, ".kvs") != 0) {
+        return;
+    }
+
+    std::vector<std::uint8_t> table(sizeof(SegmentHeader));
+    std::uint64_t n = 0;
+    SegmentHeader header;
+    if (object_size < table.size() || !store_->GetObjectRange(s3_key, 0, table, &n) || n != table.size() ||
+        !ReadSegmentHeader(table, &header) ||
+        header.count > (object_size - sizeof(SegmentHeader)) / sizeof(SegmentEntry)) {
+        return;
+    }
+    table.resize(SegmentTableBytes(header.count));
+    std::vector<SegmentEntry> entries;
+    if (!store_->GetObjectRange(s3_key, 0, table, &n) || n != table.size() ||
+        !ReadSegmentTable(table, &entries)) {
+        return;
+    }
+
+    std::uint64_t payload = 0;
+    for (const auto& entry : entries) {
+        if (entry.offset < table.size() || entry.offset > object_size || entry.length > object_size - entry.offset) {
+            return; // Corrupt table; index none of it
+        }
+        payload += entry.length;
+    }
+    bool referenced = false;
+    for (const auto& entry : entries) {
+        BlockInfo info{entry.size, entry.index, entry.has_parent != 0, entry.parent, false, {},
+                       entry.length, static_cast<Codec>(entry.codec), true, segment, entry.offset};
+        info.tenant = known_tenant(entry.tenant);
+        // Take the reference first so an eviction racing the insert finds it
+        index_.AcquireSegment(segment, entry.key, info.stored_size, payload);
+        if (!index_.InsertCold(entry.key, info)) {
+            index_.ReleaseSegment(segment, info.stored_size);
+            continue; // Already known from another object
+        }
+        referenced = true;
+        used_bytes_.fetch_add(info.stored_size, std::memory_order_relaxed);
+        tenant_used_[info.tenant].fetch_add(info.stored_size, std::memory_order_relaxed);
+        if (snapshot_) {
+            snapshot_->AppendStore(make_record(entry.key, info, payload));
         }
     }
+    if (!referenced) {
+        // Every block lives elsewhere, or the segment is still being indexed
+        // by its writer; the GC owner reaps it if that stays true
+        std::lock_guard<std::mutex> lock(orphan_mutex_);
+        orphan_segments_.emplace_back(segment, std::chrono::steady_clock::now());
+    } else if (over_high_watermark()) {
+        cv_gc_.notify_one();
+    }
+}
+
+void KVCacheImpl::write_snapshot() {
+    if (!snapshot_) {
+        return;
+    }
+    snapshot_->Write([this] {
+        std::vector<IndexRecord> records;
+        records.reserve(index_.Size());
+        std::lock_guard<std::mutex> lock(write_back_mutex_);
+        index_.ForEach([&](const PrefixKey& key, const BlockInfo& info) {
+            if (write_backs_pending_.count(key) == 0) {
+                records.push_back(make_record(key, info));
+            }
+        });
+        // Outside ForEach, which holds a shard lock
+        for (auto& record : records) {
+            if (record.segment != PrefixKey{}) {
+                record.segment_bytes = index_.SegmentPayloadBytes(record.segment);
+            }
+        }
+        return records;
+    });
+}
 
-    return {0, {}};
+bool KVCacheImpl::unindex(const PrefixKey& key, const BlockInfo& info) {
+    // The block has already left the index; release its accounting
+    drop_local(key);
+    if (snapshot_) {
+        snapshot_->AppendEvict(key, info.index);
+    }
+    if (cluster_) {
+        cluster_->PublishEvict(key, info.index);
+    }
+    return release_block(info);
 }
 
-bool KVCacheImpl::Load(const BlockRef& ref, std::vector<std::uint8_t>* out_bytes) {
-    if (!s3_client_->GetObject(ref.s3_key, out_bytes)) {
+bool KVCacheImpl::release_block(const BlockInfo& info) {
+    // A shared content object keeps its bytes until its last reference goes.
+    // Packed blocks are charged one by one; dead space left in a segment is
+    // reclaimed by compaction. Returns true if the object is no longer
+    // referenced.
+    tenant_used_[info.tenant].fetch_sub(info.stored_size, std::memory_order_relaxed);
+    if (info.has_segment) {
+        used_bytes_.fetch_sub(info.stored_size, std::memory_order_relaxed);
+        if (index_.ReleaseSegment(info.segment, info.stored_size)) {
+            return true;
+        }
+        segments_released_.store(true, std::memory_order_relaxed);
         return false;
     }
-
-    std::lock_guard<std::mutex> lock(mutex_);
-    touch_lru(ref.s3_key);
+    if (info.has_content && !index_.ReleaseContent(info.content)) {
+        return false;
+    }
+    used_bytes_.fetch_sub(info.stored_size, std::memory_order_relaxed);
     return true;
 }
 
-bool KVCacheImpl::Store(const std::vector<std::uint32_t>& tokens,
-                        std::uint32_t block_index,
-                        bytes_view block_bytes) {
-    const std::uint32_t B = config_.block_size_tokens;
-    std::uint32_t prefix_token_count = (block_index + 1) * B;
+void KVCacheImpl::account_store(const PrefixKey& key, const BlockInfo& info, BlockList* stale_objects) {
+    // A shared payload was charged when the caller acquired its content
+    std::optional<BlockInfo> previous;
+    index_.Upsert(key, info, &previous);
+    if (!info.has_content) {
+        used_bytes_.fetch_add(info.stored_size, std::memory_order_relaxed);
+    }
+    tenant_used_[info.tenant].fetch_add(info.stored_size, std::memory_order_relaxed);
+    if (!previous) {
+        return;
+    }
 
-    if (tokens.size() < prefix_token_count) {
+    if (info.has_content && previous->has_content && previous->content == info.content) {
+        // The replaced entry's reference carries over to the new one
+        index_.ReleaseContent(info.content);
+        tenant_used_[previous->tenant].fetch_sub(previous->stored_size, std::memory_order_relaxed);
+        return;
+    }
+    if (release_block(*previous) && stale_objects && object_key(key, *previous) != object_key(key, info)) {
+        stale_objects->emplace_back(key, *previous);
+    }
+}
+
+bool KVCacheImpl::acquire_content(const BlockInfo& info) {
+    // A shared payload is charged once, from when its first reference is
+    // taken until its last is released, whichever reference gets indexed.
+    // Returns true for the first reference.
+    if (!index_.AcquireContent(info.content)) {
         return false;
     }
+    used_bytes_.fetch_add(info.stored_size, std::memory_order_relaxed);
+    return true;
+}
 
-    std::vector<std::uint32_t> prefix_tokens(tokens.begin(), tokens.begin() + prefix_token_count);
-    PrefixKey pkey = MakePrefixKey(prefix_tokens, B, config_.model_id);
-    std::string pkey_hex = ToHex(pkey);
+bool KVCacheImpl::release_content(const BlockInfo& info) {
+    // Drops a reference that was never indexed. Returns true for the last.
+    if (!index_.ReleaseContent(info.content)) {
+        return false;
+    }
+    used_bytes_.fetch_sub(info.stored_size, std::memory_order_relaxed);
+    return true;
+}
 
-    std::string s3_key = make_s3_key(pkey_hex, block_index);
+bool KVCacheImpl::object_referenced(const PrefixKey& key, const BlockInfo& info) const {
+    // Whether any indexed block still reads the object 'info' names
+    if (info.has_segment) {
+        return index_.SegmentPayloadBytes(info.segment) > 0;
+    }
+    if (info.has_content) {
+        return index_.HasContent(info.content);
+    }
+    BlockInfo current;
+    return index_.Find(key, &current) && object_key(key, current) == object_key(key, info);
+}
 
-    if (!s3_client_->PutObject(s3_key, block_bytes)) {
-        return false;
+void KVCacheImpl::delete_blocks(BlockList blocks) {
+    // Deletes the objects of blocks that have left the index, on delete_io_.
+    // Whether each one is still needed is decided when the delete runs.
+    if (blocks.empty()) {
+        return;
     }
+    delete_io_->Submit([this, blocks = std::move(blocks)]() mutable { run_deletes(std::move(blocks)); });
+}
 
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    // Update or insert metadata
-    auto meta_it = block_metadata_.find(s3_key);
-    if (meta_it == block_metadata_.end()) {
-        lru_list_.push_front(s3_key);
-        block_metadata_[s3_key] = {block_bytes.size(), lru_list_.begin()};
-        used_bytes_ += block_bytes.size();
-    } else {
-        used_bytes_ -= meta_it->second.size;
-        used_bytes_ += block_bytes.size();
-        meta_it->second.size = block_bytes.size();
-        touch_lru(s3_key);
+void KVCacheImpl::run_deletes(BlockList blocks) {
+    // Runs on delete_io_. Blocks a repair unindexes are deleted by this same
+    // task rather than submitted again: Submit blocks while the pool is full,
+    // and a worker waiting on its own pool may never see room.
+    while (!blocks.empty()) {
+        std::vector<std::string> keys;
+        std::vector<std::size_t> deleted;
+        {
+            std::lock_guard<std::mutex> lock(object_mutex_);
+            for (std::size_t i = 0; i < blocks.size(); ++i) {
+                const auto& [key, info] = blocks[i];
+                std::string s3_key = object_key(key, info);
+                if (puts_in_flight_.count(s3_key) == 0 && !object_referenced(key, info) &&
+                    deletes_in_flight_.insert(s3_key).second) {
+                    keys.push_back(std::move(s3_key));
+                    deleted.push_back(i);
+                }
+            }
+        }
+        for (std::size_t i = 0; i < keys.size(); i += 1000) {
+            std::vector<std::string> batch(keys.begin() + i, keys.begin() + std::min(keys.size(), i + 1000));
+            store_->DeleteObjects(batch);
+        }
+        {
+            std::lock_guard<std::mutex> lock(object_mutex_);
+            for (const auto& s3_key : keys) {
+                deletes_in_flight_.erase(s3_key);
+            }
+        }
+        object_cv_.notify_all();
+
+        // Other nodes are not fenced: one may have stored the same key, or
+        // indexed another reference to the payload, before hearing of the
+        // eviction. Each node checks its own index once it hears of the
+        // delete, this one included, since it may have applied such a
+        // store after the check above.
+        BlockList orphaned;
+        if (cluster_) {
+            for (std::size_t i : deleted) {
+                const auto& [key, info] = blocks[i];
+                cluster_->PublishDeleted(make_record(key, info));
+                repair_deleted(key, info, &orphaned);
+            }
+        }
+        blocks = std::move(orphaned);
     }
+}
+
+void KVCacheImpl::run_repairs(const BlockList& deleted) {
+    // Runs on delete_io_, like run_deletes
+    BlockList orphaned;
+    for (const auto& [key, info] : deleted) {
+        repair_deleted(key, info, &orphaned);
+    }
+    run_deletes(std::move(orphaned));
+}
 
-    // Update HWM if this block extends it
-    auto hwm_it = prefix_hwm_.find(pkey_hex);
-    if (hwm_it == prefix_hwm_.end()) {
-        if (block_index == 0) {
-            prefix_hwm_[pkey_hex] = 0;
+void KVCacheImpl::repair_deleted(const PrefixKey& key, const BlockInfo& info, BlockList* orphaned) {
+    // The object 'info' names was deleted. Blocks indexed against it by a
+    // store that raced the delete would fail every load, so they are
+    // unindexed, unless the object was written again after the delete.
+    // While a PUT of the object is in flight the answer is not known yet;
+    // the check is left to end_put, so no delete worker waits on it.
+    const std::string s3_key = object_key(key, info);
+    {
+        std::lock_guard<std::mutex> lock(object_mutex_);
+        if (puts_in_flight_.count(s3_key) > 0) {
+            repairs_pending_[s3_key].emplace_back(key, info);
+            return;
         }
+    }
+    if (!object_referenced(key, info)) {
+        return;
+    }
+    std::uint8_t probe = 0;
+    std::uint64_t n = 0;
+    if (store_->GetObjectRange(s3_key, 0, mutable_bytes_view(&probe, 1), &n) && n == 1) {
+        return;
+    }
+
+    std::vector<PrefixKey> readers;
+    if (!info.has_segment && !info.has_content) {
+        readers.push_back(key);
     } else {
-        if (block_index == hwm_it->second + 1) {
-            hwm_it->second = block_index;
+        index_.ForEach([&](const PrefixKey& k, const BlockInfo& i) {
+            if (info.has_segment ? i.has_segment && i.segment == info.segment
+                                 : i.has_content && i.content == info.content) {
+                readers.push_back(k);
+            }
+        });
+    }
+    for (const auto& reader : readers) {
+        index_.RemoveSubtree(reader, [&](const PrefixKey& k, const BlockInfo& removed_info) {
+            if (unindex(k, removed_info) && object_key(k, removed_info) != s3_key) {
+                orphaned->emplace_back(k, removed_info);
+            }
+        });
+    }
+}
+
+KVCacheImpl::BlockList::value_type KVCacheImpl::segment_object(const PrefixKey& segment) {
+    // A BlockList entry naming a whole segment object
+    BlockInfo info;
+    info.has_segment = true;
+    info.segment = segment;
+    return {PrefixKey{}, info};
+}
+
+bool KVCacheImpl::begin_store(const std::string& s3_key, const BlockInfo& info) {
+    // Takes the content reference of a deduplicated block and decides
+    // whether this store uploads the object, fencing it if so. The first
+    // reference to a payload uploads it, and so does any reference taken
+    // while an earlier upload of it is still in flight: that one may fail,
+    // and a block must not be indexed against an object that never made it.
+    std::unique_lock<std::mutex> lock(object_mutex_);
+    object_cv_.wait(lock, [&] { return deletes_in_flight_.count(s3_key) == 0; });
+    const bool first_ref = info.has_content && acquire_content(info);
+    const bool upload = !info.has_content || first_ref || puts_in_flight_.count(s3_key) > 0;
+    if (upload) {
+        ++puts_in_flight_[s3_key];
+    }
+    return upload;
+}
+
+void KVCacheImpl::end_put(const std::string& s3_key) {
+    BlockList repairs;
+    {
+        std::lock_guard<std::mutex> lock(object_mutex_);
+        auto it = puts_in_flight_.find(s3_key);
+        if (--it->second == 0) {
+            puts_in_flight_.erase(it);
+            auto pending = repairs_pending_.find(s3_key);
+            if (pending != repairs_pending_.end()) {
+                repairs = std::move(pending->second);
+                repairs_pending_.erase(pending);
+            }
         }
     }
-    
-    // Signal GC if over capacity
-    if (used_bytes_ > capacity_bytes_) {
-        cv_gc_.notify_one();
+    if (!repairs.empty()) {
+        delete_io_->Submit([this, repairs = std::move(repairs)] { run_repairs(repairs); });
     }
+}
 
-    return true;
+bool KVCacheImpl::over_high_watermark() const {
+    double high = static_cast<double>(capacity_bytes_.load(std::memory_order_relaxed)) * config_.gc_high_watermark;
+    if (static_cast<double>(used_bytes_.load(std::memory_order_relaxed)) > high) {
+        return true;
+    }
+    for (std::uint32_t t = 0; t < config_.tenants.size() && t < num_tenants(); ++t) {
+        if (tenant_over_high(static_cast<TenantId>(t))) {
+            return true;
+        }
+    }
+    return false;
 }
 
-std::uint64_t KVCacheImpl::UsedBytes() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return used_bytes_;
+std::uint64_t KVCacheImpl::tenant_quota(TenantId tenant) const {
+    return tenant < config_.tenants.size() ? config_.tenants[tenant].capacity_bytes : 0;
 }
 
-std::uint64_t KVCacheImpl::CapacityBytes() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return capacity_bytes_;
+bool KVCacheImpl::tenant_over_high(TenantId tenant) const {
+    const std::uint64_t quota = tenant_quota(tenant);
+    return quota > 0 && static_cast<double>(tenant_used(tenant)) > static_cast<double>(quota) * config_.gc_high_watermark;
 }
 
-void KVCacheImpl::SetCapacityBytes(std::uint64_t cap) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    capacity_bytes_ = cap;
-    if (used_bytes_ > capacity_bytes_) {
-        cv_gc_.notify_one();
+std::uint64_t KVCacheImpl::low_watermark_bytes() const {
+    double low = static_cast<double>(capacity_bytes_.load(std::memory_order_relaxed)) *
+                 std::min(config_.gc_low_watermark, config_.gc_high_watermark);
+    return static_cast<std::uint64_t>(low);
+}
+
+void KVCacheImpl::GcThreadLoop() {
+    auto next_snapshot = std::chrono::steady_clock::now() + std::chrono::seconds(config_.snapshot_interval_seconds);
+    // Set when a pass freed nothing, e.g. a tenant over quota whose blocks
+    // all have other tenants' children; it is retried once a second rather
+    // than on every store
+    bool stalled = false;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(gc_mutex_);
+            cv_gc_.wait_for(lock, std::chrono::seconds(1), [this, stalled] {
+                return stop_gc_ || (!stalled && over_high_watermark() && gc_owner());
+            });
+
+            if (stop_gc_) {
+                break;
+            }
+        }
+
+        // In a cluster, only the leader evicts and compacts the shared
+        // bucket; the others follow its events
+        if (gc_owner()) {
+            stalled = over_high_watermark() && evict_batch() == 0;
+            if (segments_released_.exchange(false, std::memory_order_relaxed)) {
+                compact_segments();
+            }
+            reap_orphan_segments();
+        }
+
+        if (snapshot_ && std::chrono::steady_clock::now() >= next_snapshot) {
+            write_snapshot();
+            next_snapshot = std::chrono::steady_clock::now() + std::chrono::seconds(config_.snapshot_interval_seconds);
+        }
     }
 }
 
+std::size_t KVCacheImpl::evict_batch() {
+    // Pick victims down to the low watermark. Each one is unindexed and its
+    // bytes released immediately, one shard lock at a time, so writers see
+    // the space before any delete has gone out.
+    const std::uint64_t target = low_watermark_bytes();
+    const double capacity = static_cast<double>(capacity_bytes_.load(std::memory_order_relaxed));
+    const bool global_over = static_cast<double>(used_bytes_.load(std::memory_order_relaxed)) >
+                             capacity * config_.gc_high_watermark;
+    const std::size_t batch_size = std::clamp<std::uint32_t>(config_.gc_delete_batch, 1, 1000);
+    BlockList batch;
+    std::size_t evicted = 0;
 
-// --- KVCache Public API (forwarding to PIMPL) ---
+    auto flush = [&] {
+        delete_blocks(std::move(batch));
+        batch = {};
+    };
 
-KVCache::KVCache(const Config& cfg) : p_impl(std::make_unique<KVCacheImpl>(cfg)) {}
-KVCache::~KVCache() = default;
-LookupResult KVCache::Lookup(const std::vector<std::uint32_t>& tokens) const { return p_impl->Lookup(tokens); }
-bool KVCache::Load(const BlockRef& ref, std::vector<std::uint8_t>* out_bytes) { return p_impl->Load(ref, out_bytes); }
-bool KVCache::Store(const std::vector<std::uint32_t>& tokens, std::uint32_t block_index, bytes_view block_bytes) {
-    return p_impl->Store(tokens, block_index, block_bytes);
+    auto evict_one = [&](TenantId tenant) {
+        PrefixKey key;
+        BlockInfo info;
+        if (!index_.EvictOne(&key, &info, tenant)) {
+            return false;
+        }
+        // Victims are always leaves, so no resident block loses its prefix
+        ++evicted;
+        metrics_.Add(Counter::EvictedBytes, info.stored_size);
+        if (unindex(key, info)) {
+            batch.emplace_back(key, info);
+            if (batch.size() >= batch_size) {
+                flush();
+            }
+        } // Otherwise the content is still shared by another block
+        return true;
+    };
+
+    // A tenant past its quota gives up its own blocks only, so it cannot
+    // push out another tenant's prefixes
+    const std::uint32_t tenants = num_tenants();
+    const double low = std::min(config_.gc_low_watermark, config_.gc_high_watermark);
+    for (std::uint32_t t = 0; t < tenants; ++t) {
+        const auto tenant = static_cast<TenantId>(t);
+        if (!tenant_over_high(tenant)) {
+            continue;
+        }
+        const auto tenant_target = static_cast<std::uint64_t>(static_cast<double>(tenant_quota(tenant)) * low);
+        while (tenant_used(tenant) > tenant_target && evict_one(tenant)) {
+        }
+    }
+
+    // Past the global watermark, each victim comes from the tenant using
+    // the most of its share: its quota, or the whole capacity without one
+    std::vector<std::uint8_t> exhausted(tenants, 0);
+    while (global_over && used_bytes_.load(std::memory_order_relaxed) > target) {
+        std::uint32_t pick = tenants;
+        double worst = -1.0;
+        for (std::uint32_t t = 0; t < tenants; ++t) {
+            const std::uint64_t quota = tenant_quota(static_cast<TenantId>(t));
+            const double share = std::max(quota > 0 ? static_cast<double>(quota) : capacity, 1.0);
+            const double ratio = static_cast<double>(tenant_used(static_cast<TenantId>(t))) / share;
+            if (!exhausted[t] && ratio > worst) {
+                pick = t;
+                worst = ratio;
+            }
+        }
+        if (pick == tenants) {
+            break;
+        }
+        if (!evict_one(static_cast<TenantId>(pick))) {
+            exhausted[pick] = 1;
+        }
+    }
+    flush();
+    metrics_.Add(Counter::GcPasses);
+    metrics_.Add(Counter::Evictions, evicted);
+    return evicted;
+}
+
+void KVCacheImpl::compact_segments() {
+    // Bounded per pass so eviction is never held up for long; whatever is
+    // left is picked up on the next wakeup
+    static constexpr std::size_t kSegmentsPerPass = 16;
+    std::vector<SegmentUsage> sparse = index_.SparseSegments(config_.segment_compact_ratio, kSegmentsPerPass);
+    for (const auto& usage : sparse) {
+        compact_segment(usage);
+    }
+    if (sparse.size() == kSegmentsPerPass) {
+        segments_released_.store(true, std::memory_order_relaxed);
+    }
+}
+
+void KVCacheImpl::reap_orphan_segments() {
+    // A writer PUTs a segment before indexing its blocks, locally or via a
+    // remote Store event, so the grace period covers a follower that is
+    // lagging but not yet declared dead
+    const auto grace = std::max(std::chrono::milliseconds(30000),
+                                std::chrono::milliseconds(cluster_ ? 3ull * config_.cluster_node_timeout_ms : 0));
+    const auto now = std::chrono::steady_clock::now();
+    BlockList due;
+    {
+        std::lock_guard<std::mutex> lock(orphan_mutex_);
+        auto keep = std::remove_if(orphan_segments_.begin(), orphan_segments_.end(), [&](const auto& orphan) {
+            if (now - orphan.second < grace) {
+                return false;
+            }
+            due.push_back(segment_object(orphan.first));
+            return true;
+        });
+        orphan_segments_.erase(keep, orphan_segments_.end());
+    }
+
+    delete_blocks(std::move(due)); // Skips those indexed since
+}
+
+void KVCacheImpl::compact_segment(const SegmentUsage& usage) {
+    // Copies the blocks still indexed in the segment into a new one and
+    // repoints them. The old object goes once its last block has moved.
+    std::vector<std::pair<PrefixKey, BlockInfo>> live;
+    for (const auto& key : usage.members) {
+        BlockInfo info;
+        if (index_.Find(key, &info) && info.has_segment && info.segment == usage.segment &&
+            std::none_of(live.begin(), live.end(), [&](const auto& block) { return block.first == key; })) {
+            live.emplace_back(key, info);
+        }
+    }
+    if (live.empty()) {
+        return;
+    }
+
+    const std::string old_key = segment_key(usage.segment);
+    std::vector<std::uint8_t> old_object;
+    if (!store_->GetObject(old_key, &old_object)) {
+        return;
+    }
+    std::vector<SegmentEntry> entries(live.size());
+    std::vector<bytes_view> objects(live.size());
+    for (std::size_t i = 0; i < live.size(); ++i) {
+        const auto& [key, info] = live[i];
+        if (info.offset + info.stored_size > old_object.size()) {
+            return;
+        }
+        objects[i] = bytes_view(old_object.data() + info.offset, info.stored_size);
+        entries[i] = SegmentEntry{};
+        entries[i].key = key;
+        entries[i].parent = info.has_parent ? info.parent : PrefixKey{};
+        entries[i].size = info.size;
+        entries[i].index = info.index;
+        entries[i].codec = static_cast<std::uint8_t>(info.codec);
+        entries[i].has_parent = info.has_parent ? 1 : 0;
+        entries[i].tenant = info.tenant;
+    }
+
+    const PrefixKey segment = new_segment_id(live.back().first);
+    const std::string new_key = segment_key(segment);
+    std::vector<std::uint8_t> object;
+    BuildSegment(&entries, objects, &object);
+    if (!store_->PutObject(new_key, object)) {
+        return;
+    }
+
+    // References on the new segment come first, so a block evicted right
+    // after it moves releases the right one
+    std::uint64_t payload = 0;
+    for (const auto& entry : entries) {
+        payload += entry.length;
+    }
+    for (std::size_t i = 0; i < live.size(); ++i) {
+        index_.AcquireSegment(segment, live[i].first, live[i].second.stored_size, payload);
+    }
+
+    BlockList dead;
+    for (std::size_t i = 0; i < live.size(); ++i) {
+        const auto& [key, info] = live[i];
+        BlockInfo moved;
+        const bool relocated = index_.Relocate(key, usage.segment, segment, entries[i].offset, &moved);
+        if (relocated && snapshot_) {
+            snapshot_->AppendStore(make_record(key, moved, payload));
+        }
+        if (relocated && cluster_) {
+            cluster_->PublishStore(make_record(key, moved, payload));
+        }
+        const PrefixKey& released = relocated ? usage.segment : segment;
+        if (index_.ReleaseSegment(released, info.stored_size)) {
+            dead.push_back(segment_object(released));
+        }
+    }
+    delete_blocks(std::move(dead));
+}
+
+std::string KVCacheImpl::make_s3_key(const PrefixKey& key, std::uint32_t block_index) const {
+    return s3_key_prefix() + ToHex(key) + "/" + std::to_string(block_index) + ".kv";
+}
+
+std::string KVCacheImpl::object_key(const PrefixKey& key, const BlockInfo& info) const {
+    // Deduplicated payloads live under <model_id>/b<B>/c/<32 hex>.kv, which
+    // parse_s3_key rejects, so an S3 rebuild does not pick them up. Encoded
+    // objects carry a BlockHeader and end in .kvz instead.
+    if (info.has_segment) {
+        return segment_key(info.segment);
+    }
+    std::string s3_key = info.has_content ? s3_key_prefix() + "c/" + ToHex(info.content) + ".kv"
+                                          : make_s3_key(key, info.index);
+    if (info.codec != Codec::None) {
+        s3_key += 'z';
+    }
+    return s3_key;
+}
+
+std::string KVCacheImpl::segment_key(const PrefixKey& segment) const {
+    return s3_key_prefix() + "s/" + ToHex(segment) + ".kvs";
+}
+
+LookupResult KVCacheImpl::Lookup(const std::vector<std::uint32_t>& tokens) const {
+    ScopedOp op(metrics_, Op::Lookup);
+    const std::uint32_t B = config_.block_size_tokens;
+    const std::uint32_t num_blocks = static_cast<std::uint32_t>(tokens.size() / B);
+    metrics_.Add(Counter::Lookups);
+    metrics_.Add(Counter::LookupTokens, tokens.size());
+
+    LookupResult result{0, {}};
+    if (num_blocks == 0) {
+        return result;
+    }
+
+    // Walk the prefix tree from the root. Each step hashes one more block
+    // into the running digest and takes a shared lock on one shard only, so
+    // nothing past the first miss is hashed or probed.
+    PrefixHasher hasher(B, config_.model_id);
+    PrefixKey parent;
+    BlockInfo info;
+    for (std::uint32_t j = 0; j < num_blocks; ++j) {
+        PrefixKey key = hasher.NextBlock(tokens.data() + static_cast<std::size_t>(j) * B);
+        if (!index_.Find(key, &info)) {
+            break;
+        }
+        if (j > 0 && info.has_parent && info.parent != parent) {
+            break; // Digest collision with another lineage
+        }
+        result.handles.push_back({key, info.size, j, info.stored_size, info.codec,
+                                  info.has_segment, info.segment, info.offset});
+        parent = key;
+    }
+    result.matched_tokens = static_cast<std::uint32_t>(result.handles.size()) * B;
+    if (!result.handles.empty()) {
+        metrics_.Add(Counter::LookupHits);
+        metrics_.Add(Counter::MatchedBlocks, result.handles.size());
+        metrics_.Add(Counter::MatchedTokens, result.matched_tokens);
+    }
+    return result;
+}
+
+PrefetchTicket KVCacheImpl::Prefetch(const LookupResult& result) {
+    if (!prefetcher_ || result.handles.empty()) {
+        return 0;
+    }
+    return prefetcher_->Submit(result.handles);
+}
+
+void KVCacheImpl::CancelPrefetch(PrefetchTicket ticket) {
+    if (prefetcher_) {
+        prefetcher_->Cancel(ticket);
+    }
+}
+
+void KVCacheImpl::prefetch_block(const BlockRef& ref) {
+    // A local hit needs no GET, and is found without copying the block. A
+    // disk hit is promoted by reading it straight into the buffer DRAM
+    // keeps. A Load that arrives mid-fetch joins it through load_flights_.
+    if (dram_) {
+        BlockBuffer data = dram_->Get(ref.key);
+        if (data && data->size() == ref.size) {
+            metrics_.Add(Counter::DramHits);
+            return;
+        }
+    }
+    if (ssd_ && ssd_->Contains(ref.key)) {
+        if (!dram_) {
+            metrics_.Add(Counter::SsdHits);
+            return;
+        }
+        std::shared_ptr<Buffer> data = buffers_->Allocate(ref.size);
+        std::uint64_t bytes_read = 0;
+        if (ssd_->Get(ref.key, *data, &bytes_read) && bytes_read == ref.size) {
+            metrics_.Add(Counter::SsdHits);
+            cache_local(ref.key, std::move(data));
+            return;
+        }
+    }
+    std::shared_ptr<Buffer> scratch = buffers_->Allocate(ref.size);
+    fetch_into(ref, *scratch);
+}
+
+bool KVCacheImpl::Load(const BlockRef& ref, std::vector<std::uint8_t>* out_bytes) {
+    out_bytes->resize(ref.size);
+    return load_into(ref, *out_bytes);
+}
+
+bool KVCacheImpl::Load(const BlockRef& ref, mutable_bytes_view dest) {
+    if (dest.size() < ref.size) {
+        return false;
+    }
+    return load_into(ref, dest.subview(0, ref.size));
+}
+
+BlockBuffer KVCacheImpl::LoadShared(const BlockRef& ref) {
+    ScopedOp op(metrics_, Op::Load);
+    // A DRAM hit hands out the tier's own buffer, with no copy
+    if (dram_) {
+        BlockBuffer data = dram_->Get(ref.key);
+        if (data && data->size() == ref.size) {
+            touch(ref.key);
+            metrics_.Add(Counter::DramHits);
+            count_load(op, true, ref.size);
+            return data;
+        }
+    }
+    std::shared_ptr<Buffer> buffer = buffers_->Allocate(ref.size);
+    if (!count_load(op, load_block(ref, *buffer), ref.size)) {
+        return nullptr;
+    }
+    return buffer;
+}
+
+bool KVCacheImpl::LoadStreaming(const BlockRef& ref, mutable_bytes_view dest, const BlockLayout& layout,
+                                const ChunkCallback& on_chunk) {
+    ScopedOp op(metrics_, Op::Load);
+    return count_load(op, load_streaming(ref, dest, layout, on_chunk), ref.size);
+}
+
+bool KVCacheImpl::load_streaming(const BlockRef& ref, mutable_bytes_view dest, const BlockLayout& layout,
+                                 const ChunkCallback& on_chunk) {
+    if (dest.size() < ref.size) {
+        return false;
+    }
+    dest = dest.subview(0, ref.size);
+
+    // Slice i ends at ends[i]
+    std::vector<std::uint64_t> ends;
+    if (!layout.slice_bytes.empty()) {
+        std::uint64_t end = 0;
+        for (std::uint64_t bytes : layout.slice_bytes) {
+            ends.push_back(end += bytes);
+        }
+        if (end != ref.size) {
+            return false;
+        }
+    } else {
+        const std::uint64_t chunk = std::max<std::uint64_t>(layout.chunk_bytes, 1);
+        for (std::uint64_t end = 0; end < ref.size;) {
+            ends.push_back(end = std::min(end + chunk, ref.size));
+        }
+    }
+
+    // Hands over every slice that is complete once 'received' bytes are in
+    std::size_t next = 0;
+    std::uint64_t begin = 0;
+    bool aborted = false;
+    auto deliver = [&](std::uint64_t received) {
+        for (; next < ends.size() && ends[next] <= received; ++next) {
+            if (!on_chunk(begin, dest.subview(begin, ends[next] - begin))) {
+                aborted = true;
+                return false;
+            }
+            begin = ends[next];
+        }
+        return true;
+    };
+
+    if (read_local(ref.key, dest)) {
+        touch(ref.key);
+        return deliver(ref.size);
+    }
+
+    BlockInfo info;
+    if (!index_.Find(ref.key, &info)) {
+        return false;
+    }
+    if (info.codec != Codec::None) {
+        // Nothing is usable before the whole object is decoded
+        return load_block(ref, dest) && deliver(ref.size);
+    }
+
+    // Joins the other loads of the block and asks its ring owner first, as
+    // fetch_into does; only an S3 GET streams. One that fails before any
+    // slice was handed over, e.g. on a retry, is redone as a plain GET.
+    bool fetched = false;
+    bool shared = false;
+    bool from_peer = false;
+    BlockBuffer data = load_flights_.Do(ref.key, [&](auto& close) -> BlockBuffer {
+        from_peer = fetch_from_peer(ref.key, dest);
+        fetched = from_peer;
+        if (!fetched) {
+            const std::string s3_key = object_key(ref.key, info);
+            std::uint64_t bytes_read = 0;
+            fetched = store_->GetObjectStreaming(s3_key, info.has_segment, info.offset, dest, deliver, &bytes_read) &&
+                      bytes_read == dest.size() && next == ends.size();
+            if (!fetched && !aborted && next == 0) {
+                fetched = get_object(s3_key, info, dest);
+            }
+        }
+        const std::size_t waiters = close();
+        if (!fetched || (waiters == 0 && !dram_ && !ssd_)) {
+            return nullptr;
+        }
+        return buffers_->Copy(dest);
+    }, &shared);
+
+    metrics_.Add(shared ? Counter::CoalescedLoads : from_peer ? Counter::PeerLoads : Counter::S3Loads);
+    if (shared) {
+        if (!data || data->size() != dest.size()) {
+            return false;
+        }
+        std::memcpy(dest.data(), data->data(), data->size());
+    } else if (!fetched) {
+        return false;
+    } else if (data && (dram_ || ssd_)) {
+        cache_local(ref.key, std::move(data));
+    }
+    touch(ref.key);
+    return deliver(ref.size); // Whatever did not stream
+}
+
+bool KVCacheImpl::load_into(const BlockRef& ref, mutable_bytes_view dest) {
+    ScopedOp op(metrics_, Op::Load);
+    return count_load(op, load_block(ref, dest), dest.size());
+}
+
+bool KVCacheImpl::count_load(ScopedOp& op, bool ok, std::uint64_t bytes) const {
+    op.SetOk(ok);
+    if (!ok) {
+        metrics_.Add(Counter::LoadFailures);
+        return false;
+    }
+    op.SetBytes(bytes);
+    metrics_.Add(Counter::Loads);
+    metrics_.Add(Counter::LoadedBytes, bytes);
+    return true;
+}
+
+bool KVCacheImpl::load_block(const BlockRef& ref, mutable_bytes_view dest) {
+    if (!read_local(ref.key, dest) && !fetch_into(ref, dest)) {
+        return false;
+    }
+
+    touch(ref.key);
+    return true;
+}
+
+bool KVCacheImpl::fetch_into(const BlockRef& ref, mutable_bytes_view dest, bool ask_peers) {
+    // The leader GETs straight into its own buffer. A copy is only made if
+    // other loads joined the flight or a local tier wants the block. In a
+    // cluster it first asks the block's ring owner, which serves it from
+    // its tiers or fetches it through once for everyone.
+    bool fetched = false;
+    bool shared = false;
+    bool from_peer = false;
+    BlockBuffer data = load_flights_.Do(ref.key, [&](auto& close) -> BlockBuffer {
+        from_peer = ask_peers && fetch_from_peer(ref.key, dest);
+        if (from_peer) {
+            fetched = true;
+            const std::size_t waiters = close();
+            if (waiters == 0 && !dram_ && !ssd_) {
+                return nullptr;
+            }
+            return buffers_->Copy(dest);
+        }
+
+        // The handle does not say whether the block was deduplicated
+        BlockInfo info;
+        std::string s3_key = index_.Find(ref.key, &info) ? object_key(ref.key, info)
+                                                         : make_s3_key(ref.key, ref.index);
+        if (info.codec == Codec::None) {
+            fetched = get_object(s3_key, info, dest);
+        } else {
+            // Decoding needs the whole object first
+            std::shared_ptr<Buffer> object = buffers_->Allocate(info.stored_size);
+            fetched = get_object(s3_key, info, *object) && DecodeBlock(*object, dest);
+        }
+        const std::size_t waiters = close();
+        if (!fetched || (waiters == 0 && !dram_ && !ssd_)) {
+            return nullptr;
+        }
+        return buffers_->Copy(dest);
+    }, &shared);
+
+    metrics_.Add(shared ? Counter::CoalescedLoads : from_peer ? Counter::PeerLoads : Counter::S3Loads);
+    if (shared) {
+        if (!data || data->size() != dest.size()) {
+            return false;
+        }
+        std::memcpy(dest.data(), data->data(), data->size());
+        return true;
+    }
+    if (fetched && data && (dram_ || ssd_)) {
+        cache_local(ref.key, std::move(data));
+    }
+    return fetched;
+}
+
+bool KVCacheImpl::get_object(const std::string& s3_key, const BlockInfo& info, mutable_bytes_view buffer) {
+    // A packed block is one ranged GET out of its segment
+    std::uint64_t bytes_read = 0;
+    bool ok = info.has_segment ? store_->GetObjectRange(s3_key, info.offset, buffer, &bytes_read)
+                               : store_->GetObject(s3_key, buffer, &bytes_read);
+    return ok && bytes_read == buffer.size();
+}
+
+bool KVCacheImpl::fetch_from_peer(const PrefixKey& key, mutable_bytes_view dest) {
+    if (!cluster_ || !peers_ || !config_.cluster_peer_fetch) {
+        return false;
+    }
+    const std::string address = cluster_->PeerFor(key);
+    if (address.empty()) {
+        return false; // This node owns it, or no peer serves
+    }
+    if (!peers_->Fetch(address, key, dest)) {
+        metrics_.Add(Counter::PeerLoadFailures);
+        return false;
+    }
+    return true;
+}
+
+bool KVCacheImpl::ServePeer(const PrefixKey& key, mutable_bytes_view dest) {
+    // Fetches through with ask_peers off, so a request never bounces
+    // between nodes whose rings disagree
+    BlockInfo info;
+    if (!index_.Find(key, &info) || info.size != dest.size()) {
+        return false;
+    }
+    const BlockRef ref{key, info.size, info.index, info.stored_size, info.codec,
+                       info.has_segment, info.segment, info.offset};
+    if (!read_local(key, dest) && !fetch_into(ref, dest, false)) {
+        return false;
+    }
+    touch(key);
+    metrics_.Add(Counter::PeerServed);
+    return true;
+}
+
+bool KVCacheImpl::read_local(const PrefixKey& key, mutable_bytes_view dest) {
+    if (dram_) {
+        BlockBuffer data = dram_->Get(key);
+        if (data && data->size() == dest.size()) {
+            std::memcpy(dest.data(), data->data(), data->size());
+            metrics_.Add(Counter::DramHits);
+            return true;
+        }
+    }
+
+    std::uint64_t bytes_read = 0;
+    if (ssd_ && ssd_->Get(key, dest, &bytes_read) && bytes_read == dest.size()) {
+        metrics_.Add(Counter::SsdHits);
+        if (dram_) {
+            // Promote so the next hit is served from memory
+            cache_local(key, buffers_->Copy(dest));
+        }
+        return true;
+    }
+    return false;
+}
+
+void KVCacheImpl::cache_local(const PrefixKey& key, BlockBuffer data) {
+    if (!dram_) {
+        if (ssd_) {
+            ssd_->Put(key, *data);
+        }
+        return;
+    }
+
+    // Blocks pushed out of DRAM are demoted to the SSD tier
+    auto evicted = dram_->Put(key, std::move(data));
+    if (ssd_) {
+        for (const auto& [victim, victim_data] : evicted) {
+            ssd_->Put(victim, *victim_data);
+        }
+    }
+}
+
+void KVCacheImpl::drop_local(const PrefixKey& key) {
+    if (dram_) {
+        dram_->Erase(key);
+    }
+    if (ssd_) {
+        ssd_->Erase(key);
+    }
+}
+
+LoadAllResult KVCacheImpl::LoadAll(const LookupResult& result, mutable_bytes_view dest, std::uint32_t max_parallel) {
+    ScopedOp load_all(metrics_, Op::LoadAll);
+    const std::uint32_t n = static_cast<std::uint32_t>(result.handles.size());
+    if (n == 0) {
+        return {};
+    }
+
+    // Block i starts right after block i-1 in 'dest'
+    std::vector<std::uint64_t> offsets(n + 1, 0);
+    for (std::uint32_t i = 0; i < n; ++i) {
+        offsets[i + 1] = offsets[i] + result.handles[i].size;
+    }
+    if (dest.size() < offsets[n]) {
+        return {};
+    }
+
+    // Raw blocks packed back to back in one segment land back to back in
+    // 'dest' too, so each such run is one ranged GET. Other blocks are runs
+    // of one.
+    std::vector<std::uint32_t> runs{0};
+    for (std::uint32_t i = 1; i < n; ++i) {
+        const BlockRef& prev = result.handles[i - 1];
+        const BlockRef& ref = result.handles[i];
+        const bool contiguous = prev.packed && ref.packed && prev.segment == ref.segment &&
+                                prev.codec == Codec::None && ref.codec == Codec::None &&
+                                ref.offset == prev.offset + prev.stored_size;
+        if (!contiguous) {
+            runs.push_back(i);
+        }
+    }
+    runs.push_back(n);
+    const auto num_runs = static_cast<std::uint32_t>(runs.size() - 1);
+
+    if (max_parallel == 0) {
+        max_parallel = config_.load_parallelism;
+    }
+    const std::uint32_t lanes = std::max<std::uint32_t>(1, std::min(max_parallel, num_runs));
+
+    // Each lane claims the next unloaded run until none are left. Once a
+    // block fails, blocks after it are skipped: they could not extend the
+    // contiguous prefix anyway.
+    std::atomic<std::uint32_t> next{0};
+    std::atomic<std::uint32_t> first_failure{n};
+    std::latch done(lanes);
+
+    // Lanes run on the I/O pool; their loads are spans under this LoadAll
+    const std::uint64_t parent_span = ScopedOp::CurrentSpan();
+    auto lane = [&] {
+        SpanParentScope parent(parent_span);
+        for (std::uint32_t r = next.fetch_add(1); r < num_runs; r = next.fetch_add(1)) {
+            const std::uint32_t first = runs[r];
+            const std::uint32_t last = runs[r + 1] - 1;
+            if (first > first_failure.load()) {
+                continue;
+            }
+            std::uint32_t loaded = 0;
+            if (first == last) {
+                mutable_bytes_view slot = dest.subview(offsets[first], result.handles[first].size);
+                loaded = load_into(result.handles[first], slot) ? 1 : 0;
+            } else {
+                ScopedOp op(metrics_, Op::Load);
+                load_run(result.handles, first, last, dest.subview(offsets[first], offsets[last + 1] - offsets[first]),
+                         &loaded);
+                const std::uint64_t bytes = offsets[first + loaded] - offsets[first];
+                op.SetBytes(bytes);
+                op.SetOk(first + loaded > last);
+                metrics_.Add(Counter::Loads, loaded);
+                metrics_.Add(Counter::LoadedBytes, bytes);
+                if (first + loaded <= last) {
+                    metrics_.Add(Counter::LoadFailures);
+                }
+            }
+            const std::uint32_t failed = first + loaded;
+            if (failed <= last) {
+                std::uint32_t prev = first_failure.load();
+                while (failed < prev && !first_failure.compare_exchange_weak(prev, failed)) {
+                }
+            }
+        }
+        done.count_down();
+    };
+
+    for (std::uint32_t l = 0; l < lanes; ++l) {
+        io_->Submit(lane);
+    }
+    done.wait();
+
+    LoadAllResult out;
+    out.loaded_blocks = first_failure.load();
+    out.loaded_tokens = out.loaded_blocks * config_.block_size_tokens;
+    out.loaded_bytes = offsets[out.loaded_blocks];
+    load_all.SetBytes(out.loaded_bytes);
+    load_all.SetOk(out.loaded_blocks == n);
+    return out;
+}
+
+bool KVCacheImpl::load_run(const std::vector<BlockRef>& handles, std::uint32_t first, std::uint32_t last,
+                           mutable_bytes_view dest, std::uint32_t* loaded) {
+    // Blocks first..last are raw and contiguous in one segment and in
+    // 'dest'. Leading local hits are copied; everything from the first miss
+    // on is one ranged GET straight into 'dest', since a request costs more
+    // than re-reading a few blocks. '*loaded' is the number of leading
+    // blocks written.
+    std::vector<std::uint64_t> offsets{0};
+    for (std::uint32_t i = first; i <= last; ++i) {
+        offsets.push_back(offsets.back() + handles[i].size);
+    }
+    auto slot = [&](std::uint32_t i) { return dest.subview(offsets[i - first], handles[i].size); };
+
+    *loaded = 0;
+    std::uint32_t i = first;
+    for (; i <= last && read_local(handles[i].key, slot(i)); ++i) {
+        touch(handles[i].key);
+        ++*loaded;
+    }
+    if (i > last) {
+        return true;
+    }
+
+    const BlockRef& head = handles[i];
+    mutable_bytes_view range = dest.subview(offsets[i - first], offsets.back() - offsets[i - first]);
+    std::uint64_t bytes_read = 0;
+    if (!store_->GetObjectRange(segment_key(head.segment), head.offset, range, &bytes_read) ||
+        bytes_read != range.size()) {
+        // The segment may have been compacted since the lookup; load
+        // through the index one block at a time
+        for (; i <= last; ++i) {
+            if (!load_block(handles[i], slot(i))) {
+                return false;
+            }
+            ++*loaded;
+        }
+        return true;
+    }
+    for (; i <= last; ++i) {
+        if (dram_ || ssd_) {
+            mutable_bytes_view block = slot(i);
+            cache_local(handles[i].key, buffers_->Copy(block));
+        }
+        touch(handles[i].key);
+        ++*loaded;
+    }
+    return true;
+}
+
+bool KVCacheImpl::Store(const std::vector<std::uint32_t>& tokens,
+                        std::uint32_t block_index,
+                        bytes_view block_bytes,
+                        TenantId tenant) {
+    const std::uint32_t B = config_.block_size_tokens;
+    std::uint64_t prefix_token_count = (static_cast<std::uint64_t>(block_index) + 1) * B;
+
+    if (tokens.size() < prefix_token_count || tenant >= num_tenants()) {
+        return false;
+    }
+
+    std::vector<PrefixKey> keys = MakeBlockPrefixKeys(tokens, B, config_.model_id, block_index + 1);
+    return store_block(keys[block_index], block_index, block_bytes,
+                       block_index > 0 ? &keys[block_index - 1] : nullptr, tenant, true);
+}
+
+std::uint32_t KVCacheImpl::admit_prefix(const std::vector<PrefixKey>& keys) {
+    // Returns how many leading blocks the doorkeeper admits. Resident blocks
+    // need no admission; every other key is offered, even past the first
+    // declined one, so the whole sequence is admitted when it comes back.
+    const auto n = static_cast<std::uint32_t>(keys.size());
+    std::uint32_t admitted = n;
+    for (std::uint32_t j = 0; j < n; ++j) {
+        if (!index_.Find(keys[j], nullptr) && !doorkeeper_->Admit(keys[j]) && admitted == n) {
+            admitted = j;
+        }
+    }
+    metrics_.Add(Counter::StoresNotAdmitted, n - admitted);
+    return admitted;
+}
+
+std::uint32_t KVCacheImpl::StoreSequence(const std::vector<std::uint32_t>& tokens,
+                                         const std::vector<bytes_view>& blocks,
+                                         TenantId tenant) {
+    ScopedOp op(metrics_, Op::StoreSequence);
+    const std::uint32_t B = config_.block_size_tokens;
+    if (blocks.empty() || tokens.size() < blocks.size() * static_cast<std::uint64_t>(B) ||
+        tenant >= num_tenants()) {
+        op.SetOk(false);
+        return 0;
+    }
+
+    std::uint64_t total = 0;
+    for (const auto& block : blocks) {
+        total += block.size();
+    }
+    op.SetBytes(total);
+    if (packing_enabled()) {
+        std::uint32_t stored = store_packed(tokens, blocks, tenant);
+        op.SetOk(stored == blocks.size());
+        return stored;
+    }
+
+    // Admission looks at every key before anything is stored; without it
+    // each boundary is hashed only as the loop reaches it
+    auto n = static_cast<std::uint32_t>(blocks.size());
+    std::vector<PrefixKey> keys;
+    if (doorkeeper_) {
+        keys = MakeBlockPrefixKeys(tokens, B, config_.model_id, n);
+        n = admit_prefix(keys);
+    }
+
+    PrefixHasher hasher(B, config_.model_id);
+    PrefixKey parent;
+    std::uint32_t stored = 0;
+    for (std::uint32_t j = 0; j < n; ++j) {
+        PrefixKey key = keys.empty() ? hasher.NextBlock(tokens.data() + static_cast<std::size_t>(j) * B) : keys[j];
+        if (!store_block(key, j, blocks[j], j > 0 ? &parent : nullptr, tenant, false)) {
+            break; // Later blocks would not be reachable without this one
+        }
+        parent = key;
+        ++stored;
+    }
+    op.SetOk(stored == n);
+    return stored;
+}
+
+std::uint32_t KVCacheImpl::store_packed(const std::vector<std::uint32_t>& tokens,
+                                        const std::vector<bytes_view>& blocks, TenantId tenant) {
+    // Blocks already resident are only refreshed; the rest are packed, in
+    // order, into segments of up to pack_blocks blocks.
+    const std::uint32_t B = config_.block_size_tokens;
+    std::vector<PrefixKey> keys = MakeBlockPrefixKeys(tokens, B, config_.model_id,
+                                                      static_cast<std::uint32_t>(blocks.size()));
+    const std::uint32_t n = doorkeeper_ ? admit_prefix(keys) : static_cast<std::uint32_t>(keys.size());
+
+    std::vector<std::uint32_t> pending;
+    for (std::uint32_t j = 0; j < n; ++j) {
+        BlockInfo info{blocks[j].size(), j, j > 0, j > 0 ? keys[j - 1] : PrefixKey{}};
+        if (!index_.Refresh(keys[j], info)) {
+            pending.push_back(j);
+        } else {
+            metrics_.Add(Counter::Stores);
+            metrics_.Add(Counter::StoresResident);
+            metrics_.Add(Counter::StoredBytes, blocks[j].size());
+        }
+        if (pending.size() == config_.pack_blocks || (j + 1 == n && !pending.empty())) {
+            if (!write_segment(keys, blocks, pending, tenant)) {
+                metrics_.Add(Counter::StoreFailures);
+                return pending.front(); // Later blocks would not be reachable
+            }
+            for (std::uint32_t k : pending) {
+                metrics_.Add(Counter::Stores);
+                metrics_.Add(Counter::StoredBytes, blocks[k].size());
+            }
+            pending.clear();
+        }
+    }
+    return n;
+}
+
+bool KVCacheImpl::write_segment(const std::vector<PrefixKey>& keys, const std::vector<bytes_view>& blocks,
+                                const std::vector<std::uint32_t>& pending, TenantId tenant) {
+    // Segments are written through whatever the write policy: the blocks are
+    // indexed only once the segment is in S3
+    std::vector<BlockInfo> infos(pending.size());
+    std::vector<ObjectBuffer> encoded(pending.size());
+    std::vector<bytes_view> objects(pending.size());
+    std::vector<SegmentEntry> entries(pending.size());
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+        const std::uint32_t j = pending[i];
+        BlockInfo& info = infos[i];
+        info.size = blocks[j].size();
+        info.index = j;
+        info.has_parent = j > 0;
+        info.parent = j > 0 ? keys[j - 1] : PrefixKey{};
+        info.tenant = tenant;
+        encoded[i] = encode_block(blocks[j], &info);
+        objects[i] = encoded[i] ? bytes_view(*encoded[i]) : blocks[j];
+
+        SegmentEntry& entry = entries[i];
+        entry = SegmentEntry{};
+        entry.key = keys[j];
+        entry.parent = info.parent;
+        entry.size = info.size;
+        entry.index = j;
+        entry.codec = static_cast<std::uint8_t>(info.codec);
+        entry.has_parent = info.has_parent ? 1 : 0;
+        entry.tenant = tenant;
+    }
+
+    const PrefixKey segment = new_segment_id(keys[pending.back()]);
+    std::vector<std::uint8_t> object;
+    BuildSegment(&entries, objects, &object);
+    if (!store_->PutObject(segment_key(segment), object)) {
+        return false;
+    }
+
+    std::uint64_t payload = 0;
+    for (const auto& entry : entries) {
+        payload += entry.length;
+    }
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+        infos[i].has_segment = true;
+        infos[i].segment = segment;
+        infos[i].offset = entries[i].offset;
+        index_.AcquireSegment(segment, keys[pending[i]], infos[i].stored_size, payload);
+    }
+
+    BlockList stale_objects;
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+        const PrefixKey& key = keys[pending[i]];
+        if (dram_ || ssd_) {
+            const bytes_view block = blocks[pending[i]];
+            cache_local(key, buffers_->Copy(block));
+        }
+        account_store(key, infos[i], &stale_objects);
+        if (snapshot_) {
+            snapshot_->AppendStore(make_record(key, infos[i], payload));
+        }
+        if (cluster_) {
+            cluster_->PublishStore(make_record(key, infos[i], payload));
+        }
+    }
+    delete_blocks(std::move(stale_objects));
+    if (over_high_watermark()) {
+        cv_gc_.notify_one();
+    }
+    return true;
+}
+
+PrefixKey KVCacheImpl::new_segment_id(const PrefixKey& key) {
+    std::uint8_t name[sizeof(PrefixKey) + sizeof(std::uint64_t)];
+    const std::uint64_t counter = segment_counter_.fetch_add(1, std::memory_order_relaxed);
+    std::memcpy(name, key.data(), key.size());
+    std::memcpy(name + key.size(), &counter, sizeof(counter));
+    return MakeContentKey(bytes_view(name, sizeof(name)), segment_seed_);
+}
+
+void KVCacheImpl::LoadAsync(const BlockRef& ref, std::vector<std::uint8_t>* out_bytes, CompletionCallback done) {
+    io_->Submit([this, ref, out_bytes, done = std::move(done)] {
+        bool ok = Load(ref, out_bytes);
+        if (done) {
+            done(ok);
+        }
+    });
+}
+
+void KVCacheImpl::StoreAsync(const std::vector<std::uint32_t>& tokens,
+                             std::uint32_t block_index,
+                             bytes_view block_bytes,
+                             CompletionCallback done,
+                             TenantId tenant) {
+    const std::uint32_t B = config_.block_size_tokens;
+    std::uint64_t prefix_token_count = (static_cast<std::uint64_t>(block_index) + 1) * B;
+
+    if (tokens.size() < prefix_token_count || tenant >= num_tenants()) {
+        if (done) {
+            done(false);
+        }
+        return;
+    }
+
+    // Hash on the caller's thread so 'tokens' need not outlive this call
+    std::vector<PrefixKey> keys = MakeBlockPrefixKeys(tokens, B, config_.model_id, block_index + 1);
+    PrefixKey key = keys[block_index];
+    const bool has_parent = block_index > 0;
+    PrefixKey parent = has_parent ? keys[block_index - 1] : PrefixKey{};
+
+    if (write_back_enabled()) {
+        // Only a DRAM copy happens before the upload is queued, so do it
+        // here rather than queue a task that would itself queue the upload.
+        bool ok = store_block(key, block_index, block_bytes, has_parent ? &parent : nullptr, tenant, true);
+        if (done) {
+            done(ok);
+        }
+        return;
+    }
+
+    io_->Submit([this, key, block_index, block_bytes, has_parent, parent, tenant, done = std::move(done)] {
+        bool ok = store_block(key, block_index, block_bytes, has_parent ? &parent : nullptr, tenant, true);
+        if (done) {
+            done(ok);
+        }
+    });
+}
+
+bool KVCacheImpl::store_block(const PrefixKey& key, std::uint32_t block_index, bytes_view block_bytes,
+                              const PrefixKey* parent, TenantId tenant, bool check_admission) {
+    // 'check_admission' is false when the caller already ran admit_prefix
+    ScopedOp op(metrics_, Op::Store);
+    BlockInfo info{block_bytes.size(), block_index, parent != nullptr, parent ? *parent : PrefixKey{}};
+    info.tenant = tenant;
+    if (config_.dedup_blocks) {
+        info.has_content = true;
+        info.content = MakeContentKey(block_bytes, content_seed());
+    }
+
+    // Already resident with the same payload: nothing to upload
+    if (index_.Refresh(key, info)) {
+        metrics_.Add(Counter::StoresResident);
+        return count_store(op, true, block_bytes.size());
+    }
+    if (check_admission && doorkeeper_ && !doorkeeper_->Admit(key)) {
+        metrics_.Add(Counter::StoresNotAdmitted);
+        op.SetOk(false);
+        return false;
+    }
+
+    // Concurrent stores of one key collapse into one; the others return the
+    // leader's result. The leader re-checks residency, since a store that
+    // finished just before it started would not have been joined.
+    bool ok = store_flights_.Do(key, [&](auto&) {
+        return index_.Refresh(key, info) || write_block(key, info, block_bytes);
+    });
+    return count_store(op, ok, block_bytes.size());
+}
+
+bool KVCacheImpl::count_store(ScopedOp& op, bool ok, std::uint64_t bytes) const {
+    op.SetOk(ok);
+    op.SetBytes(bytes);
+    if (!ok) {
+        metrics_.Add(Counter::StoreFailures);
+        return false;
+    }
+    metrics_.Add(Counter::Stores);
+    metrics_.Add(Counter::StoredBytes, bytes);
+    return true;
+}
+
+ObjectBuffer KVCacheImpl::encode_block(bytes_view block_bytes, BlockInfo* info) const {
+    // Encoding is deterministic, so every reference to a deduplicated
+    // payload agrees on its codec and stored size. Blocks the codec cannot
+    // shrink are stored raw, and null is returned.
+    info->codec = Codec::None;
+    info->stored_size = block_bytes.size();
+    if (codec_options_.codec == Codec::None) {
+        return nullptr;
+    }
+    auto object = std::make_shared<std::vector<std::uint8_t>>();
+    if (!EncodeBlock(codec_options_, block_bytes, object.get())) {
+        return nullptr;
+    }
+    info->codec = codec_options_.codec;
+    info->stored_size = object->size();
+    return object;
+}
+
+bool KVCacheImpl::write_block(const PrefixKey& key, const BlockInfo& raw_info, bytes_view block_bytes) {
+    BlockInfo info = raw_info;
+    ObjectBuffer encoded = encode_block(block_bytes, &info);
+    const bytes_view object_bytes = encoded ? bytes_view(*encoded) : block_bytes;
+
+    // With dedup, a payload already in S3 is not uploaded again. The fence
+    // is released once the block is indexed or, with write-back, once the
+    // upload task is done with it.
+    const std::string s3_key = object_key(key, info);
+    const bool upload = begin_store(s3_key, info);
+    if (!upload) {
+        metrics_.Add(Counter::StoresDeduplicated);
+    }
+
+    // Local tiers keep the decoded block
+    BlockBuffer local_copy;
+    if (dram_ || ssd_) {
+        local_copy = buffers_->Copy(block_bytes);
+    }
+
+    const bool write_back = write_back_enabled();
+    if (!write_back && upload && !store_->PutObject(s3_key, object_bytes)) {
+        if (info.has_content) {
+            release_content(info);
+        }
+        end_put(s3_key);
+        return false;
+    }
+    // Blocks may be published out of order (async stores); Lookup verifies
+    // contiguity from block 0 on every probe, so no ordering is required here.
+    BlockList stale_objects;
+    if (write_back && upload) {
+        std::lock_guard<std::mutex> lock(write_back_mutex_);
+        ++write_backs_pending_[key];
+    }
+    publish_block(key, info, local_copy, &stale_objects, !(write_back && upload));
+    if (upload && !write_back) {
+        end_put(s3_key);
+    }
+    delete_blocks(std::move(stale_objects));
+
+    if (write_back && upload) {
+        // Published first, so the upload can tell an eviction from a race.
+        // It reads from the encoded object or the DRAM copy, which it keeps
+        // alive even if the tier evicts it first.
+        io_->Submit([this, key, info, s3_key, encoded, local_copy] {
+            bool put_ok = store_->PutObject(s3_key, encoded ? bytes_view(*encoded) : bytes_view(*local_copy));
+            {
+                std::lock_guard<std::mutex> lock(write_back_mutex_);
+                auto it = write_backs_pending_.find(key);
+                if (--it->second == 0) {
+                    write_backs_pending_.erase(it);
+                }
+            }
+            if (!put_ok) {
+                // Unindex it, since S3 would not have it once it leaves DRAM,
+                // along with the descendants that can no longer be matched.
+                // Still fenced, so no block sharing the payload is indexed
+                // against it without uploading it too.
+                BlockList orphaned;
+                std::size_t removed = index_.RemoveSubtree(key, [&](const PrefixKey& k, const BlockInfo& removed_info) {
+                    if (unindex(k, removed_info) && k != key) {
+                        orphaned.emplace_back(k, removed_info);
+                    }
+                });
+                if (removed == 0) {
+                    drop_local(key);
+                }
+                end_put(s3_key);
+                delete_blocks(std::move(orphaned));
+                return;
+            }
+            end_put(s3_key);
+            if (info.has_content ? !index_.HasContent(info.content) : !index_.Find(key, nullptr)) {
+                // Evicted while the upload was in flight; don't leak the object
+                delete_blocks({{key, info}});
+            } else {
+                // Journaled and announced only now that S3 has it
+                if (snapshot_) {
+                    snapshot_->AppendStore(make_record(key, info));
+                }
+                if (cluster_) {
+                    cluster_->PublishStore(make_record(key, info));
+                }
+            }
+        });
+    }
+    
+    // Signal GC once past the high watermark
+    if (over_high_watermark()) {
+        cv_gc_.notify_one();
+    }
+
+    return true;
+}
+
+void KVCacheImpl::publish_block(const PrefixKey& key, const BlockInfo& info, BlockBuffer local_copy,
+                                BlockList* stale_objects, bool announce) {
+    // 'announce' is false while the object is not in the store yet; other
+    // nodes cannot read it from there, and a restart must not index it, so
+    // the journal and the cluster hear of it after the upload
+    if (local_copy) {
+        cache_local(key, std::move(local_copy));
+    }
+    account_store(key, info, stale_objects);
+    if (!announce) {
+        return;
+    }
+    if (snapshot_) {
+        snapshot_->AppendStore(make_record(key, info));
+    }
+    if (cluster_) {
+        cluster_->PublishStore(make_record(key, info));
+    }
+}
+
+void KVCacheImpl::StoreSequenceAsync(const std::vector<std::uint32_t>& tokens,
+                                     const std::vector<bytes_view>& blocks,
+                                     SequenceCallback done,
+                                     TenantId tenant) {
+    const std::uint32_t B = config_.block_size_tokens;
+    auto n = static_cast<std::uint32_t>(blocks.size());
+    if (n == 0 || tokens.size() < n * static_cast<std::uint64_t>(B) || tenant >= num_tenants()) {
+        if (done) {
+            done(0);
+        }
+        return;
+    }
+
+    if (packing_enabled()) {
+        // A segment is published as a whole once it is in S3, so packed
+        // sequences are written by one task in segment order
+        std::uint64_t total = 0;
+        for (const auto& block : blocks) {
+            total += block.size();
+        }
+        auto prefix = std::make_shared<std::vector<std::uint32_t>>(tokens.begin(),
+                                                                   tokens.begin() + static_cast<std::size_t>(n) * B);
+        auto copies = std::make_shared<std::vector<BlockBuffer>>();
+        copies->reserve(n);
+        for (const auto& block : blocks) {
+            copies->push_back(buffers_->Copy(block));
+        }
+        write_behind_->Submit(total, [this, prefix, copies, tenant, done = std::move(done)] {
+            std::vector<bytes_view> views;
+            for (const auto& copy : *copies) {
+                views.push_back(*copy);
+            }
+            std::uint32_t stored = store_packed(*prefix, views, tenant);
+            if (done) {
+                done(stored);
+            }
+        });
+        return;
+    }
+
+    // Hash every boundary here, so 'tokens' need not outlive this call, and
+    // copy only the blocks admitted
+    auto seq = std::make_shared<SequenceUpload>();
+    seq->keys = MakeBlockPrefixKeys(tokens, B, config_.model_id, n);
+    if (doorkeeper_) {
+        n = admit_prefix(seq->keys);
+        if (n == 0) {
+            if (done) {
+                done(0);
+            }
+            return;
+        }
+        seq->keys.resize(n);
+    }
+    seq->blocks.resize(n);
+    seq->infos.resize(n);
+    seq->uploaded.assign(n, 0);
+    seq->state.assign(n, SequenceUpload::State::Queued);
+    seq->cut = n;
+    seq->remaining = n;
+    seq->done = std::move(done);
+    for (std::uint32_t j = 0; j < n; ++j) {
+        seq->infos[j] = BlockInfo{blocks[j].size(), j, j > 0, j > 0 ? seq->keys[j - 1] : PrefixKey{}};
+        seq->infos[j].tenant = tenant;
+    }
+
+    for (std::uint32_t j = 0; j < n; ++j) {
+        // Copy just before queueing, so at most one block past the budget
+        // is held while Submit waits
+        seq->blocks[j] = buffers_->Copy(blocks[j]);
+        write_behind_->Submit(blocks[j].size(), [this, seq, j] { upload_sequence_block(seq, j); });
+    }
+}
+
+void KVCacheImpl::upload_sequence_block(const std::shared_ptr<SequenceUpload>& seq, std::uint32_t j) {
+    // Only this task touches infos[j] and uploaded[j] until it settles
+    ScopedOp op(metrics_, Op::Store);
+    const PrefixKey& key = seq->keys[j];
+    BlockInfo& info = seq->infos[j];
+    const bytes_view block(*seq->blocks[j]);
+    if (config_.dedup_blocks) {
+        info.has_content = true;
+        info.content = MakeContentKey(block, content_seed());
+    }
+    if (index_.Refresh(key, info)) {
+        metrics_.Add(Counter::StoresResident);
+        count_store(op, true, block.size());
+        settle_sequence_block(seq, j, SequenceUpload::State::Resident);
+        return;
+    }
+
+    // Not joined with store_flights_: a concurrent store of the same key
+    // writes the same bytes, and the PUT stays fenced until this block is
+    // published or dropped, so dropping it never deletes the other's object
+    ObjectBuffer encoded = encode_block(block, &info);
+    const std::string s3_key = object_key(key, info);
+    const bool upload = begin_store(s3_key, info); // Fenced until the block settles
+    if (upload && !store_->PutObject(s3_key, encoded ? bytes_view(*encoded) : block)) {
+        if (info.has_content) {
+            release_content(info);
+        }
+        end_put(s3_key);
+        count_store(op, false, block.size());
+        settle_sequence_block(seq, j, SequenceUpload::State::Failed);
+        return;
+    }
+    if (!upload) {
+        metrics_.Add(Counter::StoresDeduplicated);
+    }
+    count_store(op, true, block.size());
+    seq->uploaded[j] = upload ? 1 : 0;
+    if (!dram_ && !ssd_) {
+        seq->blocks[j].reset(); // Only the local tiers want it after the upload
+    }
+    settle_sequence_block(seq, j, SequenceUpload::State::Uploaded);
+}
+
+void KVCacheImpl::settle_sequence_block(const std::shared_ptr<SequenceUpload>& seq, std::uint32_t j,
+                                        SequenceUpload::State state) {
+    using State = SequenceUpload::State;
+    auto end_upload = [&](std::uint32_t k) {
+        if (seq->uploaded[k]) {
+            end_put(object_key(seq->keys[k], seq->infos[k]));
+        }
+    };
+    BlockList stale_objects;
+    std::vector<std::uint32_t> dropped;
+    bool finished;
+    std::uint32_t stored;
+    {
+        std::lock_guard<std::mutex> lock(seq->mutex);
+        seq->state[j] = state;
+        if (state == State::Failed && j < seq->cut) {
+            // Blocks past a failure could never be matched; undo those that
+            // already made it to S3
+            for (std::uint32_t k = j + 1; k < seq->cut; ++k) {
+                if (seq->state[k] == State::Uploaded) {
+                    seq->state[k] = State::Failed;
+                    dropped.push_back(k);
+                }
+            }
+            seq->cut = j;
+        } else if (state == State::Uploaded && j > seq->cut) {
+            seq->state[j] = State::Failed;
+            dropped.push_back(j);
+        }
+        if (seq->state[j] != State::Uploaded) {
+            seq->blocks[j].reset();
+        }
+        for (std::uint32_t k : dropped) {
+            seq->blocks[k].reset();
+        }
+
+        // Publish the run that is now contiguous with what Lookup can see
+        while (seq->published < seq->cut &&
+               (seq->state[seq->published] == State::Uploaded || seq->state[seq->published] == State::Resident)) {
+            const std::uint32_t k = seq->published++;
+            if (seq->state[k] == State::Uploaded) {
+                publish_block(seq->keys[k], seq->infos[k], (dram_ || ssd_) ? seq->blocks[k] : nullptr,
+                              &stale_objects);
+                end_upload(k);
+            }
+            seq->blocks[k].reset();
+        }
+        finished = --seq->remaining == 0;
+        stored = seq->published;
+    }
+
+    // The delete runs only if no store has indexed or is writing the key
+    // by then; a shared payload goes once its last reference does
+    for (std::uint32_t k : dropped) {
+        const BlockInfo& info = seq->infos[k];
+        end_upload(k);
+        if (!info.has_content || release_content(info)) {
+            stale_objects.emplace_back(seq->keys[k], info);
+        }
+    }
+    delete_blocks(std::move(stale_objects));
+    if (over_high_watermark()) {
+        cv_gc_.notify_one();
+    }
+    if (finished && seq->done) {
+        seq->done(stored);
+    }
+}
+
+void KVCacheImpl::Flush() {
+    write_behind_->Drain();
+}
+
+std::uint64_t KVCacheImpl::UsedBytes() const {
+    return used_bytes_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t KVCacheImpl::CapacityBytes() const {
+    return capacity_bytes_.load(std::memory_order_relaxed);
+}
+
+bool KVCacheImpl::IndexRebuilding() const {
+    return rebuilding_.load(std::memory_order_relaxed);
+}
+
+CacheStats KVCacheImpl::GetStats() const {
+    CacheStats stats;
+    metrics_.Snapshot(&stats);
+    const LockWaitStats waits = index_.LockWaits();
+    stats.lock_contended = waits.contended;
+    stats.lock_wait_ns = waits.wait_ns;
+
+    stats.used_bytes = UsedBytes();
+    stats.capacity_bytes = CapacityBytes();
+    stats.index_blocks = index_.Size();
+    const std::uint64_t low = low_watermark_bytes();
+    stats.gc_backlog_bytes = stats.used_bytes > low ? stats.used_bytes - low : 0;
+    stats.gc_pending_deletes = delete_io_->InFlight();
+    stats.dram_bytes = dram_ ? dram_->UsedBytes() : 0;
+    stats.ssd_bytes = ssd_ ? ssd_->UsedBytes() : 0;
+    stats.io_in_flight = io_->InFlight();
+    stats.write_behind_bytes = write_behind_->PendingBytes();
+    stats.prefetch_bytes = prefetcher_ ? prefetcher_->PendingBytes() : 0;
+    stats.buffers = buffers_->Stats();
+    stats.cluster_nodes = cluster_ ? cluster_->LiveNodes() : 0;
+    stats.cluster_leader = cluster_ && cluster_->IsLeader();
+    if (!config_.tenants.empty()) {
+        stats.tenants.reserve(num_tenants());
+        for (std::uint32_t t = 0; t < num_tenants(); ++t) {
+            const auto tenant = static_cast<TenantId>(t);
+            stats.tenants.push_back({config_.tenants[t].name, tenant_used(tenant), tenant_quota(tenant)});
+        }
+    }
+    return stats;
+}
+
+void KVCacheImpl::SetCapacityBytes(std::uint64_t cap) {
+    capacity_bytes_.store(cap, std::memory_order_relaxed);
+    if (over_high_watermark()) {
+        cv_gc_.notify_one();
+    }
+}
+
+
+// --- KVCache Public API (forwarding to PIMPL) ---
+
+KVCache::KVCache(const Config& cfg) : p_impl(std::make_unique<KVCacheImpl>(cfg, nullptr, nullptr)) {}
+KVCache::KVCache(const Config& cfg, std::shared_ptr<ObjectStore> store)
+    : p_impl(std::make_unique<KVCacheImpl>(cfg, std::move(store), nullptr)) {}
+KVCache::KVCache(const Config& cfg, std::shared_ptr<ObjectStore> store, std::shared_ptr<PeerTransport> peers)
+    : p_impl(std::make_unique<KVCacheImpl>(cfg, std::move(store), std::move(peers))) {}
+KVCache::~KVCache() = default;
+LookupResult KVCache::Lookup(const std::vector<std::uint32_t>& tokens) const { return p_impl->Lookup(tokens); }
+PrefetchTicket KVCache::Prefetch(const std::vector<std::uint32_t>& tokens) {
+    return p_impl->Prefetch(p_impl->Lookup(tokens));
+}
+LookupResult KVCache::LookupAndPrefetch(const std::vector<std::uint32_t>& tokens, PrefetchTicket* ticket) {
+    LookupResult result = p_impl->Lookup(tokens);
+    PrefetchTicket queued = p_impl->Prefetch(result);
+    if (ticket) {
+        *ticket = queued;
+    }
+    return result;
+}
+void KVCache::CancelPrefetch(PrefetchTicket ticket) { p_impl->CancelPrefetch(ticket); }
+bool KVCache::Load(const BlockRef& ref, std::vector<std::uint8_t>* out_bytes) { return p_impl->Load(ref, out_bytes); }
+bool KVCache::Load(const BlockRef& ref, mutable_bytes_view dest) { return p_impl->Load(ref, dest); }
+std::shared_ptr<const Buffer> KVCache::LoadShared(const BlockRef& ref) { return p_impl->LoadShared(ref); }
+bool KVCache::LoadStreaming(const BlockRef& ref, mutable_bytes_view dest, const BlockLayout& layout,
+                            const ChunkCallback& on_chunk) {
+    return p_impl->LoadStreaming(ref, dest, layout, on_chunk);
+}
+LoadAllResult KVCache::LoadAll(const LookupResult& result, mutable_bytes_view dest, std::uint32_t max_parallel) {
+    return p_impl->LoadAll(result, dest, max_parallel);
+}
+std::uint64_t KVCache::TotalBytes(const LookupResult& result) {
+    std::uint64_t total = 0;
+    for (const auto& ref : result.handles) {
+        total += ref.size;
+    }
+    return total;
+}
+bool KVCache::Store(const std::vector<std::uint32_t>& tokens, std::uint32_t block_index, bytes_view block_bytes,
+                    TenantId tenant) {
+    return p_impl->Store(tokens, block_index, block_bytes, tenant);
+}
+std::uint32_t KVCache::StoreSequence(const std::vector<std::uint32_t>& tokens, const std::vector<bytes_view>& blocks,
+                                     TenantId tenant) {
+    return p_impl->StoreSequence(tokens, blocks, tenant);
+}
+std::future<std::uint32_t> KVCache::StoreSequenceAsync(const std::vector<std::uint32_t>& tokens,
+                                                       const std::vector<bytes_view>& blocks, TenantId tenant) {
+    auto promise = std::make_shared<std::promise<std::uint32_t>>();
+    std::future<std::uint32_t> future = promise->get_future();
+    p_impl->StoreSequenceAsync(tokens, blocks, [promise](std::uint32_t stored) { promise->set_value(stored); },
+                               tenant);
+    return future;
+}
+void KVCache::StoreSequenceAsync(const std::vector<std::uint32_t>& tokens, const std::vector<bytes_view>& blocks,
+                                 SequenceCallback done, TenantId tenant) {
+    p_impl->StoreSequenceAsync(tokens, blocks, std::move(done), tenant);
+}
+void KVCache::Flush() { p_impl->Flush(); }
+std::future<bool> KVCache::LoadAsync(const BlockRef& ref, std::vector<std::uint8_t>* out_bytes) {
+    auto promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> future = promise->get_future();
+    p_impl->LoadAsync(ref, out_bytes, [promise](bool ok) { promise->set_value(ok); });
+    return future;
+}
+void KVCache::LoadAsync(const BlockRef& ref, std::vector<std::uint8_t>* out_bytes, CompletionCallback done) {
+    p_impl->LoadAsync(ref, out_bytes, std::move(done));
+}
+std::future<bool> KVCache::StoreAsync(const std::vector<std::uint32_t>& tokens, std::uint32_t block_index, bytes_view block_bytes,
+                                      TenantId tenant) {
+    auto promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> future = promise->get_future();
+    p_impl->StoreAsync(tokens, block_index, block_bytes, [promise](bool ok) { promise->set_value(ok); }, tenant);
+    return future;
+}
+void KVCache::StoreAsync(const std::vector<std::uint32_t>& tokens, std::uint32_t block_index, bytes_view block_bytes,
+                         CompletionCallback done, TenantId tenant) {
+    p_impl->StoreAsync(tokens, block_index, block_bytes, std::move(done), tenant);
 }
 std::uint64_t KVCache::UsedBytes() const { return p_impl->UsedBytes(); }
 std::uint64_t KVCache::CapacityBytes() const { return p_impl->CapacityBytes(); }
 void KVCache::SetCapacityBytes(std::uint64_t cap) { p_impl->SetCapacityBytes(cap); }
+bool KVCache::IndexRebuilding() const { return p_impl->IndexRebuilding(); }
+BufferPoolStats KVCache::BufferStats() const { return p_impl->BufferStats(); }
+CacheStats KVCache::GetStats() const { return p_impl->GetStats(); }
+bool KVCache::ServePeer(const PrefixKey& key, mutable_bytes_view dest) { return p_impl->ServePeer(key, dest); }
 
 } // namespace kvcache
@@ -0,0 +1,166 @@
+#include "kvcache/buffer_pool.hpp"
+
+#include <cstring>
+#include <sys/mman.h>
+
+namespace kvcache {
+
+static constexpr std::size_t kMinClassBytes = 4096;
+static constexpr std::size_t kSlabBytes = 2u << 20; // One hugepage
+
+// --- Buffer ---
+
+Buffer::Buffer(std::shared_ptr<BufferPool> pool, std::uint8_t* data, std::size_t size, int size_class)
+    : pool_(std::move(pool)), data_(data), size_(size), size_class_(size_class) {}
+
+Buffer::~Buffer() {
+    pool_->Release(size_class_, data_);
+}
+
+// --- BufferPool ---
+
+std::shared_ptr<BufferPool> BufferPool::Create(std::uint64_t max_bytes, bool hugepages) {
+    return std::shared_ptr<BufferPool>(new BufferPool(max_bytes, hugepages));
+}
+
+BufferPool::BufferPool(std::uint64_t max_bytes, bool hugepages) : max_bytes_(max_bytes), hugepages_(hugepages) {}
+
+BufferPool::~BufferPool() {
+    // Every buffer holds a reference, so all of them are back by now
+    for (const auto& slab : slabs_) {
+        ::munmap(slab.base, slab.bytes);
+    }
+}
+
+int BufferPool::class_for(std::size_t size) {
+    if (size <= kMinClassBytes) {
+        return 0;
+    }
+    // base << k < size <= base << (k + 1), then quarter steps within it
+    int k = 0;
+    while ((kMinClassBytes << (k + 1)) < size) {
+        ++k;
+    }
+    const std::size_t step = (kMinClassBytes << k) / 4;
+    const int c = k * 4 + static_cast<int>((size + step - 1) / step) - 4;
+    return c < kNumClasses ? c : -1;
+}
+
+std::size_t BufferPool::class_bytes(int size_class) {
+    const int k = size_class / 4;
+    const int q = size_class % 4;
+    return (kMinClassBytes << k) / 4 * static_cast<std::size_t>(4 + q);
+}
+
+bool BufferPool::grow(int size_class, SizeClass& cls) {
+    // Small classes share a hugepage-sized slab; large ones get a slab each
+    const std::size_t chunk = class_bytes(size_class);
+    std::size_t bytes = chunk < kSlabBytes ? kSlabBytes : chunk;
+    if (hugepages_) {
+        bytes = (bytes + kSlabBytes - 1) / kSlabBytes * kSlabBytes;
+    }
+
+    std::lock_guard<std::mutex> lock(slab_mutex_);
+    if (bytes_reserved_.load(std::memory_order_relaxed) + bytes > max_bytes_) {
+        return false;
+    }
+    bool huge = false;
+    void* base = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (hugepages_) {
+        base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        huge = base != MAP_FAILED;
+    }
+#endif
+    if (base == MAP_FAILED) {
+        base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            return false;
+        }
+#ifdef MADV_HUGEPAGE
+        if (hugepages_) {
+            ::madvise(base, bytes, MADV_HUGEPAGE); // Best effort
+        }
+#endif
+    }
+    slabs_.push_back(Slab{base, bytes, huge});
+    bytes_reserved_.fetch_add(bytes, std::memory_order_relaxed);
+
+    cls.fresh = static_cast<std::uint8_t*>(base);
+    cls.fresh_left = bytes / chunk;
+    return true;
+}
+
+std::shared_ptr<Buffer> BufferPool::Allocate(std::size_t size) {
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+    const int c = class_for(size);
+    if (c >= 0) {
+        SizeClass& cls = classes_[c];
+        std::uint8_t* data = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(cls.mutex);
+            if (!cls.free.empty()) {
+                data = cls.free.back();
+                cls.free.pop_back();
+                reused_.fetch_add(1, std::memory_order_relaxed);
+            } else if (cls.fresh_left > 0 || grow(c, cls)) {
+                data = cls.fresh;
+                cls.fresh += class_bytes(c);
+                --cls.fresh_left;
+            }
+        }
+        if (data) {
+            bytes_in_use_.fetch_add(class_bytes(c), std::memory_order_relaxed);
+            return std::make_shared<Buffer>(shared_from_this(), data, size, c);
+        }
+    }
+    unpooled_.fetch_add(1, std::memory_order_relaxed);
+    return std::make_shared<Buffer>(shared_from_this(), new std::uint8_t[size], size, -1);
+}
+
+std::shared_ptr<Buffer> BufferPool::Copy(bytes_view data) {
+    std::shared_ptr<Buffer> buffer = Allocate(data.size());
+    if (!data.empty()) {
+        std::memcpy(buffer->data(), data.data(), data.size());
+    }
+    return buffer;
+}
+
+void BufferPool::Release(int size_class, std::uint8_t* data) {
+    if (size_class < 0) {
+        delete[] data;
+        return;
+    }
+    bytes_in_use_.fetch_sub(class_bytes(size_class), std::memory_order_relaxed);
+    SizeClass& cls = classes_[size_class];
+    std::lock_guard<std::mutex> lock(cls.mutex);
+    cls.free.push_back(data);
+}
+
+BufferPoolStats BufferPool::Stats() const {
+    BufferPoolStats stats;
+    stats.allocations = allocations_.load(std::memory_order_relaxed);
+    stats.reused = reused_.load(std::memory_order_relaxed);
+    stats.unpooled = unpooled_.load(std::memory_order_relaxed);
+    stats.bytes_in_use = bytes_in_use_.load(std::memory_order_relaxed);
+    stats.bytes_reserved = bytes_reserved_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(slab_mutex_);
+    stats.slabs = slabs_.size();
+    for (const auto& slab : slabs_) {
+        stats.hugepage_slabs += slab.hugepages ? 1 : 0;
+    }
+    return stats;
+}
+
+void BufferPool::ForEachSlab(const std::function<void(void* base, std::size_t bytes)>& visit) const {
+    std::vector<Slab> slabs;
+    {
+        std::lock_guard<std::mutex> lock(slab_mutex_);
+        slabs = slabs_;
+    }
+    for (const auto& slab : slabs) {
+        visit(slab.base, slab.bytes);
+    }
+}
+
+} // namespace kvcache
@@ -0,0 +1,571 @@
+#include "kvcache/cluster.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace kvcache {
+
+namespace {
+
+constexpr char kEventMagic[8] = {'K', 'V', 'C', 'E', 'V', 'T', 'S', '1'};
+constexpr char kHeartbeatMagic[8] = {'K', 'V', 'C', 'N', 'O', 'D', 'E', '1'};
+constexpr std::uint32_t kClusterFormatVersion = 1;
+constexpr std::uint32_t kHeartbeatLeft = 1;
+
+// Event objects fetched from one node per sync tick, so a node far behind
+// catches up without starving the others
+constexpr std::size_t kMaxObjectsPerPoll = 64;
+// Touches one node may buffer between flushes; more are dropped
+constexpr std::size_t kMaxPendingTouches = 1 << 16;
+
+// Event object: header, record_count IndexRecords, touch_count keys, then
+// clock_count entries of { uint32 id length, id, uint64 cursor }: how far
+// the writer had applied every other node's events when it wrote it
+struct EventHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t block_size;
+    PrefixKey fingerprint;
+    std::uint64_t seq;
+    std::uint32_t record_count;
+    std::uint32_t touch_count;
+    std::uint32_t clock_count;
+    std::uint8_t reserved[12];
+};
+static_assert(sizeof(EventHeader) == 64, "EventHeader is an object format");
+
+// Heartbeat object: header, the address, then cursor_count entries of
+// { uint32 id length, id, uint64 cursor }
+struct HeartbeatHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint64_t beat;
+    std::uint64_t next_seq;
+    std::uint64_t first_seq;
+    std::uint32_t address_size;
+    std::uint32_t cursor_count;
+    std::uint8_t reserved[16];
+};
+static_assert(sizeof(HeartbeatHeader) == 64, "HeartbeatHeader is an object format");
+
+struct Heartbeat {
+    HeartbeatHeader header;
+    std::string address;
+    std::map<std::string, std::uint64_t> cursors;
+};
+
+template <typename T>
+void append_pod(std::vector<std::uint8_t>* out, const T& value) {
+    const auto* p = reinterpret_cast<const std::uint8_t*>(&value);
+    out->insert(out->end(), p, p + sizeof(T));
+}
+
+void append_bytes(std::vector<std::uint8_t>* out, const std::string& bytes) {
+    out->insert(out->end(), bytes.begin(), bytes.end());
+}
+
+void append_cursors(std::vector<std::uint8_t>* out, const std::map<std::string, std::uint64_t>& cursors) {
+    for (const auto& [node, cursor] : cursors) {
+        append_pod(out, static_cast<std::uint32_t>(node.size()));
+        append_bytes(out, node);
+        append_pod(out, cursor);
+    }
+}
+
+bool parse_cursors(const std::vector<std::uint8_t>& data, std::size_t* pos, std::uint32_t count,
+                   std::map<std::string, std::uint64_t>* cursors) {
+    for (std::uint32_t i = 0; i < count; ++i) {
+        std::uint32_t id_size;
+        std::uint64_t cursor;
+        if (data.size() - *pos < sizeof(id_size)) {
+            return false;
+        }
+        std::memcpy(&id_size, data.data() + *pos, sizeof(id_size));
+        *pos += sizeof(id_size);
+        if (data.size() - *pos < static_cast<std::size_t>(id_size) + sizeof(cursor)) {
+            return false;
+        }
+        std::string id(reinterpret_cast<const char*>(data.data() + *pos), id_size);
+        *pos += id_size;
+        std::memcpy(&cursor, data.data() + *pos, sizeof(cursor));
+        *pos += sizeof(cursor);
+        (*cursors)[std::move(id)] = cursor;
+    }
+    return true;
+}
+
+bool parse_heartbeat(const std::vector<std::uint8_t>& data, Heartbeat* hb) {
+    if (data.size() < sizeof(HeartbeatHeader)) {
+        return false;
+    }
+    std::memcpy(&hb->header, data.data(), sizeof(HeartbeatHeader));
+    if (std::memcmp(hb->header.magic, kHeartbeatMagic, sizeof(kHeartbeatMagic)) != 0 ||
+        hb->header.version != kClusterFormatVersion) {
+        return false;
+    }
+    std::size_t pos = sizeof(HeartbeatHeader);
+    if (data.size() - pos < hb->header.address_size) {
+        return false;
+    }
+    hb->address.assign(reinterpret_cast<const char*>(data.data() + pos), hb->header.address_size);
+    pos += hb->header.address_size;
+    return parse_cursors(data, &pos, hb->header.cursor_count, &hb->cursors);
+}
+
+std::uint64_t ring_position(const std::string& node, int replica) {
+    const std::string name = node + "#" + std::to_string(replica);
+    PrefixKey digest = MakeContentKey(bytes_view(reinterpret_cast<const std::uint8_t*>(name.data()), name.size()));
+    return PrefixKeyHash{}(digest);
+}
+
+} // namespace
+
+// --- HashRing ---
+
+HashRing::HashRing(std::vector<std::string> nodes) : nodes_(std::move(nodes)) {
+    points_.reserve(nodes_.size() * kVirtualNodes);
+    for (std::uint32_t n = 0; n < nodes_.size(); ++n) {
+        for (int r = 0; r < kVirtualNodes; ++r) {
+            points_.emplace_back(ring_position(nodes_[n], r), n);
+        }
+    }
+    std::sort(points_.begin(), points_.end());
+}
+
+const std::string* HashRing::Owner(const PrefixKey& key) const {
+    if (points_.empty()) {
+        return nullptr;
+    }
+    const std::uint64_t position = PrefixKeyHash{}(key);
+    auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(position, std::uint32_t{0}));
+    if (it == points_.end()) {
+        it = points_.begin(); // Wrap around
+    }
+    return &nodes_[it->second];
+}
+
+// --- ClusterSync ---
+
+ClusterSync::ClusterSync(std::shared_ptr<ObjectStore> store, ClusterOptions options, const Metrics& metrics,
+                         bool resume, ApplyFn apply, TouchFn touch)
+    : store_(std::move(store)), options_(std::move(options)), metrics_(metrics), apply_(std::move(apply)),
+      touch_(std::move(touch)), fingerprint_(MakePrefixKey({}, options_.block_size, options_.model_id)),
+      view_(std::make_shared<View>()) {
+    join(resume);
+    write_heartbeat();
+    thread_ = std::thread(&ClusterSync::run, this);
+}
+
+ClusterSync::~ClusterSync() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    flush();
+    write_heartbeat(true);
+}
+
+std::string ClusterSync::heartbeat_key(const std::string& node) const {
+    return options_.prefix + "h/" + node;
+}
+
+std::string ClusterSync::event_key(const std::string& node, std::uint64_t seq) const {
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(seq));
+    return options_.prefix + "e/" + node + "/" + name;
+}
+
+void ClusterSync::join(bool resume) {
+    // Our own heartbeat, if we ran before, says where our event numbering
+    // and our reading of the others left off
+    std::vector<std::uint8_t> data;
+    Heartbeat own;
+    if (store_->GetObject(heartbeat_key(options_.node_id), &data) && parse_heartbeat(data, &own)) {
+        beat_ = own.header.beat;
+        next_seq_ = own.header.next_seq;
+        first_seq_ = own.header.first_seq;
+        if (resume) {
+            resume_cursors_ = std::move(own.cursors);
+        }
+    }
+    refresh_members(true);
+}
+
+void ClusterSync::run() {
+    using Clock = std::chrono::steady_clock;
+    const auto sync_interval = std::chrono::milliseconds(std::max<std::uint32_t>(options_.sync_interval_ms, 1));
+    const auto heartbeat_interval = std::chrono::milliseconds(options_.heartbeat_interval_ms);
+    auto next_heartbeat = Clock::now() + heartbeat_interval;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cv_.wait_for(lock, sync_interval, [this] { return stop_; })) {
+        lock.unlock();
+        // A heartbeat follows every event object, so others learn of it on
+        // their next tick; otherwise one goes out each heartbeat interval
+        const bool wrote = flush();
+        const auto now = Clock::now();
+        const bool heartbeat_due = now >= next_heartbeat;
+        if (wrote || heartbeat_due) {
+            trim_events();
+            write_heartbeat();
+        }
+        if (heartbeat_due) {
+            next_heartbeat = now + heartbeat_interval;
+        }
+        refresh_members(heartbeat_due);
+        poll_events();
+        lock.lock();
+    }
+}
+
+void ClusterSync::PublishStore(const IndexRecord& record) {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    pending_.push_back(record);
+    pending_.back().op = IndexRecord::kStore;
+}
+
+void ClusterSync::PublishEvict(const PrefixKey& key, std::uint32_t index) {
+    IndexRecord record{};
+    record.key = key;
+    record.index = index;
+    record.op = IndexRecord::kEvict;
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    pending_.push_back(record);
+}
+
+void ClusterSync::PublishDeleted(const IndexRecord& record) {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    pending_.push_back(record);
+    pending_.back().op = IndexRecord::kDeleted;
+}
+
+void ClusterSync::PublishTouch(const PrefixKey& key) {
+    if (!options_.share_recency) {
+        return;
+    }
+    // Stripe by the high half; the low half is the ring position
+    std::uint64_t high;
+    std::memcpy(&high, key.data() + 8, sizeof(high));
+    TouchStripe& stripe = touches_[high % kTouchStripes];
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    if (stripe.keys.size() < kMaxPendingTouches / kTouchStripes) {
+        stripe.keys.insert(key);
+    }
+}
+
+bool ClusterSync::flush() {
+    std::vector<IndexRecord> records;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        records.swap(pending_);
+    }
+    std::vector<PrefixKey> touched;
+    for (auto& stripe : touches_) {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        touched.insert(touched.end(), stripe.keys.begin(), stripe.keys.end());
+        stripe.keys.clear();
+    }
+    if (records.empty() && touched.empty()) {
+        return false;
+    }
+    // Evictions say which of the others' stores they follow
+    std::map<std::string, std::uint64_t> clock;
+    if (std::any_of(records.begin(), records.end(),
+                    [](const IndexRecord& record) { return record.op == IndexRecord::kEvict; })) {
+        for (const auto& [node, member] : members_) {
+            clock[node] = member.cursor;
+        }
+    }
+
+    EventHeader header{};
+    std::memcpy(header.magic, kEventMagic, sizeof(header.magic));
+    header.version = kClusterFormatVersion;
+    header.block_size = options_.block_size;
+    header.fingerprint = fingerprint_;
+    header.seq = next_seq_;
+    header.record_count = static_cast<std::uint32_t>(records.size());
+    header.touch_count = static_cast<std::uint32_t>(touched.size());
+    header.clock_count = static_cast<std::uint32_t>(clock.size());
+    std::vector<std::uint8_t> object;
+    object.reserve(sizeof(header) + records.size() * sizeof(IndexRecord) + touched.size() * sizeof(PrefixKey));
+    append_pod(&object, header);
+    for (const auto& record : records) {
+        append_pod(&object, record);
+    }
+    for (const auto& key : touched) {
+        append_pod(&object, key);
+    }
+    append_cursors(&object, clock);
+
+    if (!store_->PutObject(event_key(options_.node_id, next_seq_), object)) {
+        // Stores and evictions must reach the others, so they wait for the
+        // next tick, ahead of newer ones; touches only carry recency
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        records.insert(records.end(), pending_.begin(), pending_.end());
+        pending_.swap(records);
+        return false;
+    }
+    ++next_seq_;
+    metrics_.Add(Counter::ClusterEventsPublished, records.size() + touched.size());
+    return true;
+}
+
+void ClusterSync::trim_events() {
+    // Keep the newest event_retention objects; the heartbeat written next
+    // tells readers where the kept ones start
+    const std::uint64_t retention = std::max<std::uint32_t>(options_.event_retention, 1);
+    while (next_seq_ - first_seq_ > retention) {
+        const std::uint64_t end = std::min(next_seq_ - retention, first_seq_ + 1000);
+        std::vector<std::string> keys;
+        for (std::uint64_t seq = first_seq_; seq < end; ++seq) {
+            keys.push_back(event_key(options_.node_id, seq));
+        }
+        store_->DeleteObjects(keys);
+        first_seq_ = end;
+    }
+}
+
+void ClusterSync::write_heartbeat(bool leaving) {
+    HeartbeatHeader header{};
+    std::memcpy(header.magic, kHeartbeatMagic, sizeof(header.magic));
+    header.version = kClusterFormatVersion;
+    header.flags = leaving ? kHeartbeatLeft : 0;
+    header.beat = ++beat_;
+    header.next_seq = next_seq_;
+    header.first_seq = first_seq_;
+    header.address_size = static_cast<std::uint32_t>(options_.address.size());
+    header.cursor_count = static_cast<std::uint32_t>(members_.size());
+
+    std::vector<std::uint8_t> object;
+    append_pod(&object, header);
+    append_bytes(&object, options_.address);
+    std::map<std::string, std::uint64_t> cursors;
+    for (const auto& [node, member] : members_) {
+        cursors[node] = member.cursor;
+    }
+    append_cursors(&object, cursors);
+    store_->PutObject(heartbeat_key(options_.node_id), object);
+}
+
+void ClusterSync::refresh_members(bool discover) {
+    const auto now = std::chrono::steady_clock::now();
+    const auto timeout = std::chrono::milliseconds(options_.node_timeout_ms);
+
+    std::vector<std::string> nodes;
+    if (discover) {
+        const std::string prefix = options_.prefix + "h/";
+        store_->ListObjects(prefix, [&](const std::string& key, std::uint64_t) {
+            std::string node = key.substr(prefix.size());
+            if (!node.empty() && node.find('/') == std::string::npos && node != options_.node_id) {
+                nodes.push_back(std::move(node));
+            }
+            return true;
+        });
+    }
+    for (const auto& [node, member] : members_) {
+        nodes.push_back(node);
+    }
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+
+    bool changed = false;
+    std::vector<std::uint8_t> data;
+    for (const auto& node : nodes) {
+        Heartbeat hb;
+        const bool read = store_->GetObject(heartbeat_key(node), &data) && parse_heartbeat(data, &hb);
+        auto it = members_.find(node);
+        if (it == members_.end()) {
+            if (!read) {
+                continue;
+            }
+            // A node seen for the first time is replayed from its oldest
+            // kept event, unless we are resuming from where we read it
+            // before. Replay is safe: a Store and its later Evict are
+            // trimmed in that order.
+            Member member;
+            auto saved = resume_cursors_.find(node);
+            member.cursor = saved != resume_cursors_.end() ? saved->second : hb.header.first_seq;
+            member.beat = hb.header.beat;
+            member.last_advance = now;
+            it = members_.emplace(node, member).first;
+            changed = true;
+        }
+        Member& member = it->second;
+        if (read) {
+            if (hb.header.beat != member.beat) {
+                member.beat = hb.header.beat;
+                member.last_advance = now;
+            }
+            member.next_seq = hb.header.next_seq;
+            member.first_seq = hb.header.first_seq;
+            member.left = (hb.header.flags & kHeartbeatLeft) != 0;
+            if (hb.address != member.address) {
+                member.address = hb.address;
+                changed = true;
+            }
+        }
+        const bool live = !member.left && now - member.last_advance < timeout;
+        if (live != member.live) {
+            member.live = live;
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        update_view_locked();
+    }
+}
+
+void ClusterSync::update_view_locked() {
+    auto view = std::make_shared<View>();
+    std::vector<std::string> ring_nodes;
+    if (!options_.address.empty()) {
+        ring_nodes.push_back(options_.node_id);
+        view->addresses[options_.node_id] = options_.address;
+    }
+    for (const auto& [node, member] : members_) {
+        if (!member.live) {
+            continue;
+        }
+        ++view->live_nodes;
+        if (node < options_.node_id) {
+            view->leader = false;
+        }
+        if (!member.address.empty()) {
+            ring_nodes.push_back(node);
+            view->addresses[node] = member.address;
+        }
+    }
+    view->ring = HashRing(std::move(ring_nodes));
+    view_ = std::move(view);
+}
+
+void ClusterSync::poll_events() {
+    // Events of nodes that have since died are still applied: their last
+    // evictions matter as much as anyone's
+    for (auto& [node, member] : members_) {
+        if (member.cursor < member.first_seq) {
+            metrics_.Add(Counter::ClusterEventsLost, member.first_seq - member.cursor);
+            std::cerr << "kvcache: fell behind node " << node << "; skipping "
+                      << member.first_seq - member.cursor << " event objects" << std::endl;
+            member.cursor = member.first_seq;
+        }
+        for (std::size_t n = 0; n < kMaxObjectsPerPoll && member.cursor < member.next_seq; ++n) {
+            if (!apply_object(node, member.cursor)) {
+                break; // Retried next tick
+            }
+            ++member.cursor;
+        }
+    }
+    trim_superseded();
+}
+
+bool ClusterSync::apply_object(const std::string& node, std::uint64_t seq) {
+    std::vector<std::uint8_t> object;
+    if (!store_->GetObject(event_key(node, seq), &object)) {
+        return false;
+    }
+    EventHeader header;
+    std::map<std::string, std::uint64_t> clock;
+    bool valid = object.size() >= sizeof(header);
+    if (valid) {
+        std::memcpy(&header, object.data(), sizeof(header));
+        std::size_t pos = sizeof(header) + static_cast<std::size_t>(header.record_count) * sizeof(IndexRecord) +
+                          static_cast<std::size_t>(header.touch_count) * sizeof(PrefixKey);
+        valid = std::memcmp(header.magic, kEventMagic, sizeof(kEventMagic)) == 0 &&
+                header.version == kClusterFormatVersion && header.block_size == options_.block_size &&
+                header.fingerprint == fingerprint_ && header.seq == seq && object.size() >= pos &&
+                parse_cursors(object, &pos, header.clock_count, &clock) && pos == object.size();
+    }
+    if (!valid) {
+        // Not ours to fix; skip it rather than stall on it forever
+        std::cerr << "kvcache: ignoring malformed cluster event object " << event_key(node, seq) << std::endl;
+        return true;
+    }
+
+    // Streams are read independently, so an eviction can arrive before the
+    // store it follows, written by a third node this one is further behind
+    // on. Such a store is dropped when it turns up, or it would come back.
+    const std::uint8_t* p = object.data() + sizeof(header);
+    for (std::uint32_t i = 0; i < header.record_count; ++i, p += sizeof(IndexRecord)) {
+        IndexRecord record;
+        std::memcpy(&record, p, sizeof(record));
+        if (record.op == IndexRecord::kStore && superseded(record.key, node, seq)) {
+            continue;
+        }
+        apply_(record);
+        if (record.op == IndexRecord::kEvict) {
+            for (const auto& [writer, cursor] : clock) {
+                auto it = members_.find(writer);
+                if (writer != options_.node_id && (it == members_.end() || it->second.cursor < cursor)) {
+                    std::uint64_t& until = superseded_[record.key][writer];
+                    until = std::max(until, cursor);
+                }
+            }
+        }
+    }
+    if (options_.share_recency) {
+        for (std::uint32_t i = 0; i < header.touch_count; ++i, p += sizeof(PrefixKey)) {
+            PrefixKey key;
+            std::memcpy(key.data(), p, key.size());
+            touch_(key);
+        }
+    }
+    metrics_.Add(Counter::ClusterEventsApplied, header.record_count + header.touch_count);
+    return true;
+}
+
+bool ClusterSync::superseded(const PrefixKey& key, const std::string& node, std::uint64_t seq) const {
+    auto it = superseded_.find(key);
+    if (it == superseded_.end()) {
+        return false;
+    }
+    auto until = it->second.find(node);
+    return until != it->second.end() && seq < until->second;
+}
+
+void ClusterSync::trim_superseded() {
+    // An entry is done with once this node has read that far itself
+    for (auto it = superseded_.begin(); it != superseded_.end();) {
+        auto& writers = it->second;
+        for (auto w = writers.begin(); w != writers.end();) {
+            auto member = members_.find(w->first);
+            w = member != members_.end() && member->second.cursor >= w->second ? writers.erase(w) : std::next(w);
+        }
+        it = writers.empty() ? superseded_.erase(it) : std::next(it);
+    }
+}
+
+bool ClusterSync::IsLeader() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return view_->leader;
+}
+
+std::size_t ClusterSync::LiveNodes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return view_->live_nodes;
+}
+
+std::string ClusterSync::PeerFor(const PrefixKey& key) const {
+    std::shared_ptr<const View> view;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        view = view_;
+    }
+    const std::string* owner = view->ring.Owner(key);
+    if (!owner || *owner == options_.node_id) {
+        return {};
+    }
+    auto it = view->addresses.find(*owner);
+    return it == view->addresses.end() ? std::string() : it->second;
+}
+
+} // namespace kvcache
@@ -0,0 +1,336 @@
+#include "kvcache/codec.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#ifdef KVCACHE_WITH_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+#ifdef KVCACHE_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace kvcache {
+
+static constexpr char kBlockMagic[4] = {'K', 'V', 'B', 'K'};
+static constexpr std::uint8_t kBlockVersion = 1;
+
+// --- FP16 / FP8 Conversion ---
+
+static float half_to_float(std::uint16_t h) {
+    std::uint32_t sign = static_cast<std::uint32_t>(h & 0x8000) << 16;
+    std::uint32_t exp = (h >> 10) & 0x1F;
+    std::uint32_t mant = h & 0x3FF;
+    std::uint32_t bits;
+    if (exp == 0) {
+        if (mant == 0) {
+            bits = sign;
+        } else {
+            // Subnormal: renormalize into an FP32 normal
+            exp = 1;
+            while (!(mant & 0x400)) {
+                mant <<= 1;
+                --exp;
+            }
+            mant &= 0x3FF;
+            bits = sign | ((exp + 112) << 23) | (mant << 13);
+        }
+    } else if (exp == 31) {
+        bits = sign | 0x7F800000 | (mant << 13);
+    } else {
+        bits = sign | ((exp + 112) << 23) | (mant << 13);
+    }
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static std::uint16_t float_to_half(float f) {
+    // Round to nearest even
+    std::uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    std::uint16_t sign = static_cast<std::uint16_t>((x >> 16) & 0x8000);
+    std::uint32_t raw_exp = (x >> 23) & 0xFF;
+    std::uint32_t mant = x & 0x7FFFFF;
+    if (raw_exp == 0xFF) {
+        return sign | 0x7C00 | (mant ? 0x200 : 0);
+    }
+    std::int32_t exp = static_cast<std::int32_t>(raw_exp) - 127 + 15;
+    if (exp >= 31) {
+        return sign | 0x7C00;
+    }
+    if (exp <= 0) {
+        if (exp < -10) {
+            return sign;
+        }
+        mant |= 0x800000;
+        std::uint32_t shift = static_cast<std::uint32_t>(14 - exp);
+        std::uint32_t half = mant >> shift;
+        std::uint32_t rem = mant & ((1u << shift) - 1);
+        std::uint32_t mid = 1u << (shift - 1);
+        if (rem > mid || (rem == mid && (half & 1))) {
+            ++half;
+        }
+        return static_cast<std::uint16_t>(sign | half);
+    }
+    std::uint32_t half = sign | (static_cast<std::uint32_t>(exp) << 10) | (mant >> 13);
+    std::uint32_t rem = mant & 0x1FFF;
+    if (rem > 0x1000 || (rem == 0x1000 && (half & 1))) {
+        ++half; // A mantissa carry correctly bumps the exponent
+    }
+    return static_cast<std::uint16_t>(half);
+}
+
+// E4M3 (no infinities, 0x7F/0xFF are NaN): max normal 448, min subnormal 2^-9.
+static constexpr float kFp8Max = 448.0f;
+
+static std::uint8_t float_to_fp8(float v) {
+    std::uint8_t sign = std::signbit(v) ? 0x80 : 0;
+    float a = std::fabs(v);
+    if (!(a < kFp8Max)) {
+        return sign | 0x7E; // Saturate (also maps NaN to the max)
+    }
+    if (a == 0.0f) {
+        return sign;
+    }
+    int e;
+    std::frexp(a, &e); // a = f * 2^e, f in [0.5, 1)
+    int biased = e - 1 + 7;
+    if (biased >= 1) {
+        float mant = a / std::ldexp(1.0f, e - 1) - 1.0f;
+        int m = static_cast<int>(std::nearbyint(mant * 8.0f));
+        if (m == 8) {
+            m = 0;
+            ++biased;
+        }
+        if (biased > 15 || (biased == 15 && m == 7)) {
+            return sign | 0x7E;
+        }
+        return sign | static_cast<std::uint8_t>((biased << 3) | m);
+    }
+    int m = static_cast<int>(std::nearbyint(a / std::ldexp(1.0f, -9)));
+    if (m >= 8) {
+        return sign | 0x08; // Rounded up to the smallest normal
+    }
+    return sign | static_cast<std::uint8_t>(m);
+}
+
+static const std::array<float, 256>& fp8_table() {
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> t{};
+        for (int code = 0; code < 256; ++code) {
+            int exp = (code >> 3) & 0xF;
+            int mant = code & 0x7;
+            float v = exp == 0 ? std::ldexp(static_cast<float>(mant), -9)
+                               : std::ldexp(1.0f + static_cast<float>(mant) / 8.0f, exp - 7);
+            t[code] = (code & 0x80) ? -v : v;
+        }
+        return t;
+    }();
+    return table;
+}
+
+// --- Per-channel Quantization ---
+
+// The block is [rows][channels] FP16, row-major. The payload is one FP32
+// scale per channel followed by one code byte per value.
+static bool quantize(Codec codec, std::uint32_t channels, bytes_view data, std::uint8_t* out) {
+    const std::size_t values = data.size() / sizeof(std::uint16_t);
+    const std::size_t rows = values / channels;
+    const float qmax = codec == Codec::Int8 ? 127.0f : kFp8Max;
+
+    std::vector<float> scales(channels, 0.0f);
+    for (std::size_t r = 0; r < rows; ++r) {
+        for (std::uint32_t c = 0; c < channels; ++c) {
+            std::uint16_t h;
+            std::memcpy(&h, data.data() + (r * channels + c) * sizeof(h), sizeof(h));
+            float v = std::fabs(half_to_float(h));
+            if (std::isfinite(v)) {
+                scales[c] = std::max(scales[c], v);
+            }
+        }
+    }
+    for (float& s : scales) {
+        s = s > 0.0f ? s / qmax : 1.0f;
+    }
+    std::memcpy(out, scales.data(), channels * sizeof(float));
+
+    std::uint8_t* codes = out + channels * sizeof(float);
+    for (std::size_t r = 0; r < rows; ++r) {
+        for (std::uint32_t c = 0; c < channels; ++c) {
+            std::uint16_t h;
+            std::memcpy(&h, data.data() + (r * channels + c) * sizeof(h), sizeof(h));
+            float v = half_to_float(h) / scales[c];
+            std::uint8_t code;
+            if (codec == Codec::Int8) {
+                float q = std::isfinite(v) ? std::nearbyint(std::clamp(v, -127.0f, 127.0f)) : 0.0f;
+                code = static_cast<std::uint8_t>(static_cast<std::int8_t>(q));
+            } else {
+                code = float_to_fp8(v);
+            }
+            codes[r * channels + c] = code;
+        }
+    }
+    return true;
+}
+
+static bool dequantize(Codec codec, std::uint32_t channels, bytes_view payload, mutable_bytes_view dest) {
+    const std::size_t values = dest.size() / sizeof(std::uint16_t);
+    if (channels == 0 || values % channels != 0 ||
+        payload.size() != channels * sizeof(float) + values) {
+        return false;
+    }
+    std::vector<float> scales(channels);
+    std::memcpy(scales.data(), payload.data(), channels * sizeof(float));
+
+    const std::uint8_t* codes = payload.data() + channels * sizeof(float);
+    const auto& table = fp8_table();
+    for (std::size_t i = 0; i < values; ++i) {
+        float q = codec == Codec::Int8 ? static_cast<float>(static_cast<std::int8_t>(codes[i])) : table[codes[i]];
+        std::uint16_t h = float_to_half(q * scales[i % channels]);
+        std::memcpy(dest.data() + i * sizeof(h), &h, sizeof(h));
+    }
+    return true;
+}
+
+// --- Codec Dispatch ---
+
+bool CodecAvailable(Codec codec) {
+    switch (codec) {
+    case Codec::None:
+    case Codec::Int8:
+    case Codec::FP8:
+        return true;
+    case Codec::LZ4:
+#ifdef KVCACHE_WITH_LZ4
+        return true;
+#else
+        return false;
+#endif
+    case Codec::Zstd:
+#ifdef KVCACHE_WITH_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+bool EncodeBlock(const CodecOptions& options, bytes_view data, std::vector<std::uint8_t>* object) {
+    if (options.codec == Codec::None || !CodecAvailable(options.codec) || data.empty()) {
+        return false;
+    }
+
+    BlockHeader header{};
+    std::memcpy(header.magic, kBlockMagic, sizeof(kBlockMagic));
+    header.version = kBlockVersion;
+    header.codec = static_cast<std::uint8_t>(options.codec);
+    header.logical_size = data.size();
+
+    std::size_t payload_size = 0;
+    switch (options.codec) {
+    case Codec::Int8:
+    case Codec::FP8: {
+        const std::uint32_t channels = options.channels;
+        if (channels == 0 || data.size() % (static_cast<std::size_t>(channels) * sizeof(std::uint16_t)) != 0) {
+            return false; // Not an FP16 [rows][channels] block
+        }
+        header.channels = channels;
+        payload_size = channels * sizeof(float) + data.size() / sizeof(std::uint16_t);
+        object->resize(sizeof(header) + payload_size);
+        quantize(options.codec, channels, data, object->data() + sizeof(header));
+        break;
+    }
+#ifdef KVCACHE_WITH_LZ4
+    case Codec::LZ4: {
+        if (data.size() > static_cast<std::size_t>(LZ4_MAX_INPUT_SIZE)) {
+            return false;
+        }
+        const int src_size = static_cast<int>(data.size());
+        const int bound = LZ4_compressBound(src_size);
+        object->resize(sizeof(header) + static_cast<std::size_t>(bound));
+        const char* src = reinterpret_cast<const char*>(data.data());
+        char* dst = reinterpret_cast<char*>(object->data() + sizeof(header));
+        int n = options.level > 0 ? LZ4_compress_HC(src, dst, src_size, bound, options.level)
+                                  : LZ4_compress_default(src, dst, src_size, bound);
+        if (n <= 0) {
+            return false;
+        }
+        payload_size = static_cast<std::size_t>(n);
+        break;
+    }
+#endif
+#ifdef KVCACHE_WITH_ZSTD
+    case Codec::Zstd: {
+        const std::size_t bound = ZSTD_compressBound(data.size());
+        object->resize(sizeof(header) + bound);
+        std::size_t n = ZSTD_compress(object->data() + sizeof(header), bound, data.data(), data.size(),
+                                      options.level != 0 ? options.level : ZSTD_CLEVEL_DEFAULT);
+        if (ZSTD_isError(n)) {
+            return false;
+        }
+        payload_size = n;
+        break;
+    }
+#endif
+    default:
+        return false;
+    }
+
+    if (sizeof(header) + payload_size >= data.size()) {
+        return false; // Incompressible; raw is smaller
+    }
+    header.payload_size = payload_size;
+    object->resize(sizeof(header) + payload_size);
+    std::memcpy(object->data(), &header, sizeof(header));
+    return true;
+}
+
+bool ReadBlockHeader(bytes_view object, BlockHeader* header) {
+    if (object.size() < sizeof(BlockHeader)) {
+        return false;
+    }
+    std::memcpy(header, object.data(), sizeof(BlockHeader));
+    return std::memcmp(header->magic, kBlockMagic, sizeof(kBlockMagic)) == 0 &&
+           header->version == kBlockVersion;
+}
+
+bool DecodeBlock(bytes_view object, mutable_bytes_view dest) {
+    BlockHeader header;
+    if (!ReadBlockHeader(object, &header) || header.logical_size != dest.size() ||
+        header.payload_size != object.size() - sizeof(header)) {
+        return false;
+    }
+    bytes_view payload(object.data() + sizeof(header), header.payload_size);
+
+    switch (static_cast<Codec>(header.codec)) {
+    case Codec::Int8:
+    case Codec::FP8:
+        return dequantize(static_cast<Codec>(header.codec), header.channels, payload, dest);
+#ifdef KVCACHE_WITH_LZ4
+    case Codec::LZ4: {
+        if (dest.size() > static_cast<std::size_t>(LZ4_MAX_INPUT_SIZE)) {
+            return false;
+        }
+        int n = LZ4_decompress_safe(reinterpret_cast<const char*>(payload.data()),
+                                    reinterpret_cast<char*>(dest.data()),
+                                    static_cast<int>(payload.size()), static_cast<int>(dest.size()));
+        return n >= 0 && static_cast<std::size_t>(n) == dest.size();
+    }
+#endif
+#ifdef KVCACHE_WITH_ZSTD
+    case Codec::Zstd: {
+        std::size_t n = ZSTD_decompress(dest.data(), dest.size(), payload.data(), payload.size());
+        return !ZSTD_isError(n) && n == dest.size();
+    }
+#endif
+    default:
+        return false; // Written by a build with a codec this one lacks
+    }
+}
+
+} // namespace kvcache
@@ -0,0 +1,266 @@
+#include "kvcache/eviction_policy.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+namespace kvcache {
+
+namespace {
+
+constexpr std::uint32_t kNil = UINT32_MAX;
+
+// --- Slot Queues ---
+
+// Doubly linked FIFO queues threaded through a node array indexed by slot.
+// Front is the insertion end, back is the eviction end.
+class SlotQueues {
+public:
+    struct Node {
+        std::uint32_t prev = kNil;
+        std::uint32_t next = kNil;
+        std::uint64_t fingerprint = 0;
+        std::uint8_t queue = 0;
+        std::uint8_t freq = 0;
+    };
+
+    explicit SlotQueues(std::size_t num_queues) : queues_(num_queues) {}
+
+    Node& node(std::uint32_t slot) { return nodes_[slot]; }
+    const Node& node(std::uint32_t slot) const { return nodes_[slot]; }
+
+    void reserve(std::uint32_t slot) {
+        if (slot >= nodes_.size()) {
+            nodes_.resize(std::max<std::size_t>(slot + 1, nodes_.size() * 2));
+        }
+    }
+
+    void push_front(std::uint8_t q, std::uint32_t slot) {
+        Queue& queue = queues_[q];
+        Node& n = nodes_[slot];
+        n.queue = q;
+        n.prev = kNil;
+        n.next = queue.head;
+        if (queue.head != kNil) {
+            nodes_[queue.head].prev = slot;
+        } else {
+            queue.tail = slot;
+        }
+        queue.head = slot;
+        ++queue.size;
+    }
+
+    void push_back(std::uint8_t q, std::uint32_t slot) {
+        Queue& queue = queues_[q];
+        Node& n = nodes_[slot];
+        n.queue = q;
+        n.next = kNil;
+        n.prev = queue.tail;
+        if (queue.tail != kNil) {
+            nodes_[queue.tail].next = slot;
+        } else {
+            queue.head = slot;
+        }
+        queue.tail = slot;
+        ++queue.size;
+    }
+
+    void unlink(std::uint32_t slot) {
+        Node& n = nodes_[slot];
+        Queue& queue = queues_[n.queue];
+        if (n.prev != kNil) {
+            nodes_[n.prev].next = n.next;
+        } else {
+            queue.head = n.next;
+        }
+        if (n.next != kNil) {
+            nodes_[n.next].prev = n.prev;
+        } else {
+            queue.tail = n.prev;
+        }
+        n.prev = n.next = kNil;
+        --queue.size;
+    }
+
+    std::uint32_t back(std::uint8_t q) const { return queues_[q].tail; }
+    std::size_t size(std::uint8_t q) const { return queues_[q].size; }
+
+    void for_each(std::uint8_t q, const std::function<void(std::uint32_t)>& visit) const {
+        for (std::uint32_t s = queues_[q].tail; s != kNil; s = nodes_[s].prev) {
+            visit(s);
+        }
+    }
+
+private:
+    struct Queue {
+        std::uint32_t head = kNil;
+        std::uint32_t tail = kNil;
+        std::size_t size = 0;
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<Queue> queues_;
+};
+
+// --- LRU ---
+
+class LruPolicy : public EvictionPolicy {
+public:
+    LruPolicy() : queues_(1) {}
+
+    void Insert(std::uint32_t slot, std::uint64_t, bool cold) override {
+        queues_.reserve(slot);
+        if (cold) {
+            queues_.push_back(0, slot);
+        } else {
+            queues_.push_front(0, slot);
+        }
+    }
+
+    void Access(std::uint32_t slot) override {
+        queues_.unlink(slot);
+        queues_.push_front(0, slot);
+    }
+
+    void Remove(std::uint32_t slot) override { queues_.unlink(slot); }
+
+    bool Victim(std::uint32_t* slot) override {
+        std::uint32_t s = queues_.back(0);
+        if (s == kNil) {
+            return false;
+        }
+        queues_.unlink(s);
+        *slot = s;
+        return true;
+    }
+
+    void ForEach(const std::function<void(std::uint32_t)>& visit) const override {
+        queues_.for_each(0, visit);
+    }
+
+    std::size_t Size() const override { return queues_.size(0); }
+
+private:
+    SlotQueues queues_;
+};
+
+// --- S3-FIFO ---
+
+// S3-FIFO (Yang et al., SOSP '23): new keys enter a small FIFO holding about
+// 10% of the entries. Keys that are hit again before leaving it move to the
+// main FIFO; the rest are evicted and remembered in a ghost FIFO of
+// fingerprints, so a key that comes back soon goes straight to main. Main
+// evicts with CLOCK-style second chances. A burst of one-shot prefixes
+// therefore only cycles through the small queue and cannot flush the
+// shared prefixes held in main.
+class S3FifoPolicy : public EvictionPolicy {
+public:
+    S3FifoPolicy() : queues_(2) {}
+
+    void Insert(std::uint32_t slot, std::uint64_t fingerprint, bool cold) override {
+        queues_.reserve(slot);
+        auto& n = queues_.node(slot);
+        n.fingerprint = fingerprint;
+        n.freq = 0;
+
+        std::uint8_t q = kSmall;
+        auto ghost = ghost_.find(fingerprint);
+        if (ghost != ghost_.end()) {
+            ghost_.erase(ghost);
+            q = kMain;
+        }
+        if (cold) {
+            queues_.push_back(q, slot);
+        } else {
+            queues_.push_front(q, slot);
+        }
+    }
+
+    void Access(std::uint32_t slot) override {
+        auto& n = queues_.node(slot);
+        n.freq = static_cast<std::uint8_t>(std::min<int>(n.freq + 1, kMaxFreq));
+    }
+
+    void Remove(std::uint32_t slot) override { queues_.unlink(slot); }
+
+    bool Victim(std::uint32_t* slot) override {
+        while (Size() > 0) {
+            const std::size_t small_target = std::max<std::size_t>(1, Size() / 10);
+            if (queues_.size(kSmall) >= small_target || queues_.size(kMain) == 0) {
+                std::uint32_t s = queues_.back(kSmall);
+                auto& n = queues_.node(s);
+                queues_.unlink(s);
+                if (n.freq > 0) {
+                    n.freq = 0;
+                    queues_.push_front(kMain, s);
+                    continue;
+                }
+                remember(n.fingerprint);
+                *slot = s;
+                return true;
+            }
+
+            std::uint32_t s = queues_.back(kMain);
+            auto& n = queues_.node(s);
+            queues_.unlink(s);
+            if (n.freq > 0) {
+                --n.freq;
+                queues_.push_front(kMain, s);
+                continue;
+            }
+            *slot = s;
+            return true;
+        }
+        return false;
+    }
+
+    void ForEach(const std::function<void(std::uint32_t)>& visit) const override {
+        queues_.for_each(kSmall, visit);
+        queues_.for_each(kMain, visit);
+    }
+
+    std::size_t Size() const override { return queues_.size(kSmall) + queues_.size(kMain); }
+
+private:
+    static constexpr std::uint8_t kSmall = 0;
+    static constexpr std::uint8_t kMain = 1;
+    static constexpr int kMaxFreq = 3;
+    static constexpr std::size_t kMinGhost = 64;
+
+    void remember(std::uint64_t fingerprint) {
+        const std::uint64_t seq = ++ghost_seq_;
+        ghost_[fingerprint] = seq;
+        ghost_order_.emplace_back(fingerprint, seq);
+
+        // Keep about as many ghosts as resident entries
+        const std::size_t limit = std::max(kMinGhost, Size());
+        while (ghost_order_.size() > limit) {
+            auto [fp, s] = ghost_order_.front();
+            ghost_order_.pop_front();
+            auto it = ghost_.find(fp);
+            if (it != ghost_.end() && it->second == s) {
+                ghost_.erase(it);
+            }
+        }
+    }
+
+    SlotQueues queues_;
+    std::unordered_map<std::uint64_t, std::uint64_t> ghost_; // Fingerprint -> sequence
+    std::deque<std::pair<std::uint64_t, std::uint64_t>> ghost_order_;
+    std::uint64_t ghost_seq_ = 0;
+};
+
+} // namespace
+
+std::unique_ptr<EvictionPolicy> MakeEvictionPolicy(EvictionPolicyKind kind) {
+    switch (kind) {
+    case EvictionPolicyKind::S3Fifo:
+        return std::make_unique<S3FifoPolicy>();
+    case EvictionPolicyKind::LRU:
+    default:
+        return std::make_unique<LruPolicy>();
+    }
+}
+
+} // namespace kvcache
@@ -1,62 +1,156 @@
 #include "kvcache/hash.hpp"
-#include "xxhash.h" // Corrected include path
-#include <vector>
-#include <iomanip>
-#include <sstream>
 #include <algorithm>
-#include <iterator>
+#include <bit>
 #include <cstring>
+#include <stdexcept>
+#include <vector>
 
 namespace kvcache {
 
-// Helper to append little-endian data to a vector
+// Stores 'value' at 'out' in little-endian byte order
 template <typename T>
-void append_le(std::vector<std::uint8_t>& buf, T value) {
+static void store_le(std::uint8_t* out, T value) {
     for (size_t i = 0; i < sizeof(T); ++i) {
-        buf.push_back(static_cast<std::uint8_t>((value >> (i * 8)) & 0xFF));
+        out[i] = static_cast<std::uint8_t>((value >> (i * 8)) & 0xFF);
     }
 }
 
-PrefixKey MakePrefixKey(const std::vector<std::uint32_t>& tokens,
-                        std::uint32_t block_size,
-                        const std::string& model_id) {
-    std::vector<std::uint8_t> serialization_buffer;
-    serialization_buffer.reserve(1 + sizeof(block_size) + sizeof(uint16_t) + model_id.length() + tokens.size() * sizeof(uint32_t));
-
-    // 1. Version
-    serialization_buffer.push_back(1);
-
-    // 2. Block size
-    append_le(serialization_buffer, block_size);
-
-    // 3. Model ID
+// Feeds the key header (version, block size, model id) shared by
+// MakePrefixKey and PrefixHasher.
+static void update_key_header(const XxhOps& ops, XxhState* state,
+                              std::uint32_t block_size,
+                              const std::string& model_id) {
     if (model_id.length() > UINT16_MAX) {
         throw std::runtime_error("Model ID is too long.");
     }
-    append_le(serialization_buffer, static_cast<std::uint16_t>(model_id.length()));
-    serialization_buffer.insert(serialization_buffer.end(), model_id.begin(), model_id.end());
+    std::uint8_t header[1 + sizeof(block_size) + sizeof(std::uint16_t)];
+    header[0] = 1; // Version
+    store_le(header + 1, block_size);
+    store_le(header + 1 + sizeof(block_size), static_cast<std::uint16_t>(model_id.length()));
+    ops.update(state, header, sizeof(header));
+    ops.update(state, model_id.data(), model_id.size());
+}
 
-    // 4. Tokens
-    for (const auto& token : tokens) {
-        append_le(serialization_buffer, token);
+// Feeds tokens as little-endian uint32s. Little-endian hosts hash the
+// token array in place; others byte-swap through a stack buffer.
+static void update_tokens(const XxhOps& ops, XxhState* state, const std::uint32_t* tokens, std::size_t count) {
+    if constexpr (std::endian::native == std::endian::little) {
+        ops.update(state, tokens, count * sizeof(std::uint32_t));
+    } else {
+        std::uint8_t chunk[1024];
+        constexpr std::size_t kPerChunk = sizeof(chunk) / sizeof(std::uint32_t);
+        while (count > 0) {
+            const std::size_t n = std::min(count, kPerChunk);
+            for (std::size_t i = 0; i < n; ++i) {
+                store_le(chunk + i * sizeof(std::uint32_t), tokens[i]);
+            }
+            ops.update(state, chunk, n * sizeof(std::uint32_t));
+            tokens += n;
+            count -= n;
+        }
     }
+}
 
-    // Compute XXH3-128 hash
-    XXH128_hash_t hash = XXH3_128bits(serialization_buffer.data(), serialization_buffer.size());
-
-    // Return as a 16-byte array
+static PrefixKey to_prefix_key(const Hash128& hash) {
     PrefixKey key;
     std::memcpy(key.data(), &hash, sizeof(hash));
     return key;
 }
 
+PrefixKey MakeContentKey(bytes_view data, std::uint64_t seed) {
+    return to_prefix_key(XxhDispatch().hash(data.data(), data.size(), seed));
+}
+
+PrefixKey MakePrefixKey(tokens_view tokens,
+                        std::uint32_t block_size,
+                        const std::string& model_id) {
+    // Streaming over the pieces gives the same digest as one XXH3_128bits
+    // call over their concatenation
+    const XxhOps& ops = XxhDispatch();
+    XxhState state;
+    ops.reset(&state);
+    update_key_header(ops, &state, block_size, model_id);
+    update_tokens(ops, &state, tokens.data(), tokens.size());
+    return to_prefix_key(ops.digest(&state));
+}
+
+const char* HashBackend() {
+    return XxhDispatch().name;
+}
+
 std::string ToHex(const PrefixKey& key) {
-    std::stringstream ss;
-    ss << std::hex << std::setfill('0');
-    for (const auto& byte : key) {
-        ss << std::setw(2) << static_cast<int>(byte);
+    static constexpr char kDigits[] = "0123456789abcdef";
+    std::string hex(key.size() * 2, '0');
+    for (size_t i = 0; i < key.size(); ++i) {
+        hex[2 * i] = kDigits[key[i] >> 4];
+        hex[2 * i + 1] = kDigits[key[i] & 0x0F];
+    }
+    return hex;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool FromHex(const std::string& hex, PrefixKey* key) {
+    if (hex.size() != key->size() * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < key->size(); ++i) {
+        int hi = hex_value(hex[2 * i]);
+        int lo = hex_value(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        (*key)[i] = static_cast<std::uint8_t>((hi << 4) | lo);
+    }
+    return true;
+}
+
+// --- PrefixHasher ---
+
+PrefixHasher::PrefixHasher(std::uint32_t block_size, const std::string& model_id)
+    : ops_(XxhDispatch()), block_size_(block_size) {
+    ops_.reset(&state_);
+    update_key_header(ops_, &state_, block_size, model_id);
+}
+
+PrefixKey PrefixHasher::NextBlock(const std::uint32_t* block_tokens) {
+    update_tokens(ops_, &state_, block_tokens, block_size_);
+    ++blocks_hashed_;
+
+    // Digesting does not consume the state, so the stream continues from here.
+    return to_prefix_key(ops_.digest(&state_));
+}
+
+void MakeBlockPrefixKeys(tokens_view tokens,
+                         std::uint32_t block_size,
+                         const std::string& model_id,
+                         std::uint32_t num_blocks,
+                         PrefixKey* keys) {
+    if (static_cast<std::uint64_t>(num_blocks) * block_size > tokens.size()) {
+        throw std::invalid_argument("Not enough tokens for the requested number of blocks.");
+    }
+
+    PrefixHasher hasher(block_size, model_id);
+    for (std::uint32_t i = 0; i < num_blocks; ++i) {
+        keys[i] = hasher.NextBlock(tokens.data() + static_cast<size_t>(i) * block_size);
+    }
+}
+
+std::vector<PrefixKey> MakeBlockPrefixKeys(tokens_view tokens,
+                                           std::uint32_t block_size,
+                                           const std::string& model_id,
+                                           std::uint32_t num_blocks) {
+    if (static_cast<std::uint64_t>(num_blocks) * block_size > tokens.size()) {
+        throw std::invalid_argument("Not enough tokens for the requested number of blocks.");
     }
-    return ss.str();
+    std::vector<PrefixKey> keys(num_blocks);
+    MakeBlockPrefixKeys(tokens, block_size, model_id, num_blocks, keys.data());
+    return keys;
 }
 
 } // namespace kvcache
@@ -0,0 +1,554 @@
+#include "kvcache/index.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+
+namespace kvcache {
+
+static std::uint32_t round_up_pow2(std::uint32_t n) {
+    std::uint32_t p = 1;
+    while (p < n && p < (1u << 16)) {
+        p <<= 1;
+    }
+    return p;
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void record_wait(std::atomic<std::uint64_t>& contended, std::atomic<std::uint64_t>& wait_ns,
+                 Clock::time_point start) {
+    contended.fetch_add(1, std::memory_order_relaxed);
+    wait_ns.fetch_add(static_cast<std::uint64_t>(
+                          std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()),
+                      std::memory_order_relaxed);
+}
+
+// Takes 'lock', timing the wait into the counters only if it is contended
+template <typename Lock>
+void acquire(Lock& lock, std::atomic<std::uint64_t>& contended, std::atomic<std::uint64_t>& wait_ns) {
+    if (!lock.try_lock()) {
+        const auto start = Clock::now();
+        lock.lock();
+        record_wait(contended, wait_ns, start);
+    }
+}
+
+// Unique locks on a child's shard and its parent's shard, taken together
+// with std::lock so concurrent links in opposite directions cannot deadlock.
+// A wait is charged to the child's shard.
+struct PairLock {
+    std::unique_lock<std::shared_mutex> first;
+    std::unique_lock<std::shared_mutex> second;
+
+    PairLock(std::shared_mutex& a, std::shared_mutex* b, std::atomic<std::uint64_t>& contended,
+             std::atomic<std::uint64_t>& wait_ns)
+        : first(a, std::defer_lock) {
+        if (b && b != &a) {
+            second = std::unique_lock<std::shared_mutex>(*b, std::defer_lock);
+            if (std::try_lock(first, second) != -1) {
+                const auto start = Clock::now();
+                std::lock(first, second);
+                record_wait(contended, wait_ns, start);
+            }
+        } else {
+            acquire(first, contended, wait_ns);
+        }
+    }
+};
+
+} // namespace
+
+BlockIndex::BlockIndex(std::uint32_t num_shards, EvictionPolicyKind policy, std::uint32_t num_tenants) {
+    std::uint32_t n = round_up_pow2(num_shards == 0 ? 1 : num_shards);
+    num_tenants = std::clamp<std::uint32_t>(num_tenants, 1, 1u << 16);
+    shards_.reserve(n);
+    for (std::uint32_t i = 0; i < n; ++i) {
+        auto shard = std::make_unique<Shard>();
+        shard->policies.reserve(num_tenants);
+        for (std::uint32_t t = 0; t < num_tenants; ++t) {
+            shard->policies.push_back(MakeEvictionPolicy(policy));
+        }
+        shards_.push_back(std::move(shard));
+    }
+    shard_mask_ = n - 1;
+}
+
+BlockIndex::~BlockIndex() = default;
+
+std::shared_lock<std::shared_mutex> BlockIndex::lock_shared(const Shard& shard) {
+    std::shared_lock<std::shared_mutex> lock(shard.mutex, std::defer_lock);
+    acquire(lock, shard.lock_contended, shard.lock_wait_ns);
+    return lock;
+}
+
+std::unique_lock<std::shared_mutex> BlockIndex::lock_exclusive(const Shard& shard) {
+    std::unique_lock<std::shared_mutex> lock(shard.mutex, std::defer_lock);
+    acquire(lock, shard.lock_contended, shard.lock_wait_ns);
+    return lock;
+}
+
+BlockIndex::Shard& BlockIndex::shard_for(const PrefixKey& key) const {
+    std::uint64_t high;
+    std::memcpy(&high, key.data() + sizeof(high), sizeof(high));
+    return *shards_[high & shard_mask_];
+}
+
+EvictionPolicy& BlockIndex::policy_for(const Shard& shard, TenantId tenant) {
+    const std::size_t t = std::min<std::size_t>(tenant, shard.policies.size() - 1);
+    return *shard.policies[t];
+}
+
+std::int64_t BlockIndex::insert(const PrefixKey& key, const BlockInfo& info, bool cold, bool* inserted,
+                                std::optional<BlockInfo>* previous) {
+    const bool linked = info.has_parent && info.parent != key;
+    Shard& shard = shard_for(key);
+    Shard* parent_shard = linked ? &shard_for(info.parent) : nullptr;
+    PairLock lock(shard.mutex, parent_shard ? &parent_shard->mutex : nullptr, shard.lock_contended,
+                  shard.lock_wait_ns);
+
+    if (inserted) {
+        *inserted = false;
+    }
+    auto it = shard.slots.find(key);
+    if (it != shard.slots.end()) {
+        if (cold) {
+            return 0;
+        }
+        const std::uint32_t slot = it->second;
+        Entry& entry = shard.entries[slot];
+        if (previous) {
+            *previous = entry.info;
+        }
+        std::int64_t delta = static_cast<std::int64_t>(info.size) - static_cast<std::int64_t>(entry.info.size);
+        // Everything but the lineage, which only changes through linking
+        const bool had_parent = entry.info.has_parent;
+        const PrefixKey parent = entry.info.parent;
+        EvictionPolicy& old_policy = policy_for(shard, entry.info.tenant);
+        entry.info = info;
+        entry.info.has_parent = had_parent;
+        entry.info.parent = parent;
+        entry.last_access = clock_.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (entry.evictable) {
+            EvictionPolicy& new_policy = policy_for(shard, entry.info.tenant);
+            if (&new_policy == &old_policy) {
+                new_policy.Access(slot);
+            } else {
+                // Re-stored by another tenant, which now owns it
+                old_policy.Remove(slot);
+                new_policy.Insert(slot, PrefixKeyHash{}(key), false);
+            }
+        }
+        if (linked && !entry.info.has_parent) {
+            // Lineage was unknown (rebuilt from a LIST); link it now
+            entry.info.has_parent = true;
+            entry.info.parent = info.parent;
+            link_locked(*parent_shard, key, info.parent);
+        }
+        return delta;
+    }
+
+    BlockInfo stored = info;
+    stored.has_parent = linked;
+    insert_locked(shard, key, stored, cold);
+    if (linked) {
+        link_locked(*parent_shard, key, info.parent);
+    }
+    if (inserted) {
+        *inserted = true;
+    }
+    return static_cast<std::int64_t>(info.size);
+}
+
+void BlockIndex::insert_locked(Shard& shard, const PrefixKey& key, const BlockInfo& info, bool cold) {
+    std::uint32_t slot;
+    if (!shard.free_slots.empty()) {
+        slot = shard.free_slots.back();
+        shard.free_slots.pop_back();
+    } else {
+        slot = static_cast<std::uint32_t>(shard.entries.size());
+        shard.entries.emplace_back();
+    }
+    Entry& entry = shard.entries[slot];
+    entry.key = key;
+    entry.info = info;
+    entry.children.clear();
+    entry.last_access = clock_.fetch_add(1, std::memory_order_relaxed) + 1;
+    entry.evictable = false;
+    shard.slots.emplace(key, slot);
+
+    // Adopt children that were stored before this block
+    auto range = shard.orphans.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        entry.children.push_back(it->second);
+    }
+    shard.orphans.erase(range.first, range.second);
+
+    if (entry.children.empty()) {
+        promote_locked(shard, slot, cold);
+    }
+}
+
+void BlockIndex::link_locked(Shard& parent_shard, const PrefixKey& key, const PrefixKey& parent) {
+    auto it = parent_shard.slots.find(parent);
+    if (it == parent_shard.slots.end()) {
+        auto range = parent_shard.orphans.equal_range(parent);
+        for (auto o = range.first; o != range.second; ++o) {
+            if (o->second == key) {
+                return;
+            }
+        }
+        parent_shard.orphans.emplace(parent, key);
+        return;
+    }
+
+    const std::uint32_t slot = it->second;
+    Entry& entry = parent_shard.entries[slot];
+    if (std::find(entry.children.begin(), entry.children.end(), key) != entry.children.end()) {
+        return;
+    }
+    entry.children.push_back(key);
+    if (entry.evictable) {
+        policy_for(parent_shard, entry.info.tenant).Remove(slot);
+        entry.evictable = false;
+    }
+}
+
+void BlockIndex::promote_locked(Shard& shard, std::uint32_t slot, bool cold) {
+    Entry& entry = shard.entries[slot];
+    policy_for(shard, entry.info.tenant).Insert(slot, PrefixKeyHash{}(entry.key), cold);
+    entry.evictable = true;
+}
+
+void BlockIndex::release_locked(Shard& shard, std::uint32_t slot) {
+    Entry& entry = shard.entries[slot];
+    shard.slots.erase(entry.key);
+    entry.children.clear();
+    entry.evictable = false;
+    shard.free_slots.push_back(slot);
+}
+
+bool BlockIndex::remove_node(const PrefixKey& key, BlockInfo* info, std::vector<PrefixKey>* children) {
+    BlockInfo removed;
+    std::uint64_t last_access;
+    {
+        Shard& shard = shard_for(key);
+        auto lock = lock_exclusive(shard);
+        auto it = shard.slots.find(key);
+        if (it == shard.slots.end()) {
+            return false;
+        }
+        const std::uint32_t slot = it->second;
+        Entry& entry = shard.entries[slot];
+        removed = entry.info;
+        last_access = entry.last_access;
+        if (entry.evictable) {
+            policy_for(shard, entry.info.tenant).Remove(slot);
+        }
+        if (children) {
+            *children = std::move(entry.children);
+        } else {
+            // Keep the lineage so the children are adopted again if this
+            // key comes back
+            for (const auto& child : entry.children) {
+                shard.orphans.emplace(key, child);
+            }
+        }
+        release_locked(shard, slot);
+    }
+
+    if (removed.has_parent) {
+        detach(key, removed.parent, last_access);
+    }
+    if (info) {
+        *info = removed;
+    }
+    return true;
+}
+
+void BlockIndex::detach(const PrefixKey& key, const PrefixKey& parent, std::uint64_t last_access) {
+    Shard& shard = shard_for(key);
+    Shard& parent_shard = shard_for(parent);
+    PairLock lock(parent_shard.mutex, &shard.mutex, shard.lock_contended, shard.lock_wait_ns);
+    if (shard.slots.count(key) != 0) {
+        return; // Stored again meanwhile; the link still holds
+    }
+
+    auto it = parent_shard.slots.find(parent);
+    if (it == parent_shard.slots.end()) {
+        auto range = parent_shard.orphans.equal_range(parent);
+        for (auto o = range.first; o != range.second; ++o) {
+            if (o->second == key) {
+                parent_shard.orphans.erase(o);
+                break;
+            }
+        }
+        return;
+    }
+
+    const std::uint32_t slot = it->second;
+    Entry& entry = parent_shard.entries[slot];
+    auto child = std::find(entry.children.begin(), entry.children.end(), key);
+    if (child != entry.children.end()) {
+        entry.children.erase(child);
+    }
+    if (entry.children.empty() && !entry.evictable) {
+        // Now a leaf. Unless it was hit after its last child, the chain is
+        // cold, so it goes where the policy evicts first.
+        promote_locked(parent_shard, slot, entry.last_access <= last_access);
+    }
+}
+
+bool BlockIndex::Find(const PrefixKey& key, BlockInfo* info) const {
+    const Shard& shard = shard_for(key);
+    auto lock = lock_shared(shard);
+    auto it = shard.slots.find(key);
+    if (it == shard.slots.end()) {
+        return false;
+    }
+    if (info) {
+        *info = shard.entries[it->second].info;
+    }
+    return true;
+}
+
+std::int64_t BlockIndex::Upsert(const PrefixKey& key, const BlockInfo& info,
+                                std::optional<BlockInfo>* previous) {
+    return insert(key, info, false, nullptr, previous);
+}
+
+bool BlockIndex::InsertCold(const PrefixKey& key, const BlockInfo& info) {
+    bool inserted = false;
+    insert(key, info, true, &inserted, nullptr);
+    return inserted;
+}
+
+bool BlockIndex::Refresh(const PrefixKey& key, const BlockInfo& info) {
+    const bool linked = info.has_parent && info.parent != key;
+    Shard& shard = shard_for(key);
+    Shard* parent_shard = linked ? &shard_for(info.parent) : nullptr;
+    PairLock lock(shard.mutex, parent_shard ? &parent_shard->mutex : nullptr, shard.lock_contended,
+                  shard.lock_wait_ns);
+
+    auto it = shard.slots.find(key);
+    if (it == shard.slots.end()) {
+        return false;
+    }
+    Entry& entry = shard.entries[it->second];
+    if (entry.info.size != info.size || entry.info.has_content != info.has_content ||
+        (info.has_content && entry.info.content != info.content)) {
+        return false;
+    }
+
+    entry.last_access = clock_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (entry.evictable) {
+        policy_for(shard, entry.info.tenant).Access(it->second);
+    }
+    if (linked && !entry.info.has_parent) {
+        entry.info.has_parent = true;
+        entry.info.parent = info.parent;
+        link_locked(*parent_shard, key, info.parent);
+    }
+    return true;
+}
+
+bool BlockIndex::Touch(const PrefixKey& key) {
+    Shard& shard = shard_for(key);
+    auto lock = lock_exclusive(shard);
+    auto it = shard.slots.find(key);
+    if (it == shard.slots.end()) {
+        return false;
+    }
+    Entry& entry = shard.entries[it->second];
+    entry.last_access = clock_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (entry.evictable) {
+        policy_for(shard, entry.info.tenant).Access(it->second);
+    }
+    return true;
+}
+
+bool BlockIndex::Remove(const PrefixKey& key, BlockInfo* info) {
+    return remove_node(key, info, nullptr);
+}
+
+std::size_t BlockIndex::RemoveSubtree(const PrefixKey& key,
+                                      const std::function<void(const PrefixKey&, const BlockInfo&)>& visit) {
+    std::size_t removed = 0;
+    std::vector<PrefixKey> pending{key};
+    std::vector<PrefixKey> children;
+    while (!pending.empty()) {
+        PrefixKey next = pending.back();
+        pending.pop_back();
+        BlockInfo info;
+        if (!remove_node(next, &info, &children)) {
+            continue;
+        }
+        ++removed;
+        visit(next, info);
+        pending.insert(pending.end(), children.begin(), children.end());
+    }
+    return removed;
+}
+
+bool BlockIndex::EvictOne(PrefixKey* key, BlockInfo* info, TenantId tenant) {
+    const std::uint32_t n = NumShards();
+    std::uint32_t start = evict_cursor_.fetch_add(1, std::memory_order_relaxed);
+    for (std::uint32_t i = 0; i < n; ++i) {
+        Shard& shard = *shards_[(start + i) & shard_mask_];
+        std::uint64_t last_access;
+        {
+            auto lock = lock_exclusive(shard);
+            std::uint32_t slot;
+            if (!policy_for(shard, tenant).Victim(&slot)) {
+                continue;
+            }
+            const Entry& entry = shard.entries[slot];
+            *key = entry.key;
+            *info = entry.info;
+            last_access = entry.last_access;
+            release_locked(shard, slot);
+        }
+
+        if (info->has_parent) {
+            detach(*key, info->parent, last_access);
+        }
+        return true;
+    }
+    return false;
+}
+
+void BlockIndex::ForEach(const std::function<void(const PrefixKey&, const BlockInfo&)>& visit) const {
+    for (const auto& shard : shards_) {
+        auto lock = lock_shared(*shard);
+        // Interior blocks first; they are not evictable until their children leave
+        for (const auto& [key, slot] : shard->slots) {
+            if (!shard->entries[slot].evictable) {
+                visit(key, shard->entries[slot].info);
+            }
+        }
+        for (const auto& policy : shard->policies) {
+            policy->ForEach([&](std::uint32_t slot) {
+                visit(shard->entries[slot].key, shard->entries[slot].info);
+            });
+        }
+    }
+}
+
+bool BlockIndex::AcquireContent(const PrefixKey& content) {
+    Shard& shard = shard_for(content);
+    auto lock = lock_exclusive(shard);
+    return ++shard.content_refs[content] == 1;
+}
+
+bool BlockIndex::ReleaseContent(const PrefixKey& content) {
+    Shard& shard = shard_for(content);
+    auto lock = lock_exclusive(shard);
+    auto it = shard.content_refs.find(content);
+    if (it == shard.content_refs.end()) {
+        return false;
+    }
+    if (--it->second > 0) {
+        return false;
+    }
+    shard.content_refs.erase(it);
+    return true;
+}
+
+bool BlockIndex::HasContent(const PrefixKey& content) const {
+    const Shard& shard = shard_for(content);
+    auto lock = lock_shared(shard);
+    return shard.content_refs.count(content) != 0;
+}
+
+void BlockIndex::AcquireSegment(const PrefixKey& segment, const PrefixKey& key, std::uint64_t bytes,
+                                std::uint64_t payload_bytes) {
+    Shard& shard = shard_for(segment);
+    auto lock = lock_exclusive(shard);
+    SegmentRefs& refs = shard.segments[segment];
+    if (refs.blocks++ == 0) {
+        refs.payload_bytes = payload_bytes;
+    }
+    refs.live_bytes += bytes;
+    refs.members.push_back(key);
+}
+
+bool BlockIndex::ReleaseSegment(const PrefixKey& segment, std::uint64_t bytes) {
+    Shard& shard = shard_for(segment);
+    auto lock = lock_exclusive(shard);
+    auto it = shard.segments.find(segment);
+    if (it == shard.segments.end()) {
+        return false;
+    }
+    it->second.live_bytes -= std::min(bytes, it->second.live_bytes);
+    if (--it->second.blocks > 0) {
+        return false;
+    }
+    shard.segments.erase(it);
+    return true;
+}
+
+std::uint64_t BlockIndex::SegmentPayloadBytes(const PrefixKey& segment) const {
+    const Shard& shard = shard_for(segment);
+    auto lock = lock_shared(shard);
+    auto it = shard.segments.find(segment);
+    return it == shard.segments.end() ? 0 : it->second.payload_bytes;
+}
+
+std::vector<SegmentUsage> BlockIndex::SparseSegments(double max_live_ratio, std::size_t limit) const {
+    std::vector<SegmentUsage> sparse;
+    for (const auto& shard : shards_) {
+        auto lock = lock_shared(*shard);
+        for (const auto& [segment, refs] : shard->segments) {
+            if (sparse.size() >= limit) {
+                return sparse;
+            }
+            if (static_cast<double>(refs.live_bytes) <= static_cast<double>(refs.payload_bytes) * max_live_ratio) {
+                sparse.push_back({segment, refs.live_bytes, refs.payload_bytes, refs.members});
+            }
+        }
+    }
+    return sparse;
+}
+
+bool BlockIndex::Relocate(const PrefixKey& key, const PrefixKey& from, const PrefixKey& to, std::uint64_t offset,
+                          BlockInfo* info) {
+    Shard& shard = shard_for(key);
+    auto lock = lock_exclusive(shard);
+    auto it = shard.slots.find(key);
+    if (it == shard.slots.end()) {
+        return false;
+    }
+    BlockInfo& current = shard.entries[it->second].info;
+    if (!current.has_segment || current.segment != from) {
+        return false; // Evicted and re-stored, or moved already
+    }
+    current.segment = to;
+    current.offset = offset;
+    if (info) {
+        *info = current;
+    }
+    return true;
+}
+
+LockWaitStats BlockIndex::LockWaits() const {
+    LockWaitStats stats;
+    for (const auto& shard : shards_) {
+        stats.contended += shard->lock_contended.load(std::memory_order_relaxed);
+        stats.wait_ns += shard->lock_wait_ns.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+std::size_t BlockIndex::Size() const {
+    std::size_t total = 0;
+    for (const auto& shard : shards_) {
+        auto lock = lock_shared(*shard);
+        total += shard->slots.size();
+    }
+    return total;
+}
+
+} // namespace kvcache
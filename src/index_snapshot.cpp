@@ -0,0 +1,279 @@
+#include "kvcache/index_snapshot.hpp"
+#include "kvcache/hash.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace kvcache {
+
+static constexpr char kSnapshotMagic[8] = {'K', 'V', 'C', 'S', 'N', 'A', 'P', '1'};
+static constexpr char kJournalMagic[8] = {'K', 'V', 'C', 'J', 'R', 'N', 'L', '1'};
+static constexpr std::uint32_t kFormatVersion = 5; // 2: parent key, 3: content digest, 4: codec, 5: segments
+
+static bool write_fully(int fd, const void* data, std::size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::write(fd, p, size);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+IndexSnapshot::IndexSnapshot(const std::string& path, std::uint32_t block_size, const std::string& model_id)
+    : path_(path),
+      journal_path_(path + ".journal"),
+      old_journal_path_(path + ".journal.old"),
+      block_size_(block_size),
+      fingerprint_(MakePrefixKey({}, block_size, model_id)) {}
+
+IndexSnapshot::~IndexSnapshot() {
+    if (journal_fd_ >= 0) {
+        ::close(journal_fd_);
+    }
+}
+
+IndexSnapshot::FileHeader IndexSnapshot::make_header(const char* magic, std::uint64_t record_count) const {
+    FileHeader header{};
+    std::memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = kFormatVersion;
+    header.block_size = block_size_;
+    header.fingerprint = fingerprint_;
+    header.record_count = record_count;
+    return header;
+}
+
+bool IndexSnapshot::header_matches(const FileHeader& header, const char* magic) const {
+    return std::memcmp(header.magic, magic, sizeof(header.magic)) == 0 &&
+           header.version == kFormatVersion &&
+           header.block_size == block_size_ &&
+           header.fingerprint == fingerprint_;
+}
+
+std::uint64_t IndexSnapshot::replay_snapshot(const std::function<void(const IndexRecord&)>& apply) const {
+    int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(FileHeader)) {
+        ::close(fd);
+        return 0;
+    }
+
+    // Records are fixed-size and follow the header, so walk the mapping in place
+    std::size_t length = static_cast<std::size_t>(st.st_size);
+    void* map = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    ::madvise(map, length, MADV_SEQUENTIAL);
+
+    std::uint64_t applied = 0;
+    FileHeader header;
+    std::memcpy(&header, map, sizeof(header));
+    std::uint64_t available = (length - sizeof(FileHeader)) / sizeof(IndexRecord);
+    if (header_matches(header, kSnapshotMagic) && header.record_count <= available) {
+        const auto* base = static_cast<const std::uint8_t*>(map) + sizeof(FileHeader);
+        IndexRecord record;
+        for (std::uint64_t i = 0; i < header.record_count; ++i) {
+            std::memcpy(&record, base + i * sizeof(IndexRecord), sizeof(record));
+            apply(record);
+            ++applied;
+        }
+    }
+    ::munmap(map, length);
+    return applied;
+}
+
+std::uint64_t IndexSnapshot::replay_journal(const std::string& path,
+                                            const std::function<void(const IndexRecord&)>& apply) const {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+
+    std::uint64_t applied = 0;
+    FileHeader header;
+    if (::read(fd, &header, sizeof(header)) == static_cast<ssize_t>(sizeof(header)) &&
+        header_matches(header, kJournalMagic)) {
+        // A torn record at the tail (crash mid-append) is simply dropped
+        std::vector<IndexRecord> batch(4096);
+        ssize_t n;
+        while ((n = ::read(fd, batch.data(), batch.size() * sizeof(IndexRecord))) > 0) {
+            std::size_t count = static_cast<std::size_t>(n) / sizeof(IndexRecord);
+            for (std::size_t i = 0; i < count; ++i) {
+                apply(batch[i]);
+                ++applied;
+            }
+            if (static_cast<std::size_t>(n) % sizeof(IndexRecord) != 0) {
+                break;
+            }
+        }
+    }
+    ::close(fd);
+    return applied;
+}
+
+std::uint64_t IndexSnapshot::Load(const std::function<void(const IndexRecord&)>& apply) {
+    std::uint64_t applied = replay_snapshot(apply);
+    applied += replay_journal(old_journal_path_, apply);
+    applied += replay_journal(journal_path_, apply);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (journal_fd_ < 0) {
+        open_journal();
+    }
+    return applied;
+}
+
+bool IndexSnapshot::open_journal() {
+    // Assumes mutex_ is held. Appends to an existing journal so that a
+    // restart keeps the events not yet folded into a snapshot.
+    journal_fd_ = ::open(journal_path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (journal_fd_ < 0) {
+        return false;
+    }
+
+    struct stat st;
+    bool ok = ::fstat(journal_fd_, &st) == 0;
+    if (ok && st.st_size == 0) {
+        FileHeader header = make_header(kJournalMagic, 0);
+        ok = write_fully(journal_fd_, &header, sizeof(header));
+    } else if (ok) {
+        // Reject a journal from another configuration rather than append to it
+        FileHeader header;
+        int rfd = ::open(journal_path_.c_str(), O_RDONLY | O_CLOEXEC);
+        ok = rfd >= 0 && ::read(rfd, &header, sizeof(header)) == static_cast<ssize_t>(sizeof(header)) &&
+             header_matches(header, kJournalMagic);
+        if (rfd >= 0) {
+            ::close(rfd);
+        }
+        if (ok) {
+            // Drop a torn tail left by a crash so new records stay aligned
+            std::size_t body = static_cast<std::size_t>(st.st_size) - sizeof(FileHeader);
+            ok = ::ftruncate(journal_fd_, static_cast<off_t>(sizeof(FileHeader) + body / sizeof(IndexRecord) * sizeof(IndexRecord))) == 0;
+        }
+        if (!ok) {
+            ::close(journal_fd_);
+            journal_fd_ = ::open(journal_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+            FileHeader fresh = make_header(kJournalMagic, 0);
+            ok = journal_fd_ >= 0 && write_fully(journal_fd_, &fresh, sizeof(fresh));
+        }
+    }
+    if (!ok && journal_fd_ >= 0) {
+        ::close(journal_fd_);
+        journal_fd_ = -1;
+    }
+    return ok;
+}
+
+void IndexSnapshot::append(const IndexRecord& record) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (journal_fd_ >= 0) {
+        write_fully(journal_fd_, &record, sizeof(record));
+    }
+}
+
+void IndexSnapshot::AppendStore(IndexRecord record) {
+    record.op = IndexRecord::kStore;
+    append(record);
+}
+
+void IndexSnapshot::AppendEvict(const PrefixKey& key, std::uint32_t index) {
+    IndexRecord record{};
+    record.key = key;
+    record.index = index;
+    record.op = IndexRecord::kEvict;
+    append(record);
+}
+
+bool IndexSnapshot::fold_into_old_journal() {
+    // Assumes mutex_ is held and the journal is closed. Appends the current
+    // journal's records to the old one, then removes the current journal.
+    int in = ::open(journal_path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return errno == ENOENT;
+    }
+    int out = ::open(old_journal_path_.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    struct stat st;
+    bool ok = out >= 0 && ::fstat(in, &st) == 0 &&
+              ::lseek(in, sizeof(FileHeader), SEEK_SET) == static_cast<off_t>(sizeof(FileHeader));
+
+    // Copy whole records only, so a torn tail cannot misalign the old journal
+    std::size_t remaining = 0;
+    if (ok && static_cast<std::size_t>(st.st_size) > sizeof(FileHeader)) {
+        remaining = (static_cast<std::size_t>(st.st_size) - sizeof(FileHeader)) / sizeof(IndexRecord) * sizeof(IndexRecord);
+    }
+    std::vector<char> buf(1 << 16);
+    while (ok && remaining > 0) {
+        ssize_t n = ::read(in, buf.data(), std::min(buf.size(), remaining));
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        ok = write_fully(out, buf.data(), static_cast<std::size_t>(n));
+        remaining -= static_cast<std::size_t>(n);
+    }
+    ::close(in);
+    if (out >= 0) {
+        ok = (::close(out) == 0) && ok;
+    }
+    return ok && ::unlink(journal_path_.c_str()) == 0;
+}
+
+bool IndexSnapshot::Write(const std::function<std::vector<IndexRecord>()>& collect) {
+    std::vector<IndexRecord> records;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        records = collect();
+
+        // Events from here on go to a fresh journal. The current one stays on
+        // disk until the snapshot that covers it is in place.
+        if (journal_fd_ >= 0) {
+            ::close(journal_fd_);
+            journal_fd_ = -1;
+        }
+        bool rotated;
+        if (::access(old_journal_path_.c_str(), F_OK) == 0) {
+            // An earlier snapshot failed, so the old journal is still needed
+            rotated = fold_into_old_journal();
+        } else {
+            rotated = ::rename(journal_path_.c_str(), old_journal_path_.c_str()) == 0 || errno == ENOENT;
+        }
+        open_journal();
+        if (!rotated) {
+            return false;
+        }
+    }
+
+    std::string tmp_path = path_ + ".tmp";
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0;
+    if (ok) {
+        FileHeader header = make_header(kSnapshotMagic, records.size());
+        ok = write_fully(fd, &header, sizeof(header)) &&
+             write_fully(fd, records.data(), records.size() * sizeof(IndexRecord)) &&
+             ::fsync(fd) == 0;
+        ok = (::close(fd) == 0) && ok;
+    }
+    ok = ok && ::rename(tmp_path.c_str(), path_.c_str()) == 0;
+    if (!ok) {
+        ::unlink(tmp_path.c_str());
+        return false;
+    }
+
+    ::unlink(old_journal_path_.c_str());
+    return true;
+}
+
+} // namespace kvcache
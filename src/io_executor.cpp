@@ -0,0 +1,75 @@
+#include "kvcache/io_executor.hpp"
+
+namespace kvcache {
+
+// The executor whose worker is running on this thread, if any
+static thread_local const IoExecutor* t_current_executor = nullptr;
+
+IoExecutor::IoExecutor(std::uint32_t num_threads, std::uint32_t max_inflight)
+    : max_inflight_(max_inflight == 0 ? 1 : max_inflight) {
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+    threads_.reserve(num_threads);
+    for (std::uint32_t i = 0; i < num_threads; ++i) {
+        threads_.emplace_back(&IoExecutor::WorkerLoop, this);
+    }
+}
+
+IoExecutor::~IoExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_work_.notify_all();
+    for (auto& t : threads_) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+}
+
+void IoExecutor::Submit(std::function<void()> task) {
+    if (t_current_executor == this) {
+        task(); // Already on a worker, holding a slot
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_space_.wait(lock, [this] { return in_flight_ < max_inflight_; });
+        queue_.push_back(std::move(task));
+        ++in_flight_;
+    }
+    cv_work_.notify_one();
+}
+
+std::size_t IoExecutor::InFlight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_flight_;
+}
+
+void IoExecutor::WorkerLoop() {
+    t_current_executor = this;
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_work_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                break; // Stopping and fully drained
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --in_flight_;
+        }
+        cv_space_.notify_one();
+    }
+}
+
+} // namespace kvcache
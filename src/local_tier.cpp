@@ -0,0 +1,230 @@
+#include "kvcache/local_tier.hpp"
+
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace kvcache {
+
+// --- MemoryTier ---
+
+MemoryTier::MemoryTier(std::uint64_t capacity_bytes) : capacity_bytes_(capacity_bytes) {}
+
+BlockBuffer MemoryTier::Get(const PrefixKey& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        return nullptr;
+    }
+    lru_list_.splice(lru_list_.begin(), lru_list_, it->second.lru_it);
+    return it->second.data;
+}
+
+std::vector<std::pair<PrefixKey, BlockBuffer>> MemoryTier::Put(const PrefixKey& key, BlockBuffer data) {
+    std::vector<std::pair<PrefixKey, BlockBuffer>> evicted;
+    if (!data || data->size() > capacity_bytes_) {
+        return evicted;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        used_bytes_ -= it->second.data->size();
+        it->second.data = std::move(data);
+        used_bytes_ += it->second.data->size();
+        lru_list_.splice(lru_list_.begin(), lru_list_, it->second.lru_it);
+    } else {
+        used_bytes_ += data->size();
+        lru_list_.push_front(key);
+        entries_.emplace(key, Entry{std::move(data), lru_list_.begin()});
+    }
+
+    while (used_bytes_ > capacity_bytes_) {
+        PrefixKey victim = lru_list_.back();
+        lru_list_.pop_back();
+        auto victim_it = entries_.find(victim);
+        used_bytes_ -= victim_it->second.data->size();
+        evicted.emplace_back(victim, std::move(victim_it->second.data));
+        entries_.erase(victim_it);
+    }
+    return evicted;
+}
+
+void MemoryTier::Erase(const PrefixKey& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        used_bytes_ -= it->second.data->size();
+        lru_list_.erase(it->second.lru_it);
+        entries_.erase(it);
+    }
+}
+
+std::uint64_t MemoryTier::UsedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_bytes_;
+}
+
+// --- DiskTier ---
+
+DiskTier::DiskTier(const std::string& dir, std::uint64_t capacity_bytes)
+    : dir_(dir), capacity_bytes_(capacity_bytes) {
+    // The in-memory map starts empty, so anything already on disk is garbage
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    for (const auto& entry : std::filesystem::directory_iterator(dir_, ec)) {
+        if (entry.path().extension() == ".kv" || entry.path().extension() == ".tmp") {
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+}
+
+std::string DiskTier::path_for(const PrefixKey& key, std::uint64_t generation) const {
+    return dir_ + "/" + ToHex(key) + "." + std::to_string(generation) + ".kv";
+}
+
+static bool write_all(int fd, const std::uint8_t* data, std::size_t size) {
+    std::size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::pwrite(fd, data + done, size - done, static_cast<off_t>(done));
+        if (n <= 0) {
+            return false;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool DiskTier::Put(const PrefixKey& key, bytes_view data) {
+    if (data.size() > capacity_bytes_) {
+        return false;
+    }
+
+    // Reserve room first; victims are unlinked once the lock is dropped
+    std::vector<std::string> victims;
+    std::uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            lru_list_.splice(lru_list_.begin(), lru_list_, it->second.lru_it);
+            return true; // Blocks are immutable; the copy on disk is current
+        }
+        while (used_bytes_ + data.size() > capacity_bytes_ && !lru_list_.empty()) {
+            PrefixKey victim = lru_list_.back();
+            lru_list_.pop_back();
+            auto victim_it = entries_.find(victim);
+            used_bytes_ -= victim_it->second.size;
+            victims.push_back(path_for(victim, victim_it->second.generation));
+            entries_.erase(victim_it);
+        }
+        used_bytes_ += data.size();
+        generation = next_generation_++;
+    }
+    for (const auto& victim : victims) {
+        ::unlink(victim.c_str());
+    }
+
+    std::string final_path = path_for(key, generation);
+    std::string tmp_path = final_path + ".tmp";
+
+    bool ok = false;
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        ok = write_all(fd, data.data(), data.size());
+        ok = (::close(fd) == 0) && ok;
+        ok = ok && ::rename(tmp_path.c_str(), final_path.c_str()) == 0;
+        if (!ok) {
+            ::unlink(tmp_path.c_str());
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ok && entries_.count(key) == 0) {
+            lru_list_.push_front(key);
+            entries_.emplace(key, Entry{data.size(), generation, lru_list_.begin()});
+            return true;
+        }
+        used_bytes_ -= data.size(); // Failed, or a concurrent Put won the race
+    }
+    if (ok) {
+        ::unlink(final_path.c_str()); // The winner's file has its own name
+    }
+    return ok;
+}
+
+bool DiskTier::Get(const PrefixKey& key, mutable_bytes_view dest, std::uint64_t* bytes_read) {
+    std::uint64_t size;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end()) {
+            return false;
+        }
+        size = it->second.size;
+        path = path_for(key, it->second.generation);
+        lru_list_.splice(lru_list_.begin(), lru_list_, it->second.lru_it);
+    }
+    if (size > dest.size()) {
+        return false;
+    }
+
+    // An open descriptor keeps reading fine even if Erase unlinks the file
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    std::uint64_t done = 0;
+    while (done < size) {
+        ssize_t n = ::pread(fd, dest.data() + done, size - done, static_cast<off_t>(done));
+        if (n <= 0) {
+            break;
+        }
+        done += static_cast<std::uint64_t>(n);
+    }
+    ::close(fd);
+
+    if (done != size) {
+        return false;
+    }
+    if (bytes_read) {
+        *bytes_read = size;
+    }
+    return true;
+}
+
+bool DiskTier::Contains(const PrefixKey& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        return false;
+    }
+    lru_list_.splice(lru_list_.begin(), lru_list_, it->second.lru_it);
+    return true;
+}
+
+void DiskTier::Erase(const PrefixKey& key) {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end()) {
+            return;
+        }
+        path = path_for(key, it->second.generation);
+        used_bytes_ -= it->second.size;
+        lru_list_.erase(it->second.lru_it);
+        entries_.erase(it);
+    }
+    ::unlink(path.c_str());
+}
+
+std::uint64_t DiskTier::UsedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_bytes_;
+}
+
+} // namespace kvcache
@@ -2,37 +2,50 @@
 
 namespace kvcache {
 
+LRUTracker::LRUTracker(EvictionPolicyKind policy) : policy_(MakeEvictionPolicy(policy)) {}
+
+LRUTracker::~LRUTracker() = default;
+
 void LRUTracker::Touch(const std::string& key) {
     auto it = key_map_.find(key);
     if (it != key_map_.end()) {
-        // Key exists, move it to the front (MRU position)
-        lru_list_.splice(lru_list_.begin(), lru_list_, it->second);
+        policy_->Access(it->second);
+        return;
+    }
+
+    std::uint32_t slot;
+    if (!free_slots_.empty()) {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+        keys_[slot] = key;
     } else {
-        // Key doesn't exist, insert it at the front
-        lru_list_.push_front(key);
-        key_map_[key] = lru_list_.begin();
+        slot = static_cast<std::uint32_t>(keys_.size());
+        keys_.push_back(key);
     }
+    key_map_.emplace(key, slot);
+    policy_->Insert(slot, std::hash<std::string>{}(key), false);
 }
 
 void LRUTracker::Remove(const std::string& key) {
     auto it = key_map_.find(key);
     if (it != key_map_.end()) {
-        lru_list_.erase(it->second);
+        policy_->Remove(it->second);
+        free_slots_.push_back(it->second);
+        keys_[it->second].clear();
         key_map_.erase(it);
     }
 }
 
 std::optional<std::string> LRUTracker::Evict() {
-    if (lru_list_.empty()) {
+    std::uint32_t slot;
+    if (!policy_->Victim(&slot)) {
         return std::nullopt;
     }
 
-    // The key to evict is at the back of the list (LRU position)
-    std::string evicted_key = lru_list_.back();
-    
-    // Remove it from the list and the map
-    lru_list_.pop_back();
+    std::string evicted_key = std::move(keys_[slot]);
+    keys_[slot].clear();
     key_map_.erase(evicted_key);
+    free_slots_.push_back(slot);
 
     return evicted_key;
 }
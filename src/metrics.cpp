@@ -0,0 +1,541 @@
+#include "kvcache/metrics.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+
+namespace kvcache {
+
+namespace {
+
+thread_local std::uint64_t t_current_span = 0;
+std::atomic<std::uint64_t> g_next_span{1};
+std::atomic<std::size_t> g_next_stripe{0};
+
+std::uint64_t now_ns() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::steady_clock::now().time_since_epoch())
+                                          .count());
+}
+
+} // namespace
+
+const char* OpName(Op op) {
+    switch (op) {
+    case Op::Lookup: return "lookup";
+    case Op::Load: return "load";
+    case Op::LoadAll: return "load_all";
+    case Op::Store: return "store";
+    case Op::StoreSequence: return "store_sequence";
+    case Op::S3Get: return "s3.get";
+    case Op::S3Put: return "s3.put";
+    case Op::S3Delete: return "s3.delete";
+    case Op::S3List: return "s3.list";
+    case Op::kCount: break;
+    }
+    return "unknown";
+}
+
+// --- Metrics ---
+
+Metrics::Metrics(bool enabled, TraceSink trace_sink)
+    : enabled_(enabled), trace_sink_(std::move(trace_sink)) {
+    if (enabled_) {
+        stripes_ = std::make_unique<Stripe[]>(kStripes);
+    }
+}
+
+Metrics::~Metrics() = default;
+
+Metrics::Stripe& Metrics::stripe() const {
+    // Threads take stripes round-robin on first use; the same stripe index
+    // is used with every Metrics instance
+    thread_local const std::size_t index = g_next_stripe.fetch_add(1, std::memory_order_relaxed) % kStripes;
+    return stripes_[index];
+}
+
+std::size_t Metrics::BucketIndex(std::uint64_t ns) {
+    // Values below 4 are exact; above, four buckets per power of two
+    if (ns < 4) {
+        return static_cast<std::size_t>(ns);
+    }
+    const unsigned msb = 63 - static_cast<unsigned>(std::countl_zero(ns));
+    const std::size_t index = (msb - 1) * 4 + ((ns >> (msb - 2)) & 3);
+    return std::min(index, kBuckets - 1);
+}
+
+std::uint64_t Metrics::BucketLowerBound(std::size_t index) {
+    if (index < 4) {
+        return index;
+    }
+    const std::size_t msb = index / 4 + 1;
+    return (4 + index % 4) << (msb - 2);
+}
+
+void Metrics::Record(Op op, std::uint64_t ns) const {
+    if (!enabled_) {
+        return;
+    }
+    const auto i = static_cast<std::size_t>(op);
+    Stripe& s = stripe();
+    s.buckets[i][BucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    s.total_ns[i].fetch_add(ns, std::memory_order_relaxed);
+    std::uint64_t max = s.max_ns[i].load(std::memory_order_relaxed);
+    while (ns > max && !s.max_ns[i].compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void Metrics::AddInFlight(std::int64_t requests, std::int64_t bytes) const {
+    if (enabled_) {
+        requests_in_flight_.fetch_add(requests, std::memory_order_relaxed);
+        bytes_in_flight_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::fill(Op op, LatencyStats* stats) const {
+    const auto i = static_cast<std::size_t>(op);
+    std::array<std::uint64_t, kBuckets> buckets{};
+    for (std::size_t s = 0; s < kStripes; ++s) {
+        const Stripe& stripe = stripes_[s];
+        for (std::size_t b = 0; b < kBuckets; ++b) {
+            buckets[b] += stripe.buckets[i][b].load(std::memory_order_relaxed);
+        }
+        stats->total_ns += stripe.total_ns[i].load(std::memory_order_relaxed);
+        stats->max_ns = std::max(stats->max_ns, stripe.max_ns[i].load(std::memory_order_relaxed));
+    }
+    for (std::uint64_t n : buckets) {
+        stats->count += n;
+    }
+
+    // A percentile is the midpoint of the bucket holding its rank
+    auto percentile = [&](double p) -> std::uint64_t {
+        if (stats->count == 0) {
+            return 0;
+        }
+        const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(p / 100.0 * stats->count + 0.5));
+        std::uint64_t seen = 0;
+        for (std::size_t b = 0; b < kBuckets; ++b) {
+            seen += buckets[b];
+            if (seen >= rank) {
+                const std::uint64_t lo = BucketLowerBound(b);
+                const std::uint64_t hi = b + 1 < kBuckets ? BucketLowerBound(b + 1) : lo + 1;
+                return std::min(lo + (hi - lo) / 2, stats->max_ns);
+            }
+        }
+        return stats->max_ns;
+    };
+    stats->p50_ns = percentile(50);
+    stats->p90_ns = percentile(90);
+    stats->p99_ns = percentile(99);
+    stats->p999_ns = percentile(99.9);
+
+    // Bucket edges fall on powers of two, so these counts are exact
+    std::uint64_t below = 0;
+    std::size_t b = 0;
+    for (int k = 0; k < LatencyStats::kBounds; ++k) {
+        const std::uint64_t bound = LatencyStats::kBoundBaseNs << k;
+        for (; b < kBuckets && BucketLowerBound(b) < bound; ++b) {
+            below += buckets[b];
+        }
+        stats->le[k] = below;
+    }
+}
+
+void Metrics::Snapshot(CacheStats* stats) const {
+    if (!enabled_) {
+        return;
+    }
+    std::array<std::uint64_t, kCounters> c{};
+    for (std::size_t s = 0; s < kStripes; ++s) {
+        for (std::size_t i = 0; i < kCounters; ++i) {
+            c[i] += stripes_[s].counters[i].load(std::memory_order_relaxed);
+        }
+    }
+    auto get = [&](Counter counter) { return c[static_cast<std::size_t>(counter)]; };
+
+    stats->lookups = get(Counter::Lookups);
+    stats->lookup_hits = get(Counter::LookupHits);
+    stats->lookup_tokens = get(Counter::LookupTokens);
+    stats->matched_tokens = get(Counter::MatchedTokens);
+    stats->matched_blocks = get(Counter::MatchedBlocks);
+    stats->loads = get(Counter::Loads);
+    stats->load_failures = get(Counter::LoadFailures);
+    stats->loaded_bytes = get(Counter::LoadedBytes);
+    stats->dram_hits = get(Counter::DramHits);
+    stats->ssd_hits = get(Counter::SsdHits);
+    stats->s3_loads = get(Counter::S3Loads);
+    stats->coalesced_loads = get(Counter::CoalescedLoads);
+    stats->peer_loads = get(Counter::PeerLoads);
+    stats->peer_load_failures = get(Counter::PeerLoadFailures);
+    stats->peer_served = get(Counter::PeerServed);
+    stats->stores = get(Counter::Stores);
+    stats->store_failures = get(Counter::StoreFailures);
+    stats->stores_resident = get(Counter::StoresResident);
+    stats->stores_deduplicated = get(Counter::StoresDeduplicated);
+    stats->stores_not_admitted = get(Counter::StoresNotAdmitted);
+    stats->stored_bytes = get(Counter::StoredBytes);
+    stats->s3_gets = get(Counter::S3Gets);
+    stats->s3_get_errors = get(Counter::S3GetErrors);
+    stats->s3_get_bytes = get(Counter::S3GetBytes);
+    stats->s3_puts = get(Counter::S3Puts);
+    stats->s3_put_errors = get(Counter::S3PutErrors);
+    stats->s3_put_bytes = get(Counter::S3PutBytes);
+    stats->s3_deletes = get(Counter::S3Deletes);
+    stats->s3_delete_errors = get(Counter::S3DeleteErrors);
+    stats->s3_lists = get(Counter::S3Lists);
+    stats->evictions = get(Counter::Evictions);
+    stats->evicted_bytes = get(Counter::EvictedBytes);
+    stats->gc_passes = get(Counter::GcPasses);
+    stats->cluster_events_published = get(Counter::ClusterEventsPublished);
+    stats->cluster_events_applied = get(Counter::ClusterEventsApplied);
+    stats->cluster_events_lost = get(Counter::ClusterEventsLost);
+
+    stats->s3_requests_in_flight =
+        static_cast<std::uint64_t>(std::max<std::int64_t>(0, requests_in_flight_.load(std::memory_order_relaxed)));
+    stats->s3_bytes_in_flight =
+        static_cast<std::uint64_t>(std::max<std::int64_t>(0, bytes_in_flight_.load(std::memory_order_relaxed)));
+
+    fill(Op::Lookup, &stats->lookup);
+    fill(Op::Load, &stats->load);
+    fill(Op::LoadAll, &stats->load_all);
+    fill(Op::Store, &stats->store);
+    fill(Op::StoreSequence, &stats->store_sequence);
+    fill(Op::S3Get, &stats->s3_get);
+    fill(Op::S3Put, &stats->s3_put);
+    fill(Op::S3Delete, &stats->s3_delete);
+    fill(Op::S3List, &stats->s3_list);
+}
+
+// --- ScopedOp ---
+
+ScopedOp::ScopedOp(const Metrics& metrics, Op op)
+    : metrics_(metrics), op_(op), timed_(metrics.Enabled() || metrics.Tracing()) {
+    if (!timed_) {
+        return;
+    }
+    start_ns_ = now_ns();
+    if (metrics_.Tracing()) {
+        id_ = g_next_span.fetch_add(1, std::memory_order_relaxed);
+        parent_ = t_current_span;
+        t_current_span = id_;
+    }
+}
+
+ScopedOp::~ScopedOp() {
+    if (!timed_) {
+        return;
+    }
+    const std::uint64_t duration = now_ns() - start_ns_;
+    metrics_.Record(op_, duration);
+    if (id_ != 0) {
+        t_current_span = parent_;
+        metrics_.Emit(TraceSpan{OpName(op_), id_, parent_, start_ns_, duration, bytes_, ok_});
+    }
+}
+
+std::uint64_t ScopedOp::CurrentSpan() {
+    return t_current_span;
+}
+
+SpanParentScope::SpanParentScope(std::uint64_t parent) : saved_(t_current_span) {
+    t_current_span = parent;
+}
+
+SpanParentScope::~SpanParentScope() {
+    t_current_span = saved_;
+}
+
+// --- MeteredObjectStore ---
+
+MeteredObjectStore::MeteredObjectStore(std::shared_ptr<ObjectStore> inner, const Metrics& metrics)
+    : inner_(std::move(inner)), metrics_(metrics) {}
+
+bool MeteredObjectStore::get(std::uint64_t expected_bytes, const std::function<bool(std::uint64_t*)>& request) {
+    ScopedOp op(metrics_, Op::S3Get);
+    const auto in_flight = static_cast<std::int64_t>(expected_bytes);
+    metrics_.AddInFlight(1, in_flight);
+    std::uint64_t bytes_read = 0;
+    const bool ok = request(&bytes_read);
+    metrics_.AddInFlight(-1, -in_flight);
+
+    metrics_.Add(Counter::S3Gets);
+    if (ok) {
+        metrics_.Add(Counter::S3GetBytes, bytes_read);
+    } else {
+        metrics_.Add(Counter::S3GetErrors);
+    }
+    op.SetBytes(bytes_read);
+    op.SetOk(ok);
+    return ok;
+}
+
+bool MeteredObjectStore::GetObject(const std::string& key, std::vector<std::uint8_t>* data) {
+    return get(0, [&](std::uint64_t* n) {
+        bool ok = inner_->GetObject(key, data);
+        *n = ok ? data->size() : 0;
+        return ok;
+    });
+}
+
+bool MeteredObjectStore::GetObject(const std::string& key, mutable_bytes_view dest, std::uint64_t* bytes_read) {
+    return get(dest.size(), [&](std::uint64_t* n) {
+        bool ok = inner_->GetObject(key, dest, n);
+        if (ok && bytes_read) {
+            *bytes_read = *n;
+        }
+        return ok;
+    });
+}
+
+bool MeteredObjectStore::GetObjectRange(const std::string& key, std::uint64_t offset, mutable_bytes_view dest,
+                                        std::uint64_t* bytes_read) {
+    return get(dest.size(), [&](std::uint64_t* n) {
+        bool ok = inner_->GetObjectRange(key, offset, dest, n);
+        if (ok && bytes_read) {
+            *bytes_read = *n;
+        }
+        return ok;
+    });
+}
+
+bool MeteredObjectStore::GetObjectStreaming(const std::string& key, bool ranged, std::uint64_t offset,
+                                            mutable_bytes_view dest,
+                                            const std::function<bool(std::uint64_t received)>& on_progress,
+                                            std::uint64_t* bytes_read) {
+    return get(dest.size(), [&](std::uint64_t* n) {
+        bool ok = inner_->GetObjectStreaming(key, ranged, offset, dest, on_progress, n);
+        if (ok && bytes_read) {
+            *bytes_read = *n;
+        }
+        return ok;
+    });
+}
+
+bool MeteredObjectStore::PutObject(const std::string& key, bytes_view data) {
+    ScopedOp op(metrics_, Op::S3Put);
+    const auto in_flight = static_cast<std::int64_t>(data.size());
+    metrics_.AddInFlight(1, in_flight);
+    const bool ok = inner_->PutObject(key, data);
+    metrics_.AddInFlight(-1, -in_flight);
+
+    metrics_.Add(Counter::S3Puts);
+    if (ok) {
+        metrics_.Add(Counter::S3PutBytes, data.size());
+    } else {
+        metrics_.Add(Counter::S3PutErrors);
+    }
+    op.SetBytes(data.size());
+    op.SetOk(ok);
+    return ok;
+}
+
+bool MeteredObjectStore::DeleteObject(const std::string& key) {
+    ScopedOp op(metrics_, Op::S3Delete);
+    metrics_.AddInFlight(1, 0);
+    const bool ok = inner_->DeleteObject(key);
+    metrics_.AddInFlight(-1, 0);
+    metrics_.Add(Counter::S3Deletes);
+    if (!ok) {
+        metrics_.Add(Counter::S3DeleteErrors);
+    }
+    op.SetOk(ok);
+    return ok;
+}
+
+std::size_t MeteredObjectStore::DeleteObjects(const std::vector<std::string>& keys) {
+    ScopedOp op(metrics_, Op::S3Delete);
+    metrics_.AddInFlight(1, 0);
+    const std::size_t failed = inner_->DeleteObjects(keys);
+    metrics_.AddInFlight(-1, 0);
+    metrics_.Add(Counter::S3Deletes, keys.size());
+    metrics_.Add(Counter::S3DeleteErrors, failed);
+    op.SetOk(failed == 0);
+    return failed;
+}
+
+bool MeteredObjectStore::ListObjects(const std::string& prefix,
+                                     const std::function<bool(const std::string& key, std::uint64_t size)>& visit) {
+    // The caller's work per key is not the store's latency; time the
+    // listing alone by leaving the visits out
+    metrics_.Add(Counter::S3Lists);
+    const bool timed = metrics_.Enabled();
+    std::uint64_t visiting_ns = 0;
+    const std::uint64_t start = timed ? now_ns() : 0;
+    const bool ok = inner_->ListObjects(prefix, [&](const std::string& key, std::uint64_t size) {
+        if (!timed) {
+            return visit(key, size);
+        }
+        const std::uint64_t t0 = now_ns();
+        const bool more = visit(key, size);
+        visiting_ns += now_ns() - t0;
+        return more;
+    });
+    if (timed) {
+        metrics_.Record(Op::S3List, now_ns() - start - visiting_ns);
+    }
+    return ok;
+}
+
+// --- Prometheus ---
+
+namespace {
+
+void append(std::string* out, const char* fmt, const std::string& a, const char* b, double value) {
+    char line[256];
+    std::snprintf(line, sizeof(line), fmt, a.c_str(), b, value);
+    *out += line;
+}
+
+void metric(std::string* out, const std::string& prefix, const char* name, const char* type, const char* help) {
+    *out += "# HELP " + prefix + "_" + name + " " + help + "\n";
+    *out += "# TYPE " + prefix + "_" + name + " " + type + "\n";
+}
+
+void value(std::string* out, const std::string& prefix, const char* name, std::uint64_t v, const char* labels = "") {
+    *out += prefix + "_" + name + labels + " " + std::to_string(v) + "\n";
+}
+
+void counter(std::string* out, const std::string& prefix, const char* name, const char* help, std::uint64_t v) {
+    metric(out, prefix, name, "counter", help);
+    value(out, prefix, name, v);
+}
+
+void gauge(std::string* out, const std::string& prefix, const char* name, const char* help, std::uint64_t v) {
+    metric(out, prefix, name, "gauge", help);
+    value(out, prefix, name, v);
+}
+
+// Quotes a label value per the exposition format
+std::string label(const std::string& v) {
+    std::string quoted = "\"";
+    for (char c : v) {
+        if (c == '\\' || c == '"') {
+            quoted += '\\';
+            quoted += c;
+        } else if (c == '\n') {
+            quoted += "\\n";
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+void histogram(std::string* out, const std::string& prefix, const char* op, const LatencyStats& stats) {
+    const std::string name = prefix + "_op_duration_seconds";
+    for (int k = 0; k < LatencyStats::kBounds; ++k) {
+        char line[160];
+        std::snprintf(line, sizeof(line), "%s_bucket{op=\"%s\",le=\"%.9g\"} %llu\n", name.c_str(), op,
+                      static_cast<double>(LatencyStats::kBoundBaseNs << k) / 1e9,
+                      static_cast<unsigned long long>(stats.le[k]));
+        *out += line;
+    }
+    *out += name + "_bucket{op=\"" + op + "\",le=\"+Inf\"} " + std::to_string(stats.count) + "\n";
+    append(out, "%s_sum{op=\"%s\"} %.9g\n", name, op, static_cast<double>(stats.total_ns) / 1e9);
+    *out += name + "_count{op=\"" + op + "\"} " + std::to_string(stats.count) + "\n";
+}
+
+} // namespace
+
+std::string FormatPrometheus(const CacheStats& s, const std::string& prefix) {
+    std::string out;
+    counter(&out, prefix, "lookups_total", "Lookup calls.", s.lookups);
+    counter(&out, prefix, "lookup_hits_total", "Lookups that matched at least one block.", s.lookup_hits);
+    counter(&out, prefix, "lookup_tokens_total", "Tokens passed to Lookup.", s.lookup_tokens);
+    counter(&out, prefix, "matched_tokens_total", "Tokens matched by Lookup.", s.matched_tokens);
+    counter(&out, prefix, "matched_blocks_total", "Blocks matched by Lookup.", s.matched_blocks);
+
+    counter(&out, prefix, "loads_total", "Blocks loaded.", s.loads);
+    counter(&out, prefix, "load_failures_total", "Block loads that failed.", s.load_failures);
+    counter(&out, prefix, "loaded_bytes_total", "Bytes of blocks loaded.", s.loaded_bytes);
+    metric(&out, prefix, "load_source_total", "counter", "Block loads by where the bytes came from.");
+    value(&out, prefix, "load_source_total", s.dram_hits, "{source=\"dram\"}");
+    value(&out, prefix, "load_source_total", s.ssd_hits, "{source=\"ssd\"}");
+    value(&out, prefix, "load_source_total", s.s3_loads, "{source=\"s3\"}");
+    value(&out, prefix, "load_source_total", s.coalesced_loads, "{source=\"coalesced\"}");
+    value(&out, prefix, "load_source_total", s.peer_loads, "{source=\"peer\"}");
+    counter(&out, prefix, "peer_load_failures_total", "Peer fetches that fell back to the object store.",
+            s.peer_load_failures);
+    counter(&out, prefix, "peer_served_total", "Blocks served to other cluster nodes.", s.peer_served);
+
+    counter(&out, prefix, "stores_total", "Blocks stored.", s.stores);
+    counter(&out, prefix, "store_failures_total", "Block stores that failed.", s.store_failures);
+    counter(&out, prefix, "stores_resident_total", "Stores of blocks already resident.", s.stores_resident);
+    counter(&out, prefix, "stores_deduplicated_total", "Stores whose payload was already uploaded.",
+            s.stores_deduplicated);
+    counter(&out, prefix, "stores_not_admitted_total", "Stores declined by the admission policy.",
+            s.stores_not_admitted);
+    counter(&out, prefix, "stored_bytes_total", "Bytes of blocks stored.", s.stored_bytes);
+
+    metric(&out, prefix, "s3_requests_total", "counter", "Object store requests; deletes count keys.");
+    value(&out, prefix, "s3_requests_total", s.s3_gets, "{op=\"get\"}");
+    value(&out, prefix, "s3_requests_total", s.s3_puts, "{op=\"put\"}");
+    value(&out, prefix, "s3_requests_total", s.s3_deletes, "{op=\"delete\"}");
+    value(&out, prefix, "s3_requests_total", s.s3_lists, "{op=\"list\"}");
+    metric(&out, prefix, "s3_errors_total", "counter", "Object store requests that failed.");
+    value(&out, prefix, "s3_errors_total", s.s3_get_errors, "{op=\"get\"}");
+    value(&out, prefix, "s3_errors_total", s.s3_put_errors, "{op=\"put\"}");
+    value(&out, prefix, "s3_errors_total", s.s3_delete_errors, "{op=\"delete\"}");
+    metric(&out, prefix, "s3_bytes_total", "counter", "Bytes moved by object store requests.");
+    value(&out, prefix, "s3_bytes_total", s.s3_get_bytes, "{op=\"get\"}");
+    value(&out, prefix, "s3_bytes_total", s.s3_put_bytes, "{op=\"put\"}");
+
+    counter(&out, prefix, "evictions_total", "Blocks evicted by GC.", s.evictions);
+    counter(&out, prefix, "evicted_bytes_total", "Stored bytes released by eviction.", s.evicted_bytes);
+    counter(&out, prefix, "gc_passes_total", "GC eviction passes.", s.gc_passes);
+
+    metric(&out, prefix, "cluster_events_total", "counter", "Cluster index events by outcome.");
+    value(&out, prefix, "cluster_events_total", s.cluster_events_published, "{event=\"published\"}");
+    value(&out, prefix, "cluster_events_total", s.cluster_events_applied, "{event=\"applied\"}");
+    value(&out, prefix, "cluster_events_total", s.cluster_events_lost, "{event=\"lost\"}");
+
+    counter(&out, prefix, "lock_contended_total", "Index shard lock acquisitions that waited.", s.lock_contended);
+    metric(&out, prefix, "lock_wait_seconds_total", "counter", "Time spent waiting on index shard locks.");
+    append(&out, "%s_%s %.9g\n", prefix, "lock_wait_seconds_total", static_cast<double>(s.lock_wait_ns) / 1e9);
+
+    gauge(&out, prefix, "used_bytes", "Stored bytes counted against capacity.", s.used_bytes);
+    gauge(&out, prefix, "capacity_bytes", "Cache capacity.", s.capacity_bytes);
+    gauge(&out, prefix, "index_blocks", "Blocks in the index.", s.index_blocks);
+    gauge(&out, prefix, "gc_backlog_bytes", "Used bytes above the GC low watermark.", s.gc_backlog_bytes);
+    gauge(&out, prefix, "gc_pending_deletes", "DeleteObjects batches queued or running.", s.gc_pending_deletes);
+    metric(&out, prefix, "tier_bytes", "gauge", "Bytes held by each local tier.");
+    value(&out, prefix, "tier_bytes", s.dram_bytes, "{tier=\"dram\"}");
+    value(&out, prefix, "tier_bytes", s.ssd_bytes, "{tier=\"ssd\"}");
+    gauge(&out, prefix, "s3_requests_in_flight", "Object store requests under way.", s.s3_requests_in_flight);
+    gauge(&out, prefix, "s3_bytes_in_flight", "Bytes of object store GETs and PUTs under way.",
+          s.s3_bytes_in_flight);
+    gauge(&out, prefix, "io_in_flight", "I/O pool tasks queued or running.", s.io_in_flight);
+    gauge(&out, prefix, "write_behind_bytes", "Bytes queued for write-behind upload.", s.write_behind_bytes);
+    gauge(&out, prefix, "prefetch_bytes", "Bytes queued or in flight for prefetch.", s.prefetch_bytes);
+    gauge(&out, prefix, "cluster_nodes", "Live cluster nodes including this one.", s.cluster_nodes);
+    gauge(&out, prefix, "cluster_leader", "1 if this node runs eviction for the cluster.", s.cluster_leader ? 1 : 0);
+    gauge(&out, prefix, "buffer_pool_bytes_in_use", "Pooled buffer bytes in use.", s.buffers.bytes_in_use);
+    gauge(&out, prefix, "buffer_pool_bytes_reserved", "Buffer pool slab bytes mapped.", s.buffers.bytes_reserved);
+    if (!s.tenants.empty()) {
+        metric(&out, prefix, "tenant_used_bytes", "gauge", "Stored bytes counted against each tenant.");
+        for (const auto& tenant : s.tenants) {
+            const std::string labels = "{tenant=" + label(tenant.name) + "}";
+            value(&out, prefix, "tenant_used_bytes", tenant.used_bytes, labels.c_str());
+        }
+        metric(&out, prefix, "tenant_capacity_bytes", "gauge", "Tenant quota; 0 without one.");
+        for (const auto& tenant : s.tenants) {
+            const std::string labels = "{tenant=" + label(tenant.name) + "}";
+            value(&out, prefix, "tenant_capacity_bytes", tenant.capacity_bytes, labels.c_str());
+        }
+    }
+
+    metric(&out, prefix, "op_duration_seconds", "histogram", "Latency of cache operations and store requests.");
+    histogram(&out, prefix, "lookup", s.lookup);
+    histogram(&out, prefix, "load", s.load);
+    histogram(&out, prefix, "load_all", s.load_all);
+    histogram(&out, prefix, "store", s.store);
+    histogram(&out, prefix, "store_sequence", s.store_sequence);
+    histogram(&out, prefix, "s3_get", s.s3_get);
+    histogram(&out, prefix, "s3_put", s.s3_put);
+    histogram(&out, prefix, "s3_delete", s.s3_delete);
+    histogram(&out, prefix, "s3_list", s.s3_list);
+    return out;
+}
+
+} // namespace kvcache
@@ -0,0 +1,252 @@
+#include "kvcache/object_store.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+
+namespace kvcache {
+
+// --- MemoryObjectStore ---
+
+MemoryObjectStore::Object MemoryObjectStore::find(const std::string& key) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = objects_.find(key);
+    return it == objects_.end() ? nullptr : it->second;
+}
+
+bool MemoryObjectStore::GetObject(const std::string& key, std::vector<std::uint8_t>* data) {
+    Object object = find(key);
+    if (!object) {
+        return false;
+    }
+    data->assign(object->begin(), object->end());
+    return true;
+}
+
+bool MemoryObjectStore::GetObject(const std::string& key, mutable_bytes_view dest, std::uint64_t* bytes_read) {
+    Object object = find(key);
+    if (!object || object->size() > dest.size()) {
+        return false;
+    }
+    if (!object->empty()) {
+        std::memcpy(dest.data(), object->data(), object->size());
+    }
+    if (bytes_read) {
+        *bytes_read = object->size();
+    }
+    return true;
+}
+
+bool MemoryObjectStore::GetObjectRange(const std::string& key, std::uint64_t offset, mutable_bytes_view dest,
+                                       std::uint64_t* bytes_read) {
+    Object object = find(key);
+    if (!object || offset > object->size()) {
+        return false;
+    }
+    std::size_t length = std::min<std::uint64_t>(dest.size(), object->size() - offset);
+    if (length > 0) {
+        std::memcpy(dest.data(), object->data() + offset, length);
+    }
+    if (bytes_read) {
+        *bytes_read = length;
+    }
+    return true;
+}
+
+bool MemoryObjectStore::GetObjectStreaming(const std::string& key, bool ranged, std::uint64_t offset,
+                                           mutable_bytes_view dest,
+                                           const std::function<bool(std::uint64_t received)>& on_progress,
+                                           std::uint64_t* bytes_read) {
+    Object object = find(key);
+    if (!object) {
+        return false;
+    }
+    if (!ranged) {
+        offset = 0;
+    } else if (dest.empty() || offset >= object->size()) {
+        return false;
+    }
+    std::size_t length = object->size() - offset;
+    if (ranged) {
+        length = std::min<std::size_t>(length, dest.size());
+    } else if (length > dest.size()) {
+        return false; // Does not fit
+    }
+
+    std::size_t received = 0;
+    while (received < length) {
+        std::size_t chunk = std::min(kStreamChunkBytes, length - received);
+        std::memcpy(dest.data() + received, object->data() + offset + received, chunk);
+        received += chunk;
+        if (!on_progress(received)) {
+            return false;
+        }
+    }
+    if (bytes_read) {
+        *bytes_read = length;
+    }
+    return true;
+}
+
+bool MemoryObjectStore::PutObject(const std::string& key, bytes_view data) {
+    // Copy before taking the lock; readers never see a partial object
+    auto object = std::make_shared<const std::vector<std::uint8_t>>(data.begin(), data.end());
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    Object& slot = objects_[key];
+    if (slot) {
+        stored_bytes_ -= slot->size();
+    }
+    stored_bytes_ += object->size();
+    slot = std::move(object);
+    return true;
+}
+
+bool MemoryObjectStore::DeleteObject(const std::string& key) {
+    Object dropped; // Freed outside the lock
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto it = objects_.find(key);
+    if (it != objects_.end()) {
+        stored_bytes_ -= it->second->size();
+        dropped = std::move(it->second);
+        objects_.erase(it);
+    }
+    return true;
+}
+
+std::size_t MemoryObjectStore::DeleteObjects(const std::vector<std::string>& keys) {
+    for (const auto& key : keys) {
+        DeleteObject(key);
+    }
+    return 0;
+}
+
+bool MemoryObjectStore::ListObjects(const std::string& prefix,
+                                    const std::function<bool(const std::string& key, std::uint64_t size)>& visit) {
+    // Snapshot the matching keys so 'visit' may call back into the store
+    std::vector<std::pair<std::string, std::uint64_t>> listing;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (auto it = objects_.lower_bound(prefix);
+             it != objects_.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+            listing.emplace_back(it->first, it->second->size());
+        }
+    }
+    for (const auto& [key, size] : listing) {
+        if (!visit(key, size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::size_t MemoryObjectStore::ObjectCount() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return objects_.size();
+}
+
+std::uint64_t MemoryObjectStore::StoredBytes() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return stored_bytes_;
+}
+
+// --- LatencyObjectStore ---
+
+LatencyObjectStore::LatencyObjectStore(std::shared_ptr<ObjectStore> inner, const LatencyProfile& profile)
+    : inner_(std::move(inner)), profile_(profile) {}
+
+void LatencyObjectStore::delay(std::uint32_t latency_us, std::uint64_t bytes) const {
+    double us = latency_us;
+    if (profile_.jitter > 0.0 && us > 0.0) {
+        thread_local std::mt19937 rng(std::random_device{}());
+        std::uniform_real_distribution<double> scale(1.0 - profile_.jitter, 1.0 + profile_.jitter);
+        us *= std::max(scale(rng), 0.0);
+    }
+    if (profile_.bandwidth_bytes_per_sec > 0) {
+        us += static_cast<double>(bytes) * 1e6 / static_cast<double>(profile_.bandwidth_bytes_per_sec);
+    }
+    if (us >= 1.0) {
+        std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(us));
+    }
+}
+
+bool LatencyObjectStore::GetObject(const std::string& key, std::vector<std::uint8_t>* data) {
+    bool ok = inner_->GetObject(key, data);
+    delay(profile_.get_latency_us, ok ? data->size() : 0);
+    return ok;
+}
+
+bool LatencyObjectStore::GetObject(const std::string& key, mutable_bytes_view dest, std::uint64_t* bytes_read) {
+    std::uint64_t n = 0;
+    bool ok = inner_->GetObject(key, dest, &n);
+    delay(profile_.get_latency_us, ok ? n : 0);
+    if (ok && bytes_read) {
+        *bytes_read = n;
+    }
+    return ok;
+}
+
+bool LatencyObjectStore::GetObjectRange(const std::string& key, std::uint64_t offset, mutable_bytes_view dest,
+                                        std::uint64_t* bytes_read) {
+    std::uint64_t n = 0;
+    bool ok = inner_->GetObjectRange(key, offset, dest, &n);
+    delay(profile_.get_latency_us, ok ? n : 0);
+    if (ok && bytes_read) {
+        *bytes_read = n;
+    }
+    return ok;
+}
+
+bool LatencyObjectStore::GetObjectStreaming(const std::string& key, bool ranged, std::uint64_t offset,
+                                            mutable_bytes_view dest,
+                                            const std::function<bool(std::uint64_t received)>& on_progress,
+                                            std::uint64_t* bytes_read) {
+    delay(profile_.get_latency_us, 0);
+    if (profile_.bandwidth_bytes_per_sec == 0) {
+        return inner_->GetObjectStreaming(key, ranged, offset, dest, on_progress, bytes_read);
+    }
+    // Hold back each progress report until the bytes would have arrived
+    const auto start = std::chrono::steady_clock::now();
+    const double bytes_per_us = static_cast<double>(profile_.bandwidth_bytes_per_sec) / 1e6;
+    return inner_->GetObjectStreaming(
+        key, ranged, offset, dest,
+        [&](std::uint64_t received) {
+            std::this_thread::sleep_until(
+                start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                            std::chrono::duration<double, std::micro>(received / bytes_per_us)));
+            return on_progress(received);
+        },
+        bytes_read);
+}
+
+bool LatencyObjectStore::PutObject(const std::string& key, bytes_view data) {
+    delay(profile_.put_latency_us, data.size());
+    return inner_->PutObject(key, data);
+}
+
+bool LatencyObjectStore::DeleteObject(const std::string& key) {
+    delay(profile_.meta_latency_us, 0);
+    return inner_->DeleteObject(key);
+}
+
+std::size_t LatencyObjectStore::DeleteObjects(const std::vector<std::string>& keys) {
+    delay(profile_.meta_latency_us, 0);
+    return inner_->DeleteObjects(keys);
+}
+
+bool LatencyObjectStore::ListObjects(const std::string& prefix,
+                                     const std::function<bool(const std::string& key, std::uint64_t size)>& visit) {
+    // One LIST round trip per 1000 keys, as S3 pages them
+    std::size_t listed = 0;
+    delay(profile_.meta_latency_us, 0);
+    return inner_->ListObjects(prefix, [&](const std::string& key, std::uint64_t size) {
+        if (++listed % 1000 == 0) {
+            delay(profile_.meta_latency_us, 0);
+        }
+        return visit(key, size);
+    });
+}
+
+} // namespace kvcache
@@ -0,0 +1,367 @@
+#include "kvcache/peer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace kvcache {
+
+namespace {
+
+// Wire format, host byte order (peers run the same build):
+//   request:  magic, reserved, key[16], size      (32 bytes)
+//   response: magic, status, length, then 'length' payload bytes
+constexpr std::uint32_t kPeerMagic = 0x3150564B; // "KVP1"
+constexpr std::uint32_t kStatusOk = 0;
+constexpr std::uint32_t kStatusMiss = 1;
+constexpr std::uint64_t kMaxPeerBlockBytes = 1ull << 30;
+
+struct PeerRequest {
+    std::uint32_t magic;
+    std::uint32_t reserved;
+    PrefixKey key;
+    std::uint64_t size;
+};
+static_assert(sizeof(PeerRequest) == 32, "PeerRequest is a wire format");
+
+struct PeerResponse {
+    std::uint32_t magic;
+    std::uint32_t status;
+    std::uint64_t length;
+};
+static_assert(sizeof(PeerResponse) == 16, "PeerResponse is a wire format");
+
+bool send_fully(int fd, const void* data, std::size_t size) {
+    const auto* p = static_cast<const std::uint8_t*>(data);
+    while (size > 0) {
+        ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool recv_fully(int fd, void* data, std::size_t size) {
+    auto* p = static_cast<std::uint8_t*>(data);
+    while (size > 0) {
+        ssize_t n = ::recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+void set_timeouts(int fd, std::uint32_t timeout_ms) {
+    timeval tv{};
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = static_cast<suseconds_t>(timeout_ms % 1000) * 1000;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// Connects to "host:port" within 'timeout_ms', or returns -1
+int connect_to(const std::string& address, std::uint32_t timeout_ms) {
+    const std::size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        return -1;
+    }
+    std::string host = address.substr(0, colon);
+    const std::string port = address.substr(colon + 1);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2); // [v6]:port
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* results = nullptr;
+    if (::getaddrinfo(host.c_str(), port.c_str(), &hints, &results) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo* ai = results; ai && fd < 0; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int rc = ::connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (rc != 0 && errno == EINPROGRESS) {
+            pollfd pfd{fd, POLLOUT, 0};
+            int error = 0;
+            socklen_t len = sizeof(error);
+            rc = ::poll(&pfd, 1, static_cast<int>(timeout_ms)) == 1 &&
+                         ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0
+                     ? 0
+                     : -1;
+        }
+        if (rc != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    ::freeaddrinfo(results);
+    if (fd >= 0) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        set_timeouts(fd, timeout_ms);
+    }
+    return fd;
+}
+
+} // namespace
+
+// --- LocalPeerTransport ---
+
+void LocalPeerTransport::Register(const std::string& address, PeerHandler handler) {
+    auto shared = std::make_shared<const PeerHandler>(std::move(handler));
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    handlers_[address] = std::move(shared);
+}
+
+void LocalPeerTransport::Unregister(const std::string& address) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    handlers_.erase(address);
+}
+
+bool LocalPeerTransport::Fetch(const std::string& address, const PrefixKey& key, mutable_bytes_view dest) {
+    std::shared_ptr<const PeerHandler> handler;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = handlers_.find(address);
+        if (it == handlers_.end()) {
+            return false;
+        }
+        handler = it->second;
+    }
+    return (*handler)(key, dest);
+}
+
+// --- TcpPeerTransport ---
+
+TcpPeerTransport::TcpPeerTransport(std::uint32_t timeout_ms, std::size_t connections_per_peer,
+                                   std::uint32_t max_idle_ms)
+    : timeout_ms_(std::max<std::uint32_t>(timeout_ms, 1)), connections_per_peer_(connections_per_peer),
+      max_idle_(max_idle_ms) {}
+
+TcpPeerTransport::~TcpPeerTransport() {
+    for (auto& [address, connections] : idle_) {
+        for (const auto& connection : connections) {
+            ::close(connection.fd);
+        }
+    }
+}
+
+int TcpPeerTransport::take_connection(const std::string& address, bool* reused) {
+    // The newest idle connection is reused; ones idle too long to trust
+    // are closed, and being the oldest they sit at the front
+    std::vector<int> expired;
+    int fd = -1;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = idle_.find(address);
+        if (it != idle_.end()) {
+            auto& connections = it->second;
+            const Clock::time_point cutoff = Clock::now() - max_idle_;
+            auto fresh = std::find_if(connections.begin(), connections.end(),
+                                      [&](const IdleConnection& c) { return c.since >= cutoff; });
+            for (auto stale = connections.begin(); stale != fresh; ++stale) {
+                expired.push_back(stale->fd);
+            }
+            connections.erase(connections.begin(), fresh);
+            if (!connections.empty()) {
+                fd = connections.back().fd;
+                connections.pop_back();
+            }
+        }
+    }
+    for (int stale : expired) {
+        ::close(stale);
+    }
+    *reused = fd >= 0;
+    return fd >= 0 ? fd : connect_to(address, timeout_ms_);
+}
+
+void TcpPeerTransport::return_connection(const std::string& address, int fd) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& connections = idle_[address];
+        if (connections.size() < connections_per_peer_) {
+            connections.push_back({fd, Clock::now()});
+            return;
+        }
+    }
+    ::close(fd);
+}
+
+bool TcpPeerTransport::Fetch(const std::string& address, const PrefixKey& key, mutable_bytes_view dest) {
+    bool reused = false;
+    int fd = take_connection(address, &reused);
+    if (fd < 0) {
+        return false;
+    }
+    PeerRequest request{kPeerMagic, 0, key, dest.size()};
+    PeerResponse response{};
+    while (!send_fully(fd, &request, sizeof(request)) || !recv_fully(fd, &response, sizeof(response)) ||
+           response.magic != kPeerMagic) {
+        ::close(fd);
+        if (!reused) {
+            return false;
+        }
+        // The server may have closed it while idle; try once more afresh
+        reused = false;
+        fd = connect_to(address, timeout_ms_);
+        if (fd < 0) {
+            return false;
+        }
+    }
+    if (response.status != kStatusOk) {
+        return_connection(address, fd); // A clean miss leaves the stream usable
+        return false;
+    }
+    if (response.length != dest.size() || !recv_fully(fd, dest.data(), dest.size())) {
+        ::close(fd);
+        return false;
+    }
+    return_connection(address, fd);
+    return true;
+}
+
+// --- TcpPeerServer ---
+
+TcpPeerServer::TcpPeerServer(std::uint16_t port, PeerHandler handler, PeerCheck check,
+                             std::size_t max_connections, std::uint32_t idle_timeout_ms)
+    : handler_(std::move(handler)), check_(std::move(check)), max_connections_(std::max<std::size_t>(max_connections, 1)),
+      idle_timeout_ms_(std::max<std::uint32_t>(idle_timeout_ms, 1)) {
+    int fd = ::socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "kvcache: peer server socket failed: " << std::strerror(errno) << std::endl;
+        return;
+    }
+    int one = 1;
+    int zero = 0;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero)); // Accept IPv4 too
+    sockaddr_in6 addr{};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    socklen_t len = sizeof(addr);
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 128) != 0 ||
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+        std::cerr << "kvcache: peer server cannot listen on port " << port << ": " << std::strerror(errno)
+                  << std::endl;
+        ::close(fd);
+        return;
+    }
+    listen_fd_ = fd;
+    port_ = ntohs(addr.sin6_port);
+    accept_thread_ = std::thread(&TcpPeerServer::accept_loop, this);
+}
+
+TcpPeerServer::~TcpPeerServer() {
+    stop_ = true;
+    if (listen_fd_ >= 0) {
+        ::shutdown(listen_fd_, SHUT_RDWR); // Wakes accept()
+    }
+    if (accept_thread_.joinable()) {
+        accept_thread_.join();
+    }
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+    }
+
+    std::vector<std::unique_ptr<Connection>> connections;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections.swap(connections_);
+        for (auto& connection : connections) {
+            ::shutdown(connection->fd, SHUT_RDWR); // Wakes recv()
+        }
+    }
+    for (auto& connection : connections) {
+        connection->thread.join();
+        ::close(connection->fd);
+    }
+}
+
+void TcpPeerServer::reap_locked() {
+    auto done = std::partition(connections_.begin(), connections_.end(),
+                               [](const auto& connection) { return !connection->done.load(); });
+    for (auto it = done; it != connections_.end(); ++it) {
+        (*it)->thread.join();
+        ::close((*it)->fd);
+    }
+    connections_.erase(done, connections_.end());
+}
+
+void TcpPeerServer::accept_loop() {
+    while (!stop_) {
+        int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break; // Shut down
+        }
+        set_timeouts(fd, idle_timeout_ms_); // A receive timing out closes the connection
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        reap_locked();
+        if (stop_ || connections_.size() >= max_connections_) {
+            ::close(fd);
+            continue;
+        }
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        Connection* raw = connection.get();
+        connection->thread = std::thread(&TcpPeerServer::serve, this, raw);
+        connections_.push_back(std::move(connection));
+    }
+}
+
+void TcpPeerServer::serve(Connection* connection) {
+    // One buffer per connection, grown to the largest block served. It is
+    // only sized once check_ has accepted the request.
+    std::vector<std::uint8_t> buffer;
+    PeerRequest request;
+    while (!stop_ && recv_fully(connection->fd, &request, sizeof(request))) {
+        if (request.magic != kPeerMagic || request.size > kMaxPeerBlockBytes) {
+            break;
+        }
+        bool ok = !check_ || check_(request.key, request.size);
+        if (ok) {
+            buffer.resize(request.size);
+            ok = handler_(request.key, buffer);
+        }
+        PeerResponse response{kPeerMagic, ok ? kStatusOk : kStatusMiss, ok ? request.size : 0};
+        if (!send_fully(connection->fd, &response, sizeof(response)) ||
+            (ok && !send_fully(connection->fd, buffer.data(), buffer.size()))) {
+            break;
+        }
+    }
+    connection->done = true;
+}
+
+} // namespace kvcache
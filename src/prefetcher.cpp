@@ -0,0 +1,99 @@
+#include "kvcache/prefetcher.hpp"
+
+namespace kvcache {
+
+Prefetcher::Prefetcher(std::uint32_t num_threads, std::uint64_t budget_bytes, Fetch fetch)
+    : fetch_(std::move(fetch)), budget_bytes_(budget_bytes) {
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+    threads_.reserve(num_threads);
+    for (std::uint32_t i = 0; i < num_threads; ++i) {
+        threads_.emplace_back(&Prefetcher::WorkerLoop, this);
+    }
+}
+
+Prefetcher::~Prefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : threads_) {
+        t.join();
+    }
+}
+
+std::uint64_t Prefetcher::Submit(const std::vector<BlockRef>& blocks) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const std::uint64_t ticket = next_ticket_;
+    Request request;
+    for (const auto& ref : blocks) {
+        if (pending_bytes_ + ref.size > budget_bytes_) {
+            break; // Later blocks are needed later; leave them to Load
+        }
+        pending_bytes_ += ref.size;
+        request.queued_bytes += ref.size;
+        ++request.remaining;
+        queue_.push(Item{ref.index, next_seq_++, ref, ticket});
+    }
+    if (request.remaining == 0) {
+        return 0;
+    }
+    ++next_ticket_;
+    requests_.emplace(ticket, request);
+    cv_.notify_all();
+    return ticket;
+}
+
+void Prefetcher::Cancel(std::uint64_t ticket) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = requests_.find(ticket);
+    if (it == requests_.end() || it->second.cancelled) {
+        return;
+    }
+    // Items stay in the queue; workers discard them when popped
+    it->second.cancelled = true;
+    pending_bytes_ -= it->second.queued_bytes;
+    it->second.queued_bytes = 0;
+}
+
+std::uint64_t Prefetcher::PendingBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_bytes_;
+}
+
+void Prefetcher::WorkerLoop() {
+    while (true) {
+        Item item;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (stop_) {
+                return;
+            }
+            item = queue_.top();
+            queue_.pop();
+
+            auto it = requests_.find(item.ticket);
+            Request& request = it->second;
+            const bool cancelled = request.cancelled;
+            if (!cancelled) {
+                request.queued_bytes -= item.ref.size; // Now in flight
+            }
+            if (--request.remaining == 0) {
+                requests_.erase(it);
+            }
+            if (cancelled) {
+                continue;
+            }
+        }
+
+        fetch_(item.ref);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_bytes_ -= item.ref.size;
+    }
+}
+
+} // namespace kvcache
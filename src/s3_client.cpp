@@ -1,29 +1,379 @@
 #include "kvcache/s3_client.hpp"
+#include "kvcache/io_executor.hpp"
 #include "kvcache/s3_settings.hpp"
 
 #include <aws/core/Aws.h>
 #include <aws/core/auth/AWSCredentials.h>
+#include <aws/core/client/AWSError.h>
+#include <aws/core/client/CoreErrors.h>
+#include <aws/core/client/RetryStrategy.h>
 #include <aws/core/utils/logging/LogLevel.h>
+#include <aws/core/utils/threading/Executor.h>
 #include <aws/s3/S3Client.h>
+#include <aws/s3/model/AbortMultipartUploadRequest.h>
+#include <aws/s3/model/CompleteMultipartUploadRequest.h>
+#include <aws/s3/model/CompletedMultipartUpload.h>
+#include <aws/s3/model/CompletedPart.h>
+#include <aws/s3/model/CreateMultipartUploadRequest.h>
 #include <aws/s3/model/GetObjectRequest.h>
 #include <aws/s3/model/PutObjectRequest.h>
+#include <aws/s3/model/UploadPartRequest.h>
 #include <aws/s3/model/DeleteObjectRequest.h>
+#include <aws/s3/model/DeleteObjectsRequest.h>
+#include <aws/s3/model/Delete.h>
+#include <aws/s3/model/ObjectIdentifier.h>
+#include <aws/s3/model/ListObjectsV2Request.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <sstream>
+#include <latch>
+#include <mutex>
+#include <random>
+#include <streambuf>
 
 namespace kvcache {
 
+static const char kAllocationTag[] = "kvcache";
+
+// Read-only, seekable streambuf over caller-owned memory. The SDK seeks on
+// the body to compute checksums and to rewind it for retries, so the whole
+// buffer is exposed as the get area. There is no put area, so the memory
+// behind the const_cast is never written.
+class ViewStreamBuf : public std::streambuf {
+public:
+    ViewStreamBuf(const std::uint8_t* data, std::size_t size) {
+        char* begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+        setg(begin, begin, begin + size);
+    }
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        if (!(which & std::ios_base::in)) {
+            return pos_type(off_type(-1));
+        }
+        off_type base = 0;
+        if (dir == std::ios_base::cur) {
+            base = gptr() - eback();
+        } else if (dir == std::ios_base::end) {
+            base = egptr() - eback();
+        }
+        return seekpos(pos_type(base + off), which);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+        off_type offset = off_type(pos);
+        if (!(which & std::ios_base::in) || offset < 0 || offset > egptr() - eback()) {
+            return pos_type(off_type(-1));
+        }
+        setg(eback(), eback() + offset, egptr());
+        return pos;
+    }
+};
+
+// Upload body that reads directly from a bytes_view. The streambuf is a base
+// so it is constructed before the iostream that points at it.
+struct ViewStreamBufHolder {
+    explicit ViewStreamBufHolder(bytes_view data) : streambuf(data.data(), data.size()) {}
+    ViewStreamBuf streambuf;
+};
+
+class ViewIOStream : private ViewStreamBufHolder, public Aws::IOStream {
+public:
+    explicit ViewIOStream(bytes_view data) : ViewStreamBufHolder(data), Aws::IOStream(&streambuf) {}
+};
+
+// --- SDK Lifetime ---
+
+// Aws::InitAPI and ShutdownAPI are process-wide, so the first client
+// initializes the SDK and the last one shuts it down.
+static std::mutex g_sdk_mutex;
+static std::size_t g_sdk_refs = 0;
+static Aws::SDKOptions g_sdk_options;
+
+static void acquire_sdk() {
+    std::lock_guard<std::mutex> lock(g_sdk_mutex);
+    if (g_sdk_refs++ == 0) {
+        g_sdk_options.loggingOptions.logLevel = Aws::Utils::Logging::LogLevel::Fatal;
+        Aws::InitAPI(g_sdk_options);
+    }
+}
+
+static void release_sdk() {
+    std::lock_guard<std::mutex> lock(g_sdk_mutex);
+    if (--g_sdk_refs == 0) {
+        Aws::ShutdownAPI(g_sdk_options);
+    }
+}
+
+// --- Retry Strategy ---
+
+// Exponential backoff with full jitter: retry n sleeps a uniform random time
+// in [0, min(cap, base * 2^n)], so clients that failed together do not
+// retry together.
+class JitteredRetryStrategy : public Aws::Client::RetryStrategy {
+public:
+    JitteredRetryStrategy(long max_retries, long base_ms, long cap_ms)
+        : max_retries_(max_retries), base_ms_(base_ms), cap_ms_(cap_ms) {}
+
+    bool ShouldRetry(const Aws::Client::AWSError<Aws::Client::CoreErrors>& error,
+                     long attempted_retries) const override {
+        return attempted_retries < max_retries_ && error.ShouldRetry();
+    }
+
+    long CalculateDelayBeforeNextRetry(const Aws::Client::AWSError<Aws::Client::CoreErrors>&,
+                                       long attempted_retries) const override {
+        const long shift = std::min<long>(attempted_retries, 20);
+        const long ceiling = std::min(cap_ms_, base_ms_ << shift);
+        thread_local std::minstd_rand rng(std::random_device{}());
+        return std::uniform_int_distribution<long>(0, std::max<long>(ceiling, 0))(rng);
+    }
+
+    long GetMaxAttempts() const override { return max_retries_ + 1; }
+
+private:
+    long max_retries_;
+    long base_ms_;
+    long cap_ms_;
+};
+
+// Write-only streambuf over caller memory. The SDK asks the response stream
+// factory for a fresh stream on every attempt and a retried body starts over
+// from its first byte, so the factory rewinds it; Written() is then what the
+// last attempt wrote. A write that does not fit fails the transfer.
+class DestStreamBuf : public std::streambuf {
+public:
+    explicit DestStreamBuf(mutable_bytes_view dest) : dest_(dest) {}
+
+    std::uint64_t Written() const { return written_; }
+
+    // Called by the response stream factory at the start of each attempt
+    void Rewind() { written_ = 0; }
+
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        const auto count = static_cast<std::uint64_t>(n);
+        if (count > dest_.size() - written_) {
+            return 0;
+        }
+        std::memcpy(dest_.data() + written_, s, count);
+        written_ += count;
+        return n;
+    }
+
+    int_type overflow(int_type ch) override {
+        if (traits_type::eq_int_type(ch, traits_type::eof())) {
+            return traits_type::not_eof(ch);
+        }
+        char c = traits_type::to_char_type(ch);
+        return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+    }
+
+private:
+    mutable_bytes_view dest_;
+    std::uint64_t written_ = 0;
+};
+
+// Write-only streambuf over caller memory that reports progress after each
+// write. The SDK writes the response body as it is received, so this sees
+// every piece as soon as it is off the wire. A write that does not fit, or
+// a false return from the callback, fails the write and the transfer.
+//
+// Unlike DestStreamBuf it cannot simply rewind for a retry: progress
+// already reported cannot be taken back, so a retry once any of the body
+// has arrived fails too; one before that starts clean.
+class ProgressStreamBuf : public std::streambuf {
+public:
+    ProgressStreamBuf(mutable_bytes_view dest, const std::function<bool(std::uint64_t)>& on_progress)
+        : dest_(dest), on_progress_(on_progress) {}
+
+    std::uint64_t Received() const { return received_; }
+    bool Restarted() const { return restarted_; }
+
+    // Called by the response stream factory at the start of each attempt
+    void Restart() { restarted_ = restarted_ || received_ > 0; }
+
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        const auto count = static_cast<std::uint64_t>(n);
+        if (restarted_ || count > dest_.size() - received_) {
+            return 0;
+        }
+        std::memcpy(dest_.data() + received_, s, count);
+        received_ += count;
+        return on_progress_(received_) ? n : 0;
+    }
+
+    int_type overflow(int_type ch) override {
+        if (traits_type::eq_int_type(ch, traits_type::eof())) {
+            return traits_type::not_eof(ch);
+        }
+        char c = traits_type::to_char_type(ch);
+        return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+    }
+
+private:
+    mutable_bytes_view dest_;
+    const std::function<bool(std::uint64_t)>& on_progress_;
+    std::uint64_t received_ = 0;
+    bool restarted_ = false;
+};
+
 // PIMPL for hiding AWS SDK headers
 struct S3Client::S3ClientImpl {
-    Aws::SDKOptions aws_options;
     std::unique_ptr<Aws::S3::S3Client> s3;
     std::string bucket;
+
+    // Large transfers are split into parts; null when disabled
+    std::uint64_t multipart_threshold = 0;
+    std::uint64_t part_size = 0;
+    std::uint32_t parallelism = 1;
+    std::unique_ptr<IoExecutor> part_io;
+
+    bool split(std::uint64_t size) const { return part_io && size >= multipart_threshold && size > part_size; }
+    bool run_parts(std::size_t num_parts, const std::function<bool(std::size_t)>& part);
+    bool get_range(const std::string& key, std::uint64_t offset, mutable_bytes_view dest,
+                   std::uint64_t* length, std::uint64_t* object_size);
+    bool get_parts(const std::string& key, std::uint64_t offset, mutable_bytes_view dest,
+                   std::uint64_t* object_size);
+    bool put_multipart(const std::string& key, bytes_view data);
 };
 
+bool S3Client::S3ClientImpl::run_parts(std::size_t num_parts, const std::function<bool(std::size_t)>& part) {
+    // The caller works as one lane and up to parallelism-1 more run on the
+    // part pool, each claiming the next part. A lane stuck in the pool's
+    // queue finds nothing left to do, so a busy pool only costs speed.
+    const std::size_t lanes = std::min<std::size_t>(parallelism, num_parts);
+    std::atomic<std::size_t> next{0};
+    std::atomic<bool> ok{true};
+    std::latch done(static_cast<std::ptrdiff_t>(lanes - 1));
+
+    auto lane = [&] {
+        for (std::size_t i = next.fetch_add(1); i < num_parts && ok.load(); i = next.fetch_add(1)) {
+            if (!part(i)) {
+                ok = false;
+            }
+        }
+    };
+    for (std::size_t l = 1; l < lanes; ++l) {
+        part_io->Submit([&] {
+            lane();
+            done.count_down();
+        });
+    }
+    lane();
+    done.wait();
+    return ok.load();
+}
+
+bool S3Client::S3ClientImpl::get_range(const std::string& key, std::uint64_t offset, mutable_bytes_view dest,
+                                       std::uint64_t* length, std::uint64_t* object_size) {
+    DestStreamBuf streambuf(dest);
+
+    Aws::S3::Model::GetObjectRequest request;
+    request.SetBucket(bucket);
+    request.SetKey(key);
+    request.SetRange("bytes=" + std::to_string(offset) + "-" + std::to_string(offset + dest.size() - 1));
+    request.SetResponseStreamFactory([&streambuf]() {
+        streambuf.Rewind();
+        return Aws::New<Aws::IOStream>(kAllocationTag, &streambuf);
+    });
+
+    auto outcome = s3->GetObject(request);
+    if (!outcome.IsSuccess()) {
+        return false;
+    }
+
+    *length = static_cast<std::uint64_t>(outcome.GetResult().GetContentLength());
+    if (*length > dest.size() || streambuf.Written() != *length) {
+        return false; // Range ignored by the server, or the body came up short
+    }
+    if (object_size) {
+        // "bytes <first>-<last>/<total>"
+        const Aws::String& range = outcome.GetResult().GetContentRange();
+        std::size_t slash = range.rfind('/');
+        *object_size = slash == Aws::String::npos ? 0 : std::strtoull(range.c_str() + slash + 1, nullptr, 10);
+    }
+    return true;
+}
+
+bool S3Client::S3ClientImpl::get_parts(const std::string& key, std::uint64_t offset, mutable_bytes_view dest,
+                                       std::uint64_t* object_size) {
+    // Every part streams into its own slice of 'dest'. Succeeds only if
+    // each part came back whole, i.e. the range lies inside the object.
+    const std::size_t num_parts = static_cast<std::size_t>((dest.size() + part_size - 1) / part_size);
+    std::vector<std::uint64_t> sizes(num_parts, 0);
+    bool ok = run_parts(num_parts, [&](std::size_t i) {
+        const std::uint64_t begin = i * part_size;
+        mutable_bytes_view slice = dest.subview(begin, std::min<std::uint64_t>(part_size, dest.size() - begin));
+        std::uint64_t length = 0;
+        return get_range(key, offset + begin, slice, &length, i == 0 ? object_size : nullptr) &&
+               length == slice.size();
+    });
+    return ok;
+}
+
+bool S3Client::S3ClientImpl::put_multipart(const std::string& key, bytes_view data) {
+    Aws::S3::Model::CreateMultipartUploadRequest create;
+    create.SetBucket(bucket);
+    create.SetKey(key);
+    auto created = s3->CreateMultipartUpload(create);
+    if (!created.IsSuccess()) {
+        return false;
+    }
+    const Aws::String upload_id = created.GetResult().GetUploadId();
+
+    // Parts upload in place from the caller's memory, like PutObject
+    const std::size_t num_parts = static_cast<std::size_t>((data.size() + part_size - 1) / part_size);
+    std::vector<Aws::String> etags(num_parts);
+    bool ok = run_parts(num_parts, [&](std::size_t i) {
+        const std::uint64_t begin = i * part_size;
+        const std::uint64_t length = std::min<std::uint64_t>(part_size, data.size() - begin);
+
+        Aws::S3::Model::UploadPartRequest request;
+        request.SetBucket(bucket);
+        request.SetKey(key);
+        request.SetUploadId(upload_id);
+        request.SetPartNumber(static_cast<int>(i + 1));
+        request.SetBody(Aws::MakeShared<ViewIOStream>(kAllocationTag, bytes_view(data.data() + begin, length)));
+        request.SetContentLength(static_cast<long long>(length));
+
+        auto outcome = s3->UploadPart(request);
+        if (!outcome.IsSuccess()) {
+            return false;
+        }
+        etags[i] = outcome.GetResult().GetETag();
+        return true;
+    });
+
+    if (ok) {
+        Aws::S3::Model::CompletedMultipartUpload completed;
+        for (std::size_t i = 0; i < num_parts; ++i) {
+            completed.AddParts(Aws::S3::Model::CompletedPart().WithETag(etags[i]).WithPartNumber(static_cast<int>(i + 1)));
+        }
+        Aws::S3::Model::CompleteMultipartUploadRequest complete;
+        complete.SetBucket(bucket);
+        complete.SetKey(key);
+        complete.SetUploadId(upload_id);
+        complete.SetMultipartUpload(completed);
+        if (s3->CompleteMultipartUpload(complete).IsSuccess()) {
+            return true;
+        }
+    }
+
+    // Uploaded parts are billed until the upload is aborted
+    Aws::S3::Model::AbortMultipartUploadRequest abort;
+    abort.SetBucket(bucket);
+    abort.SetKey(key);
+    abort.SetUploadId(upload_id);
+    s3->AbortMultipartUpload(abort);
+    return false;
+}
+
 S3Client::S3Client(const Config& cfg) : p_impl(std::make_unique<S3ClientImpl>()) {
-    p_impl->aws_options.loggingOptions.logLevel = Aws::Utils::Logging::LogLevel::Fatal;
-    Aws::InitAPI(p_impl->aws_options);
-    
+    acquire_sdk();
+
     Aws::Client::ClientConfiguration aws_cfg;
     if (!cfg.s3_region.empty()) {
         aws_cfg.region = cfg.s3_region;
@@ -31,6 +381,17 @@ S3Client::S3Client(const Config& cfg) : p_impl(std::make_unique<S3ClientImpl>())
     if (!cfg.s3_endpoint.empty()) {
         aws_cfg.endpointOverride = cfg.s3_endpoint;
     }
+    aws_cfg.maxConnections = std::max<std::uint32_t>(cfg.s3_max_connections, 1);
+    aws_cfg.enableTcpKeepAlive = cfg.s3_tcp_keep_alive;
+    aws_cfg.tcpKeepAliveIntervalMs = cfg.s3_keep_alive_interval_ms;
+    aws_cfg.connectTimeoutMs = cfg.s3_connect_timeout_ms;
+    aws_cfg.requestTimeoutMs = cfg.s3_request_timeout_ms;
+    aws_cfg.retryStrategy = Aws::MakeShared<JitteredRetryStrategy>(kAllocationTag,
+        cfg.s3_max_retries, cfg.s3_retry_base_ms, cfg.s3_retry_max_backoff_ms);
+    if (cfg.s3_executor_threads > 0) {
+        aws_cfg.executor = Aws::MakeShared<Aws::Utils::Threading::PooledThreadExecutor>(kAllocationTag,
+            cfg.s3_executor_threads);
+    }
     
     Aws::Auth::AWSCredentials creds;
     if (!cfg.aws_access_key_id.empty() && !cfg.aws_secret_access_key.empty()) {
@@ -46,10 +407,19 @@ S3Client::S3Client(const Config& cfg) : p_impl(std::make_unique<S3ClientImpl>())
         useVirtualAddressing);
     
     p_impl->bucket = cfg.s3_bucket;
+
+    if (cfg.multipart_threshold_bytes > 0 && cfg.transfer_parallelism > 1) {
+        p_impl->multipart_threshold = cfg.multipart_threshold_bytes;
+        p_impl->part_size = std::max<std::uint64_t>(cfg.multipart_part_bytes, 5ull << 20);
+        p_impl->parallelism = cfg.transfer_parallelism;
+        p_impl->part_io = std::make_unique<IoExecutor>(cfg.transfer_parallelism, cfg.transfer_parallelism * 4);
+    }
 }
 
 S3Client::~S3Client() {
-    Aws::ShutdownAPI(p_impl->aws_options);
+    p_impl->part_io.reset();
+    p_impl->s3.reset();
+    release_sdk();
 }
 
 bool S3Client::GetObject(const std::string& key, std::vector<std::uint8_t>* data) {
@@ -63,22 +433,128 @@ bool S3Client::GetObject(const std::string& key, std::vector<std::uint8_t>* data
         return false;
     }
 
-    auto& body = outcome.GetResult().GetBody();
-    std::stringstream ss;
-    ss << body.rdbuf();
-    std::string s = ss.str();
-    data->assign(s.begin(), s.end());
+    // Read the body once, straight into the sized vector
+    auto& result = outcome.GetResult();
+    auto length = static_cast<std::streamsize>(result.GetContentLength());
+    data->resize(static_cast<size_t>(length));
+    auto& body = result.GetBody();
+    body.read(reinterpret_cast<char*>(data->data()), length);
+    return body.gcount() == length;
+}
+
+bool S3Client::GetObject(const std::string& key, mutable_bytes_view dest, std::uint64_t* bytes_read) {
+    // A large destination is usually the exact object size, so try parallel
+    // ranged GETs first. Anything else (a smaller object, a failed part)
+    // falls back to one stream.
+    std::uint64_t object_size = 0;
+    if (p_impl->split(dest.size()) && p_impl->get_parts(key, 0, dest, &object_size) &&
+        object_size == dest.size()) {
+        if (bytes_read) {
+            *bytes_read = object_size;
+        }
+        return true;
+    }
+
+    // The SDK writes the response body through this streambuf into 'dest'.
+    // It must outlive the outcome, which owns the stream wrapping it.
+    DestStreamBuf streambuf(dest);
+
+    Aws::S3::Model::GetObjectRequest request;
+    request.SetBucket(p_impl->bucket);
+    request.SetKey(key);
+    request.SetResponseStreamFactory([&streambuf]() {
+        streambuf.Rewind();
+        return Aws::New<Aws::IOStream>(kAllocationTag, &streambuf);
+    });
+
+    auto outcome = p_impl->s3->GetObject(request);
+    if (!outcome.IsSuccess()) {
+        return false;
+    }
+
+    auto length = static_cast<std::uint64_t>(outcome.GetResult().GetContentLength());
+    if (length > dest.size() || streambuf.Written() != length) {
+        return false; // Body did not fit, or came up short
+    }
+    if (bytes_read) {
+        *bytes_read = length;
+    }
+    return true;
+}
+
+bool S3Client::GetObjectRange(const std::string& key, std::uint64_t offset, mutable_bytes_view dest,
+                              std::uint64_t* bytes_read) {
+    if (dest.empty()) {
+        if (bytes_read) {
+            *bytes_read = 0;
+        }
+        return true;
+    }
+    // Split ranges need every part inside the object; one that runs past
+    // its end is retried as a single GET, which may come back short
+    if (p_impl->split(dest.size()) && p_impl->get_parts(key, offset, dest, nullptr)) {
+        if (bytes_read) {
+            *bytes_read = dest.size();
+        }
+        return true;
+    }
+
+    std::uint64_t length = 0;
+    if (!p_impl->get_range(key, offset, dest, &length, nullptr)) {
+        return false;
+    }
+    if (bytes_read) {
+        *bytes_read = length;
+    }
+    return true;
+}
+
+bool S3Client::GetObjectStreaming(const std::string& key, bool ranged, std::uint64_t offset, mutable_bytes_view dest,
+                                  const std::function<bool(std::uint64_t received)>& on_progress,
+                                  std::uint64_t* bytes_read) {
+    ProgressStreamBuf streambuf(dest, on_progress);
+
+    Aws::S3::Model::GetObjectRequest request;
+    request.SetBucket(p_impl->bucket);
+    request.SetKey(key);
+    if (ranged) {
+        if (dest.empty()) {
+            return false;
+        }
+        request.SetRange("bytes=" + std::to_string(offset) + "-" + std::to_string(offset + dest.size() - 1));
+    }
+    request.SetResponseStreamFactory([&streambuf]() {
+        streambuf.Restart();
+        return Aws::New<Aws::IOStream>(kAllocationTag, &streambuf);
+    });
+
+    auto outcome = p_impl->s3->GetObject(request);
+    if (!outcome.IsSuccess() || streambuf.Restarted()) {
+        return false;
+    }
+    auto length = static_cast<std::uint64_t>(outcome.GetResult().GetContentLength());
+    if (length != streambuf.Received()) {
+        return false; // Truncated, or did not fit
+    }
+    if (bytes_read) {
+        *bytes_read = length;
+    }
     return true;
 }
 
 bool S3Client::PutObject(const std::string& key, bytes_view data) {
+    if (p_impl->split(data.size())) {
+        return p_impl->put_multipart(key, data);
+    }
+
     Aws::S3::Model::PutObjectRequest request;
     request.SetBucket(p_impl->bucket);
     request.SetKey(key);
 
-    auto stream = std::make_shared<Aws::StringStream>();
-    stream->write(reinterpret_cast<const char*>(data.data()), data.size());
-    request.SetBody(stream);
+    // Upload straight from the caller's memory; it must stay valid until
+    // this call returns.
+    request.SetBody(Aws::MakeShared<ViewIOStream>(kAllocationTag, data));
+    request.SetContentLength(static_cast<long long>(data.size()));
 
     auto outcome = p_impl->s3->PutObject(request);
     if (!outcome.IsSuccess()) {
@@ -101,4 +577,58 @@ bool S3Client::DeleteObject(const std::string& key) {
     return true;
 }
 
+std::size_t S3Client::DeleteObjects(const std::vector<std::string>& keys) {
+    if (keys.empty()) {
+        return 0;
+    }
+
+    Aws::Vector<Aws::S3::Model::ObjectIdentifier> objects;
+    objects.reserve(keys.size());
+    for (const auto& key : keys) {
+        objects.push_back(Aws::S3::Model::ObjectIdentifier().WithKey(key));
+    }
+
+    // Quiet mode: the response only lists the keys that failed
+    Aws::S3::Model::Delete del;
+    del.SetObjects(objects);
+    del.SetQuiet(true);
+
+    Aws::S3::Model::DeleteObjectsRequest request;
+    request.SetBucket(p_impl->bucket);
+    request.SetDelete(del);
+
+    auto outcome = p_impl->s3->DeleteObjects(request);
+    if (!outcome.IsSuccess()) {
+        // std::cerr << "DeleteObjects error: " << outcome.GetError().GetMessage() << std::endl;
+        return keys.size();
+    }
+    return outcome.GetResult().GetErrors().size();
+}
+
+bool S3Client::ListObjects(const std::string& prefix,
+                           const std::function<bool(const std::string& key, std::uint64_t size)>& visit) {
+    Aws::S3::Model::ListObjectsV2Request request;
+    request.SetBucket(p_impl->bucket);
+    request.SetPrefix(prefix);
+
+    while (true) {
+        auto outcome = p_impl->s3->ListObjectsV2(request);
+        if (!outcome.IsSuccess()) {
+            // std::cerr << "ListObjectsV2 error: " << outcome.GetError().GetMessage() << std::endl;
+            return false;
+        }
+
+        const auto& result = outcome.GetResult();
+        for (const auto& object : result.GetContents()) {
+            if (!visit(object.GetKey(), static_cast<std::uint64_t>(object.GetSize()))) {
+                return false;
+            }
+        }
+        if (!result.GetIsTruncated()) {
+            return true;
+        }
+        request.SetContinuationToken(result.GetNextContinuationToken());
+    }
+}
+
 } // namespace kvcache
\ No newline at end of file
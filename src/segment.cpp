@@ -0,0 +1,63 @@
+#include "kvcache/segment.hpp"
+
+#include <cstring>
+
+namespace kvcache {
+
+static constexpr char kSegmentMagic[4] = {'K', 'V', 'S', 'G'};
+static constexpr std::uint8_t kSegmentVersion = 1;
+
+std::size_t SegmentTableBytes(std::uint32_t count) {
+    return sizeof(SegmentHeader) + static_cast<std::size_t>(count) * sizeof(SegmentEntry);
+}
+
+void BuildSegment(std::vector<SegmentEntry>* entries, const std::vector<bytes_view>& objects,
+                  std::vector<std::uint8_t>* segment) {
+    const std::uint32_t count = static_cast<std::uint32_t>(entries->size());
+    std::size_t total = SegmentTableBytes(count);
+    for (const auto& object : objects) {
+        total += object.size();
+    }
+
+    segment->resize(total);
+    std::uint64_t offset = SegmentTableBytes(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        SegmentEntry& entry = (*entries)[i];
+        entry.offset = offset;
+        entry.length = objects[i].size();
+        std::memcpy(segment->data() + offset, objects[i].data(), objects[i].size());
+        offset += objects[i].size();
+    }
+
+    SegmentHeader header{};
+    std::memcpy(header.magic, kSegmentMagic, sizeof(kSegmentMagic));
+    header.version = kSegmentVersion;
+    header.count = count;
+    std::memcpy(segment->data(), &header, sizeof(header));
+    if (count > 0) {
+        std::memcpy(segment->data() + sizeof(header), entries->data(), count * sizeof(SegmentEntry));
+    }
+}
+
+bool ReadSegmentHeader(bytes_view data, SegmentHeader* header) {
+    if (data.size() < sizeof(SegmentHeader)) {
+        return false;
+    }
+    std::memcpy(header, data.data(), sizeof(SegmentHeader));
+    return std::memcmp(header->magic, kSegmentMagic, sizeof(kSegmentMagic)) == 0 &&
+           header->version == kSegmentVersion;
+}
+
+bool ReadSegmentTable(bytes_view data, std::vector<SegmentEntry>* entries) {
+    SegmentHeader header;
+    if (!ReadSegmentHeader(data, &header) || data.size() < SegmentTableBytes(header.count)) {
+        return false;
+    }
+    entries->resize(header.count);
+    if (header.count > 0) {
+        std::memcpy(entries->data(), data.data() + sizeof(header), header.count * sizeof(SegmentEntry));
+    }
+    return true;
+}
+
+} // namespace kvcache
@@ -0,0 +1,74 @@
+#include "kvcache/write_behind.hpp"
+
+namespace kvcache {
+
+WriteBehindQueue::WriteBehindQueue(std::uint32_t num_threads, std::uint64_t budget_bytes)
+    : budget_bytes_(budget_bytes) {
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+    threads_.reserve(num_threads);
+    for (std::uint32_t i = 0; i < num_threads; ++i) {
+        threads_.emplace_back(&WriteBehindQueue::WorkerLoop, this);
+    }
+}
+
+WriteBehindQueue::~WriteBehindQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_work_.notify_all();
+    for (auto& t : threads_) {
+        t.join();
+    }
+}
+
+void WriteBehindQueue::Submit(std::uint64_t bytes, std::function<void()> task) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_space_.wait(lock, [&] {
+            return pending_tasks_ == 0 || pending_bytes_ + bytes <= budget_bytes_;
+        });
+        pending_bytes_ += bytes;
+        ++pending_tasks_;
+        queue_.push_back(Task{bytes, std::move(task)});
+    }
+    cv_work_.notify_one();
+}
+
+void WriteBehindQueue::Drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_space_.wait(lock, [this] { return pending_tasks_ == 0; });
+}
+
+std::uint64_t WriteBehindQueue::PendingBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_bytes_;
+}
+
+void WriteBehindQueue::WorkerLoop() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_work_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                break; // Stopping and fully drained
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        task.run();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_bytes_ -= task.bytes;
+            --pending_tasks_;
+        }
+        cv_space_.notify_all();
+    }
+}
+
+} // namespace kvcache
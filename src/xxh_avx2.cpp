@@ -0,0 +1,10 @@
+// Built with -mavx2
+#include "kvcache/xxh_variant.hpp"
+
+namespace kvcache {
+
+const XxhOps* XxhOpsAvx2() {
+    return &kXxhOps;
+}
+
+} // namespace kvcache
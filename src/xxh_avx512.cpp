@@ -0,0 +1,10 @@
+// Built with -mavx512f
+#include "kvcache/xxh_variant.hpp"
+
+namespace kvcache {
+
+const XxhOps* XxhOpsAvx512() {
+    return &kXxhOps;
+}
+
+} // namespace kvcache
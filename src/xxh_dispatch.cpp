@@ -0,0 +1,36 @@
+// Built with the library's default flags: the baseline every CPU of the
+// target architecture runs
+#include "kvcache/xxh_variant.hpp"
+
+#if defined(KVCACHE_XXH_DISPATCH) && defined(__x86_64__)
+#define KVCACHE_XXH_X86_VARIANTS 1
+#endif
+
+namespace kvcache {
+
+#ifdef KVCACHE_XXH_X86_VARIANTS
+const XxhOps* XxhOpsAvx2();
+const XxhOps* XxhOpsAvx512();
+#endif
+
+std::vector<const XxhOps*> XxhAvailable() {
+    std::vector<const XxhOps*> builds{&kXxhOps};
+#ifdef KVCACHE_XXH_X86_VARIANTS
+    // Also checks that the OS saves the wider registers
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        builds.push_back(XxhOpsAvx2());
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        builds.push_back(XxhOpsAvx512());
+    }
+#endif
+    return builds;
+}
+
+const XxhOps& XxhDispatch() {
+    static const XxhOps* const ops = XxhAvailable().back();
+    return *ops;
+}
+
+} // namespace kvcache